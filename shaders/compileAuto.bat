@@ -9,6 +9,11 @@ for /f %%f in ('dir /b') do (
         %VK_SDK_PATH%\Bin\glslangValidator -V !str! -o !str!.spv
         @echo off
     )
+    if "!sub!"==".comp" (
+        @echo on
+        %VK_SDK_PATH%\Bin\glslangValidator -V !str! -o !str!.spv
+        @echo off
+    )
     if "!sub!"==".frag" (
         @echo on
         %VK_SDK_PATH%\Bin\glslangValidator -V !str! -o !str!.spv
@@ -0,0 +1,28 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) in vec2 fragUV;
+
+layout(binding = 0) uniform sampler2D depthSampler;
+
+layout(push_constant) uniform DepthDownsamplePushConstant {
+    uint divisor;
+} pcbo;
+
+void main()
+{
+    int divisor = int(pcbo.divisor);
+    ivec2 base = ivec2(gl_FragCoord.xy) * divisor;
+    ivec2 maxCoord = textureSize(depthSampler, 0) - 1;
+
+    //Farthest depth of the block, particles are only hidden where the whole block covers them
+    float depth = 0.0;
+    for(int y = 0; y < divisor; y++)
+    {
+        for(int x = 0; x < divisor; x++)
+        {
+            depth = max(depth, texelFetch(depthSampler, min(base + ivec2(x, y), maxCoord), 0).r);
+        }
+    }
+    gl_FragDepth = depth;
+}
\ No newline at end of file
@@ -0,0 +1,27 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) in vec2 fragUV;
+layout(location = 1) flat in int fragLayer;
+
+layout(location = 0) out vec4 outColour;
+
+layout(binding = 2) uniform sampler2DArray texSampler;
+
+void main()
+{
+    //Textures have no alpha, a row of tapering blades is cut out of the quad instead
+    float up = 1.0 - fragUV.y;
+    float blade = abs(fract(fragUV.x * 4.0) - 0.5) * 2.0;
+    if(blade > 1.0 - up)
+        discard;
+
+    vec3 col = texture(texSampler, vec3(fragUV, fragLayer)).rgb;
+    col *= mix(0.5, 1.0, up); //darker at the roots
+
+    //Lit as ground facing up, matching the terrain's light
+    float intensity = max(0,dot(normalize(vec3(1,1,0)), vec3(0,1,0)));
+    intensity += 0.2; //ambient
+    intensity = clamp(intensity, 0, 1);
+    outColour = vec4(col*intensity, 1);
+}
\ No newline at end of file
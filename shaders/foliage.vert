@@ -0,0 +1,62 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+struct FoliageInstance
+{
+    vec4 positionScale;
+};
+
+layout(std430, binding = 0) readonly buffer InstanceBuffer {
+    FoliageInstance instances[];
+};
+layout(std430, binding = 1) readonly buffer VisibleBuffer {
+    uint visible[];
+};
+
+layout(location = 0) out vec2 fragUV;
+layout(location = 1) flat out int fragLayer;
+
+out gl_PerVertex
+{
+    vec4 gl_Position;
+};
+
+layout(push_constant) uniform FoliagePushConstantBufferObject {
+    mat4 viewProj;
+    vec4 viewPosition; //w is the type's draw distance
+    ivec4 type; //x first visible slot, y texture layer
+} pcbo;
+
+//Same hash foliageCull.comp thins instances with
+float hash(uint n)
+{
+    n = (n ^ 61u) ^ (n >> 16);
+    n *= 9u;
+    n ^= n >> 4;
+    n *= 0x27d4eb2du;
+    n ^= n >> 15;
+    return float(n) / 4294967295.0;
+}
+
+const vec2 corners[6] = vec2[](vec2(0, 0), vec2(1, 0), vec2(0, 1), vec2(0, 1), vec2(1, 0), vec2(1, 1));
+
+void main()
+{
+    uint index = visible[pcbo.type.x + gl_InstanceIndex];
+    vec4 instance = instances[index].positionScale;
+
+    //Two quads crossed at right angles, turned by a per instance angle
+    vec2 corner = corners[gl_VertexIndex % 6];
+    float angle = hash(index) * 3.14159265 + (gl_VertexIndex / 6) * 1.57079633;
+    vec3 across = vec3(cos(angle), 0, sin(angle));
+
+    //Sinks into the ground approaching the draw distance rather than popping out
+    float fade = 1.0 - smoothstep(pcbo.viewPosition.w * 0.8, pcbo.viewPosition.w,
+                                  distance(instance.xyz, pcbo.viewPosition.xyz));
+    float size = instance.w * fade;
+    vec3 worldPos = instance.xyz + across * (corner.x - 0.5) * size + vec3(0, corner.y * size, 0);
+
+    gl_Position = pcbo.viewProj * vec4(worldPos, 1.0);
+    fragUV = vec2(corner.x, 1.0 - corner.y);
+    fragLayer = pcbo.type.y;
+}
\ No newline at end of file
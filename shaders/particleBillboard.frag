@@ -0,0 +1,17 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) in vec2 fragUV;
+
+layout(location = 0) out vec4 outColour;
+
+layout(binding = 1) uniform sampler2D texSampler;
+
+void main()
+{
+    //Round sprite so the quad edges aren't visible
+    float falloff = 1.0 - smoothstep(0.4, 0.5, length(fragUV - 0.5));
+    vec4 colour = texture(texSampler, fragUV);
+    colour.a *= falloff;
+    outColour = colour;
+}
\ No newline at end of file
@@ -0,0 +1,40 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+struct ParticleBillboard
+{
+    vec4 positionSize;
+};
+
+layout(std430, binding = 0) readonly buffer ParticleBillboardBuffer {
+    ParticleBillboard particles[];
+} billboards;
+
+layout(location = 0) out vec2 fragUV;
+
+out gl_PerVertex
+{
+    vec4 gl_Position;
+};
+
+layout(push_constant) uniform ParticlePushConstantBufferObject {
+    mat4 view;
+    mat4 proj;
+} pcbo;
+
+void main()
+{
+    //Triangle strip corners (0,0) (1,0) (0,1) (1,1)
+    vec2 corner = vec2(gl_VertexIndex & 1, (gl_VertexIndex >> 1) & 1);
+    vec4 particle = billboards.particles[gl_InstanceIndex].positionSize;
+
+    //Camera axes are the first two rows of the view rotation
+    vec3 cameraRight = vec3(pcbo.view[0][0], pcbo.view[1][0], pcbo.view[2][0]);
+    vec3 cameraUp = vec3(pcbo.view[0][1], pcbo.view[1][1], pcbo.view[2][1]);
+
+    vec2 offset = (corner - 0.5) * particle.w;
+    vec3 worldPos = particle.xyz + cameraRight*offset.x + cameraUp*offset.y;
+
+    gl_Position = pcbo.proj * pcbo.view * vec4(worldPos, 1.0);
+    fragUV = vec2(corner.x, 1.0 - corner.y);
+}
\ No newline at end of file
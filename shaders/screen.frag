@@ -6,12 +6,53 @@ layout(location = 0) in vec2 fragUV;
 layout(location = 0) out vec4 outColour;
 
 layout(binding = 0) uniform sampler2D texSampler;
+layout(binding = 1) uniform sampler2D depthSampler;
+layout(binding = 2) uniform sampler2D particleSampler;
+layout(binding = 3) uniform sampler2D particleDepthSampler;
+
+layout(push_constant) uniform ScreenPushConstantBufferObject {
+    vec4 particleParams;
+    vec4 depthParams;
+} pcbo;
 
 float sq(float a) { return a*a; }
 float zSphere(vec2 point)
 {
     return sqrt(sq(0.25) - sq(point.x - 0.5) - sq(point.y - 0.5));
 }
+
+float linearDepth(float depth)
+{
+    return pcbo.depthParams.y / (depth + pcbo.depthParams.x);
+}
+
+//Bilinear upsample of the low resolution particles, with each texel weighted down
+//by how far its depth is from the full resolution depth to avoid bleeding over edges
+vec4 upsampleParticles()
+{
+    ivec2 size = textureSize(particleSampler, 0);
+    vec2 texel = fragUV * vec2(size) - 0.5;
+    ivec2 base = ivec2(floor(texel));
+    vec2 f = fract(texel);
+
+    float fullDepth = linearDepth(texelFetch(depthSampler, ivec2(gl_FragCoord.xy), 0).r);
+
+    vec4 total = vec4(0.0);
+    float totalWeight = 0.0;
+    for(int i = 0; i < 4; i++)
+    {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        ivec2 coord = clamp(base + offset, ivec2(0), size - 1);
+        float bilinear = (offset.x == 1 ? f.x : 1.0 - f.x) * (offset.y == 1 ? f.y : 1.0 - f.y);
+        float lowDepth = linearDepth(texelFetch(particleDepthSampler, coord, 0).r);
+        float weight = bilinear / (0.001 + abs(fullDepth - lowDepth) / fullDepth);
+
+        total += texelFetch(particleSampler, coord, 0) * weight;
+        totalWeight += weight;
+    }
+    return total / max(totalWeight, 0.00001);
+}
+
 void main()
 {
 //    vec2 dir = fragUV - vec2(0.5);
@@ -24,4 +65,11 @@ void main()
 //    }
 //    else
         outColour = texture(texSampler, fragUV);
+
+    if(pcbo.particleParams.x > 0.5)
+    {
+        //Particles are premultiplied with coverage in alpha
+        vec4 particles = upsampleParticles();
+        outColour.rgb = outColour.rgb * (1.0 - particles.a) + particles.rgb;
+    }
 }
\ No newline at end of file
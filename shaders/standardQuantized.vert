@@ -0,0 +1,42 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+//Decode variant of standard.vert for QuantizedVertex. The unorm16 position is 0-1 within the
+//mesh bounds, the model matrix scales it back out. The uv is read as half floats directly.
+layout(location = 0) in vec4 inPosition;
+layout(location = 1) in vec2 inUV;
+layout(location = 2) in vec2 inNormal;
+
+layout(location = 0) out vec2 fragUV;
+layout(location = 1) out vec3 fragNormal;
+
+out gl_PerVertex
+{
+    vec4 gl_Position;
+};
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 model;
+} ubo;
+
+layout(push_constant) uniform PushConstantBufferObject {
+    mat4 model;
+    mat4 view;
+    mat4 proj;
+} pcbo;
+
+vec3 decodeOctahedral(vec2 encoded)
+{
+    vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-normal.z, 0.0);
+    normal.x += normal.x >= 0.0 ? -fold : fold;
+    normal.y += normal.y >= 0.0 ? -fold : fold;
+    return normalize(normal);
+}
+
+void main()
+{
+    gl_Position = pcbo.proj * pcbo.view * pcbo.model * vec4(inPosition.xyz, 1.0);
+    fragUV = inUV;
+    fragNormal = decodeOctahedral(inNormal);
+}
\ No newline at end of file
@@ -0,0 +1,44 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) out vec3 fragNormal;
+layout(location = 1) out vec3 fragPos;
+
+out gl_PerVertex
+{
+    vec4 gl_Position;
+};
+
+layout(push_constant) uniform TerrainPushConstantBufferObject {
+    mat4 view;
+    mat4 proj;
+    vec4 gridParams; //x patch quads per side, y patches along x, zw heightmap samples
+    vec4 spacing; //xy world distance between samples
+} pcbo;
+
+layout(binding = 1) uniform sampler2D heightSampler;
+
+float height(ivec2 coord)
+{
+    ivec2 size = ivec2(pcbo.gridParams.zw);
+    return texelFetch(heightSampler, clamp(coord, ivec2(0), size - 1), 0).r;
+}
+
+void main()
+{
+    //Grid position comes from the index alone, the patch from the instance
+    int patchVerts = int(pcbo.gridParams.x) + 1;
+    int patchesX = int(pcbo.gridParams.y);
+    ivec2 local = ivec2(gl_VertexIndex % patchVerts, gl_VertexIndex / patchVerts);
+    ivec2 origin = ivec2(gl_InstanceIndex % patchesX, gl_InstanceIndex / patchesX) * int(pcbo.gridParams.x);
+    ivec2 coord = min(origin + local, ivec2(pcbo.gridParams.zw) - 1);
+
+    vec3 position = vec3(coord.x * pcbo.spacing.x, height(coord), coord.y * pcbo.spacing.y);
+
+    float dx = (height(coord + ivec2(1, 0)) - height(coord - ivec2(1, 0))) / (2.0 * pcbo.spacing.x);
+    float dz = (height(coord + ivec2(0, 1)) - height(coord - ivec2(0, 1))) / (2.0 * pcbo.spacing.y);
+
+    gl_Position = pcbo.proj * pcbo.view * vec4(position, 1.0);
+    fragNormal = normalize(vec3(-dx, 1.0, -dz));
+    fragPos = position;
+}
\ No newline at end of file
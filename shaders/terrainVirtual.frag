@@ -0,0 +1,37 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) in vec3 fragNormal;
+layout(location = 1) in vec3 fragPos;
+
+layout(location = 0) out vec4 outColour;
+
+layout(binding = 2) uniform sampler2D pageCache;
+layout(binding = 3) uniform sampler2D pageTable;
+
+layout(constant_id = 0) const float virtualSize = 50.0;
+layout(constant_id = 1) const float levelZeroPages = 64.0;
+layout(constant_id = 2) const float cachePages = 16.0;
+layout(constant_id = 3) const float pageSize = 128.0;
+layout(constant_id = 4) const float pageBorder = 2.0;
+
+void main()
+{
+    //Page table holds the finest baked page covering each level zero page, xy its cache slot and z its level
+    vec2 uv = clamp(fragPos.xz / virtualSize, 0.0, 0.99999);
+    vec4 entry = round(textureLod(pageTable, uv, 0) * 255.0);
+
+    vec3 col = vec3(0.5);
+    if(entry.w > 0)
+    {
+        float pages = levelZeroPages / exp2(entry.z);
+        vec2 inPage = fract(uv * pages);
+        vec2 texel = entry.xy * pageSize + pageBorder + inPage * (pageSize - 2 * pageBorder);
+        col = textureLod(pageCache, texel / (cachePages * pageSize), 0).rgb;
+    }
+
+    float intensity = max(0,dot(normalize(vec3(1,1,0)), fragNormal));
+    intensity += 0.2; //ambient
+    intensity = clamp(intensity, 0, 1);
+    outColour = vec4(col*intensity, 1);
+}
\ No newline at end of file
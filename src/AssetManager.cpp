@@ -0,0 +1,441 @@
+#include "AssetManager.h"
+#include "logger.h"
+#include "Model.h"
+#include "Texture.h"
+#include "vulkanInterface.h"
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <stdexcept>
+
+AssetManager::AssetManager(VulkanInterface* inVulkanInterface) :
+	vki(inVulkanInterface)
+{
+	threadPool.resize(2);
+
+	placeholder = new Texture(vki, {}, false, true);
+	placeholder->fill(0xFF808080);
+	placeholder->upload();
+	placeholder->finishUpload();
+}
+
+AssetManager::~AssetManager()
+{
+	threadPool.wait();
+	threadPool.destroy();
+	finishBatches(true);
+	deleteAbandoned();
+	//Their owners are already gone
+	finishedLoads.clear();
+
+	logStats();
+	//Models first, they hold references to textures
+	for(auto &entry : models)
+	{
+		Logger() << "Model never released: " << entry.first;
+		delete entry.second.asset;
+	}
+	models.clear();
+	for(auto &entry : textures)
+	{
+		Logger() << "Texture never released: " << entry.first;
+		delete entry.second.asset;
+	}
+	textures.clear();
+	delete placeholder;
+}
+
+std::string AssetManager::canonicalPath(const std::string &path)
+{
+#ifdef _WIN32
+	char resolved[_MAX_PATH];
+	if(_fullpath(resolved, path.c_str(), _MAX_PATH))
+		return resolved;
+#else
+	char resolved[PATH_MAX];
+	if(realpath(path.c_str(), resolved))
+		return resolved;
+#endif
+	return path;
+}
+
+template <typename T>
+T* AssetManager::find(std::map<std::string, AssetEntry<T> > &entries, const std::string &key)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = entries.find(key);
+	if(it == entries.end())
+		return nullptr;
+
+	it->second.references++;
+	hits++;
+	Logger() << "Asset cache hit: " << key << " (" << it->second.references << " references)";
+	return it->second.asset;
+}
+
+template <typename T>
+T* AssetManager::insert(std::map<std::string, AssetEntry<T> > &entries, std::map<const T*, std::string> &keys,
+                        const std::string &key, T* loaded)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = entries.find(key);
+	if(it != entries.end())
+	{
+		it->second.references++;
+		hits++;
+		return it->second.asset;
+	}
+
+	AssetEntry<T> entry = {};
+	entry.asset = loaded;
+	entry.references = 1;
+	entries[key] = entry;
+	keys[loaded] = key;
+	misses++;
+	Logger() << "Asset cache miss: " << key;
+	return loaded;
+}
+
+template <typename T>
+bool AssetManager::remove(std::map<std::string, AssetEntry<T> > &entries, std::map<const T*, std::string> &keys, T* asset)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto key = keys.find(asset);
+	if(key == keys.end())
+		throw std::runtime_error("Released an asset the asset manager didn't hand out");
+
+	auto it = entries.find(key->second);
+	if(--it->second.references > 0)
+		return false;
+
+	Logger() << "Asset freed: " << key->second;
+	entries.erase(it);
+	keys.erase(key);
+	return true;
+}
+
+Model* AssetManager::acquireModel(const std::string &filename, VertexFormat format, MeshRetention retention)
+{
+	std::string key = canonicalPath(filename) + "|" + std::to_string(format) + "|" + std::to_string(retention);
+	Model* model = find(models, key);
+	if(model)
+		return model;
+
+	//Nothing is read until the worker picks it up
+	auto created = new Model(vki, filename, format, retention, true);
+	model = insert(models, modelKeys, key, created);
+	if(model != created)
+	{
+		delete created;
+		return model;
+	}
+	{
+		std::lock_guard<std::mutex> lock(loadedMutex);
+		loading.insert(model);
+	}
+	threadPool.addJob(std::bind(&AssetManager::loadModel, this, model));
+	return model;
+}
+
+Texture* AssetManager::acquireTexture(const std::vector<std::string> &filenames, bool cube, bool async)
+{
+	std::string key;
+	for(const std::string &filename : filenames)
+		key += canonicalPath(filename) + "|";
+	key += cube ? "cube" : "array";
+	Texture* texture = find(textures, key);
+	if(!texture)
+	{
+		if(async)
+		{
+			auto created = new Texture(vki, filenames, cube, true);
+			texture = insert(textures, textureKeys, key, created);
+			if(texture == created)
+			{
+				{
+					std::lock_guard<std::mutex> lock(loadedMutex);
+					loading.insert(texture);
+				}
+				threadPool.addJob(std::bind(&AssetManager::decodeTexture, this, texture));
+			}
+			else
+				delete created;
+		}
+		else
+		{
+			//Loaded unlocked so other assets can load meanwhile
+			auto loaded = new Texture(vki, filenames, cube);
+			texture = insert(textures, textureKeys, key, loaded);
+			if(texture != loaded)
+				delete loaded;
+		}
+	}
+
+	if(!async)
+		waitForResident(texture);
+	return texture;
+}
+
+void AssetManager::release(Model* model)
+{
+	if(!model || !remove(models, modelKeys, model))
+		return;
+	if(model->isResident() || cancel(model))
+		delete model;
+}
+
+void AssetManager::release(Texture* texture)
+{
+	if(!texture || !remove(textures, textureKeys, texture))
+		return;
+	if(texture->isResident() || cancel(texture))
+		delete texture;
+}
+
+void AssetManager::loadModel(Model* model)
+{
+	bool loaded = true;
+	try
+	{
+		model->loadFile();
+	}
+	catch(const std::exception &e)
+	{
+		//Never becomes resident so it's never drawn
+		Logger() << "Model failed to load: " << e.what();
+		loaded = false;
+	}
+
+	std::lock_guard<std::mutex> lock(loadedMutex);
+	loading.erase(model);
+	if(cancelled.erase(model))
+		abandonedModels.emplace_back(model);
+	else if(loaded)
+		loadedModels.emplace_back(model);
+}
+
+void AssetManager::decodeTexture(Texture* texture)
+{
+	try
+	{
+		texture->decode();
+	}
+	catch(const std::exception &e)
+	{
+		//Magenta so the missing file stands out, models waiting on it still appear
+		Logger() << "Texture failed to decode: " << e.what();
+		texture->fill(0xFFFF00FF);
+	}
+
+	std::lock_guard<std::mutex> lock(loadedMutex);
+	loading.erase(texture);
+	if(cancelled.erase(texture))
+		abandonedTextures.emplace_back(texture);
+	else
+		decodedTextures.emplace_back(texture);
+}
+
+void AssetManager::loadAsync(std::function<void()> work, std::function<void()> finish)
+{
+	threadPool.addJob(std::bind(&AssetManager::runLoad, this, std::move(work), std::move(finish)));
+}
+
+void AssetManager::runLoad(const std::function<void()> &work, const std::function<void()> &finish)
+{
+	try
+	{
+		work();
+	}
+	catch(const std::exception &e)
+	{
+		Logger() << "Asynchronous load failed: " << e.what();
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(loadedMutex);
+	finishedLoads.emplace_back(finish);
+}
+
+void AssetManager::waitForWorkers()
+{
+	threadPool.wait();
+}
+
+bool AssetManager::update()
+{
+	process();
+
+	//Outside process, a completion may block on a texture which processes again
+	std::vector<std::function<void()> > finished;
+	{
+		std::lock_guard<std::mutex> lock(loadedMutex);
+		finished.swap(finishedLoads);
+	}
+	for(const std::function<void()> &finish : finished)
+	{
+		finish();
+		residentChanged = true;
+	}
+
+	bool changed = residentChanged;
+	residentChanged = false;
+	return changed;
+}
+
+void AssetManager::process()
+{
+	finishBatches(false);
+	deleteAbandoned();
+
+	//A model's mesh can land before its textures
+	for(auto it = uploadedModels.begin(); it != uploadedModels.end();)
+	{
+		if((*it)->finishUpload())
+		{
+			residentChanged = true;
+			it = uploadedModels.erase(it);
+		}
+		else
+			++it;
+	}
+
+	PendingBatch pending = {};
+	{
+		std::lock_guard<std::mutex> lock(loadedMutex);
+		size_t textureCount = std::min<size_t>(decodedTextures.size(), ASSET_UPLOADS_PER_FRAME);
+		size_t modelCount = std::min<size_t>(loadedModels.size(), ASSET_UPLOADS_PER_FRAME - textureCount);
+		pending.textures.assign(decodedTextures.begin(), decodedTextures.begin() + textureCount);
+		decodedTextures.erase(decodedTextures.begin(), decodedTextures.begin() + textureCount);
+		pending.models.assign(loadedModels.begin(), loadedModels.begin() + modelCount);
+		loadedModels.erase(loadedModels.begin(), loadedModels.begin() + modelCount);
+	}
+	if(pending.textures.empty() && pending.models.empty())
+		return;
+
+	//Every copy this frame goes in one submission that nothing waits on
+	vki->beginUploadBatch();
+	for(Texture* texture : pending.textures)
+		texture->upload();
+	for(Model* model : pending.models)
+		model->upload(true);
+	pending.batch = vki->submitUploadBatch();
+	inFlight.emplace_back(pending);
+}
+
+void AssetManager::finishBatches(bool wait)
+{
+	for(auto it = inFlight.begin(); it != inFlight.end();)
+	{
+		if(!vki->finishUploadBatch(it->batch, wait))
+		{
+			++it;
+			continue;
+		}
+
+		for(Texture* texture : it->textures)
+			texture->finishUpload();
+		uploadedModels.insert(uploadedModels.end(), it->models.begin(), it->models.end());
+		residentChanged = residentChanged || !it->textures.empty();
+
+		//Deleting a model releases its textures, which may look through inFlight
+		std::vector<Model*> releasedModels = std::move(it->releasedModels);
+		std::vector<Texture*> releasedTextures = std::move(it->releasedTextures);
+		it = inFlight.erase(it);
+		for(Model* model : releasedModels)
+			delete model;
+		for(Texture* texture : releasedTextures)
+			delete texture;
+	}
+}
+
+bool AssetManager::cancel(Model* model)
+{
+	if(!cancelLoading(model))
+		return false;
+	{
+		std::lock_guard<std::mutex> lock(loadedMutex);
+		loadedModels.erase(std::remove(loadedModels.begin(), loadedModels.end(), model), loadedModels.end());
+	}
+	uploadedModels.erase(std::remove(uploadedModels.begin(), uploadedModels.end(), model), uploadedModels.end());
+
+	for(PendingBatch &pending : inFlight)
+	{
+		auto it = std::find(pending.models.begin(), pending.models.end(), model);
+		if(it != pending.models.end())
+		{
+			pending.models.erase(it);
+			pending.releasedModels.emplace_back(model);
+			return false;
+		}
+	}
+	return true;
+}
+
+bool AssetManager::cancel(Texture* texture)
+{
+	if(!cancelLoading(texture))
+		return false;
+	{
+		std::lock_guard<std::mutex> lock(loadedMutex);
+		decodedTextures.erase(std::remove(decodedTextures.begin(), decodedTextures.end(), texture),
+		                      decodedTextures.end());
+	}
+
+	for(PendingBatch &pending : inFlight)
+	{
+		auto it = std::find(pending.textures.begin(), pending.textures.end(), texture);
+		if(it != pending.textures.end())
+		{
+			pending.textures.erase(it);
+			pending.releasedTextures.emplace_back(texture);
+			return false;
+		}
+	}
+	return true;
+}
+
+bool AssetManager::cancelLoading(const void* asset)
+{
+	std::lock_guard<std::mutex> lock(loadedMutex);
+	if(!loading.count(asset))
+		return true;
+	cancelled.insert(asset);
+	return false;
+}
+
+void AssetManager::deleteAbandoned()
+{
+	std::vector<Model*> modelsToDelete;
+	std::vector<Texture*> texturesToDelete;
+	{
+		std::lock_guard<std::mutex> lock(loadedMutex);
+		modelsToDelete.swap(abandonedModels);
+		texturesToDelete.swap(abandonedTextures);
+	}
+	//Models first, they hold references to textures
+	for(Model* model : modelsToDelete)
+		delete model;
+	for(Texture* texture : texturesToDelete)
+		delete texture;
+}
+
+void AssetManager::waitForResident(Texture* texture)
+{
+	while(!texture->isResident())
+	{
+		process();
+		std::this_thread::yield();
+	}
+}
+
+Texture* AssetManager::getPlaceholder() const
+{
+	return placeholder;
+}
+
+void AssetManager::logStats()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	Logger() << "Asset cache: " << hits << " hits " << misses << " misses, "
+	         << models.size() << " models " << textures.size() << " textures held";
+}
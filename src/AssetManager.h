@@ -0,0 +1,134 @@
+#ifndef VULKANITE_ASSETMANAGER_H
+#define VULKANITE_ASSETMANAGER_H
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+#include "GenericThreadPool.h"
+#include "Mesh.h"
+
+//Decoded assets uploaded in one frame's batch, the rest wait for the next frame
+#define ASSET_UPLOADS_PER_FRAME 8
+
+class VulkanInterface;
+class Model;
+class Texture;
+struct UploadBatch;
+
+template <typename T>
+struct AssetEntry
+{
+	T* asset;
+	uint32_t references;
+};
+
+//Hands out one Model or Texture per canonical path and import options, the mesh and textures of a
+//model come with it. Every acquire needs a matching release, the asset is deleted with the last one or
+//as soon as a load still running for it has finished.
+//Asynchronous assets are read and decoded on worker threads, then uploaded from update in a batch
+//per frame and made resident once the GPU has finished copying them.
+class AssetManager
+{
+	struct PendingBatch
+	{
+		UploadBatch* batch;
+		std::vector<Texture*> textures;
+		std::vector<Model*> models;
+		//Released while their copies run, deleted once the batch has finished
+		std::vector<Texture*> releasedTextures;
+		std::vector<Model*> releasedModels;
+	};
+
+	VulkanInterface* vki;
+	GenericThreadPool threadPool;
+	Texture* placeholder;
+
+	std::mutex mutex;
+	std::map<std::string, AssetEntry<Model> > models;
+	std::map<std::string, AssetEntry<Texture> > textures;
+	//Back to the key for release
+	std::map<const Model*, std::string> modelKeys;
+	std::map<const Texture*, std::string> textureKeys;
+
+	//Finished on a worker, waiting for an upload batch
+	std::mutex loadedMutex;
+	std::vector<Model*> loadedModels;
+	std::vector<Texture*> decodedTextures;
+	//Handed to a worker and not back yet
+	std::set<const void*> loading;
+	//Released while loading, the worker leaves them for the main thread to delete
+	std::set<const void*> cancelled;
+	std::vector<Model*> abandonedModels;
+	std::vector<Texture*> abandonedTextures;
+	//Completions of loadAsync work that has finished
+	std::vector<std::function<void()> > finishedLoads;
+	//Main thread only
+	std::vector<PendingBatch> inFlight;
+	//Mesh copied, waiting on their textures
+	std::vector<Model*> uploadedModels;
+
+	//Since update last returned it
+	bool residentChanged = false;
+
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+
+	//Absolute with links and dots resolved so different spellings of a file share an entry.
+	//Left as given when it doesn't exist, the loader reports that.
+	static std::string canonicalPath(const std::string &path);
+
+	template <typename T>
+	T* find(std::map<std::string, AssetEntry<T> > &entries, const std::string &key);
+	//Keeps the first when another thread loaded the same key meanwhile, returns the one to use
+	template <typename T>
+	T* insert(std::map<std::string, AssetEntry<T> > &entries, std::map<const T*, std::string> &keys,
+	          const std::string &key, T* loaded);
+	template <typename T>
+	bool remove(std::map<std::string, AssetEntry<T> > &entries, std::map<const T*, std::string> &keys, T* asset);
+
+	void loadModel(Model* model);
+	void decodeTexture(Texture* texture);
+	void runLoad(const std::function<void()> &work, const std::function<void()> &finish);
+	//Uploads what the workers finished and makes finished uploads resident
+	void process();
+	//Marks what finished batches copied as resident
+	void finishBatches(bool wait);
+	//Takes an asset that never became resident off every queue without waiting. False when a worker
+	//or an upload batch still has it, it is deleted once they are done with it.
+	bool cancel(Model* model);
+	bool cancel(Texture* texture);
+	bool cancelLoading(const void* asset);
+	void deleteAbandoned();
+	void waitForResident(Texture* texture);
+
+public:
+	explicit AssetManager(VulkanInterface* inVulkanInterface);
+	//Deletes anything never released and logs it
+	~AssetManager();
+
+	//Returns straight away, nothing may draw the model until it is resident
+	Model* acquireModel(const std::string &filename, VertexFormat format = VERTEX_FORMAT_FLOAT,
+	                    MeshRetention retention = MESH_RETAIN_NONE);
+	//Blocks until resident unless async is set
+	Texture* acquireTexture(const std::vector<std::string> &filenames, bool cube, bool async = false);
+	void release(Model* model);
+	void release(Texture* texture);
+	//For anything the caches don't hold. Work runs on a worker, finish on the main thread from update once it
+	//succeeded, a failure is logged and finish never runs.
+	void loadAsync(std::function<void()> work, std::function<void()> finish);
+	//Blocks until the workers are idle, whatever loadAsync was handed may be deleted after it
+	void waitForWorkers();
+
+	//Call once per frame on the main thread before recording, true when anything became resident since the last call
+	bool update();
+	//Grey, bound in place of model textures that aren't resident yet
+	Texture* getPlaceholder() const;
+
+	void logStats();
+};
+
+#endif //VULKANITE_ASSETMANAGER_H
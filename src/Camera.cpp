@@ -18,6 +18,7 @@ Camera::Camera(float fov, float aspectRatio, float nearDist, float farDist)	:
 
 void Camera::lookAt(glm::vec3 eye, glm::vec3 centre, glm::vec3 up)
 {
+	position = eye;
 	viewMatrix = glm::lookAt(eye, centre, up);
 }
 
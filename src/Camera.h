@@ -14,6 +14,7 @@ public:
 
 	glm::mat4 viewMatrix;
 	glm::mat4 projectionMatrix;
+	glm::vec3 position;
 
 	void lookAt(glm::vec3 eye, glm::vec3 centre, glm::vec3 up);
 
@@ -0,0 +1,45 @@
+#include "Frustum.h"
+#include <glm/geometric.hpp>
+
+Frustum::Frustum(const glm::mat4 &viewProjection)
+{
+	update(viewProjection);
+}
+
+void Frustum::update(const glm::mat4 &viewProjection)
+{
+	glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+	glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+	glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+	glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+
+	planes[0] = row3 + row0;
+	planes[1] = row3 - row0;
+	planes[2] = row3 + row1;
+	planes[3] = row3 - row1;
+	//-w <= z holds for both depth conventions, at worst it keeps a sliver behind the near plane
+	planes[4] = row3 + row2;
+	planes[5] = row3 - row2;
+
+	for(auto &plane : planes)
+		plane /= glm::length(glm::vec3(plane));
+}
+
+bool Frustum::intersects(glm::vec3 boundsMin, glm::vec3 boundsMax) const
+{
+	for(const auto &plane : planes)
+	{
+		//Corner furthest along the plane normal
+		glm::vec3 positive(plane.x >= 0 ? boundsMax.x : boundsMin.x,
+		                   plane.y >= 0 ? boundsMax.y : boundsMin.y,
+		                   plane.z >= 0 ? boundsMax.z : boundsMin.z);
+		if(glm::dot(glm::vec3(plane), positive) + plane.w < 0)
+			return false;
+	}
+	return true;
+}
+
+const glm::vec4* Frustum::getPlanes() const
+{
+	return planes;
+}
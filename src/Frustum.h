@@ -0,0 +1,24 @@
+#ifndef VULKANITE_FRUSTUM_H
+#define VULKANITE_FRUSTUM_H
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+//View frustum planes pulled from a combined projection and view matrix, normals face inwards
+class Frustum
+{
+	glm::vec4 planes[6];
+
+public:
+	Frustum() = default;
+	explicit Frustum(const glm::mat4 &viewProjection);
+
+	void update(const glm::mat4 &viewProjection);
+	//Conservative, boxes near a corner can pass while being just outside
+	bool intersects(glm::vec3 boundsMin, glm::vec3 boundsMax) const;
+	//All six planes, normals are unit length
+	const glm::vec4* getPlanes() const;
+};
+
+#endif //VULKANITE_FRUSTUM_H
@@ -0,0 +1,89 @@
+#include "Heightfield.h"
+#include <algorithm>
+#include <glm/geometric.hpp>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HEIGHTFIELD_SSE
+#include <emmintrin.h>
+#endif
+
+//Shared by the scalar and SSE paths so both round identically
+static inline glm::vec3 gatherNormal(float left, float right, float down, float up, float twoSpacingX, float twoSpacingZ)
+{
+	float dx = (right - left) / twoSpacingX;
+	float dz = (up - down) / twoSpacingZ;
+	float inv = 1.0f / std::sqrt((dx * dx + 1.0f) + dz * dz);
+	return glm::vec3(-dx * inv, inv, -dz * inv);
+}
+
+float Heightfield::height(int x, int z) const
+{
+	x = std::min(std::max(x, 0), static_cast<int>(width) - 1);
+	z = std::min(std::max(z, 0), static_cast<int>(depth) - 1);
+	return heights[z * width + x];
+}
+
+glm::vec3 Heightfield::position(int x, int z) const
+{
+	x = std::min(std::max(x, 0), static_cast<int>(width) - 1);
+	z = std::min(std::max(z, 0), static_cast<int>(depth) - 1);
+	return glm::vec3(x * spacingX, heights[z * width + x], z * spacingZ);
+}
+
+glm::vec3 Heightfield::normal(int x, int z) const
+{
+	return gatherNormal(height(x - 1, z), height(x + 1, z), height(x, z - 1), height(x, z + 1),
+	                    2.0f * spacingX, 2.0f * spacingZ);
+}
+
+void Heightfield::normalRow(int z, glm::vec3 *out) const
+{
+	auto w = static_cast<int>(width);
+	const float* row = &heights[std::min(std::max(z, 0), static_cast<int>(depth) - 1) * width];
+	const float* down = &heights[std::min(std::max(z - 1, 0), static_cast<int>(depth) - 1) * width];
+	const float* up = &heights[std::min(std::max(z + 1, 0), static_cast<int>(depth) - 1) * width];
+	float twoSpacingX = 2.0f * spacingX;
+	float twoSpacingZ = 2.0f * spacingZ;
+
+	//Edge columns clamp, everything between reads its neighbours directly
+	int x = 1;
+#ifdef HEIGHTFIELD_SSE
+	__m128 twoX = _mm_set1_ps(twoSpacingX);
+	__m128 twoZ = _mm_set1_ps(twoSpacingZ);
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 sign = _mm_set1_ps(-0.0f);
+	for(; x + 4 <= w - 1; x += 4)
+	{
+		__m128 dx = _mm_div_ps(_mm_sub_ps(_mm_loadu_ps(row + x + 1), _mm_loadu_ps(row + x - 1)), twoX);
+		__m128 dz = _mm_div_ps(_mm_sub_ps(_mm_loadu_ps(up + x), _mm_loadu_ps(down + x)), twoZ);
+		__m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), one), _mm_mul_ps(dz, dz));
+		__m128 inv = _mm_div_ps(one, _mm_sqrt_ps(lengthSq));
+
+		float nx[4], ny[4], nz[4];
+		_mm_storeu_ps(nx, _mm_mul_ps(_mm_xor_ps(dx, sign), inv));
+		_mm_storeu_ps(ny, inv);
+		_mm_storeu_ps(nz, _mm_mul_ps(_mm_xor_ps(dz, sign), inv));
+		for(int i = 0; i < 4; i++)
+			out[x + i] = glm::vec3(nx[i], ny[i], nz[i]);
+	}
+#endif
+	for(; x < w - 1; x++)
+	{
+		out[x] = gatherNormal(row[x - 1], row[x + 1], down[x], up[x], twoSpacingX, twoSpacingZ);
+	}
+
+	out[0] = normal(0, z);
+	if(w > 1)
+		out[w - 1] = normal(w - 1, z);
+}
+
+float Heightfield::worldWidth() const
+{
+	return (width - 1) * spacingX;
+}
+
+float Heightfield::worldDepth() const
+{
+	return (depth - 1) * spacingZ;
+}
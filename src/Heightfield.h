@@ -0,0 +1,29 @@
+#ifndef VULKANITE_HEIGHTFIELD_H
+#define VULKANITE_HEIGHTFIELD_H
+
+#include <glm/vec3.hpp>
+#include <vector>
+#include <cstdint>
+
+//Regular grid of world space heights, sample (0,0) sits at the world origin
+struct Heightfield
+{
+	uint32_t width = 0;
+	uint32_t depth = 0;
+	float spacingX = 1.0f;
+	float spacingZ = 1.0f;
+	std::vector<float> heights;
+
+	//Sample lookups clamp to the edge of the grid
+	float height(int x, int z) const;
+	glm::vec3 position(int x, int z) const;
+	//Central difference normal
+	glm::vec3 normal(int x, int z) const;
+	//Normals for a whole row of samples into out[0..width), bit identical to normal()
+	void normalRow(int z, glm::vec3* out) const;
+
+	float worldWidth() const;
+	float worldDepth() const;
+};
+
+#endif //VULKANITE_HEIGHTFIELD_H
@@ -0,0 +1,285 @@
+#include "HeightfieldQuery.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <thread>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+//Rays handed to each worker in a batched raycast
+#define QUERY_RAYS_PER_JOB 4096
+
+HeightfieldQuery::HeightfieldQuery(const Heightfield *inHeightfield) :
+	heightfield(inHeightfield)
+{
+	if(heightfield->width < 2 || heightfield->depth < 2)
+		throw std::runtime_error("Heightfield too small to query");
+
+	cellsX = heightfield->width - 1;
+	cellsZ = heightfield->depth - 1;
+
+	glm::uvec2 size(cellsX, cellsZ);
+	levelSizes.emplace_back(size);
+	while(size.x > 1 || size.y > 1)
+	{
+		size = (size + glm::uvec2(1)) / 2u;
+		levelSizes.emplace_back(size);
+	}
+	levels.resize(levelSizes.size());
+	for(size_t i = 0; i < levels.size(); i++)
+		levels[i].resize(levelSizes[i].x * levelSizes[i].y);
+
+	refresh(0, 0, heightfield->width - 1, heightfield->depth - 1);
+
+	threadPool.resize(static_cast<int>(std::max(1u, std::thread::hardware_concurrency())));
+}
+
+HeightfieldQuery::~HeightfieldQuery()
+{
+	threadPool.destroy();
+}
+
+void HeightfieldQuery::refresh(uint32_t x0, uint32_t z0, uint32_t x1, uint32_t z1)
+{
+	//A sample touches the cells on either side of it
+	x0 = x0 > 0 ? x0 - 1 : 0;
+	z0 = z0 > 0 ? z0 - 1 : 0;
+	x1 = std::min(x1, cellsX - 1);
+	z1 = std::min(z1, cellsZ - 1);
+	if(x0 > x1 || z0 > z1)
+		return;
+
+	for(uint32_t level = 0; level < levels.size(); level++)
+	{
+		buildLevel(level, x0 >> level, z0 >> level, x1 >> level, z1 >> level);
+	}
+}
+
+void HeightfieldQuery::buildLevel(uint32_t level, uint32_t x0, uint32_t z0, uint32_t x1, uint32_t z1)
+{
+	glm::uvec2 size = levelSizes[level];
+	std::vector<glm::vec2> &bounds = levels[level];
+	for(uint32_t z = z0; z <= z1; z++)
+	{
+		for(uint32_t x = x0; x <= x1; x++)
+		{
+			glm::vec2 range;
+			if(level == 0)
+			{
+				float h00 = heightfield->heights[z * heightfield->width + x];
+				float h10 = heightfield->heights[z * heightfield->width + x + 1];
+				float h01 = heightfield->heights[(z + 1) * heightfield->width + x];
+				float h11 = heightfield->heights[(z + 1) * heightfield->width + x + 1];
+				range.x = std::min(std::min(h00, h10), std::min(h01, h11));
+				range.y = std::max(std::max(h00, h10), std::max(h01, h11));
+			}
+			else
+			{
+				glm::uvec2 childSize = levelSizes[level - 1];
+				const std::vector<glm::vec2> &children = levels[level - 1];
+				range = children[(z * 2) * childSize.x + x * 2];
+				for(uint32_t cz = z * 2; cz < std::min(z * 2 + 2, childSize.y); cz++)
+				{
+					for(uint32_t cx = x * 2; cx < std::min(x * 2 + 2, childSize.x); cx++)
+					{
+						range.x = std::min(range.x, children[cz * childSize.x + cx].x);
+						range.y = std::max(range.y, children[cz * childSize.x + cx].y);
+					}
+				}
+			}
+			bounds[z * size.x + x] = range;
+		}
+	}
+}
+
+float HeightfieldQuery::heightAt(float x, float z) const
+{
+	float fx = glm::clamp(x / heightfield->spacingX, 0.0f, static_cast<float>(cellsX));
+	float fz = glm::clamp(z / heightfield->spacingZ, 0.0f, static_cast<float>(cellsZ));
+	uint32_t cx = std::min(static_cast<uint32_t>(fx), cellsX - 1);
+	uint32_t cz = std::min(static_cast<uint32_t>(fz), cellsZ - 1);
+	float u = fx - cx;
+	float v = fz - cz;
+
+	const float* row = &heightfield->heights[cz * heightfield->width + cx];
+	float h00 = row[0];
+	float h10 = row[1];
+	float h01 = row[heightfield->width];
+	float h11 = row[heightfield->width + 1];
+
+	//Cells are split along the (0,0)-(1,1) diagonal like the terrain index buffer
+	if(u >= v)
+		return h00 + (h10 - h00) * u + (h11 - h10) * v;
+	return h00 + (h11 - h01) * u + (h01 - h00) * v;
+}
+
+glm::vec3 HeightfieldQuery::normalAt(float x, float z) const
+{
+	float fx = glm::clamp(x / heightfield->spacingX, 0.0f, static_cast<float>(cellsX));
+	float fz = glm::clamp(z / heightfield->spacingZ, 0.0f, static_cast<float>(cellsZ));
+	auto cx = static_cast<int>(std::min(static_cast<uint32_t>(fx), cellsX - 1));
+	auto cz = static_cast<int>(std::min(static_cast<uint32_t>(fz), cellsZ - 1));
+	float u = fx - cx;
+	float v = fz - cz;
+
+	//Matches the smooth shading normals rather than the flat triangle
+	glm::vec3 n0 = glm::mix(heightfield->normal(cx, cz), heightfield->normal(cx + 1, cz), u);
+	glm::vec3 n1 = glm::mix(heightfield->normal(cx, cz + 1), heightfield->normal(cx + 1, cz + 1), u);
+	return glm::normalize(glm::mix(n0, n1, v));
+}
+
+bool HeightfieldQuery::intersectNode(const TerrainRay &ray, glm::vec3 invDirection, uint32_t level,
+                                     uint32_t x, uint32_t z, float maxDistance, float &entry) const
+{
+	glm::vec2 range = levels[level][z * levelSizes[level].x + x];
+	glm::vec3 boundsMin(static_cast<float>(x << level) * heightfield->spacingX, range.x,
+	                    static_cast<float>(z << level) * heightfield->spacingZ);
+	glm::vec3 boundsMax(static_cast<float>(std::min((x + 1) << level, cellsX)) * heightfield->spacingX, range.y,
+	                    static_cast<float>(std::min((z + 1) << level, cellsZ)) * heightfield->spacingZ);
+
+	glm::vec3 t0 = (boundsMin - ray.origin) * invDirection;
+	glm::vec3 t1 = (boundsMax - ray.origin) * invDirection;
+	glm::vec3 tMin = glm::min(t0, t1);
+	glm::vec3 tMax = glm::max(t0, t1);
+
+	float tNear = std::max(std::max(tMin.x, tMin.y), std::max(tMin.z, 0.0f));
+	float tFar = std::min(std::min(tMax.x, tMax.y), std::min(tMax.z, maxDistance));
+	entry = tNear;
+	return tNear <= tFar;
+}
+
+static bool intersectTriangle(const TerrainRay &ray, glm::vec3 p0, glm::vec3 p1, glm::vec3 p2, float &distance)
+{
+	glm::vec3 edge1 = p1 - p0;
+	glm::vec3 edge2 = p2 - p0;
+	glm::vec3 p = glm::cross(ray.direction, edge2);
+	float det = glm::dot(edge1, p);
+	if(std::fabs(det) < 1e-12f)
+		return false;
+
+	float invDet = 1.0f / det;
+	glm::vec3 s = ray.origin - p0;
+	float u = glm::dot(s, p) * invDet;
+	if(u < 0.0f || u > 1.0f)
+		return false;
+
+	glm::vec3 q = glm::cross(s, edge1);
+	float v = glm::dot(ray.direction, q) * invDet;
+	if(v < 0.0f || u + v > 1.0f)
+		return false;
+
+	distance = glm::dot(edge2, q) * invDet;
+	return distance >= 0.0f;
+}
+
+bool HeightfieldQuery::intersectCell(const TerrainRay &ray, uint32_t x, uint32_t z, float &distance) const
+{
+	auto ix = static_cast<int>(x);
+	auto iz = static_cast<int>(z);
+	glm::vec3 p00 = heightfield->position(ix, iz);
+	glm::vec3 p10 = heightfield->position(ix + 1, iz);
+	glm::vec3 p01 = heightfield->position(ix, iz + 1);
+	glm::vec3 p11 = heightfield->position(ix + 1, iz + 1);
+
+	bool found = false;
+	float t;
+	if(intersectTriangle(ray, p00, p10, p11, t) && t < distance)
+	{
+		distance = t;
+		found = true;
+	}
+	if(intersectTriangle(ray, p00, p11, p01, t) && t < distance)
+	{
+		distance = t;
+		found = true;
+	}
+	return found;
+}
+
+bool HeightfieldQuery::raycast(const TerrainRay &ray, TerrainHit &hit) const
+{
+	hit = {};
+
+	glm::vec3 invDirection;
+	for(int i = 0; i < 3; i++)
+	{
+		//Keeps the slab test finite for axis aligned rays
+		float d = ray.direction[i];
+		invDirection[i] = std::fabs(d) > 1e-12f ? 1.0f / d : (d < 0.0f ? -1e30f : 1e30f);
+	}
+
+	struct StackEntry
+	{
+		uint32_t level;
+		uint32_t x;
+		uint32_t z;
+		float entry;
+	};
+	//Each level pushes at most four children onto what is left of the one above
+	StackEntry stack[4 * 33];
+	int stackSize = 0;
+
+	float best = ray.maxDistance;
+	auto top = static_cast<uint32_t>(levels.size() - 1);
+	float entry;
+	if(intersectNode(ray, invDirection, top, 0, 0, best, entry))
+		stack[stackSize++] = {top, 0, 0, entry};
+
+	while(stackSize > 0)
+	{
+		StackEntry node = stack[--stackSize];
+		if(node.entry > best)
+			continue;
+
+		if(node.level == 0)
+		{
+			if(intersectCell(ray, node.x, node.z, best))
+				hit.hit = true;
+			continue;
+		}
+
+		uint32_t childLevel = node.level - 1;
+		glm::uvec2 childSize = levelSizes[childLevel];
+		StackEntry children[4];
+		int childCount = 0;
+		for(uint32_t cz = node.z * 2; cz < std::min(node.z * 2 + 2, childSize.y); cz++)
+		{
+			for(uint32_t cx = node.x * 2; cx < std::min(node.x * 2 + 2, childSize.x); cx++)
+			{
+				if(intersectNode(ray, invDirection, childLevel, cx, cz, best, entry))
+					children[childCount++] = {childLevel, cx, cz, entry};
+			}
+		}
+
+		//Pushed far to near so the nearest child is visited first and can cut off the rest
+		std::sort(children, children + childCount, [](const StackEntry &a, const StackEntry &b)
+		{
+			return a.entry > b.entry;
+		});
+		for(int i = 0; i < childCount; i++)
+			stack[stackSize++] = children[i];
+	}
+
+	if(hit.hit)
+	{
+		hit.distance = best;
+		hit.position = ray.origin + ray.direction * best;
+		hit.normal = normalAt(hit.position.x, hit.position.z);
+	}
+	return hit.hit;
+}
+
+void HeightfieldQuery::raycast(const std::vector<TerrainRay> &rays, std::vector<TerrainHit> &hits)
+{
+	hits.resize(rays.size());
+	for(size_t first = 0; first < rays.size(); first += QUERY_RAYS_PER_JOB)
+	{
+		size_t last = std::min(first + QUERY_RAYS_PER_JOB, rays.size());
+		threadPool.addJob([this, &rays, &hits, first, last]
+		{
+			for(size_t i = first; i < last; i++)
+				raycast(rays[i], hits[i]);
+		});
+	}
+	threadPool.wait();
+}
@@ -0,0 +1,60 @@
+#ifndef VULKANITE_HEIGHTFIELDQUERY_H
+#define VULKANITE_HEIGHTFIELDQUERY_H
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <vector>
+#include <cstdint>
+#include "Heightfield.h"
+#include "GenericThreadPool.h"
+
+struct TerrainRay
+{
+	glm::vec3 origin;
+	//Expected to be normalised, distances are measured along it
+	glm::vec3 direction;
+	float maxDistance;
+};
+
+struct TerrainHit
+{
+	bool hit;
+	float distance;
+	glm::vec3 position;
+	glm::vec3 normal;
+};
+
+//Height, normal and ray queries against the triangulated heightfield. Rays descend a
+//min/max height pyramid over the grid cells and only test triangles in cells they reach.
+class HeightfieldQuery
+{
+	const Heightfield* heightfield;
+	uint32_t cellsX;
+	uint32_t cellsZ;
+	//levels[0] holds one min/max per grid cell, each level above halves both dimensions
+	std::vector<std::vector<glm::vec2> > levels;
+	std::vector<glm::uvec2> levelSizes;
+	GenericThreadPool threadPool;
+
+	void buildLevel(uint32_t level, uint32_t x0, uint32_t z0, uint32_t x1, uint32_t z1);
+	bool intersectNode(const TerrainRay &ray, glm::vec3 invDirection, uint32_t level, uint32_t x, uint32_t z,
+	                   float maxDistance, float &entry) const;
+	bool intersectCell(const TerrainRay &ray, uint32_t x, uint32_t z, float &distance) const;
+
+public:
+	explicit HeightfieldQuery(const Heightfield* inHeightfield);
+	~HeightfieldQuery();
+
+	//Rebuilds the pyramid over the samples in [x0,x1]x[z0,z1] after the heights change
+	void refresh(uint32_t x0, uint32_t z0, uint32_t x1, uint32_t z1);
+
+	//Heights follow the rendered triangles, positions outside the grid clamp to its edge
+	float heightAt(float x, float z) const;
+	glm::vec3 normalAt(float x, float z) const;
+
+	bool raycast(const TerrainRay &ray, TerrainHit &hit) const;
+	//Splits the rays between worker threads, hits[i] answers rays[i]
+	void raycast(const std::vector<TerrainRay> &rays, std::vector<TerrainHit> &hits);
+};
+
+#endif //VULKANITE_HEIGHTFIELDQUERY_H
@@ -0,0 +1,133 @@
+#include "HeightmapReader.h"
+#include "PngHeightmapReader.h"
+#include "logger.h"
+#include <stb_image.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+uint32_t HeightmapReader::getWidth() const
+{
+	return width;
+}
+
+uint32_t HeightmapReader::getDepth() const
+{
+	return depth;
+}
+
+uint32_t HeightmapReader::getRowsRead() const
+{
+	return rowsRead;
+}
+
+static std::string lowerExtension(const std::string &filename)
+{
+	size_t dot = filename.find_last_of('.');
+	if(dot == std::string::npos)
+		return "";
+	std::string extension = filename.substr(dot + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	return extension;
+}
+
+HeightmapReader* HeightmapReader::open(const std::string &filename)
+{
+	std::string extension = lowerExtension(filename);
+	if(extension == "png")
+		return new PngHeightmapReader(filename);
+	if(extension == "r16")
+	{
+		uint32_t side = RawHeightmapReader::squareSide(filename, RAW_HEIGHT_UINT16);
+		return new RawHeightmapReader(filename, RAW_HEIGHT_UINT16, side, side);
+	}
+	if(extension == "r32" || extension == "raw")
+	{
+		uint32_t side = RawHeightmapReader::squareSide(filename, RAW_HEIGHT_FLOAT32);
+		return new RawHeightmapReader(filename, RAW_HEIGHT_FLOAT32, side, side);
+	}
+	return new ImageHeightmapReader(filename);
+}
+
+static size_t rawSampleBytes(RawHeightFormat format)
+{
+	return format == RAW_HEIGHT_UINT16 ? sizeof(uint16_t) : sizeof(float);
+}
+
+RawHeightmapReader::RawHeightmapReader(const std::string &filename, RawHeightFormat format, uint32_t width, uint32_t depth) :
+	stream(filename.c_str(), std::ios::binary),
+	format(format)
+{
+	if(!stream.is_open())
+		throw std::runtime_error("Heightmap could not be opened " + filename);
+	if(width == 0 || depth == 0)
+		throw std::runtime_error("Raw heightmap needs a size " + filename);
+	this->width = width;
+	this->depth = depth;
+	row.resize(width * rawSampleBytes(format));
+
+	Logger() << "Raw heightmap " << filename << " " << width << "x" << depth
+	         << (format == RAW_HEIGHT_UINT16 ? ", 16 bit" : ", float");
+}
+
+uint32_t RawHeightmapReader::readRows(float* out, uint32_t rows)
+{
+	uint32_t count = 0;
+	for(; count < rows && rowsRead < depth; count++, rowsRead++)
+	{
+		stream.read(row.data(), row.size());
+		if(!stream)
+			throw std::runtime_error("Raw heightmap is truncated");
+
+		float* outRow = out + static_cast<size_t>(count) * width;
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(row.data());
+		if(format == RAW_HEIGHT_UINT16)
+		{
+			for(uint32_t x = 0; x < width; x++)
+				outRow[x] = (bytes[x * 2] | (bytes[x * 2 + 1] << 8)) / 65535.0f;
+		}
+		else
+			memcpy(outRow, bytes, row.size());
+	}
+	return count;
+}
+
+uint32_t RawHeightmapReader::squareSide(const std::string &filename, RawHeightFormat format)
+{
+	std::ifstream file(filename.c_str(), std::ios::binary | std::ios::ate);
+	if(!file.is_open())
+		throw std::runtime_error("Heightmap could not be opened " + filename);
+	uint64_t samples = static_cast<uint64_t>(file.tellg()) / rawSampleBytes(format);
+	uint64_t side = static_cast<uint64_t>(std::sqrt(static_cast<double>(samples)) + 0.5);
+	if(side * side * rawSampleBytes(format) != static_cast<uint64_t>(file.tellg()))
+		throw std::runtime_error("Raw heightmap is not square, its size can't be inferred " + filename);
+	return static_cast<uint32_t>(side);
+}
+
+ImageHeightmapReader::ImageHeightmapReader(const std::string &filename)
+{
+	int comp;
+	int imageWidth;
+	int imageHeight;
+	pixels = stbi_load(filename.c_str(), &imageWidth, &imageHeight, &comp, STBI_grey);
+	if(!pixels)
+		throw std::runtime_error("Heightmap could not be loaded " + filename);
+	width = static_cast<uint32_t>(imageWidth);
+	depth = static_cast<uint32_t>(imageHeight);
+}
+
+ImageHeightmapReader::~ImageHeightmapReader()
+{
+	stbi_image_free(pixels);
+}
+
+uint32_t ImageHeightmapReader::readRows(float* out, uint32_t rows)
+{
+	uint32_t count = std::min(rows, depth - rowsRead);
+	const unsigned char* source = pixels + static_cast<size_t>(rowsRead) * width;
+	for(size_t i = 0; i < static_cast<size_t>(count) * width; i++)
+		out[i] = source[i] / 255.0f;
+	rowsRead += count;
+	return count;
+}
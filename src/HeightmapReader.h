@@ -0,0 +1,67 @@
+#ifndef VULKANITE_HEIGHTMAPREADER_H
+#define VULKANITE_HEIGHTMAPREADER_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+//Single channel heightmap decoded top to bottom a few rows at a time.
+//Integer samples are normalised to [0, 1], float samples are passed through unchanged.
+class HeightmapReader
+{
+protected:
+	uint32_t width = 0;
+	uint32_t depth = 0;
+	uint32_t rowsRead = 0;
+
+public:
+	virtual ~HeightmapReader() = default;
+
+	uint32_t getWidth() const;
+	uint32_t getDepth() const;
+	uint32_t getRowsRead() const;
+
+	//Decodes the next rows into out[0..rows*width), returns how many rows were available
+	virtual uint32_t readRows(float* out, uint32_t rows) = 0;
+
+	//Picks a reader from the extension, .png streams at full bit depth, .r16/.r32/.raw are square raw dumps
+	//and anything else is decoded whole through stb_image
+	static HeightmapReader* open(const std::string &filename);
+};
+
+enum RawHeightFormat
+{
+	RAW_HEIGHT_UINT16,
+	RAW_HEIGHT_FLOAT32
+};
+
+//Headerless little endian samples, row major
+class RawHeightmapReader : public HeightmapReader
+{
+	std::ifstream stream;
+	RawHeightFormat format;
+	std::vector<char> row;
+
+public:
+	RawHeightmapReader(const std::string &filename, RawHeightFormat format, uint32_t width, uint32_t depth);
+
+	uint32_t readRows(float* out, uint32_t rows) override;
+
+	//Width and depth of a square raw file from its size
+	static uint32_t squareSide(const std::string &filename, RawHeightFormat format);
+};
+
+//Fallback for formats stb_image knows, the whole image is decoded up front as 8 bit grey
+class ImageHeightmapReader : public HeightmapReader
+{
+	unsigned char* pixels = nullptr;
+
+public:
+	explicit ImageHeightmapReader(const std::string &filename);
+	~ImageHeightmapReader() override;
+
+	uint32_t readRows(float* out, uint32_t rows) override;
+};
+
+#endif //VULKANITE_HEIGHTMAPREADER_H
@@ -0,0 +1,264 @@
+#include "Inflate.h"
+#include <cstring>
+#include <stdexcept>
+
+static const uint16_t lengthBase[29] = {
+		3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+		35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint16_t lengthExtra[29] = {
+		0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+		3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t distanceBase[30] = {
+		1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+		257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint16_t distanceExtra[30] = {
+		0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+		7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+InflateStream::InflateStream(SourceFunction source) :
+	source(std::move(source)),
+	input(INFLATE_INPUT_SIZE),
+	window(INFLATE_WINDOW_SIZE)
+{
+}
+
+uint8_t InflateStream::nextByte()
+{
+	if(inputPos == inputLength)
+	{
+		inputLength = source(input.data(), input.size());
+		inputPos = 0;
+		if(inputLength == 0)
+			throw std::runtime_error("Deflate stream is truncated");
+	}
+	return input[inputPos++];
+}
+
+uint32_t InflateStream::bits(uint32_t count)
+{
+	while(bitCount < count)
+	{
+		bitBuffer |= static_cast<uint32_t>(nextByte()) << bitCount;
+		bitCount += 8;
+	}
+	uint32_t value = bitBuffer & ((1u << count) - 1);
+	bitBuffer >>= count;
+	bitCount -= count;
+	return value;
+}
+
+int InflateStream::decode(const Huffman &huffman)
+{
+	//Canonical codes are read a bit at a time, first is the first code of the current length
+	int code = 0;
+	int first = 0;
+	int index = 0;
+	for(int len = 1; len < 16; len++)
+	{
+		code |= bits(1);
+		int count = huffman.count[len];
+		if(code - count < first)
+			return huffman.symbol[index + (code - first)];
+		index += count;
+		first += count;
+		first <<= 1;
+		code <<= 1;
+	}
+	throw std::runtime_error("Deflate stream has an invalid Huffman code");
+}
+
+int InflateStream::build(Huffman &huffman, const uint8_t* lengths, int count)
+{
+	memset(huffman.count, 0, sizeof(huffman.count));
+	for(int i = 0; i < count; i++)
+		huffman.count[lengths[i]]++;
+	if(huffman.count[0] == count)
+		return 0;
+
+	//Codes left over, negative means over-subscribed and positive an incomplete set
+	int left = 1;
+	for(int len = 1; len < 16; len++)
+	{
+		left <<= 1;
+		left -= huffman.count[len];
+		if(left < 0)
+			return left;
+	}
+
+	uint16_t offsets[16];
+	offsets[1] = 0;
+	for(int len = 1; len < 15; len++)
+		offsets[len + 1] = offsets[len] + huffman.count[len];
+	for(int i = 0; i < count; i++)
+	{
+		if(lengths[i] != 0)
+			huffman.symbol[offsets[lengths[i]]++] = static_cast<uint16_t>(i);
+	}
+	return left;
+}
+
+void InflateStream::readBlockHeader()
+{
+	if(lastBlock)
+	{
+		state = INFLATE_DONE;
+		return;
+	}
+
+	lastBlock = bits(1) != 0;
+	uint32_t type = bits(2);
+	if(type == 0)
+	{
+		//Stored blocks start on a byte boundary, anything left in the bit buffer is padding
+		bitBuffer = 0;
+		bitCount = 0;
+		uint32_t length = bits(16);
+		uint32_t complement = bits(16);
+		if(length != (~complement & 0xFFFF))
+			throw std::runtime_error("Deflate stored block length is corrupt");
+		storedRemaining = length;
+		state = INFLATE_BLOCK_STORED;
+	}
+	else if(type == 1)
+	{
+		uint8_t lengths[288 + 30];
+		int i = 0;
+		for(; i < 144; i++) lengths[i] = 8;
+		for(; i < 256; i++) lengths[i] = 9;
+		for(; i < 280; i++) lengths[i] = 7;
+		for(; i < 288; i++) lengths[i] = 8;
+		build(lengthCode, lengths, 288);
+		for(i = 0; i < 30; i++) lengths[i] = 5;
+		build(distanceCode, lengths, 30);
+		state = INFLATE_BLOCK_HUFFMAN;
+	}
+	else if(type == 2)
+	{
+		readDynamicTables();
+		state = INFLATE_BLOCK_HUFFMAN;
+	}
+	else
+		throw std::runtime_error("Deflate stream has an invalid block type");
+}
+
+void InflateStream::readDynamicTables()
+{
+	static const uint8_t order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+	int lengthCount = bits(5) + 257;
+	int distanceCount = bits(5) + 1;
+	int codeCount = bits(4) + 4;
+	if(lengthCount > 286 || distanceCount > 30)
+		throw std::runtime_error("Deflate stream has too many codes");
+
+	uint8_t lengths[288 + 30] = {};
+	for(int i = 0; i < codeCount; i++)
+		lengths[order[i]] = static_cast<uint8_t>(bits(3));
+	Huffman codeLengthCode;
+	if(build(codeLengthCode, lengths, 19) != 0)
+		throw std::runtime_error("Deflate stream has an incomplete code length code");
+
+	int index = 0;
+	while(index < lengthCount + distanceCount)
+	{
+		int symbol = decode(codeLengthCode);
+		if(symbol < 16)
+		{
+			lengths[index++] = static_cast<uint8_t>(symbol);
+			continue;
+		}
+
+		uint8_t value = 0;
+		int repeat;
+		if(symbol == 16)
+		{
+			if(index == 0)
+				throw std::runtime_error("Deflate stream repeats a missing length");
+			value = lengths[index - 1];
+			repeat = 3 + bits(2);
+		}
+		else if(symbol == 17)
+			repeat = 3 + bits(3);
+		else
+			repeat = 11 + bits(7);
+		if(index + repeat > lengthCount + distanceCount)
+			throw std::runtime_error("Deflate stream has too many lengths");
+		while(repeat--)
+			lengths[index++] = value;
+	}
+
+	if(lengths[256] == 0)
+		throw std::runtime_error("Deflate stream has no end of block code");
+	//Incomplete codes are only allowed when there is a single code
+	int left = build(lengthCode, lengths, lengthCount);
+	if(left < 0 || (left > 0 && lengthCount - lengthCode.count[0] != 1))
+		throw std::runtime_error("Deflate stream has an invalid literal/length code");
+	left = build(distanceCode, lengths + lengthCount, distanceCount);
+	if(left < 0 || (left > 0 && distanceCount - distanceCode.count[0] != 1))
+		throw std::runtime_error("Deflate stream has an invalid distance code");
+}
+
+size_t InflateStream::read(uint8_t* out, size_t size)
+{
+	uint8_t* start = out;
+	uint8_t* end = out + size;
+	while(out < end)
+	{
+		if(copyLength > 0)
+		{
+			while(copyLength > 0 && out < end)
+			{
+				put(window[(totalOut - copyDistance) & (INFLATE_WINDOW_SIZE - 1)], out);
+				copyLength--;
+			}
+			continue;
+		}
+
+		if(state == INFLATE_BLOCK_HEADER)
+			readBlockHeader();
+		else if(state == INFLATE_BLOCK_STORED)
+		{
+			while(storedRemaining > 0 && out < end)
+			{
+				put(nextByte(), out);
+				storedRemaining--;
+			}
+			if(storedRemaining == 0)
+				state = INFLATE_BLOCK_HEADER;
+		}
+		else if(state == INFLATE_BLOCK_HUFFMAN)
+		{
+			int symbol = decode(lengthCode);
+			if(symbol < 256)
+				put(static_cast<uint8_t>(symbol), out);
+			else if(symbol == 256)
+				state = INFLATE_BLOCK_HEADER;
+			else
+			{
+				symbol -= 257;
+				if(symbol >= 29)
+					throw std::runtime_error("Deflate stream has an invalid length symbol");
+				copyLength = lengthBase[symbol] + bits(lengthExtra[symbol]);
+
+				symbol = decode(distanceCode);
+				if(symbol >= 30)
+					throw std::runtime_error("Deflate stream has an invalid distance symbol");
+				copyDistance = distanceBase[symbol] + bits(distanceExtra[symbol]);
+				if(copyDistance > totalOut)
+					throw std::runtime_error("Deflate stream refers before its start");
+			}
+		}
+		else
+			break;
+	}
+	return static_cast<size_t>(out - start);
+}
+
+bool InflateStream::finished() const
+{
+	return state == INFLATE_DONE && copyLength == 0;
+}
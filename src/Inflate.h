@@ -0,0 +1,76 @@
+#ifndef VULKANITE_INFLATE_H
+#define VULKANITE_INFLATE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#define INFLATE_WINDOW_SIZE 32768
+#define INFLATE_INPUT_SIZE 65536
+
+//Raw deflate decoder that produces output on demand, only the 32KB history window is kept
+//so arbitrarily large streams can be decompressed a piece at a time
+class InflateStream
+{
+public:
+	//Fills the buffer with compressed bytes, returns 0 once the source is exhausted
+	typedef std::function<size_t(uint8_t*, size_t)> SourceFunction;
+
+private:
+	struct Huffman
+	{
+		uint16_t count[16];
+		uint16_t symbol[288];
+	};
+
+	enum State
+	{
+		INFLATE_BLOCK_HEADER,
+		INFLATE_BLOCK_STORED,
+		INFLATE_BLOCK_HUFFMAN,
+		INFLATE_DONE
+	};
+
+	SourceFunction source;
+	std::vector<uint8_t> input;
+	size_t inputPos = 0;
+	size_t inputLength = 0;
+	uint32_t bitBuffer = 0;
+	uint32_t bitCount = 0;
+
+	std::vector<uint8_t> window;
+	uint64_t totalOut = 0;
+
+	State state = INFLATE_BLOCK_HEADER;
+	bool lastBlock = false;
+	uint32_t storedRemaining = 0;
+	//Back reference still being copied when the caller's buffer filled up
+	uint32_t copyLength = 0;
+	uint32_t copyDistance = 0;
+
+	Huffman lengthCode;
+	Huffman distanceCode;
+
+	uint8_t nextByte();
+	uint32_t bits(uint32_t count);
+	int decode(const Huffman &huffman);
+	static int build(Huffman &huffman, const uint8_t* lengths, int count);
+	void readBlockHeader();
+	void readDynamicTables();
+	inline void put(uint8_t value, uint8_t* &out)
+	{
+		window[totalOut & (INFLATE_WINDOW_SIZE - 1)] = value;
+		totalOut++;
+		*out++ = value;
+	}
+
+public:
+	explicit InflateStream(SourceFunction source);
+
+	//Decompresses up to size bytes, fewer are only returned at the end of the stream
+	size_t read(uint8_t* out, size_t size);
+	bool finished() const;
+};
+
+#endif //VULKANITE_INFLATE_H
@@ -0,0 +1,130 @@
+#include "MappedFile.h"
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string &filename)
+{
+	open(filename);
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+#ifdef _WIN32
+
+void MappedFile::open(const std::string &filename)
+{
+	close();
+
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+	                          OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if(file == INVALID_HANDLE_VALUE)
+		throw std::runtime_error("Could not open " + filename);
+	fileHandle = file;
+
+	LARGE_INTEGER fileSize;
+	if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		close();
+		throw std::runtime_error("Could not map empty file " + filename);
+	}
+	mappedSize = static_cast<size_t>(fileSize.QuadPart);
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if(!mapping)
+	{
+		close();
+		throw std::runtime_error("Could not map " + filename);
+	}
+	mappingHandle = mapping;
+
+	mapped = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if(!mapped)
+	{
+		close();
+		throw std::runtime_error("Could not map " + filename);
+	}
+}
+
+void MappedFile::close()
+{
+	if(mapped)
+		UnmapViewOfFile(mapped);
+	if(mappingHandle)
+		CloseHandle(mappingHandle);
+	if(fileHandle)
+		CloseHandle(fileHandle);
+
+	mapped = nullptr;
+	mappedSize = 0;
+	mappingHandle = nullptr;
+	fileHandle = nullptr;
+}
+
+#else
+
+void MappedFile::open(const std::string &filename)
+{
+	close();
+
+	fileDescriptor = ::open(filename.c_str(), O_RDONLY);
+	if(fileDescriptor < 0)
+		throw std::runtime_error("Could not open " + filename);
+
+	struct stat fileStat = {};
+	if(fstat(fileDescriptor, &fileStat) != 0 || fileStat.st_size == 0)
+	{
+		close();
+		throw std::runtime_error("Could not map empty file " + filename);
+	}
+	mappedSize = static_cast<size_t>(fileStat.st_size);
+
+	void* address = mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+	if(address == MAP_FAILED)
+	{
+		close();
+		throw std::runtime_error("Could not map " + filename);
+	}
+	mapped = static_cast<const char*>(address);
+}
+
+void MappedFile::close()
+{
+	if(mapped)
+		munmap(const_cast<char*>(mapped), mappedSize);
+	if(fileDescriptor >= 0)
+		::close(fileDescriptor);
+
+	mapped = nullptr;
+	mappedSize = 0;
+	fileDescriptor = -1;
+}
+
+#endif
+
+bool MappedFile::isOpen() const
+{
+	return mapped != nullptr;
+}
+
+const char* MappedFile::data() const
+{
+	return mapped;
+}
+
+size_t MappedFile::size() const
+{
+	return mappedSize;
+}
@@ -0,0 +1,36 @@
+#ifndef VULKANITE_MAPPEDFILE_H
+#define VULKANITE_MAPPEDFILE_H
+
+#include <string>
+#include <cstddef>
+
+//Read only memory mapping of a whole file, pages are loaded by the OS on first touch
+class MappedFile
+{
+	const char* mapped = nullptr;
+	size_t mappedSize = 0;
+
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#else
+	int fileDescriptor = -1;
+#endif
+
+public:
+	MappedFile() = default;
+	explicit MappedFile(const std::string &filename);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	void open(const std::string &filename);
+	void close();
+
+	bool isOpen() const;
+	const char* data() const;
+	size_t size() const;
+};
+
+#endif //VULKANITE_MAPPEDFILE_H
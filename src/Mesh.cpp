@@ -5,6 +5,11 @@
 #include "Mesh.h"
 
 #include <utility>
+#include <limits>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 #include "vulkanInterface.h"
 #include "logger.h"
 
@@ -27,42 +32,54 @@ Mesh::~Mesh()
 	Logger() << "Vertex buffer memory freed";
 }
 
-void Mesh::load(aiMesh* assimpMesh)
+void Mesh::load(const Vertex* inVertices, size_t inVertexCount, const uint32_t* inIndices, size_t inIndexCount,
+                VertexFormat inFormat)
 {
-	for(unsigned int j = 0; j < assimpMesh->mNumFaces; j++)
+	upload(inVertices, inVertexCount, inIndices, inIndexCount, VK_INDEX_TYPE_UINT32, inFormat);
+}
+
+void Mesh::load(const Vertex* inVertices, size_t inVertexCount, const uint16_t* inIndices, size_t inIndexCount,
+                VertexFormat inFormat)
+{
+	upload(inVertices, inVertexCount, inIndices, inIndexCount, VK_INDEX_TYPE_UINT16, inFormat);
+}
+
+void Mesh::upload(const Vertex* inVertices, size_t inVertexCount, const void* inIndices, size_t inIndexCount,
+                  VkIndexType sourceIndexType, VertexFormat inFormat)
+{
+	format = inFormat;
+	vertexCount = static_cast<uint32_t>(inVertexCount);
+	indexCount = static_cast<uint32_t>(inIndexCount);
+	if(submeshes.empty())
+		submeshes.push_back({0, indexCount, 0, 0});
+	if(lods.empty())
+		lods.push_back({0, static_cast<uint32_t>(submeshes.size()), indexCount / 3, 0});
+	if(format == VERTEX_FORMAT_QUANTIZED)
 	{
-		aiFace& assimpFace = assimpMesh->mFaces[j];
-		for(unsigned int k = 0; k < assimpFace.mNumIndices; k++)
-		{
-			indices.push_back(assimpFace.mIndices[k]);
-		}
+		std::vector<QuantizedVertex> quantized = quantize(inVertices, inVertexCount, boundsMin, boundsMax);
+		createVertexBuffer(quantized.data(), sizeof(QuantizedVertex) * quantized.size());
 	}
-	for(unsigned int j = 0; j < assimpMesh->mNumVertices; j++)
+	else
 	{
-		aiVector3D vertex = assimpMesh->mVertices[j];
-		glm::vec3 glmVert = glm::vec3(vertex.x,vertex.y,vertex.z);
-		vertices.push_back(glmVert);
-
-		aiVector3D uv = assimpMesh->mTextureCoords[0][j];
-		glm::vec2 glmUv = glm::vec2(uv.x,1-uv.y);
-		uvs.push_back(glmUv);
-
-		aiVector3D normal = assimpMesh->mNormals[j];
-		glm::vec3 glmNormal = glm::vec3(normal.x,normal.y,normal.z);
-		normals.push_back(glmNormal);
-
-		//materialIndices.push_back(assimpMesh->mMaterialIndex);
-
-		Vertex collatedVertex;
-		collatedVertex.position = glmVert;
-		collatedVertex.uv = glmUv;
-		collatedVertex.normal = glmNormal;
-		//collatedVertex.materialIndex = assimpMesh->mMaterialIndex;
-		collatedVertices.push_back(collatedVertex);
+		createVertexBuffer(inVertices, sizeof(Vertex) * inVertexCount);
 	}
+	indexType = vki->createIndexBuffer(inIndices, inIndexCount, sourceIndexType, indexBuffer, indexBufferMemory);
 
-	createVertexBuffer();
-	createIndexBuffer();
+	std::vector<glm::vec3>().swap(positions);
+	std::vector<uint32_t>().swap(indices);
+	if(retention == MESH_RETAIN_POSITIONS)
+	{
+		positions.resize(inVertexCount);
+		for(size_t i = 0; i < inVertexCount; i++)
+			positions[i] = inVertices[i].position;
+		if(sourceIndexType == VK_INDEX_TYPE_UINT16)
+			indices.assign(static_cast<const uint16_t*>(inIndices), static_cast<const uint16_t*>(inIndices) + inIndexCount);
+		else
+			indices.assign(static_cast<const uint32_t*>(inIndices), static_cast<const uint32_t*>(inIndices) + inIndexCount);
+	}
+	Logger() << "Mesh uploaded, " << lods.size() << " LODs " << submeshes.size() << " submeshes " << vertexCount << " vertices " << indexCount
+	         << (indexType == VK_INDEX_TYPE_UINT16 ? " 16 bit" : " 32 bit") << " indices, "
+	         << getResidentBytes() << " bytes resident on the CPU";
 }
 
 void Mesh::load(std::vector<glm::vec3> inVertices,
@@ -70,72 +87,93 @@ void Mesh::load(std::vector<glm::vec3> inVertices,
                 std::vector<glm::vec3> inNormals,
                 std::vector<uint32_t> inIndices)
 {
-	vertices = std::move(inVertices);
-	uvs = std::move(inUVs);
-	normals = std::move(inNormals);
-	indices = std::move(inIndices);
+	std::vector<Vertex> collatedVertices(inVertices.size());
+	for(size_t j = 0; j < inVertices.size(); j++)
+	{
+		collatedVertices[j].position = inVertices[j];
+		collatedVertices[j].uv = inUVs[j];
+		collatedVertices[j].normal = inNormals[j];
+	}
 
-	size_t size = vertices.size();
-	for(auto j = 0; j < size; j++)
+	boundsMin = glm::vec3(std::numeric_limits<float>::max());
+	boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+	for(const glm::vec3 &vertex : inVertices)
 	{
-		//materialIndices.push_back(assimpMesh->mMaterialIndex);
-
-		Vertex collatedVertex;
-		collatedVertex.position = vertices[j];
-		collatedVertex.uv = uvs[j];
-		collatedVertex.normal = normals[j];
-		//collatedVertex.materialIndex = assimpMesh->mMaterialIndex;
-		collatedVertices.push_back(collatedVertex);
+		boundsMin = glm::min(boundsMin, vertex);
+		boundsMax = glm::max(boundsMax, vertex);
 	}
 
-	createVertexBuffer();
-	createIndexBuffer();
+	load(collatedVertices.data(), collatedVertices.size(), inIndices.data(), inIndices.size());
 }
 
-void Mesh::createVertexBuffer()
+std::vector<QuantizedVertex> Mesh::quantize(const Vertex* inVertices, size_t vertexCount,
+                                            glm::vec3 inBoundsMin, glm::vec3 inBoundsMax)
 {
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
+	//Flat axes stay at 0 rather than dividing by a zero extent
+	glm::vec3 extent = inBoundsMax - inBoundsMin;
+	glm::vec3 invExtent = glm::vec3(extent.x > 0 ? 1 / extent.x : 0,
+	                                extent.y > 0 ? 1 / extent.y : 0,
+	                                extent.z > 0 ? 1 / extent.z : 0);
+
+	std::vector<QuantizedVertex> quantized(vertexCount);
+	for(size_t i = 0; i < vertexCount; i++)
+	{
+		const Vertex &vertex = inVertices[i];
+		QuantizedVertex &out = quantized[i];
 
-	VkDeviceSize bufferSize = sizeof(collatedVertices[0]) * collatedVertices.size();
-	vki->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-					  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-					  stagingBuffer, stagingBufferMemory);
+		glm::vec3 position = glm::clamp((vertex.position - inBoundsMin) * invExtent, 0.0f, 1.0f);
+		for(int k = 0; k < 3; k++)
+			out.position[k] = static_cast<uint16_t>(position[k] * 65535.0f + 0.5f);
+		out.position[3] = 0;
 
-	void* data;
-	vkMapMemory(vki->logicalDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, collatedVertices.data(), bufferSize);
-	vkUnmapMemory(vki->logicalDevice, stagingBufferMemory);
+		out.uv[0] = glm::packHalf1x16(vertex.uv.x);
+		out.uv[1] = glm::packHalf1x16(vertex.uv.y);
 
-	vki->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-					  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-					  vertexBuffer, vertexBufferMemory);
+		//Project onto the octahedron then fold the lower half over the upper
+		glm::vec3 normal = vertex.normal / (glm::abs(vertex.normal.x) + glm::abs(vertex.normal.y) + glm::abs(vertex.normal.z) + 1e-20f);
+		glm::vec2 octahedral(normal.x, normal.y);
+		if(normal.z < 0)
+		{
+			octahedral = (1.0f - glm::abs(glm::vec2(normal.y, normal.x))) *
+			             glm::vec2(normal.x >= 0 ? 1.0f : -1.0f, normal.y >= 0 ? 1.0f : -1.0f);
+		}
+		for(int k = 0; k < 2; k++)
+			out.normal[k] = static_cast<int16_t>(glm::round(glm::clamp(octahedral[k], -1.0f, 1.0f) * 32767.0f));
+	}
+	return quantized;
+}
 
-	vki->copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
+glm::mat4 Mesh::positionTransform() const
+{
+	if(format != VERTEX_FORMAT_QUANTIZED)
+		return glm::mat4(1.0f);
+	return glm::scale(glm::translate(glm::mat4(1.0f), boundsMin), boundsMax - boundsMin);
+}
 
-	vkDestroyBuffer(vki->logicalDevice, stagingBuffer, nullptr);
-	vkFreeMemory(vki->logicalDevice, stagingBufferMemory, nullptr);
+size_t Mesh::getResidentBytes() const
+{
+	return sizeof(glm::vec3) * positions.capacity() + sizeof(uint32_t) * indices.capacity();
 }
 
-void Mesh::createIndexBuffer()
+void Mesh::createVertexBuffer(const void* vertexData, VkDeviceSize bufferSize)
 {
 	VkBuffer stagingBuffer;
 	VkDeviceMemory stagingBufferMemory;
-	VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+
 	vki->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
 					  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
 					  stagingBuffer, stagingBufferMemory);
+
 	void* data;
 	vkMapMemory(vki->logicalDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, indices.data(), bufferSize);
+	memcpy(data, vertexData, bufferSize);
 	vkUnmapMemory(vki->logicalDevice, stagingBufferMemory);
 
 	vki->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
 					  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-					  indexBuffer, indexBufferMemory);
+					  vertexBuffer, vertexBufferMemory);
 
-	vki->copyBuffer(stagingBuffer, indexBuffer, bufferSize);
+	vki->copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
 
-	vkDestroyBuffer(vki->logicalDevice, stagingBuffer, nullptr);
-	vkFreeMemory(vki->logicalDevice, stagingBufferMemory, nullptr);
+	vki->destroyStagingBuffer(stagingBuffer, stagingBufferMemory);
 }
\ No newline at end of file
@@ -7,8 +7,8 @@
 
 #include <glm/vec3.hpp>
 #include <glm/vec2.hpp>
+#include <glm/mat4x4.hpp>
 #include <vector>
-#include <assimp/scene.h>
 #include <vulkan/vulkan.h>
 
 class VulkanInterface;
@@ -20,24 +20,68 @@ struct Vertex
 	glm::vec3 normal;
 };
 
+//16 bytes instead of 32. Positions are unorm16 within the mesh bounds, uvs half floats and
+//normals octahedral encoded snorm16, matches standardQuantized.vert
+struct QuantizedVertex
+{
+	uint16_t position[4]; //w unused, 3 component 16 bit formats aren't required for vertex input
+	uint16_t uv[2];
+	int16_t normal[2];
+};
+
+enum VertexFormat
+{
+	VERTEX_FORMAT_FLOAT,
+	VERTEX_FORMAT_QUANTIZED
+};
+
+//A range of the shared vertex and index buffers drawn with one material.
+//Indices are relative to vertexOffset, so they stay small enough for 16 bits per submesh.
+struct Submesh
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	int32_t vertexOffset;
+	uint32_t material;
+};
+
+//One level of detail, its submeshes are consecutive in Mesh::submeshes
+struct MeshLod
+{
+	uint32_t firstSubmesh;
+	uint32_t submeshCount;
+	uint32_t triangleCount;
+	float error; //Furthest the simplified surface may sit from the original, in model units
+};
+
+//What a mesh keeps on the CPU once its buffers are uploaded
+enum MeshRetention
+{
+	MESH_RETAIN_NONE,
+	//Positions and indices, enough for collision or picking
+	MESH_RETAIN_POSITIONS
+};
+
 class Mesh
 {
-	void createVertexBuffer();
-	void createIndexBuffer();
+	void createVertexBuffer(const void* data, VkDeviceSize size);
+	void upload(const Vertex* inVertices, size_t inVertexCount, const void* inIndices, size_t inIndexCount,
+	            VkIndexType sourceIndexType, VertexFormat inFormat);
 
 	VulkanInterface* vki;
 	VkDeviceMemory vertexBufferMemory;
 	VkDeviceMemory indexBufferMemory;
 
-	std::vector<glm::vec3> vertices;
-	std::vector<glm::vec2> uvs;
-	std::vector<glm::vec3> normals;
-
-	std::vector<Vertex> collatedVertices;
 public:
 	explicit Mesh(VulkanInterface* inVulkanInterface);
 	~Mesh();
-	void load(aiMesh* assimpMesh);
+	//Copies straight into the staging buffers, only what retention asks for is kept on the CPU.
+	//Quantizing needs boundsMin and boundsMax set first.
+	//32 bit indices are stored as 16 bit when they all fit
+	void load(const Vertex* inVertices, size_t inVertexCount, const uint32_t* inIndices, size_t inIndexCount,
+	          VertexFormat inFormat = VERTEX_FORMAT_FLOAT);
+	void load(const Vertex* inVertices, size_t inVertexCount, const uint16_t* inIndices, size_t inIndexCount,
+	          VertexFormat inFormat = VERTEX_FORMAT_FLOAT);
 	void load(std::vector<glm::vec3> inVertices,
 	          std::vector<glm::vec2> inUVs,
 	          std::vector<glm::vec3> inNormals,
@@ -45,7 +89,28 @@ public:
 
 	VkBuffer vertexBuffer;
 	VkBuffer indexBuffer;
+	uint32_t vertexCount = 0;
+	uint32_t indexCount = 0;
+	VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	VertexFormat format = VERTEX_FORMAT_FLOAT;
+	//Set before load
+	MeshRetention retention = MESH_RETAIN_NONE;
+	//Set before load, left empty a single submesh covers the whole mesh
+	std::vector<Submesh> submeshes;
+	//Set before load, finest first. Left empty a single level covers every submesh.
+	std::vector<MeshLod> lods;
+	//Only filled with MESH_RETAIN_POSITIONS, indices stay relative to each submesh's vertex offset
+	std::vector<glm::vec3> positions;
 	std::vector<uint32_t> indices;
+
+	static std::vector<QuantizedVertex> quantize(const Vertex* inVertices, size_t vertexCount,
+	                                             glm::vec3 inBoundsMin, glm::vec3 inBoundsMax);
+	//Maps vertex positions into the mesh's space, scales quantized positions back out of the bounds
+	glm::mat4 positionTransform() const;
+	//Bytes of vertex and index data still held on the CPU
+	size_t getResidentBytes() const;
 };
 
 #endif //VULKANITE_MESH_H
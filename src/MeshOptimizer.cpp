@@ -0,0 +1,466 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <glm/geometric.hpp>
+
+//Symmetric 4x4 plane quadric, upper triangle
+struct Quadric
+{
+	double a[10];
+};
+
+static void addPlane(Quadric &q, glm::vec3 normal, float d, float weight)
+{
+	double p[4] = {normal.x, normal.y, normal.z, d};
+	int k = 0;
+	for(int i = 0; i < 4; i++)
+		for(int j = i; j < 4; j++)
+			q.a[k++] += weight * p[i] * p[j];
+}
+
+static void addQuadric(Quadric &q, const Quadric &other)
+{
+	for(int k = 0; k < 10; k++)
+		q.a[k] += other.a[k];
+}
+
+static double evaluate(const Quadric &q, glm::vec3 position)
+{
+	double p[4] = {position.x, position.y, position.z, 1};
+	double result = 0;
+	int k = 0;
+	for(int i = 0; i < 4; i++)
+	{
+		for(int j = i; j < 4; j++)
+		{
+			result += (i == j ? 1 : 2) * q.a[k++] * p[i] * p[j];
+		}
+	}
+	return std::max(result, 0.0);
+}
+
+struct Collapse
+{
+	uint32_t from;
+	uint32_t to;
+	double cost;
+};
+
+void MeshOptimizer::optimize(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices)
+{
+	if(indices.size() < 3 || vertices.empty())
+		return;
+
+	optimizeIndices(vertices, indices);
+	reorderVertices(vertices, indices);
+}
+
+void MeshOptimizer::optimizeIndices(const std::vector<Vertex> &vertices, std::vector<uint32_t> &indices)
+{
+	if(indices.size() < 3)
+		return;
+
+	std::vector<uint32_t> ordered;
+	std::vector<size_t> clusters;
+	tipsify(indices, vertices.size(), ordered, clusters);
+	sortClusters(vertices, ordered, clusters);
+	indices.swap(ordered);
+}
+
+float MeshOptimizer::simplify(const std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices,
+                              size_t targetIndexCount, float maxError, std::vector<uint32_t> &outIndices)
+{
+	outIndices = indices;
+	size_t vertexCount = vertices.size();
+
+	//Vertices at the same position are wedges of one point, they differ in uv or normal
+	std::vector<uint32_t> point(vertexCount);
+	std::vector<uint32_t> wedges;
+	std::unordered_map<std::string, uint32_t> pointLookup;
+	for(size_t v = 0; v < vertexCount; v++)
+	{
+		std::string key(reinterpret_cast<const char*>(&vertices[v].position), sizeof(glm::vec3));
+		auto found = pointLookup.insert(std::make_pair(key, static_cast<uint32_t>(wedges.size())));
+		if(found.second)
+			wedges.push_back(0);
+		point[v] = found.first->second;
+		wedges[point[v]]++;
+	}
+
+	//Each point's quadric sums the planes of the triangles around it, weighted by area
+	std::vector<Quadric> quadrics(wedges.size());
+	memset(quadrics.data(), 0, sizeof(Quadric) * quadrics.size());
+	for(size_t t = 0; t < indices.size(); t += 3)
+	{
+		const glm::vec3 &p0 = vertices[indices[t + 0]].position;
+		const glm::vec3 &p1 = vertices[indices[t + 1]].position;
+		const glm::vec3 &p2 = vertices[indices[t + 2]].position;
+		glm::vec3 cross = glm::cross(p1 - p0, p2 - p0);
+		float length = glm::length(cross);
+		if(length <= 0)
+			continue;
+		glm::vec3 normal = cross / length;
+		for(int k = 0; k < 3; k++)
+			addPlane(quadrics[point[indices[t + k]]], normal, -glm::dot(normal, p0), length * 0.5f);
+	}
+
+	//Edges used by one triangle are borders, their ends and every seam stay put
+	std::vector<bool> locked(vertexCount, false);
+	std::unordered_map<uint64_t, uint32_t> edgeUses;
+	for(size_t t = 0; t < indices.size(); t += 3)
+	{
+		for(int k = 0; k < 3; k++)
+		{
+			uint64_t a = point[indices[t + k]];
+			uint64_t b = point[indices[t + (k + 1) % 3]];
+			edgeUses[std::min(a, b) << 32 | std::max(a, b)]++;
+		}
+	}
+	for(size_t t = 0; t < indices.size(); t += 3)
+	{
+		for(int k = 0; k < 3; k++)
+		{
+			uint32_t a = indices[t + k];
+			uint32_t b = indices[t + (k + 1) % 3];
+			uint64_t pa = point[a];
+			uint64_t pb = point[b];
+			if(edgeUses[std::min(pa, pb) << 32 | std::max(pa, pb)] == 1)
+				locked[a] = locked[b] = true;
+		}
+	}
+	for(size_t v = 0; v < vertexCount; v++)
+	{
+		if(wedges[point[v]] > 1)
+			locked[v] = true;
+	}
+
+	double maxCost = static_cast<double>(maxError) * maxError;
+	double acceptedCost = 0;
+	std::vector<Collapse> collapses;
+	std::vector<uint32_t> remap(vertexCount);
+	std::vector<bool> touched(vertexCount);
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+	std::vector<uint32_t> adjacency;
+	//Passes of independent collapses, each pass works from fresh adjacency
+	while(outIndices.size() > targetIndexCount)
+	{
+		collapses.clear();
+		for(size_t t = 0; t < outIndices.size(); t += 3)
+		{
+			for(int k = 0; k < 3; k++)
+			{
+				uint32_t a = outIndices[t + k];
+				uint32_t b = outIndices[t + (k + 1) % 3];
+				Quadric combined = quadrics[point[a]];
+				addQuadric(combined, quadrics[point[b]]);
+				if(!locked[a])
+					collapses.push_back({a, b, evaluate(combined, vertices[b].position)});
+				if(!locked[b])
+					collapses.push_back({b, a, evaluate(combined, vertices[a].position)});
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b)
+		{
+			return a.cost < b.cost;
+		});
+
+		std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+		for(uint32_t index : outIndices)
+			adjacencyOffsets[index + 1]++;
+		for(size_t v = 0; v < vertexCount; v++)
+			adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+		adjacency.resize(outIndices.size());
+		std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for(size_t i = 0; i < outIndices.size(); i++)
+			adjacency[fill[outIndices[i]]++] = static_cast<uint32_t>(i / 3);
+
+		for(size_t v = 0; v < vertexCount; v++)
+			remap[v] = static_cast<uint32_t>(v);
+		std::fill(touched.begin(), touched.end(), false);
+
+		size_t removedIndices = 0;
+		size_t wantedIndices = outIndices.size() - targetIndexCount;
+		for(const Collapse &collapse : collapses)
+		{
+			if(collapse.cost > maxCost || removedIndices >= wantedIndices)
+				break;
+			if(touched[collapse.from] || touched[collapse.to])
+				continue;
+
+			//Refuse if any remaining triangle around the moving vertex would flip
+			glm::vec3 target = vertices[collapse.to].position;
+			bool flips = false;
+			size_t removedHere = 0;
+			for(uint32_t a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1] && !flips; a++)
+			{
+				const uint32_t* triangle = &outIndices[adjacency[a] * 3];
+				bool shared = false;
+				for(int k = 0; k < 3; k++)
+					shared |= point[triangle[k]] == point[collapse.to];
+				if(shared)
+				{
+					removedHere += 3;
+					continue;
+				}
+
+				glm::vec3 before[3];
+				glm::vec3 after[3];
+				for(int k = 0; k < 3; k++)
+				{
+					before[k] = vertices[triangle[k]].position;
+					after[k] = triangle[k] == collapse.from ? target : before[k];
+				}
+				glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+				glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+				//Turning most of the way over counts too, small turns add up over several passes
+				flips = glm::dot(normalBefore, normalAfter) <= 0.25f * glm::length(normalBefore) * glm::length(normalAfter);
+			}
+			if(flips)
+				continue;
+
+			//The neighbourhood is frozen for the rest of the pass so the flip test above stays valid
+			remap[collapse.from] = collapse.to;
+			for(uint32_t a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1]; a++)
+			{
+				for(int k = 0; k < 3; k++)
+					touched[outIndices[adjacency[a] * 3 + k]] = true;
+			}
+			addQuadric(quadrics[point[collapse.to]], quadrics[point[collapse.from]]);
+			acceptedCost = std::max(acceptedCost, collapse.cost);
+			removedIndices += removedHere;
+		}
+		if(removedIndices == 0)
+			break;
+
+		//Triangles that lost a corner are dropped
+		size_t write = 0;
+		for(size_t t = 0; t < outIndices.size(); t += 3)
+		{
+			uint32_t a = remap[outIndices[t + 0]];
+			uint32_t b = remap[outIndices[t + 1]];
+			uint32_t c = remap[outIndices[t + 2]];
+			if(point[a] == point[b] || point[b] == point[c] || point[a] == point[c])
+				continue;
+			outIndices[write++] = a;
+			outIndices[write++] = b;
+			outIndices[write++] = c;
+		}
+		outIndices.resize(write);
+	}
+	return static_cast<float>(std::sqrt(acceptedCost));
+}
+
+MeshCacheStats MeshOptimizer::analyze(const std::vector<uint32_t> &indices, size_t vertexCount)
+{
+	MeshCacheStats stats = {};
+	if(indices.empty())
+		return stats;
+
+	//Entry time of each vertex into the FIFO, it's still cached while fewer than the cache size
+	//misses have happened since
+	std::vector<size_t> cachedAt(vertexCount, 0);
+	std::vector<bool> used(vertexCount, false);
+	size_t misses = 0;
+	size_t uniqueVertices = 0;
+	for(uint32_t index : indices)
+	{
+		if(!used[index])
+		{
+			used[index] = true;
+			uniqueVertices++;
+		}
+		if(cachedAt[index] == 0 || misses - cachedAt[index] >= MESH_OPTIMIZER_CACHE_SIZE)
+		{
+			misses++;
+			cachedAt[index] = misses;
+		}
+	}
+
+	stats.acmr = static_cast<float>(misses) / (indices.size() / 3);
+	stats.atvr = static_cast<float>(misses) / uniqueVertices;
+	return stats;
+}
+
+//Sander et al. 2007, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"
+void MeshOptimizer::tipsify(const std::vector<uint32_t> &indices, size_t vertexCount,
+                            std::vector<uint32_t> &outIndices, std::vector<size_t> &outClusters)
+{
+	size_t triangleCount = indices.size() / 3;
+
+	//Triangles around each vertex, packed with offsets
+	std::vector<uint32_t> live(vertexCount, 0);
+	for(size_t i = 0; i < triangleCount * 3; i++)
+		live[indices[i]]++;
+	std::vector<size_t> adjacencyOffsets(vertexCount + 1, 0);
+	for(size_t v = 0; v < vertexCount; v++)
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + live[v];
+	std::vector<uint32_t> adjacency(adjacencyOffsets[vertexCount]);
+	std::vector<size_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for(size_t t = 0; t < triangleCount; t++)
+	{
+		for(int k = 0; k < 3; k++)
+			adjacency[fill[indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+	}
+
+	std::vector<size_t> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<uint32_t> deadEnd;
+	std::vector<uint32_t> candidates;
+	size_t time = MESH_OPTIMIZER_CACHE_SIZE + 1;
+	size_t cursor = 0;
+
+	outIndices.clear();
+	outIndices.reserve(triangleCount * 3);
+	outClusters.clear();
+	outClusters.push_back(0);
+
+	//Start fanning around the first vertex with triangles
+	int64_t fanning = -1;
+	for(size_t v = 0; v < vertexCount && fanning < 0; v++)
+		if(live[v] > 0)
+			fanning = static_cast<int64_t>(v);
+
+	while(fanning >= 0)
+	{
+		candidates.clear();
+		for(size_t a = adjacencyOffsets[fanning]; a < adjacencyOffsets[fanning + 1]; a++)
+		{
+			uint32_t t = adjacency[a];
+			if(emitted[t])
+				continue;
+			for(int k = 0; k < 3; k++)
+			{
+				uint32_t v = indices[t * 3 + k];
+				outIndices.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if(time - cacheTime[v] > MESH_OPTIMIZER_CACHE_SIZE)
+				{
+					cacheTime[v] = time;
+					time++;
+				}
+			}
+			emitted[t] = true;
+		}
+
+		//Next fanning vertex is the candidate still in cache that stays there longest
+		int64_t next = -1;
+		int64_t best = -1;
+		for(uint32_t v : candidates)
+		{
+			if(live[v] == 0)
+				continue;
+			int64_t priority = 0;
+			if(time - cacheTime[v] + 2 * live[v] <= MESH_OPTIMIZER_CACHE_SIZE)
+				priority = static_cast<int64_t>(time - cacheTime[v]);
+			if(priority > best)
+			{
+				best = priority;
+				next = v;
+			}
+		}
+
+		//Dead end, back up through recently used vertices then scan for any vertex left
+		if(next < 0)
+		{
+			while(!deadEnd.empty() && next < 0)
+			{
+				uint32_t v = deadEnd.back();
+				deadEnd.pop_back();
+				if(live[v] > 0)
+					next = v;
+			}
+			while(cursor < vertexCount && next < 0)
+			{
+				if(live[cursor] > 0)
+					next = static_cast<int64_t>(cursor);
+				cursor++;
+			}
+			//Jumping breaks vertex locality, a natural place to start a new overdraw cluster
+			if(next >= 0 && outClusters.back() != outIndices.size() / 3)
+				outClusters.push_back(outIndices.size() / 3);
+		}
+		fanning = next;
+	}
+}
+
+void MeshOptimizer::sortClusters(const std::vector<Vertex> &vertices, std::vector<uint32_t> &indices,
+                                 std::vector<size_t> &clusters)
+{
+	size_t triangleCount = indices.size() / 3;
+	if(clusters.empty() || clusters.back() != triangleCount)
+		clusters.push_back(triangleCount);
+	size_t clusterCount = clusters.size() - 1;
+	if(clusterCount < 2)
+		return;
+
+	//Area weighted centroid and normal of each cluster and of the whole mesh
+	std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0));
+	std::vector<glm::vec3> normals(clusterCount, glm::vec3(0));
+	std::vector<float> areas(clusterCount, 0);
+	glm::vec3 meshCentroid(0);
+	float meshArea = 0;
+	for(size_t c = 0; c < clusterCount; c++)
+	{
+		for(size_t t = clusters[c]; t < clusters[c + 1]; t++)
+		{
+			const glm::vec3 &p0 = vertices[indices[t * 3 + 0]].position;
+			const glm::vec3 &p1 = vertices[indices[t * 3 + 1]].position;
+			const glm::vec3 &p2 = vertices[indices[t * 3 + 2]].position;
+			glm::vec3 cross = glm::cross(p1 - p0, p2 - p0);
+			float area = glm::length(cross) * 0.5f;
+			centroids[c] += (p0 + p1 + p2) / 3.0f * area;
+			normals[c] += cross;
+			areas[c] += area;
+		}
+		meshCentroid += centroids[c];
+		meshArea += areas[c];
+		if(areas[c] > 0)
+			centroids[c] /= areas[c];
+	}
+	if(meshArea > 0)
+		meshCentroid /= meshArea;
+
+	//Clusters facing away from the middle of the mesh are likely to occlude the rest, draw them first
+	std::vector<float> outward(clusterCount);
+	std::vector<size_t> order(clusterCount);
+	for(size_t c = 0; c < clusterCount; c++)
+	{
+		float normalLength = glm::length(normals[c]);
+		outward[c] = normalLength > 0 ? glm::dot(centroids[c] - meshCentroid, normals[c] / normalLength) : 0;
+		order[c] = c;
+	}
+	std::stable_sort(order.begin(), order.end(), [&outward](size_t a, size_t b)
+	{
+		return outward[a] > outward[b];
+	});
+
+	std::vector<uint32_t> sorted;
+	sorted.reserve(indices.size());
+	for(size_t c : order)
+		sorted.insert(sorted.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+	indices.swap(sorted);
+}
+
+void MeshOptimizer::reorderVertices(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices)
+{
+	//Vertices renumbered by first use so fetches walk the vertex buffer forwards
+	const uint32_t unused = UINT32_MAX;
+	std::vector<uint32_t> remap(vertices.size(), unused);
+	std::vector<Vertex> reordered;
+	reordered.reserve(vertices.size());
+	for(uint32_t &index : indices)
+	{
+		if(remap[index] == unused)
+		{
+			remap[index] = static_cast<uint32_t>(reordered.size());
+			reordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	vertices.swap(reordered);
+}
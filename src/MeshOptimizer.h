@@ -0,0 +1,45 @@
+#ifndef VULKANITE_MESHOPTIMIZER_H
+#define VULKANITE_MESHOPTIMIZER_H
+
+#include <cstdint>
+#include <vector>
+#include "Mesh.h"
+
+//Post transform cache size the orderings target and the statistics simulate
+#define MESH_OPTIMIZER_CACHE_SIZE 16
+
+struct MeshCacheStats
+{
+	//Average cache misses per triangle, 0.5 is the best a large mesh can reach
+	float acmr;
+	//Average transforms per vertex, 1.0 means every vertex was transformed once
+	float atvr;
+};
+
+//Import time reordering of a triangle list for the GPU. Tipsify orders triangles for the post
+//transform cache, the clusters it produces are sorted so outward facing ones draw first to cut
+//overdraw, then vertices are renumbered in the order the indices first fetch them.
+class MeshOptimizer
+{
+	static void tipsify(const std::vector<uint32_t> &indices, size_t vertexCount,
+	                    std::vector<uint32_t> &outIndices, std::vector<size_t> &outClusters);
+	static void sortClusters(const std::vector<Vertex> &vertices, std::vector<uint32_t> &indices,
+	                         std::vector<size_t> &clusters);
+	static void reorderVertices(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices);
+
+public:
+	//Reorders in place, the mesh renders the same triangles. Unreferenced vertices are dropped.
+	static void optimize(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices);
+	//Triangle ordering only, for index lists sharing vertices with another
+	static void optimizeIndices(const std::vector<Vertex> &vertices, std::vector<uint32_t> &indices);
+	//Quadric error edge collapse (Garland and Heckbert 1997) towards the target index count. Vertices
+	//only move onto their neighbours so the result indexes the same vertices. Borders and uv or
+	//normal seams are kept, collapses past maxError or flipping a triangle are refused.
+	//Returns the largest error accepted as a distance.
+	static float simplify(const std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices,
+	                      size_t targetIndexCount, float maxError, std::vector<uint32_t> &outIndices);
+	//Simulates a FIFO cache of MESH_OPTIMIZER_CACHE_SIZE entries over the index order
+	static MeshCacheStats analyze(const std::vector<uint32_t> &indices, size_t vertexCount);
+};
+
+#endif //VULKANITE_MESHOPTIMIZER_H
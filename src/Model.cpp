@@ -5,28 +5,48 @@
 #include "Model.h"
 #include "logger.h"
 #include "vulkanInterface.h"
-#include <assimp/Importer.hpp>
+#include "ModelCache.h"
 #include <utility>
-#include <assimp/postprocess.h>
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <glm/geometric.hpp>
 
 Model::Model(VulkanInterface *inVulkanInterface, Mesh* inMesh) :
 		vki(inVulkanInterface)
 {
 	mesh = inMesh;
 	texture = nullptr;
+	resident = true;
 }
 
-Model::Model(VulkanInterface *inVulkanInterface, std::string filename) :
+Model::Model(VulkanInterface *inVulkanInterface, std::string inFilename, VertexFormat inFormat, MeshRetention inRetention,
+             bool deferred) :
+	filename(std::move(inFilename)),
+	format(inFormat),
+	retention(inRetention),
 	vki(inVulkanInterface)
 {
-	load(std::move(filename));
+	mesh = nullptr;
+	//Until its own textures are resident
+	texture = vki->assets->getPlaceholder();
+	if(deferred)
+		return;
+
+	loadFile();
+	upload(false);
+	finishUpload();
 }
 
 Model::~Model()
 {
+	if(descriptorPool != VK_NULL_HANDLE)
+		vkDestroyDescriptorPool(vki->logicalDevice, descriptorPool, nullptr);
+	delete cache;
+	delete cooked;
 	delete mesh;
-	if(texture)
-		delete texture;
+	for(Texture* acquired : textures)
+		vki->assets->release(acquired);
 }
 
 void Model::draw(VkCommandBuffer commandBuffer)
@@ -36,119 +56,243 @@ void Model::draw(VkCommandBuffer commandBuffer)
 
 void Model::draw(VkCommandBuffer commandBuffer, uint32_t instanceCount)
 {
+	//Every submesh shares the one pair of buffers
 	VkDeviceSize offsets[] = {0};
 	vkCmdBindVertexBuffers(commandBuffer, 0,1, &mesh->vertexBuffer, offsets);
-	vkCmdBindIndexBuffer(commandBuffer, mesh->indexBuffer, 0,VK_INDEX_TYPE_UINT32);
-	vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(mesh->indices.size()),
-	                 instanceCount, 0, 0, 0);
+	vkCmdBindIndexBuffer(commandBuffer, mesh->indexBuffer, 0, mesh->indexType);
+	const MeshLod &lod = mesh->lods[0];
+	for(uint32_t i = lod.firstSubmesh; i < lod.firstSubmesh + lod.submeshCount; i++)
+	{
+		const Submesh &submesh = mesh->submeshes[i];
+		vkCmdDrawIndexed(commandBuffer, submesh.indexCount,
+		                 instanceCount, submesh.firstIndex, submesh.vertexOffset, 0);
+	}
 }
 
-void Model::load(std::string filename)
+void Model::draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t lod)
 {
-	Assimp::Importer importer;
-	Logger(1) << "Loading model: " << filename;
-	const aiScene* scene = importer.ReadFile(filename,
-											 aiProcess_CalcTangentSpace
-											 | aiProcess_Triangulate
-											 | aiProcess_JoinIdenticalVertices
-											 | aiProcess_SortByPType
-											 | aiProcess_LimitBoneWeights
-											 | aiProcess_ValidateDataStructure
-											 | aiProcess_PreTransformVertices
-	);
-
-	if(!scene)
+	const MeshLod &level = mesh->lods[std::min<size_t>(lod, mesh->lods.size() - 1)];
+	VkDeviceSize offsets[] = {0};
+	vkCmdBindVertexBuffers(commandBuffer, 0,1, &mesh->vertexBuffer, offsets);
+	vkCmdBindIndexBuffer(commandBuffer, mesh->indexBuffer, 0, mesh->indexType);
+	//Submeshes are sorted by material, so each set is bound once
+	uint32_t boundMaterial = UINT32_MAX;
+	for(uint32_t i = level.firstSubmesh; i < level.firstSubmesh + level.submeshCount; i++)
 	{
-		Logger(1) << importer.GetErrorString();
-		Logger(1) << "Could not load Mesh. Error importing";
-		throw std::runtime_error("Failed to load model file");
+		const Submesh &submesh = mesh->submeshes[i];
+		if(submesh.material != boundMaterial && submesh.material < materialDescriptorSets.size())
+		{
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+			                        0, 1, &materialDescriptorSets[submesh.material], 0, nullptr);
+			boundMaterial = submesh.material;
+		}
+		vkCmdDrawIndexed(commandBuffer, submesh.indexCount, 1, submesh.firstIndex, submesh.vertexOffset, 0);
 	}
+}
 
-//	Logger(1) << "Animations: " << scene->mNumAnimations;
-//	for(unsigned int i = 0; i < scene->mNumAnimations; i++)
-//	{
-//		aiAnimation* assimpAnimation = scene->mAnimations[i];
-//		Logger(1) << "Animation name: " << assimpAnimation->mName.C_Str();
-//		Logger(1) << "Animation channels: " << assimpAnimation->mNumChannels;
-//		Logger(1) << "TPS: " << assimpAnimation->mTicksPerSecond;
-//
-//		//Convert into own class layout
-//		//Actually using vectors instead of array+size
-//		Animation* anim = new Animation();
-//		anim->name = assimpAnimation->mName.C_Str();
-//		//One channel per node
-//		anim->channels = assimpAnimation->mNumChannels;
-//		//Framerate of animation basically
-//		anim->tickRate = assimpAnimation->mTicksPerSecond;
-//		//Duration of animation
-//		anim->duration = assimpAnimation->mDuration;
-//		for(unsigned int j = 0; j < assimpAnimation->mNumChannels; j++)
-//		{
-//			aiNodeAnim* an = assimpAnimation->mChannels[j];
-//			anim->animNodes[an->mNodeName.C_Str()] = an;
-//		}
-//		//Add to map of animations
-//		animations[anim->name] = anim;
-//	}
-
-	for(unsigned int i = 0; i < scene->mNumMaterials; i++)
+uint32_t Model::selectLod(glm::vec3 position, glm::vec3 viewPosition, float projectionScale, uint32_t currentLod) const
+{
+	glm::vec3 centre = position + (mesh->boundsMin + mesh->boundsMax) * 0.5f;
+	float radius = glm::length(mesh->boundsMax - mesh->boundsMin) * 0.5f;
+	float distance = std::max(glm::length(centre - viewPosition), radius);
+	float screenSize = radius * std::abs(projectionScale) / distance;
+
+	//Thresholds already crossed have to be crossed back by the hysteresis margin
+	uint32_t lod = 0;
+	float threshold = MODEL_LOD_SCREEN_SIZE;
+	for(uint32_t level = 1; level < mesh->lods.size(); level++)
 	{
-		aiMaterial* assimpMaterial = scene->mMaterials[i];
+		float margin = level <= currentLod ? 1 + MODEL_LOD_HYSTERESIS : 1 - MODEL_LOD_HYSTERESIS;
+		if(screenSize >= threshold * margin)
+			break;
+		lod = level;
+		threshold *= 0.5f;
+	}
+	return lod;
+}
 
-		aiString nnn;
-		assimpMaterial->Get(AI_MATKEY_NAME, nnn);
-		//Don't care about default material
-		if(strcmp(nnn.C_Str(), AI_DEFAULT_MATERIAL_NAME) == 0)
-			continue;
+void Model::createDescriptorSets(VkDescriptorSetLayout layout, VkDescriptorBufferInfo uniformBufferInfo)
+{
+	//Shared models keep the sets from whoever created them first
+	if(descriptorPool != VK_NULL_HANDLE)
+		return;
+	//Built by finishUpload once the textures are in
+	if(!resident)
+	{
+		descriptorSetsRequested = true;
+		requestedLayout = layout;
+		requestedUniformBufferInfo = uniformBufferInfo;
+		return;
+	}
 
-		aiString texPath;
-		//Retrieve diffuse texture and load it
-		if(assimpMaterial->GetTexture(aiTextureType_DIFFUSE, 0, &texPath) == AI_SUCCESS)
-		{
-			Logger() << texPath.C_Str();
-			std::string backslashFixed = texPath.C_Str();
-			std::replace(backslashFixed.begin(), backslashFixed.end(), '\\', '/');
-
-			//Convert to correct folder
-			std::string baseFolder = std::string(filename);
-			baseFolder = baseFolder.substr(0, baseFolder.find_last_of("/"));
-			//Load image
-			texture = new Texture(vki, {std::string(baseFolder + "/" + texPath.C_Str())}, false);
-		}
+	//A model without materials still gets one set for its fallback texture
+	auto setCount = static_cast<uint32_t>(std::max<size_t>(materials.size(), 1));
+
+	std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	poolSizes[0].descriptorCount = setCount;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[1].descriptorCount = setCount;
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = setCount;
+	VK_RESULT_CHECK(vkCreateDescriptorPool(vki->logicalDevice, &poolInfo, nullptr, &descriptorPool))
+
+	std::vector<VkDescriptorSetLayout> layouts(setCount, layout);
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = descriptorPool;
+	allocInfo.descriptorSetCount = setCount;
+	allocInfo.pSetLayouts = layouts.data();
+	materialDescriptorSets.resize(setCount);
+	VK_RESULT_CHECK(vkAllocateDescriptorSets(vki->logicalDevice, &allocInfo, materialDescriptorSets.data()))
+
+	for(uint32_t i = 0; i < setCount; i++)
+	{
+		Texture* materialTexture = i < materials.size() && materials[i] ? materials[i] : texture;
+		if(!materialTexture)
+			throw std::runtime_error("Model material has no texture to fall back to");
+
+		VkDescriptorImageInfo imageInfo = {};
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageInfo.imageView = materialTexture->texture.imageView;
+		imageInfo.sampler = materialTexture->textureSampler;
+
+		std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
+		descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[0].dstSet = materialDescriptorSets[i];
+		descriptorWrites[0].dstBinding = 0;
+		descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		descriptorWrites[0].descriptorCount = 1;
+		descriptorWrites[0].pBufferInfo = &uniformBufferInfo;
+
+		descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[1].dstSet = materialDescriptorSets[i];
+		descriptorWrites[1].dstBinding = 1;
+		descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		descriptorWrites[1].descriptorCount = 1;
+		descriptorWrites[1].pImageInfo = &imageInfo;
+
+		vkUpdateDescriptorSets(vki->logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
 	}
+	Logger() << "Model descriptor sets created for " << setCount << " materials";
+}
 
-	//Collate images for opengl texture array
-//	std::vector<std::string> texPaths;
-//	for(unsigned int i = 0; i < materials.size(); i++)
-//	{
-//		texPaths.push_back(materials[i].image->getName());
-//	}
-
-	//Load textures and place into singular OpenGL texture Array
-//	if(texPaths.size() > 0)
-//	{
-//		ImageLoader* imgLoader = static_cast<ImageLoader*>(AssetManager::i()->getLoader("image"));
-//		texture = imgLoader->loadTexture(texPaths);
-//	}
-
-	//Save root node
-//	rootNodeName = scene->mRootNode->mName.C_Str();
-	//Loop over all nodes recursively starting from root
-//	nodeLoop(scene->mRootNode, 0, nullptr);
-
-	//Load as specific mesh type depending on if boned or not
-	for(unsigned int i = 0; i < scene->mNumMeshes; i++)
+const Mesh* Model::getMesh() const
+{
+	return mesh;
+}
+
+void Model::loadFile()
+{
+	Logger(1) << "Loading model: " << filename;
+
+	//The cooked file is used whenever it was made from this exact source, Assimp only runs when it wasn't
+	std::string cookedFilename = ModelCache::cookedFilename(filename);
+	uint64_t cacheKey = ModelCache::makeKey(filename);
+	cache = new ModelCache();
+	if(cache->open(cookedFilename, cacheKey))
+	{
+		//Reading a byte of every page pulls the file in here rather than during upload
+		const ModelCacheHeader &header = cache->getHeader();
+		auto bytes = reinterpret_cast<const volatile char*>(&header);
+		uint64_t end = std::max(header.indicesOffset + header.indexCount * header.indexSize, header.texturesOffset + header.texturesSize);
+		char touched = 0;
+		for(uint64_t offset = 0; offset < end; offset += 4096)
+			touched ^= bytes[offset];
+		(void) touched;
+		Logger(1) << "Model read from cooked file " << cookedFilename;
+		return;
+	}
+	delete cache;
+	cache = nullptr;
+
+	cooked = new CookedModel(ModelCache::import(filename));
+	ModelCache::write(cookedFilename, cacheKey, *cooked);
+}
+
+void Model::upload(bool asyncTextures)
+{
+	std::vector<std::string> texturePaths;
+	if(cache)
+	{
+		const ModelCacheHeader &header = cache->getHeader();
+		mesh = new Mesh(vki);
+		mesh->retention = retention;
+		mesh->boundsMin = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+		mesh->boundsMax = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+		mesh->submeshes.assign(cache->submeshes(), cache->submeshes() + header.submeshCount);
+		mesh->lods.assign(cache->lods(), cache->lods() + header.lodCount);
+		if(header.indexSize == sizeof(uint16_t))
+			mesh->load(cache->vertices(), header.vertexCount, static_cast<const uint16_t*>(cache->indices()), header.indexCount, format);
+		else
+			mesh->load(cache->vertices(), header.vertexCount, static_cast<const uint32_t*>(cache->indices()), header.indexCount, format);
+		texturePaths = cache->textures();
+		delete cache;
+		cache = nullptr;
+	}
+	else if(cooked)
+	{
+		mesh = new Mesh(vki);
+		mesh->retention = retention;
+		mesh->boundsMin = cooked->boundsMin;
+		mesh->boundsMax = cooked->boundsMax;
+		mesh->submeshes = cooked->submeshes;
+		mesh->lods = cooked->lods;
+		mesh->load(cooked->vertices.data(), cooked->vertices.size(), cooked->indices.data(), cooked->indices.size(), format);
+		texturePaths = cooked->textures;
+		delete cooked;
+		cooked = nullptr;
+	}
+	else
+	{
+		throw std::runtime_error("Model uploaded before its file was loaded");
+	}
+
+	//Materials sharing a path share the texture
+	for(size_t i = 0; i < texturePaths.size(); i++)
 	{
-		aiMesh* assimpMesh = scene->mMeshes[i];
-		std::string meshName = assimpMesh->mName.C_Str();
-//		if(assimpMesh->mNumBones > 0)
-//		{
-//			boneMeshes[i] = new BoneMesh(meshName, assimpMesh, assimpNodes);
-//		}
-//		else
+		Texture* materialTexture = nullptr;
+		for(size_t j = 0; j < i && !materialTexture; j++)
+		{
+			if(!texturePaths[i].empty() && texturePaths[j] == texturePaths[i])
+				materialTexture = materials[j];
+		}
+		if(!materialTexture && !texturePaths[i].empty())
 		{
-			mesh = new Mesh(vki);
-			mesh->load(assimpMesh);
+			materialTexture = vki->assets->acquireTexture({texturePaths[i]}, false, asyncTextures);
+			textures.push_back(materialTexture);
 		}
+		materials.push_back(materialTexture);
 	}
-}
\ No newline at end of file
+
+	for(size_t i = 0; i < mesh->lods.size(); i++)
+		Logger(1) << "LOD " << i << ": " << mesh->lods[i].triangleCount << " triangles";
+}
+
+bool Model::finishUpload()
+{
+	if(resident)
+		return true;
+	for(Texture* acquired : textures)
+	{
+		if(!acquired->isResident())
+			return false;
+	}
+
+	if(!textures.empty())
+		texture = textures.front();
+	resident = true;
+	if(descriptorSetsRequested)
+		createDescriptorSets(requestedLayout, requestedUniformBufferInfo);
+	Logger(1) << "Model resident: " << filename;
+	return true;
+}
+
+bool Model::isResident() const
+{
+	return resident;
+}
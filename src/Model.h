@@ -9,10 +9,19 @@
 #include <glm/vec2.hpp>
 #include <vulkan/vulkan.h>
 #include <vector>
+#include <string>
 #include "Texture.h"
 #include "Mesh.h"
 
 class VulkanInterface;
+class ModelCache;
+struct CookedModel;
+
+//Projected bounding radius, as a fraction of half the screen height, below which LOD 1 is drawn.
+//Each coarser level starts at half the size of the one before.
+#define MODEL_LOD_SCREEN_SIZE 0.5f
+//How far past a threshold the size has to go before the level changes, so it doesn't pop back and forth
+#define MODEL_LOD_HYSTERESIS 0.1f
 
 struct InstanceData
 {
@@ -21,19 +30,56 @@ struct InstanceData
 
 class Model
 {
-	void load(std::string filename);
+	std::string filename;
+	VertexFormat format = VERTEX_FORMAT_FLOAT;
+	MeshRetention retention = MESH_RETAIN_NONE;
+	//Filled by loadFile and consumed by upload, one or the other
+	ModelCache * cache = nullptr;
+	CookedModel * cooked = nullptr;
+	bool resident = false;
 
 	Mesh * mesh;
+	//Acquired from the asset manager once per distinct path
+	std::vector<Texture*> textures;
+	//Each material's texture, falls back to texture when the material has none
+	std::vector<Texture*> materials;
+
+	//One set per material from the model's own pool
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+	std::vector<VkDescriptorSet> materialDescriptorSets;
+	//Asked for before the model was resident
+	bool descriptorSetsRequested = false;
+	VkDescriptorSetLayout requestedLayout = VK_NULL_HANDLE;
+	VkDescriptorBufferInfo requestedUniformBufferInfo = {};
 
 	VulkanInterface * vki;
 
 public:
-	Model(VulkanInterface *inVulkanInterface, std::string filename);
+	//Deferred leaves loadFile, upload and finishUpload to the caller so the file can be read on a worker
+	Model(VulkanInterface *inVulkanInterface, std::string inFilename, VertexFormat inFormat = VERTEX_FORMAT_FLOAT,
+	      MeshRetention inRetention = MESH_RETAIN_NONE, bool deferred = false);
 	Model(VulkanInterface *inVulkanInterface, Mesh* inMesh);
 	~Model();
 	void draw(VkCommandBuffer commandBuffer);
 	void draw(VkCommandBuffer commandBuffer, uint32_t instanceCount);
+	//Binds each material's descriptor set before its submeshes, needs createDescriptorSets first
+	void draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t lod);
+	//Level for the model's bounds drawn at position, projectionScale is the projection's [1][1]
+	uint32_t selectLod(glm::vec3 position, glm::vec3 viewPosition, float projectionScale, uint32_t currentLod) const;
+	//Binding 0 the uniform buffer, binding 1 the material's texture. Only the first call creates them.
+	void createDescriptorSets(VkDescriptorSetLayout layout, VkDescriptorBufferInfo uniformBufferInfo);
+	const Mesh* getMesh() const;
+
+	//Reads the cooked file or imports the source, safe off the main thread
+	void loadFile();
+	//Creates the mesh and acquires the material textures, asynchronously if asked
+	void upload(bool asyncTextures);
+	//True once the mesh upload has finished and every texture is resident, call until it is
+	bool finishUpload();
+	//Nothing may be drawn until it is
+	bool isResident() const;
 
+	//First texture of the model, used by materials without their own. The asset manager's placeholder until resident.
 	Texture * texture;
 };
 
@@ -0,0 +1,379 @@
+#include "ModelCache.h"
+#include "logger.h"
+#include "MeshOptimizer.h"
+#include "GenericThreadPool.h"
+#include "vulkanInterface.h"
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <glm/common.hpp>
+
+#define FNV_OFFSET_BASIS 14695981039346656037ull
+#define FNV_PRIME 1099511628211ull
+
+static uint64_t fnv1a(uint64_t hash, const char* data, size_t size)
+{
+	for(size_t i = 0; i < size; i++)
+	{
+		hash ^= static_cast<unsigned char>(data[i]);
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+std::string ModelCache::cookedFilename(const std::string &source)
+{
+	return source + ".cooked";
+}
+
+uint64_t ModelCache::makeKey(const std::string &source)
+{
+	MappedFile sourceFile(source);
+	uint64_t hash = fnv1a(FNV_OFFSET_BASIS, sourceFile.data(), sourceFile.size());
+	uint32_t version = MODEL_CACHE_VERSION;
+	return fnv1a(hash, reinterpret_cast<const char*>(&version), sizeof(version));
+}
+
+CookedModel ModelCache::import(const std::string &source)
+{
+	Assimp::Importer importer;
+	const aiScene* scene = importer.ReadFile(source,
+	                                         aiProcess_CalcTangentSpace
+	                                         | aiProcess_Triangulate
+	                                         | aiProcess_JoinIdenticalVertices
+	                                         | aiProcess_SortByPType
+	                                         | aiProcess_LimitBoneWeights
+	                                         | aiProcess_ValidateDataStructure
+	                                         | aiProcess_PreTransformVertices
+	);
+
+	if(!scene)
+	{
+		Logger(1) << importer.GetErrorString();
+		Logger(1) << "Could not load Mesh. Error importing";
+		throw std::runtime_error("Failed to load model file");
+	}
+	if(scene->mNumMeshes == 0)
+		throw std::runtime_error("Model has no meshes " + source);
+
+	CookedModel model;
+	for(unsigned int i = 0; i < scene->mNumMaterials; i++)
+	{
+		aiMaterial* assimpMaterial = scene->mMaterials[i];
+		model.textures.emplace_back();
+
+		aiString nnn;
+		assimpMaterial->Get(AI_MATKEY_NAME, nnn);
+		//Don't care about default material
+		if(strcmp(nnn.C_Str(), AI_DEFAULT_MATERIAL_NAME) == 0)
+			continue;
+
+		aiString texPath;
+		//Retrieve diffuse texture path relative to the model's folder
+		if(assimpMaterial->GetTexture(aiTextureType_DIFFUSE, 0, &texPath) == AI_SUCCESS)
+		{
+			Logger() << texPath.C_Str();
+			std::string backslashFixed = texPath.C_Str();
+			std::replace(backslashFixed.begin(), backslashFixed.end(), '\\', '/');
+
+			std::string baseFolder = source.substr(0, source.find_last_of('/'));
+			model.textures.back() = baseFolder + "/" + backslashFixed;
+		}
+	}
+
+	std::vector<CookedSubmesh> submeshes;
+	for(unsigned int i = 0; i < scene->mNumMeshes; i++)
+	{
+		aiMesh* assimpMesh = scene->mMeshes[i];
+		//Points and lines split off by SortByPType aren't drawn
+		if(!(assimpMesh->mPrimitiveTypes & aiPrimitiveType_TRIANGLE))
+			continue;
+
+		submeshes.emplace_back();
+		CookedSubmesh &submesh = submeshes.back();
+		submesh.material = assimpMesh->mMaterialIndex;
+		for(unsigned int j = 0; j < assimpMesh->mNumFaces; j++)
+		{
+			aiFace& assimpFace = assimpMesh->mFaces[j];
+			for(unsigned int k = 0; k < assimpFace.mNumIndices; k++)
+			{
+				submesh.indices.push_back(assimpFace.mIndices[k]);
+			}
+		}
+
+		submesh.vertices.resize(assimpMesh->mNumVertices);
+		for(unsigned int j = 0; j < assimpMesh->mNumVertices; j++)
+		{
+			Vertex &vertex = submesh.vertices[j];
+			aiVector3D position = assimpMesh->mVertices[j];
+			vertex.position = glm::vec3(position.x, position.y, position.z);
+			vertex.uv = glm::vec2(0);
+			if(assimpMesh->mTextureCoords[0])
+			{
+				aiVector3D uv = assimpMesh->mTextureCoords[0][j];
+				vertex.uv = glm::vec2(uv.x, 1 - uv.y);
+			}
+			vertex.normal = glm::vec3(0, 1, 0);
+			if(assimpMesh->mNormals)
+			{
+				aiVector3D normal = assimpMesh->mNormals[j];
+				vertex.normal = glm::vec3(normal.x, normal.y, normal.z);
+			}
+		}
+	}
+	if(submeshes.empty())
+		throw std::runtime_error("Model has no triangles " + source);
+
+	optimize(source, submeshes);
+
+	//Packed in material order so drawing changes material as rarely as possible
+	std::stable_sort(submeshes.begin(), submeshes.end(), [](const CookedSubmesh &a, const CookedSubmesh &b)
+	{
+		return a.material < b.material;
+	});
+	//Each level lists every submesh. One that ran out of levels reuses its coarsest range.
+	size_t lodCount = 1;
+	std::vector<std::vector<Submesh> > ranges(submeshes.size());
+	for(size_t i = 0; i < submeshes.size(); i++)
+	{
+		const CookedSubmesh &submesh = submeshes[i];
+		lodCount = std::max(lodCount, submesh.lods.size() + 1);
+		Submesh range = {};
+		range.vertexOffset = static_cast<int32_t>(model.vertices.size());
+		range.material = submesh.material;
+		model.vertices.insert(model.vertices.end(), submesh.vertices.begin(), submesh.vertices.end());
+		for(size_t level = 0; level <= submesh.lods.size(); level++)
+		{
+			const std::vector<uint32_t> &levelIndices = level == 0 ? submesh.indices : submesh.lods[level - 1];
+			range.firstIndex = static_cast<uint32_t>(model.indices.size());
+			range.indexCount = static_cast<uint32_t>(levelIndices.size());
+			ranges[i].push_back(range);
+			model.indices.insert(model.indices.end(), levelIndices.begin(), levelIndices.end());
+		}
+	}
+	for(size_t level = 0; level < lodCount; level++)
+	{
+		MeshLod lod = {};
+		lod.firstSubmesh = static_cast<uint32_t>(model.submeshes.size());
+		for(size_t i = 0; i < submeshes.size(); i++)
+		{
+			size_t available = std::min(level, ranges[i].size() - 1);
+			model.submeshes.push_back(ranges[i][available]);
+			lod.triangleCount += ranges[i][available].indexCount / 3;
+			if(available > 0)
+				lod.error = std::max(lod.error, submeshes[i].lodErrors[available - 1]);
+		}
+		lod.submeshCount = static_cast<uint32_t>(submeshes.size());
+		model.lods.push_back(lod);
+		Logger() << source << " LOD " << level << " " << lod.triangleCount << " triangles, error " << lod.error;
+	}
+
+	model.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+	model.boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+	for(const Vertex &vertex : model.vertices)
+	{
+		model.boundsMin = glm::min(model.boundsMin, vertex.position);
+		model.boundsMax = glm::max(model.boundsMax, vertex.position);
+	}
+	return model;
+}
+
+void ModelCache::buildLods(CookedSubmesh &submesh)
+{
+	glm::vec3 boundsMin(std::numeric_limits<float>::max());
+	glm::vec3 boundsMax(-std::numeric_limits<float>::max());
+	for(const Vertex &vertex : submesh.vertices)
+	{
+		boundsMin = glm::min(boundsMin, vertex.position);
+		boundsMax = glm::max(boundsMax, vertex.position);
+	}
+	float maxError = glm::length(boundsMax - boundsMin) * MODEL_LOD_MAX_ERROR;
+
+	//Each level simplifies the last, so errors add up
+	const std::vector<uint32_t>* previous = &submesh.indices;
+	float error = 0;
+	for(int level = 1; level < MODEL_LOD_COUNT; level++)
+	{
+		std::vector<uint32_t> simplified;
+		error += MeshOptimizer::simplify(submesh.vertices, *previous, previous->size() / 6 * 3, maxError, simplified);
+		//Not worth a level if borders, seams or the error limit held it back
+		if(simplified.empty() || simplified.size() * 10 > previous->size() * 9)
+			break;
+		MeshOptimizer::optimizeIndices(submesh.vertices, simplified);
+		submesh.lods.push_back(simplified);
+		submesh.lodErrors.push_back(error);
+		previous = &submesh.lods.back();
+	}
+}
+
+void ModelCache::optimize(const std::string &source, std::vector<CookedSubmesh> &submeshes)
+{
+	//Each mesh reorders on its own job, the statistics are logged once they're all done
+	std::vector<MeshCacheStats> before(submeshes.size());
+	std::vector<MeshCacheStats> after(submeshes.size());
+	auto threadCount = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+	GenericThreadPool meshPool(std::min(threadCount, static_cast<int>(submeshes.size())));
+	for(size_t i = 0; i < submeshes.size(); i++)
+	{
+		meshPool.addJob([i, &submeshes, &before, &after]
+		{
+			CookedSubmesh &mesh = submeshes[i];
+			before[i] = MeshOptimizer::analyze(mesh.indices, mesh.vertices.size());
+			MeshOptimizer::optimize(mesh.vertices, mesh.indices);
+			after[i] = MeshOptimizer::analyze(mesh.indices, mesh.vertices.size());
+			buildLods(mesh);
+		});
+	}
+	meshPool.wait();
+	meshPool.destroy();
+
+	for(size_t i = 0; i < submeshes.size(); i++)
+	{
+		Logger() << source << " mesh " << i << " ACMR " << before[i].acmr << " -> " << after[i].acmr
+		         << ", ATVR " << before[i].atvr << " -> " << after[i].atvr;
+	}
+}
+
+void ModelCache::write(const std::string &filename, uint64_t key, const CookedModel &model)
+{
+	std::string texturePaths;
+	for(const std::string &texture : model.textures)
+	{
+		texturePaths += texture;
+		texturePaths += '\0';
+	}
+
+	ModelCacheHeader cacheHeader = {};
+	cacheHeader.magic = MODEL_CACHE_MAGIC;
+	cacheHeader.version = MODEL_CACHE_VERSION;
+	cacheHeader.key = key;
+	cacheHeader.vertexCount = model.vertices.size();
+	cacheHeader.indexCount = model.indices.size();
+	for(int i = 0; i < 3; i++)
+	{
+		cacheHeader.boundsMin[i] = model.boundsMin[i];
+		cacheHeader.boundsMax[i] = model.boundsMax[i];
+	}
+	cacheHeader.submeshCount = static_cast<uint32_t>(model.submeshes.size());
+	cacheHeader.lodCount = static_cast<uint32_t>(model.lods.size());
+	cacheHeader.materialCount = static_cast<uint32_t>(model.textures.size());
+	cacheHeader.texturesSize = static_cast<uint32_t>(texturePaths.size());
+	//Narrowed here so 16 bit indices go from the mapping to the GPU without conversion
+	bool narrow = chooseIndexType(model.indices.data(), model.indices.size()) == VK_INDEX_TYPE_UINT16;
+	std::vector<uint16_t> narrowIndices;
+	if(narrow)
+		narrowIndices.assign(model.indices.begin(), model.indices.end());
+	cacheHeader.indexSize = narrow ? sizeof(uint16_t) : sizeof(uint32_t);
+	cacheHeader.verticesOffset = sizeof(ModelCacheHeader);
+	cacheHeader.submeshesOffset = cacheHeader.verticesOffset + sizeof(Vertex) * model.vertices.size();
+	cacheHeader.lodsOffset = cacheHeader.submeshesOffset + sizeof(Submesh) * model.submeshes.size();
+	cacheHeader.indicesOffset = cacheHeader.lodsOffset + sizeof(MeshLod) * model.lods.size();
+	cacheHeader.texturesOffset = cacheHeader.indicesOffset + cacheHeader.indexSize * model.indices.size();
+
+	std::ofstream stream(filename.c_str(), std::ios::binary);
+	if(!stream.is_open())
+	{
+		Logger() << "Could not write cooked model " << filename;
+		return;
+	}
+	stream.write(reinterpret_cast<const char*>(&cacheHeader), sizeof(cacheHeader));
+	stream.write(reinterpret_cast<const char*>(model.vertices.data()), sizeof(Vertex) * model.vertices.size());
+	stream.write(reinterpret_cast<const char*>(model.submeshes.data()), sizeof(Submesh) * model.submeshes.size());
+	stream.write(reinterpret_cast<const char*>(model.lods.data()), sizeof(MeshLod) * model.lods.size());
+	if(narrow)
+		stream.write(reinterpret_cast<const char*>(narrowIndices.data()), sizeof(uint16_t) * narrowIndices.size());
+	else
+		stream.write(reinterpret_cast<const char*>(model.indices.data()), sizeof(uint32_t) * model.indices.size());
+	stream.write(texturePaths.data(), texturePaths.size());
+
+	Logger() << "Cooked model " << filename << " written";
+}
+
+void ModelCache::cook(const std::string &source)
+{
+	write(cookedFilename(source), makeKey(source), import(source));
+}
+
+bool ModelCache::open(const std::string &filename, uint64_t key)
+{
+	close();
+
+	std::ifstream exists(filename.c_str());
+	if(!exists.good())
+		return false;
+	exists.close();
+
+	try
+	{
+		file.open(filename);
+	}
+	catch(const std::runtime_error &e)
+	{
+		Logger() << e.what();
+		return false;
+	}
+
+	header = reinterpret_cast<const ModelCacheHeader*>(file.data());
+	bool valid = file.size() >= sizeof(ModelCacheHeader) &&
+	             header->magic == MODEL_CACHE_MAGIC &&
+	             header->version == MODEL_CACHE_VERSION &&
+	             header->key == key &&
+	             (header->indexSize == sizeof(uint16_t) || header->indexSize == sizeof(uint32_t)) &&
+	             file.size() >= header->texturesOffset + header->texturesSize;
+	if(!valid)
+	{
+		Logger() << "Cooked model " << filename << " is stale";
+		close();
+		return false;
+	}
+	return true;
+}
+
+void ModelCache::close()
+{
+	file.close();
+	header = nullptr;
+}
+
+const ModelCacheHeader& ModelCache::getHeader() const
+{
+	return *header;
+}
+
+const Vertex* ModelCache::vertices() const
+{
+	return reinterpret_cast<const Vertex*>(file.data() + header->verticesOffset);
+}
+
+const Submesh* ModelCache::submeshes() const
+{
+	return reinterpret_cast<const Submesh*>(file.data() + header->submeshesOffset);
+}
+
+const MeshLod* ModelCache::lods() const
+{
+	return reinterpret_cast<const MeshLod*>(file.data() + header->lodsOffset);
+}
+
+const void* ModelCache::indices() const
+{
+	return file.data() + header->indicesOffset;
+}
+
+std::vector<std::string> ModelCache::textures() const
+{
+	std::vector<std::string> paths;
+	const char* path = file.data() + header->texturesOffset;
+	for(uint32_t i = 0; i < header->materialCount; i++)
+	{
+		paths.emplace_back(path);
+		path += paths.back().size() + 1;
+	}
+	return paths;
+}
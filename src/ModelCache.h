@@ -0,0 +1,105 @@
+#ifndef VULKANITE_MODELCACHE_H
+#define VULKANITE_MODELCACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/vec3.hpp>
+#include "MappedFile.h"
+#include "Mesh.h"
+
+#define MODEL_CACHE_MAGIC 0x434D5456 //"VTMC"
+#define MODEL_CACHE_VERSION 5
+
+//Levels including the full detail one, each aims for half the triangles of the last
+#define MODEL_LOD_COUNT 4
+//Largest simplification error allowed for one level, as a fraction of the submesh's bounds diagonal
+#define MODEL_LOD_MAX_ERROR 0.02f
+
+struct ModelCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	//Hash of the source file, a different hash means it was edited since cooking
+	uint64_t key;
+	uint64_t vertexCount;
+	uint64_t indexCount;
+	float boundsMin[3];
+	float boundsMax[3];
+	uint32_t submeshCount;
+	uint32_t lodCount;
+	uint32_t materialCount;
+	//One texture path per material stored back to back, each followed by a null
+	uint32_t texturesSize;
+	//Bytes per stored index, 2 when every index fits in 16 bits
+	uint32_t indexSize;
+	uint32_t padding;
+	//Byte offsets of each array from the start of the file
+	uint64_t verticesOffset;
+	uint64_t submeshesOffset;
+	uint64_t lodsOffset;
+	uint64_t indicesOffset;
+	uint64_t texturesOffset;
+};
+
+//One source mesh while it's imported and optimized on its own
+struct CookedSubmesh
+{
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	uint32_t material;
+	//Simplified index lists over the same vertices, coarsest last, with their error
+	std::vector<std::vector<uint32_t> > lods;
+	std::vector<float> lodErrors;
+};
+
+//Everything Model takes from a source file, already in the layout and order the GPU reads.
+//Every submesh is packed into the one vertex and index array, sorted by material within each level of detail.
+struct CookedModel
+{
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	std::vector<Submesh> submeshes;
+	std::vector<MeshLod> lods;
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	//Diffuse texture of each material relative to the working directory, empty when it has none
+	std::vector<std::string> textures;
+};
+
+//Models cooked into a binary file next to their source so later runs skip Assimp.
+//Vertices and indices are read straight out of the mapping into staging buffers.
+class ModelCache
+{
+	MappedFile file;
+	const ModelCacheHeader* header = nullptr;
+
+public:
+	static std::string cookedFilename(const std::string &source);
+	//FNV-1a over the source file bytes and the format version
+	static uint64_t makeKey(const std::string &source);
+	//The full Assimp import and post processing then MeshOptimizer, throws if the source can't be read
+	static CookedModel import(const std::string &source);
+	//Vertex cache, overdraw and vertex fetch ordering then simplified levels of detail, one job per submesh.
+	//Logs ACMR and ATVR before and after.
+	static void optimize(const std::string &source, std::vector<CookedSubmesh> &submeshes);
+	//Up to MODEL_LOD_COUNT - 1 simplified index lists, stops early once a level barely shrinks
+	static void buildLods(CookedSubmesh &submesh);
+	static void write(const std::string &filename, uint64_t key, const CookedModel &model);
+	//Imports the source and writes its cooked file, for cooking ahead of time
+	static void cook(const std::string &source);
+
+	//False when the cooked file is missing, truncated or from an older source or format
+	bool open(const std::string &filename, uint64_t key);
+	void close();
+
+	const ModelCacheHeader& getHeader() const;
+	const Vertex* vertices() const;
+	const Submesh* submeshes() const;
+	const MeshLod* lods() const;
+	//uint16_t or uint32_t by the header's indexSize
+	const void* indices() const;
+	std::vector<std::string> textures() const;
+};
+
+#endif //VULKANITE_MODELCACHE_H
@@ -4,16 +4,36 @@
 
 #include "ParticleSystem.h"
 #include "logger.h"
-#include <random>
+#include <fstream>
+#include <sstream>
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/transform.hpp>
 #include <glm/gtx/quaternion.hpp>
 
-ParticleSystem::ParticleSystem(VulkanInterface *inVulkanInterface, std::string particleModelFilename) :
-	vki(inVulkanInterface)
+ParticleSystem::ParticleSystem(VulkanInterface *inVulkanInterface, std::string particleModelFilename,
+                               bool inDeterministic, uint32_t inSeed) :
+	vki(inVulkanInterface),
+	deterministic(inDeterministic),
+	seed(inSeed)
 {
 	maxParticles = 1000;
-	threadPool.resize(8);
+	glm::vec3 size = boundsMax - boundsMin;
+	float extent = std::max(size.x, std::max(size.y, size.z));
+	lodDistances = {{extent * 0.5f, extent, extent * 2.0f}};
+	lodCounts.fill(0);
+	viewPosition = glm::vec3(0);
+	if(seed == 0)
+	{
+		std::random_device device;
+		seed = device();
+	}
+	randGen.seed(seed);
+	Logger() << "Particle seed " << seed;
+
+	if(deterministic)
+		chunkPool.resize(PARTICLE_CHUNKS);
+	else
+		threadPool.resize(8);
 	initParticles();
 	loadModel(std::move(particleModelFilename));
 }
@@ -22,26 +42,29 @@ ParticleSystem::~ParticleSystem()
 {
 	vkDestroyBuffer(vki->logicalDevice, instanceBuffer, nullptr);
 	vkFreeMemory(vki->logicalDevice, instanceBufferMemory, nullptr);
+	vkDestroyBuffer(vki->logicalDevice, billboardBuffer, nullptr);
+	vkFreeMemory(vki->logicalDevice, billboardBufferMemory, nullptr);
 
-	delete particleModel;
+	vki->assets->release(particleModel);
 	threadPool.destroy();
+	chunkPool.destroy();
 }
 
 void ParticleSystem::initParticles()
 {
 	particles.resize(maxParticles);
-	std::random_device seed;
-	std::mt19937 randGen(seed());
-	std::uniform_real_distribution<float> uniform_dist(0,10);
+	std::uniform_real_distribution<float> x_dist(boundsMin.x, boundsMax.x);
+	std::uniform_real_distribution<float> y_dist(boundsMin.y, boundsMax.y);
+	std::uniform_real_distribution<float> z_dist(boundsMin.z, boundsMax.z);
 	std::uniform_real_distribution<float> vel_dist(-1,1);
 
 	for(auto && particle : particles)
 	{
 		particle = new Particle();
 		particle->alive = true;
-		particle->position = glm::vec3(uniform_dist(randGen),
-		                              uniform_dist(randGen),
-		                              uniform_dist(randGen));
+		particle->position = glm::vec3(x_dist(randGen),
+		                              y_dist(randGen),
+		                              z_dist(randGen));
 		particle->rotation = glm::quat(1,0,0,0);
 		particle->velocity = glm::vec3(0);
 	}
@@ -52,44 +75,300 @@ void ParticleSystem::initParticles()
 
 void ParticleSystem::update()
 {
-	particleInstanceData.clear();
-	for (auto &&particle : particles)
+	frameIndex++;
+	lodCounts.fill(0);
+
+	if(deterministic)
 	{
-		if (particle->alive)
+		//Fixed contiguous chunks, each always run on the same thread
+		auto count = static_cast<uint32_t>(particles.size());
+		uint32_t chunkSize = (count + PARTICLE_CHUNKS - 1) / PARTICLE_CHUNKS;
+		for(uint32_t chunk = 0; chunk < PARTICLE_CHUNKS; chunk++)
+		{
+			uint32_t begin = std::min(chunk * chunkSize, count);
+			uint32_t end = std::min(begin + chunkSize, count);
+			chunkPool.addJob(std::bind(&ParticleSystem::updateChunk, this, chunk, begin, end), chunk);
+		}
+		chunkPool.wait();
+
+		for(auto &&counts : chunkLodCounts)
 		{
-			threadPool.addJob(std::bind(particleUpdate, this, particle));
+			for(uint32_t lod = 0; lod < PARTICLE_LOD_LEVELS; lod++)
+				lodCounts[lod] += counts[lod];
 		}
 	}
-	threadPool.wait();
+	else
+	{
+		for(uint32_t i = 0; i < particles.size(); i++)
+		{
+			Particle* particle = particles[i];
+			if(!particle->alive)
+				continue;
+
+			uint32_t lod = particleLod(particle);
+			lodCounts[lod]++;
+
+			//Distant particles only update every 2^lod frames with a larger step,
+			//offset by index so the updates are spread evenly over the frames
+			uint32_t interval = 1u << lod;
+			if((i + frameIndex) % interval == 0)
+			{
+				threadPool.addJob(std::bind(&ParticleSystem::particleUpdate, this, particle,
+				                            static_cast<float>(interval)));
+			}
+		}
+		threadPool.wait();
+	}
+
+	if(renderMode == PARTICLE_RENDER_BILLBOARD)
+		copyBillboards();
+	else
+		copyMatrices();
+}
+
+uint32_t ParticleSystem::particleLod(const Particle *particle) const
+{
+	float distance = glm::distance(particle->position, viewPosition);
 
-	copyMatrices();
+	uint32_t lod = 0;
+	while(lod < lodDistances.size() && distance > lodDistances[lod])
+		lod++;
+	return lod;
 }
 
-void ParticleSystem::particleUpdate(Particle *particle)
+void ParticleSystem::updateChunk(uint32_t chunk, uint32_t begin, uint32_t end)
 {
-	particle->velocity.y -= 9.8*0.0001f;
-	particle->position += particle->velocity;
-	if(particle->position.y < 0)
+	std::array<uint32_t, PARTICLE_LOD_LEVELS>& counts = chunkLodCounts[chunk];
+	counts.fill(0);
+
+	for(uint32_t i = begin; i < end; i++)
 	{
-		particle->position.y = 0;
+		Particle* particle = particles[i];
+		if(!particle->alive)
+			continue;
+
+		uint32_t lod = particleLod(particle);
+		counts[lod]++;
+
+		uint32_t interval = 1u << lod;
+		if((i + frameIndex) % interval == 0)
+			particleUpdate(particle, static_cast<float>(interval));
+	}
+}
+
+void ParticleSystem::particleUpdate(Particle *particle, float steps)
+{
+	particle->velocity.y -= 9.8*0.0001f*steps;
+	particle->position += particle->velocity*steps;
+	if(particle->position.y < boundsMin.y)
+	{
+		particle->position.y = boundsMin.y;
 		particle->velocity.y *= -1;
 	}
-	if(particle->position.x > 10) {particle->position.x = 10; particle->velocity.x *= -1;}
-	if(particle->position.x < 0) {particle->position.x = 0; particle->velocity.x *= -1;}
-	if(particle->position.z > 10) {particle->position.z = 10; particle->velocity.z *= -1;}
-	if(particle->position.z < 0) {particle->position.z = 0; particle->velocity.z *= -1;}
+	if(particle->position.x > boundsMax.x) {particle->position.x = boundsMax.x; particle->velocity.x *= -1;}
+	if(particle->position.x < boundsMin.x) {particle->position.x = boundsMin.x; particle->velocity.x *= -1;}
+	if(particle->position.z > boundsMax.z) {particle->position.z = boundsMax.z; particle->velocity.z *= -1;}
+	if(particle->position.z < boundsMin.z) {particle->position.z = boundsMin.z; particle->velocity.z *= -1;}
+}
+
+void ParticleSystem::setRenderMode(ParticleRenderMode mode)
+{
+	renderMode = mode;
+}
+
+ParticleRenderMode ParticleSystem::getRenderMode() const
+{
+	return renderMode;
+}
+
+void ParticleSystem::setBillboardSize(float size)
+{
+	billboardSize = size;
+}
+
+VkDeviceSize ParticleSystem::getBillboardBufferSize() const
+{
+	return billboardBufferSize;
+}
+
+void ParticleSystem::setViewPosition(glm::vec3 position)
+{
+	viewPosition = position;
+}
+
+void ParticleSystem::setLodDistances(float halfRate, float quarterRate, float eighthRate)
+{
+	lodDistances = {{halfRate, quarterRate, eighthRate}};
+}
+
+const std::array<uint32_t, PARTICLE_LOD_LEVELS>& ParticleSystem::getLodCounts() const
+{
+	return lodCounts;
+}
+
+uint32_t ParticleSystem::getSeed() const
+{
+	return seed;
+}
+
+bool ParticleSystem::isDeterministic() const
+{
+	return deterministic;
+}
+
+template<typename T>
+static void writeSnapshotValue(std::vector<char> &data, const T &value)
+{
+	const char* bytes = reinterpret_cast<const char*>(&value);
+	data.insert(data.end(), bytes, bytes + sizeof(T));
+}
+
+template<typename T>
+static T readSnapshotValue(const std::vector<char> &data, size_t &offset)
+{
+	if(offset + sizeof(T) > data.size())
+		throw std::runtime_error("Particle snapshot is truncated");
+
+	T value;
+	memcpy(&value, data.data() + offset, sizeof(T));
+	offset += sizeof(T);
+	return value;
+}
+
+std::vector<char> ParticleSystem::snapshot() const
+{
+	std::vector<char> data;
+	writeSnapshotValue(data, static_cast<uint32_t>(PARTICLE_SNAPSHOT_MAGIC));
+	writeSnapshotValue(data, static_cast<uint32_t>(PARTICLE_SNAPSHOT_VERSION));
+	writeSnapshotValue(data, seed);
+	writeSnapshotValue(data, frameIndex);
+	writeSnapshotValue(data, static_cast<uint32_t>(particles.size()));
+	writeSnapshotValue(data, lodDistances);
+	writeSnapshotValue(data, viewPosition);
+
+	//Generator state so anything drawn after the snapshot also replays
+	std::ostringstream randState;
+	randState << randGen;
+	std::string randString = randState.str();
+	writeSnapshotValue(data, static_cast<uint32_t>(randString.size()));
+	data.insert(data.end(), randString.begin(), randString.end());
+
+	for(auto &&particle : particles)
+	{
+		writeSnapshotValue(data, static_cast<uint8_t>(particle->alive ? 1 : 0));
+		writeSnapshotValue(data, particle->position);
+		writeSnapshotValue(data, particle->rotation);
+		writeSnapshotValue(data, particle->velocity);
+	}
+
+	return data;
+}
+
+void ParticleSystem::restore(const std::vector<char> &data)
+{
+	size_t offset = 0;
+	if(readSnapshotValue<uint32_t>(data, offset) != PARTICLE_SNAPSHOT_MAGIC)
+		throw std::runtime_error("Not a particle snapshot");
+	if(readSnapshotValue<uint32_t>(data, offset) != PARTICLE_SNAPSHOT_VERSION)
+		throw std::runtime_error("Unsupported particle snapshot version");
+
+	auto snapshotSeed = readSnapshotValue<uint32_t>(data, offset);
+	auto snapshotFrame = readSnapshotValue<uint32_t>(data, offset);
+	auto count = readSnapshotValue<uint32_t>(data, offset);
+	if(count != particles.size())
+		throw std::runtime_error("Particle snapshot count doesn't match system");
+
+	auto snapshotLodDistances = readSnapshotValue<std::array<float, PARTICLE_LOD_LEVELS-1> >(data, offset);
+	auto snapshotViewPosition = readSnapshotValue<glm::vec3>(data, offset);
+
+	auto randLength = readSnapshotValue<uint32_t>(data, offset);
+	if(offset + randLength > data.size())
+		throw std::runtime_error("Particle snapshot is truncated");
+	std::istringstream randState(std::string(data.data() + offset, randLength));
+	offset += randLength;
+
+	//Read everything before applying so a bad snapshot leaves the system untouched
+	std::vector<Particle> restored(count);
+	for(auto &&particle : restored)
+	{
+		particle.alive = readSnapshotValue<uint8_t>(data, offset) != 0;
+		particle.position = readSnapshotValue<glm::vec3>(data, offset);
+		particle.rotation = readSnapshotValue<glm::quat>(data, offset);
+		particle.velocity = readSnapshotValue<glm::vec3>(data, offset);
+	}
+	if(offset != data.size())
+		throw std::runtime_error("Particle snapshot has trailing data");
+
+	std::mt19937 snapshotRandGen;
+	randState >> snapshotRandGen;
+	if(randState.fail())
+		throw std::runtime_error("Particle snapshot has invalid generator state");
+
+	seed = snapshotSeed;
+	frameIndex = snapshotFrame;
+	lodDistances = snapshotLodDistances;
+	viewPosition = snapshotViewPosition;
+	randGen = snapshotRandGen;
+	for(uint32_t i = 0; i < count; i++)
+		*particles[i] = restored[i];
+}
+
+void ParticleSystem::saveSnapshot(const std::string &filename) const
+{
+	std::vector<char> data = snapshot();
+
+	std::ofstream stream(filename.c_str(), std::ios::binary);
+	if(!stream.is_open())
+		throw std::runtime_error("Could not open particle snapshot " + filename);
+	stream.write(data.data(), data.size());
+	Logger() << "Particle snapshot saved to " << filename;
+}
+
+void ParticleSystem::loadSnapshot(const std::string &filename)
+{
+	std::ifstream stream(filename.c_str(), std::ios::binary);
+	if(!stream.is_open())
+		throw std::runtime_error("Could not open particle snapshot " + filename);
+
+	std::vector<char> data((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+	restore(data);
+	Logger() << "Particle snapshot loaded from " << filename;
+}
+
+uint64_t ParticleSystem::stateHash() const
+{
+	std::vector<char> data = snapshot();
+
+	uint64_t hash = 14695981039346656037ull;
+	for(char c : data)
+	{
+		hash ^= static_cast<uint8_t>(c);
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
 
-	glm::mat4 particleMatrix = glm::translate(particle->position);
-	//particleMatrix *= glm::toMat4(particle->rotation);
+bool ParticleSystem::verifyReplay(uint32_t frames)
+{
+	std::vector<char> start = snapshot();
+	for(uint32_t i = 0; i < frames; i++)
+		update();
+	uint64_t firstHash = stateHash();
+
+	restore(start);
+	for(uint32_t i = 0; i < frames; i++)
+		update();
+	uint64_t secondHash = stateHash();
 
-	ParticleInstanceData d = {particleMatrix};
-	std::lock_guard<std::mutex> lock(matricesMutex);
-	particleInstanceData.emplace_back(d);
+	bool matched = firstHash == secondHash;
+	Logger() << "Particle replay over " << frames << " frames " << (matched ? "matched" : "diverged")
+	         << ", hashes " << std::hex << firstHash << " " << secondHash << std::dec;
+	return matched;
 }
 
 void ParticleSystem::loadModel(std::string filename)
 {
-	particleModel = new Model(vki, std::move(filename));
+	particleModel = vki->assets->acquireModel(filename);
 }
 
 void ParticleSystem::prepareInstanceBuffer()
@@ -98,21 +377,72 @@ void ParticleSystem::prepareInstanceBuffer()
 	vki->createBuffer(instanceBufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
 	                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
 	                  instanceBuffer, instanceBufferMemory);
+
+	billboardBufferSize = sizeof(ParticleBillboardData) * maxParticles;
+	vki->createBuffer(billboardBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+	                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	                  billboardBuffer, billboardBufferMemory);
 }
 
 void ParticleSystem::copyMatrices()
 {
+	//Built serially so the matrices include particles skipped by the LOD this frame
+	particleInstanceData.clear();
+	for(auto &&particle : particles)
+	{
+		if(particle->alive)
+		{
+			glm::mat4 particleMatrix = glm::translate(particle->position);
+			//particleMatrix *= glm::toMat4(particle->rotation);
+
+			ParticleInstanceData d = {particleMatrix};
+			particleInstanceData.emplace_back(d);
+		}
+	}
+
 	void* data;
 	vkMapMemory(vki->logicalDevice, instanceBufferMemory, 0, instanceBufferSize, 0, &data);
-	memcpy(data, particleInstanceData.data(), instanceBufferSize);
+	memcpy(data, particleInstanceData.data(), sizeof(ParticleInstanceData) * particleInstanceData.size());
 	vkUnmapMemory(vki->logicalDevice, instanceBufferMemory);
+
+	instanceCount = static_cast<uint32_t>(particleInstanceData.size());
+}
+
+void ParticleSystem::copyBillboards()
+{
+	particleBillboardData.clear();
+	for(auto &&particle : particles)
+	{
+		if(particle->alive)
+		{
+			ParticleBillboardData d = {glm::vec4(particle->position, billboardSize)};
+			particleBillboardData.emplace_back(d);
+		}
+	}
+
+	void* data;
+	vkMapMemory(vki->logicalDevice, billboardBufferMemory, 0, billboardBufferSize, 0, &data);
+	memcpy(data, particleBillboardData.data(), sizeof(ParticleBillboardData) * particleBillboardData.size());
+	vkUnmapMemory(vki->logicalDevice, billboardBufferMemory);
+
+	instanceCount = static_cast<uint32_t>(particleBillboardData.size());
 }
 
 void ParticleSystem::draw(VkCommandBuffer commandBuffer)
 {
 	update();
 
+	if(renderMode == PARTICLE_RENDER_BILLBOARD)
+	{
+		//Quad corners come from gl_VertexIndex and positions from the storage buffer, so nothing is bound
+		vkCmdDraw(commandBuffer, 4, instanceCount, 0, 0);
+		return;
+	}
+
+	if(!particleModel->isResident())
+		return;
+
 	VkDeviceSize offsets[] = {0};
 	vkCmdBindVertexBuffers(commandBuffer, 1,1, &instanceBuffer, offsets);
-	particleModel->draw(commandBuffer, static_cast<uint32_t>(particleInstanceData.size()));
+	particleModel->draw(commandBuffer, instanceCount);
 }
\ No newline at end of file
@@ -6,6 +6,9 @@
 #define VULKANITE_PARTICLESYSTEM_H
 
 #include "GenericThreadPool.h"
+#include "SpecificThreadPool.h"
+#include <array>
+#include <random>
 #include <glm/mat4x4.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include "vulkanInterface.h"
@@ -23,6 +26,26 @@ struct ParticleInstanceData
 	glm::mat4 transform;
 };
 
+//Billboard data read from a storage buffer, xyz is position and w is quad size
+struct ParticleBillboardData
+{
+	glm::vec4 positionSize;
+};
+
+enum ParticleRenderMode
+{
+	PARTICLE_RENDER_MESH,
+	PARTICLE_RENDER_BILLBOARD
+};
+
+//Simulation LOD levels, each level updates at half the rate of the previous
+#define PARTICLE_LOD_LEVELS 4
+//Chunks in deterministic mode, chunk i is always simulated by thread i
+#define PARTICLE_CHUNKS 8
+
+#define PARTICLE_SNAPSHOT_MAGIC 0x53535056 //"VPSS"
+#define PARTICLE_SNAPSHOT_VERSION 1
+
 class ParticleSystem
 {
 	VulkanInterface * vki;
@@ -34,23 +57,79 @@ class ParticleSystem
 	VkBuffer instanceBuffer;
 	VkDeviceMemory instanceBufferMemory;
 
-	std::mutex matricesMutex;
+	std::vector<ParticleBillboardData> particleBillboardData;
+	VkDeviceSize billboardBufferSize;
+	VkDeviceMemory billboardBufferMemory;
+
+	ParticleRenderMode renderMode = PARTICLE_RENDER_BILLBOARD;
+	float billboardSize = 0.2f;
+	uint32_t instanceCount = 0;
+
 	GenericThreadPool threadPool;
 
+	//Deterministic mode seeds from a fixed value and simulates in fixed chunks per thread
+	bool deterministic;
+	uint32_t seed;
+	std::mt19937 randGen;
+	SpecificThreadPool chunkPool;
+	std::array<std::array<uint32_t, PARTICLE_LOD_LEVELS>, PARTICLE_CHUNKS> chunkLodCounts;
+
+	//Particles spawn inside this box and bounce off its floor and sides
+	glm::vec3 boundsMin = glm::vec3(0.0f);
+	glm::vec3 boundsMax = glm::vec3(10.0f);
+
+	//Distance from the viewer beyond which particles update at 1/2, 1/4 and 1/8 rate,
+	//defaults to half, one and two times the longest side of the bounds
+	std::array<float, PARTICLE_LOD_LEVELS-1> lodDistances;
+	std::array<uint32_t, PARTICLE_LOD_LEVELS> lodCounts;
+	glm::vec3 viewPosition;
+	uint32_t frameIndex = 0;
+
 	void initParticles();
-	void particleUpdate(Particle *particle);
+	uint32_t particleLod(const Particle *particle) const;
+	void particleUpdate(Particle *particle, float steps);
+	void updateChunk(uint32_t chunk, uint32_t begin, uint32_t end);
 	void loadModel(std::string filename);
 	void prepareInstanceBuffer();
 	void copyMatrices();
+	void copyBillboards();
 
 public:
-	explicit ParticleSystem(VulkanInterface *inVulkanInterface, std::string particleModelFilename);
+	//A seed of 0 picks one from std::random_device, getSeed returns the seed actually used
+	explicit ParticleSystem(VulkanInterface *inVulkanInterface, std::string particleModelFilename,
+	                        bool inDeterministic = false, uint32_t inSeed = 0);
 	~ParticleSystem();
 
 	Model* particleModel;
+	//Storage buffer of ParticleBillboardData, read by the billboard vertex shader
+	VkBuffer billboardBuffer;
+	VkDeviceSize getBillboardBufferSize() const;
 
 	void update();
 	void draw(VkCommandBuffer commandBuffer);
+
+	void setRenderMode(ParticleRenderMode mode);
+	ParticleRenderMode getRenderMode() const;
+	void setBillboardSize(float size);
+
+	void setViewPosition(glm::vec3 position);
+	void setLodDistances(float halfRate, float quarterRate, float eighthRate);
+	//Number of alive particles in each simulation LOD during the last update
+	const std::array<uint32_t, PARTICLE_LOD_LEVELS>& getLodCounts() const;
+
+	uint32_t getSeed() const;
+	bool isDeterministic() const;
+
+	//Binary copy of the full simulation state, restore throws if the data doesn't match this system
+	std::vector<char> snapshot() const;
+	void restore(const std::vector<char> &data);
+	void saveSnapshot(const std::string &filename) const;
+	void loadSnapshot(const std::string &filename);
+	//FNV-1a hash of the snapshot, equal hashes mean bit-exact state
+	uint64_t stateHash() const;
+	//Steps frames updates, restores the state from before them and steps again. True when both
+	//runs end in the same stateHash, the system is left at the end of the second run.
+	bool verifyReplay(uint32_t frames);
 };
 
 
@@ -0,0 +1,204 @@
+#include "PngHeightmapReader.h"
+#include "logger.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+PngHeightmapReader::PngHeightmapReader(const std::string &filename) :
+	stream(filename.c_str(), std::ios::binary),
+	filename(filename)
+{
+	static const unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+
+	if(!stream.is_open())
+		throw std::runtime_error("Heightmap could not be opened " + filename);
+	unsigned char fileSignature[8];
+	stream.read(reinterpret_cast<char*>(fileSignature), sizeof(fileSignature));
+	if(!stream || memcmp(fileSignature, signature, sizeof(signature)) != 0)
+		throw std::runtime_error("Not a PNG file " + filename);
+
+	if(nextChunk() != "IHDR" || chunkRemaining != 13)
+		throw std::runtime_error("PNG is missing its header " + filename);
+	width = readUint32();
+	depth = readUint32();
+	unsigned char info[5];
+	stream.read(reinterpret_cast<char*>(info), sizeof(info));
+	bitDepth = info[0];
+	uint32_t colourType = info[1];
+	//Compression and filter method must be 0, interlaced images can't be read a row at a time
+	if(info[2] != 0 || info[3] != 0)
+		throw std::runtime_error("PNG uses an unknown compression or filter method " + filename);
+	if(info[4] != 0)
+		throw std::runtime_error("Interlaced PNG heightmaps are not supported " + filename);
+	if(bitDepth != 8 && bitDepth != 16)
+		throw std::runtime_error("PNG heightmaps must be 8 or 16 bit " + filename);
+
+	uint32_t channels;
+	if(colourType == 0)
+		channels = 1;
+	else if(colourType == 2)
+		channels = 3;
+	else if(colourType == 4)
+		channels = 2;
+	else if(colourType == 6)
+		channels = 4;
+	else
+		throw std::runtime_error("Palette PNG heightmaps are not supported " + filename);
+	if(width == 0 || depth == 0)
+		throw std::runtime_error("PNG has no pixels " + filename);
+	bytesPerPixel = channels * bitDepth / 8;
+
+	//Skip ancillary chunks up to the first image data
+	stream.seekg(4, std::ios::cur);
+	std::string type;
+	while((type = nextChunk()) != "IDAT")
+	{
+		if(type == "IEND")
+			throw std::runtime_error("PNG has no image data " + filename);
+		stream.seekg(chunkRemaining + 4, std::ios::cur);
+	}
+
+	//Image data is a zlib stream, the two byte header is checked here and the adler checksum ignored
+	uint8_t zlibHeader[2];
+	if(readImageData(zlibHeader, 2) != 2 || (zlibHeader[0] & 0x0F) != 8 ||
+	   ((zlibHeader[0] << 8) | zlibHeader[1]) % 31 != 0 || (zlibHeader[1] & 0x20) != 0)
+		throw std::runtime_error("PNG image data is not a zlib stream " + filename);
+	inflate = new InflateStream([this](uint8_t* out, size_t size) { return readImageData(out, size); });
+
+	size_t rowBytes = static_cast<size_t>(width) * bytesPerPixel;
+	previousRow.assign(rowBytes, 0);
+	currentRow.assign(rowBytes, 0);
+
+	Logger() << "PNG heightmap " << filename << " " << width << "x" << depth << ", " << bitDepth << " bit, "
+	         << channels << " channel";
+}
+
+PngHeightmapReader::~PngHeightmapReader()
+{
+	delete inflate;
+}
+
+uint32_t PngHeightmapReader::readUint32()
+{
+	unsigned char bytes[4];
+	stream.read(reinterpret_cast<char*>(bytes), sizeof(bytes));
+	if(!stream)
+		throw std::runtime_error("PNG is truncated " + filename);
+	return (static_cast<uint32_t>(bytes[0]) << 24) | (bytes[1] << 16) | (bytes[2] << 8) | bytes[3];
+}
+
+std::string PngHeightmapReader::nextChunk()
+{
+	chunkRemaining = readUint32();
+	char type[4];
+	stream.read(type, sizeof(type));
+	if(!stream)
+		throw std::runtime_error("PNG is truncated " + filename);
+	return std::string(type, sizeof(type));
+}
+
+size_t PngHeightmapReader::readImageData(uint8_t* out, size_t size)
+{
+	size_t produced = 0;
+	while(produced < size && !idatFinished)
+	{
+		if(chunkRemaining == 0)
+		{
+			//Consecutive IDAT chunks form one stream, skip the CRC and move to the next
+			stream.seekg(4, std::ios::cur);
+			if(nextChunk() != "IDAT")
+			{
+				idatFinished = true;
+				break;
+			}
+			continue;
+		}
+
+		size_t count = std::min(static_cast<size_t>(chunkRemaining), size - produced);
+		stream.read(reinterpret_cast<char*>(out + produced), count);
+		if(!stream)
+			throw std::runtime_error("PNG image data is truncated " + filename);
+		chunkRemaining -= static_cast<uint32_t>(count);
+		produced += count;
+	}
+	return produced;
+}
+
+void PngHeightmapReader::unfilter(uint8_t filter)
+{
+	uint8_t* row = currentRow.data();
+	const uint8_t* above = previousRow.data();
+	size_t rowBytes = currentRow.size();
+	size_t bpp = bytesPerPixel;
+
+	switch(filter)
+	{
+		case 0:
+			break;
+		case 1:
+			for(size_t i = bpp; i < rowBytes; i++)
+				row[i] += row[i - bpp];
+			break;
+		case 2:
+			for(size_t i = 0; i < rowBytes; i++)
+				row[i] += above[i];
+			break;
+		case 3:
+			for(size_t i = 0; i < bpp; i++)
+				row[i] += above[i] / 2;
+			for(size_t i = bpp; i < rowBytes; i++)
+				row[i] += (row[i - bpp] + above[i]) / 2;
+			break;
+		case 4:
+			for(size_t i = 0; i < bpp; i++)
+				row[i] += above[i];
+			for(size_t i = bpp; i < rowBytes; i++)
+			{
+				int a = row[i - bpp];
+				int b = above[i];
+				int c = above[i - bpp];
+				int p = a + b - c;
+				int pa = abs(p - a);
+				int pb = abs(p - b);
+				int pc = abs(p - c);
+				if(pa <= pb && pa <= pc)
+					row[i] += a;
+				else if(pb <= pc)
+					row[i] += b;
+				else
+					row[i] += c;
+			}
+			break;
+		default:
+			throw std::runtime_error("PNG scanline has an unknown filter " + filename);
+	}
+}
+
+uint32_t PngHeightmapReader::readRows(float* out, uint32_t rows)
+{
+	uint32_t count = 0;
+	for(; count < rows && rowsRead < depth; count++, rowsRead++)
+	{
+		uint8_t filter;
+		if(inflate->read(&filter, 1) != 1 || inflate->read(currentRow.data(), currentRow.size()) != currentRow.size())
+			throw std::runtime_error("PNG image data ends early " + filename);
+		unfilter(filter);
+
+		float* outRow = out + static_cast<size_t>(count) * width;
+		const uint8_t* sample = currentRow.data();
+		if(bitDepth == 16)
+		{
+			//Samples are big endian
+			for(uint32_t x = 0; x < width; x++, sample += bytesPerPixel)
+				outRow[x] = ((sample[0] << 8) | sample[1]) / 65535.0f;
+		}
+		else
+		{
+			for(uint32_t x = 0; x < width; x++, sample += bytesPerPixel)
+				outRow[x] = sample[0] / 255.0f;
+		}
+		currentRow.swap(previousRow);
+	}
+	return count;
+}
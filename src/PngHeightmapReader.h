@@ -0,0 +1,36 @@
+#ifndef VULKANITE_PNGHEIGHTMAPREADER_H
+#define VULKANITE_PNGHEIGHTMAPREADER_H
+
+#include "HeightmapReader.h"
+#include "Inflate.h"
+
+//Streaming PNG decoder for 8 and 16 bit grey, grey alpha, RGB and RGBA images.
+//Scanlines are inflated and unfiltered one at a time and only the first channel is kept,
+//so memory stays at two scanlines however large the image is.
+class PngHeightmapReader : public HeightmapReader
+{
+	std::ifstream stream;
+	std::string filename;
+	uint32_t chunkRemaining = 0;
+	bool idatFinished = false;
+	InflateStream* inflate = nullptr;
+
+	uint32_t bitDepth = 0;
+	uint32_t bytesPerPixel = 0;
+	std::vector<uint8_t> previousRow;
+	std::vector<uint8_t> currentRow;
+
+	uint32_t readUint32();
+	//Next chunk header, returns the chunk type and leaves its length in chunkRemaining
+	std::string nextChunk();
+	size_t readImageData(uint8_t* out, size_t size);
+	void unfilter(uint8_t filter);
+
+public:
+	explicit PngHeightmapReader(const std::string &filename);
+	~PngHeightmapReader() override;
+
+	uint32_t readRows(float* out, uint32_t rows) override;
+};
+
+#endif //VULKANITE_PNGHEIGHTMAPREADER_H
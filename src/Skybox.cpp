@@ -14,7 +14,7 @@ Skybox::Skybox(VulkanInterface *inVulkan):
 
 Skybox::~Skybox()
 {
-	delete texture;
+	vki->assets->release(texture);
 
 	vkDestroyDescriptorSetLayout(vki->logicalDevice, descriptorSetLayout, nullptr);
 	vkDestroyPipelineLayout(vki->logicalDevice, pipelineLayout, nullptr);
@@ -79,14 +79,14 @@ void Skybox::createTexture()
 	 * view starting at baseArrayLayer correspond to faces in the order
 	 * +X, -X, +Y, -Y, +Z, -Z.
 	 */
-	texture = new Texture(vki, {
+	texture = vki->assets->acquireTexture({
 			"images/envmap_interstellar/interstellar_lf.tga",
 			"images/envmap_interstellar/interstellar_rt.tga",
 			"images/envmap_interstellar/interstellar_up.tga",
 			"images/envmap_interstellar/interstellar_dn.tga",
 			"images/envmap_interstellar/interstellar_ft.tga",
 			"images/envmap_interstellar/interstellar_bk.tga"
-	}, true);
+	}, true, true);
 }
 
 void Skybox::createDescriptor()
@@ -118,7 +118,10 @@ void Skybox::createDescriptor()
 
 	VK_RESULT_CHECK(vkAllocateDescriptorSets(vki->logicalDevice, &allocInfo, &descriptorSet))
 	Logger() << "Descriptor sets allocated";
+}
 
+void Skybox::writeDescriptor()
+{
 	VkDescriptorImageInfo imageInfo = {};
 	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 	imageInfo.imageView = texture->texture.imageView;
@@ -134,6 +137,7 @@ void Skybox::createDescriptor()
 	descriptorWrites[0].pImageInfo = &imageInfo;
 
 	vkUpdateDescriptorSets(vki->logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+	descriptorWritten = true;
 }
 
 std::vector<VkVertexInputBindingDescription> Skybox::getBindingDescription()
@@ -332,7 +336,7 @@ void Skybox::updateCommandBuffer(VkCommandBufferInheritanceInfo inheritanceInfo)
 
 	VkDeviceSize offsets[] = {0};
 	vkCmdBindVertexBuffers(commandBuffer, 0,1, &vertexBuffer, offsets);
-	vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0,VK_INDEX_TYPE_UINT32);
+	vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, indexType);
 	vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()),
 	                 1, 0, 0, 0);
 
@@ -366,6 +370,12 @@ void Skybox::updatePushConstantCommandBuffer(VkCommandBufferInheritanceInfo inhe
 
 void Skybox::draw(std::vector<VkCommandBuffer> * commandBuffers, VkCommandBufferInheritanceInfo inheritanceInfo)
 {
+	//The clear colour shows until the cubemap is resident
+	if(!texture->isResident())
+		return;
+	if(!descriptorWritten)
+		writeDescriptor();
+
 	if(!commandBufferFilled)
 		updateCommandBuffer(inheritanceInfo);
 
@@ -402,23 +412,5 @@ void Skybox::createVertexBuffer()
 
 void Skybox::createIndexBuffer()
 {
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
-	vki->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-	                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-	                  stagingBuffer, stagingBufferMemory);
-	void* data;
-	vkMapMemory(vki->logicalDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, indices.data(), bufferSize);
-	vkUnmapMemory(vki->logicalDevice, stagingBufferMemory);
-
-	vki->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-	                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-	                  indexBuffer, indexBufferMemory);
-
-	vki->copyBuffer(stagingBuffer, indexBuffer, bufferSize);
-
-	vkDestroyBuffer(vki->logicalDevice, stagingBuffer, nullptr);
-	vkFreeMemory(vki->logicalDevice, stagingBufferMemory, nullptr);
+	indexType = vki->createIndexBuffer(indices.data(), indices.size(), VK_INDEX_TYPE_UINT32, indexBuffer, indexBufferMemory);
 }
\ No newline at end of file
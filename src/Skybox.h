@@ -31,11 +31,13 @@ class Skybox
 	VkDeviceMemory vertexBufferMemory;
 	VkBuffer indexBuffer;
 	VkDeviceMemory indexBufferMemory;
+	VkIndexType indexType;
 
 	VkPipeline pipeline;
 	VkPipelineLayout pipelineLayout;
 	VkDescriptorSetLayout descriptorSetLayout;
 	VkDescriptorSet descriptorSet;
+	bool descriptorWritten = false;
 	bool commandBufferFilled = false;
 	VkCommandBuffer commandBuffer = nullptr;
 	VkCommandBuffer pushConstantCommandBuffer = nullptr;
@@ -46,6 +48,8 @@ class Skybox
 
 	void createTexture();
 	void createDescriptor();
+	//Once the texture is resident
+	void writeDescriptor();
 	std::vector<VkVertexInputBindingDescription> getBindingDescription();
 	std::vector<VkVertexInputAttributeDescription> getAttributeDescription();
 	void createPipeline();
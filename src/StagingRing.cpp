@@ -0,0 +1,188 @@
+#include "StagingRing.h"
+#include "vulkanInterface.h"
+#include "logger.h"
+#include <limits>
+#include <stdexcept>
+
+StagingRing::StagingRing(VulkanInterface* inVulkan, VkDeviceSize inCapacity) :
+	vki(inVulkan),
+	capacity(inCapacity)
+{
+	vki->createBuffer(capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+	                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	                  buffer, bufferMemory);
+
+	void* data;
+	VK_RESULT_CHECK(vkMapMemory(vki->logicalDevice, bufferMemory, 0, capacity, 0, &data))
+	mapped = static_cast<char*>(data);
+	Logger() << "Staging ring created with " << capacity / 1024 << "KB";
+}
+
+StagingRing::~StagingRing()
+{
+	while(!inFlight.empty())
+		retire(true);
+	if(commandBuffer)
+	{
+		vkEndCommandBuffer(commandBuffer);
+		vkFreeCommandBuffers(vki->logicalDevice, vki->commandPool, 1, &commandBuffer);
+	}
+	destroyBuffers(pendingBuffers, pendingMemories);
+
+	vkUnmapMemory(vki->logicalDevice, bufferMemory);
+	vkDestroyBuffer(vki->logicalDevice, buffer, nullptr);
+	vkFreeMemory(vki->logicalDevice, bufferMemory, nullptr);
+}
+
+void StagingRing::retire(bool wait)
+{
+	while(!inFlight.empty())
+	{
+		Submission &oldest = inFlight.front();
+		if(wait)
+			vkWaitForFences(vki->logicalDevice, 1, &oldest.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+		else if(vkGetFenceStatus(vki->logicalDevice, oldest.fence) != VK_SUCCESS)
+			break;
+		wait = false;
+
+		used -= oldest.bytes;
+		destroyBuffers(oldest.buffers, oldest.memories);
+		vkDestroyFence(vki->logicalDevice, oldest.fence, nullptr);
+		vkFreeCommandBuffers(vki->logicalDevice, vki->commandPool, 1, &oldest.commandBuffer);
+		inFlight.pop_front();
+	}
+
+	//Nothing live, start from the front again so fewer allocations have to wrap
+	if(used == 0)
+		head = 0;
+}
+
+void* StagingRing::allocate(VkDeviceSize size, VkDeviceSize &offset, VkDeviceSize alignment)
+{
+	if(size + alignment > capacity)
+		throw std::runtime_error("Staging ring allocation larger than the ring");
+
+	retire(false);
+	while(true)
+	{
+		//Allocations that would run off the end skip the remainder and start at the front
+		VkDeviceSize aligned = (head + alignment - 1) / alignment * alignment;
+		VkDeviceSize needed;
+		if(aligned + size <= capacity)
+		{
+			offset = aligned;
+			needed = aligned - head + size;
+		}
+		else
+		{
+			offset = 0;
+			needed = capacity - head + size;
+		}
+		if(used + needed <= capacity)
+		{
+			used += needed;
+			pendingBytes += needed;
+			break;
+		}
+
+		//Full, this round has to go out before anything can be waited on
+		if(inFlight.empty())
+			flush(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_READ_BIT);
+		retire(true);
+	}
+
+	head = offset + size;
+	return mapped + offset;
+}
+
+VkCommandBuffer StagingRing::commands()
+{
+	if(commandBuffer)
+		return commandBuffer;
+
+	VkCommandBufferAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandPool = vki->commandPool;
+	allocInfo.commandBufferCount = 1;
+	VK_RESULT_CHECK(vkAllocateCommandBuffers(vki->logicalDevice, &allocInfo, &commandBuffer))
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	//Earlier frames may still be reading what is about to be overwritten
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+	                     0, 0, nullptr, 0, nullptr, 0, nullptr);
+	return commandBuffer;
+}
+
+void StagingRing::flush(VkPipelineStageFlags dstStages, VkAccessFlags dstAccess)
+{
+	if(!commandBuffer)
+	{
+		//Nothing recorded, the newest allocations can be handed straight back
+		head = (head + capacity - pendingBytes) % capacity;
+		used -= pendingBytes;
+		pendingBytes = 0;
+		retire(false);
+		//Only earlier submissions can still be using them
+		if(!pendingBuffers.empty())
+		{
+			while(!inFlight.empty())
+				retire(true);
+			destroyBuffers(pendingBuffers, pendingMemories);
+		}
+		return;
+	}
+
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = dstAccess;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStages,
+	                     0, 1, &barrier, 0, nullptr, 0, nullptr);
+	VK_RESULT_CHECK(vkEndCommandBuffer(commandBuffer))
+
+	Submission submission = {};
+	submission.bytes = pendingBytes;
+	submission.commandBuffer = commandBuffer;
+	submission.buffers.swap(pendingBuffers);
+	submission.memories.swap(pendingMemories);
+
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	VK_RESULT_CHECK(vkCreateFence(vki->logicalDevice, &fenceInfo, nullptr, &submission.fence))
+	vki->submitAsync(commandBuffer, submission.fence);
+
+	inFlight.emplace_back(submission);
+	commandBuffer = VK_NULL_HANDLE;
+	pendingBytes = 0;
+}
+
+void StagingRing::destroyAfterFlush(VkBuffer oldBuffer, VkDeviceMemory oldMemory)
+{
+	pendingBuffers.emplace_back(oldBuffer);
+	pendingMemories.emplace_back(oldMemory);
+}
+
+void StagingRing::destroyBuffers(std::vector<VkBuffer> &buffers, std::vector<VkDeviceMemory> &memories)
+{
+	for(VkBuffer oldBuffer : buffers)
+		vkDestroyBuffer(vki->logicalDevice, oldBuffer, nullptr);
+	for(VkDeviceMemory oldMemory : memories)
+		vkFreeMemory(vki->logicalDevice, oldMemory, nullptr);
+	buffers.clear();
+	memories.clear();
+}
+
+VkBuffer StagingRing::getBuffer() const
+{
+	return buffer;
+}
+
+bool StagingRing::hasPending() const
+{
+	return commandBuffer != VK_NULL_HANDLE || pendingBytes > 0;
+}
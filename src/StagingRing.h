@@ -0,0 +1,64 @@
+#ifndef VULKANITE_STAGINGRING_H
+#define VULKANITE_STAGINGRING_H
+
+#include <vulkan/vulkan.h>
+#include <deque>
+#include <vector>
+
+class VulkanInterface;
+
+//Persistently mapped upload buffer shared by small per frame updates. Space is handed out
+//front to back and wraps around, each flush is submitted with a fence and its bytes are
+//reused once the GPU has finished copying them.
+class StagingRing
+{
+	struct Submission
+	{
+		VkDeviceSize bytes;
+		VkCommandBuffer commandBuffer;
+		VkFence fence;
+		std::vector<VkBuffer> buffers;
+		std::vector<VkDeviceMemory> memories;
+	};
+
+	VulkanInterface* vki;
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceMemory bufferMemory = VK_NULL_HANDLE;
+	char* mapped = nullptr;
+	VkDeviceSize capacity;
+
+	//Live bytes run from the oldest unfinished allocation up to head, including padding
+	//and anything skipped when wrapping. pendingBytes of them are from this flush.
+	VkDeviceSize head = 0;
+	VkDeviceSize used = 0;
+	VkDeviceSize pendingBytes = 0;
+	VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+	//Destroyed with the next flush's submission
+	std::vector<VkBuffer> pendingBuffers;
+	std::vector<VkDeviceMemory> pendingMemories;
+	std::deque<Submission> inFlight;
+
+	void retire(bool wait);
+	void destroyBuffers(std::vector<VkBuffer> &buffers, std::vector<VkDeviceMemory> &memories);
+
+public:
+	StagingRing(VulkanInterface* inVulkan, VkDeviceSize inCapacity);
+	~StagingRing();
+
+	//Reserves host memory for size bytes and returns where it sits in getBuffer(). Blocks on the
+	//oldest flush if the ring is full, and throws if size can never fit. The copy out of it
+	//must be recorded before the next allocation since a full ring flushes what is recorded.
+	void* allocate(VkDeviceSize size, VkDeviceSize &offset, VkDeviceSize alignment = 16);
+	//Primary command buffer for the copies out of this flush's allocations, begun on first use
+	//after a barrier against earlier reads of the destinations
+	VkCommandBuffer commands();
+	//Submits the recorded copies, later submissions on the queue see them at dstStages
+	void flush(VkPipelineStageFlags dstStages, VkAccessFlags dstAccess);
+	//Takes ownership of a buffer the copies recorded so far read from, it is destroyed once they finish
+	void destroyAfterFlush(VkBuffer oldBuffer, VkDeviceMemory oldMemory);
+
+	VkBuffer getBuffer() const;
+	bool hasPending() const;
+};
+
+#endif //VULKANITE_STAGINGRING_H
@@ -3,19 +3,65 @@
 //
 
 #include "Terrain.h"
+#include "TerrainQuadtree.h"
+#include "TerrainStreamer.h"
+#include "HeightfieldQuery.h"
+#include "TerrainRtin.h"
+#include "TerrainCache.h"
+#include "HeightmapReader.h"
+#include "StagingRing.h"
+#include "TerrainVirtualTexture.h"
+#include "TerrainFoliage.h"
 #include "vulkanInterface.h"
 #include "logger.h"
-#include <stb_image.h>
-
-Terrain::Terrain(VulkanInterface *inVulkan, std::string filename):
-		vki(inVulkan)
+#include "GenericThreadPool.h"
+#include <thread>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstring>
+#include <memory>
+
+//Heightmap rows handed to each worker when building the monolithic grid
+#define TERRAIN_ROWS_PER_JOB 64
+//Cells along the side of each culling chunk in monolithic terrain
+#define TERRAIN_CULL_CHUNK_CELLS 64
+//Upload space shared by edits, a few frames of a large brush fit before it has to wait
+#define TERRAIN_STAGING_RING_SIZE (8 * 1024 * 1024)
+//Density of the finest virtual texture level
+#define TERRAIN_VT_TEXELS_PER_UNIT 32.0f
+//Same scatter on every run
+#define TERRAIN_FOLIAGE_SEED 1234
+
+Terrain::Terrain(VulkanInterface *inVulkan, std::string inFilename, TerrainMode inMode, bool deferred):
+		vki(inVulkan),
+		mode(inMode),
+		filename(std::move(inFilename)),
+		viewPosition(0)
 {
-	loadData(filename);
+	if(deferred)
+		return;
+	loadFile();
+	upload();
 }
 
 Terrain::~Terrain()
 {
-	delete texture;
+	vki->assets->release(texture);
+	delete cache;
+	delete quadtree;
+	delete streamer;
+	delete query;
+	delete rtin;
+	//Waits for outstanding edit uploads before their destinations go
+	delete stagingRing;
+	delete virtualTexture;
+	delete foliage;
+	if(heightSampler)
+	{
+		vkDestroySampler(vki->logicalDevice, heightSampler, nullptr);
+		heightTexture.destroy(vki->logicalDevice);
+	}
 
 	vkDestroyDescriptorSetLayout(vki->logicalDevice, descriptorSetLayout, nullptr);
 	vkDestroyPipelineLayout(vki->logicalDevice, pipelineLayout, nullptr);
@@ -26,94 +72,695 @@ Terrain::~Terrain()
 	vkFreeMemory(vki->logicalDevice, vertexBufferMemory, nullptr);
 }
 
-glm::vec3 constructNormal(glm::vec3 p1, glm::vec3 p2, glm::vec3 p3)
+void Terrain::loadFile()
 {
-	glm::vec3 u = p2 - p1;
-	glm::vec3 v = p3 - p1;
+	//Streamed tiles are read by the streamer once uploaded
+	if(mode == TERRAIN_STREAMED)
+		return;
+
+	if(mode == TERRAIN_DISPLACED)
+	{
+		//Only the shared patch indices and the height texture go to the GPU
+		loadHeightfield();
+		buildDisplaced();
+	}
+	else
+	{
+		//Anything that changes the built mesh has to be part of the key
+		std::vector<float> cacheParameters = {
+				static_cast<float>(mode), desiredWidth, desiredHeight, desiredDepth,
+				mode == TERRAIN_ADAPTIVE ? errorTolerance : 0.0f
+		};
+		std::string cacheFilename = filename + ".cache";
+		uint64_t cacheKey = TerrainCache::makeKey(filename, cacheParameters);
+		if(loadCache(cacheFilename, cacheKey))
+			Logger() << "Terrain loaded from cache " << cacheFilename;
+		else
+		{
+			loadHeightfield();
+
+			if(mode == TERRAIN_CHUNKED)
+				buildChunked();
+			else if(mode == TERRAIN_ADAPTIVE)
+				buildAdaptive();
+			else
+				buildMonolithic();
+
+			TerrainCache::write(cacheFilename, cacheKey, heightfield,
+			                    quadtree ? quadtree->getNodes() : std::vector<TerrainNode>(), chunks, vertices, indices);
+		}
+	}
+	query = new HeightfieldQuery(&heightfield);
+}
 
-	glm::vec3 normal = glm::vec3(
-			(u.y * v.z) - (u.z * v.y),
-			(u.z * v.x) - (u.x * v.z),
-			(u.x * v.y) - (u.y * v.x)
-	);
+void Terrain::upload()
+{
+	if(mode == TERRAIN_STREAMED)
+	{
+		//Vertex buffers belong to the streamer's tiles
+		buildStreamed();
+	}
+	else if(cache)
+	{
+		//Straight from the mapping into the staging buffers
+		const TerrainCacheHeader& header = cache->getHeader();
+		createVertexBuffer(cache->vertices(), header.vertexCount);
+		createIndexBuffer(cache->indices(), header.indexCount);
+		delete cache;
+		cache = nullptr;
+	}
+	else if(!vertices.empty())
+		createVertexBuffer(vertices.data(), vertices.size());
+	if(!indices.empty())
+		createIndexBuffer(indices.data(), indices.size());
 
-	return normal;
+	createTexture();
+	if(mode != TERRAIN_STREAMED)
+	{
+		//Material blend is baked into pages from the height texture, streamed tiles keep the triplanar shader
+		createHeightTexture();
+		virtualTexture = new TerrainVirtualTexture(vki, &heightfield, texture, heightTexture, heightSampler,
+		                                           TERRAIN_VT_TEXELS_PER_UNIT);
+		createFoliage();
+	}
+	createDescriptor();
+	createPipeline();
+	allocateCommandBuffers();
 }
 
-void Terrain::loadData(std::string filename)
+void Terrain::loadHeightfield()
 {
-	int comp;
-	int vertWidth;
-	int vertHeight;
-	stbi_uc* heightData = stbi_load(filename.c_str(), &vertWidth, &vertHeight, &comp, STBI_rgb_alpha);
-	if(!heightData)
-		throw std::runtime_error("Heightmap could not be loaded");
+	//Decoded single channel at the source's bit depth, 16 bit heightmaps keep their full precision
+	std::unique_ptr<HeightmapReader> reader(HeightmapReader::open(filename));
+	int vertWidth = static_cast<int>(reader->getWidth());
+	int vertHeight = static_cast<int>(reader->getDepth());
+	if(vertWidth < 2 || vertHeight < 2)
+		throw std::runtime_error("Heightmap is too small " + filename);
 
 	int tileWidth = vertWidth-1;
 	int tileHeight = vertHeight-1;
-	float desiredWidth = 50;
-	float desiredHeight = 10;
-	float desiredDepth = 50;
 
-	vertices.reserve(static_cast<uint32_t>(vertWidth * vertHeight));
-	for(int i = 0; i < vertHeight; i++)
+	heightfield.width = static_cast<uint32_t>(vertWidth);
+	heightfield.depth = static_cast<uint32_t>(vertHeight);
+	heightfield.spacingX = desiredWidth/tileWidth;
+	heightfield.spacingZ = desiredDepth/tileHeight;
+	heightfield.heights.resize(static_cast<size_t>(vertWidth) * vertHeight);
+	uint32_t rows = reader->readRows(heightfield.heights.data(), heightfield.depth);
+	if(rows != heightfield.depth)
+		throw std::runtime_error("Heightmap is truncated " + filename);
+
+	for(size_t i = 0; i < heightfield.heights.size(); i++)
+	{
+		heightfield.heights[i] *= desiredHeight;
+	}
+}
+
+bool Terrain::loadCache(const std::string &cacheFilename, uint64_t key)
+{
+	std::unique_ptr<TerrainCache> opened(new TerrainCache());
+	if(!opened->open(cacheFilename, key))
+		return false;
+
+	const TerrainCacheHeader& header = opened->getHeader();
+	heightfield.width = header.width;
+	heightfield.depth = header.depth;
+	heightfield.spacingX = header.spacingX;
+	heightfield.spacingZ = header.spacingZ;
+	heightfield.heights.assign(opened->heights(), opened->heights() + header.width * header.depth);
+
+	if(mode == TERRAIN_CHUNKED)
 	{
-		for(int j = 0; j < vertWidth; j++)
+		quadtree = new TerrainQuadtree(&heightfield, 32,
+		                               std::vector<TerrainNode>(opened->nodes(), opened->nodes() + header.nodeCount));
+	}
+	chunks.assign(opened->chunks(), opened->chunks() + header.chunkCount);
+
+	//Vertices and indices stay mapped until upload copies them
+	cache = opened.release();
+	return true;
+}
+
+void Terrain::buildChunked()
+{
+	quadtree = new TerrainQuadtree(&heightfield, 32, vertices, indices);
+}
+
+void Terrain::buildStreamed()
+{
+	//Keep roughly a 3x3 block of tiles around the viewer, with headroom in the budget for recently left tiles
+	streamer = new TerrainStreamer(vki, filename, 0, 0);
+	const TerrainTileHeader& header = streamer->getHeader();
+	float tileWorldSize = header.tileSize * std::max(header.spacingX, header.spacingZ);
+	VkDeviceSize tileBytes = sizeof(TerrainVertex) * (header.tileSize + 1) * (header.tileSize + 1);
+	streamer->setLoadRadius(tileWorldSize * 1.5f);
+	streamer->setMemoryBudget(tileBytes * 32);
+
+	streamer->buildIndices(indices);
+	Logger() << "Streaming terrain " << header.width << "x" << header.depth << " in "
+	         << header.tilesX * header.tilesZ << " tiles";
+}
+
+void Terrain::buildAdaptive()
+{
+	if(!rtin)
+		rtin = new TerrainRtin(&heightfield, 64);
+	rtin->build(errorTolerance, vertices, indices, chunks);
+	Logger() << "Adaptive terrain " << indices.size() / 3 << " triangles at tolerance " << errorTolerance;
+}
+
+void Terrain::setErrorTolerance(float tolerance)
+{
+	errorTolerance = tolerance;
+	if(mode != TERRAIN_ADAPTIVE)
+		return;
+
+	//Buffers may still be in use by the last frame
+	vki->waitForIdle();
+	vkDestroyBuffer(vki->logicalDevice, indexBuffer, nullptr);
+	vkFreeMemory(vki->logicalDevice, indexBufferMemory, nullptr);
+	vkDestroyBuffer(vki->logicalDevice, vertexBuffer, nullptr);
+	vkFreeMemory(vki->logicalDevice, vertexBufferMemory, nullptr);
+
+	buildAdaptive();
+	createVertexBuffer(vertices.data(), vertices.size());
+	createIndexBuffer(indices.data(), indices.size());
+}
+
+void Terrain::buildDisplaced()
+{
+	uint32_t row = displacedPatchSize + 1;
+	displacedPatchesX = (heightfield.width - 2) / displacedPatchSize + 1;
+	displacedPatchesZ = (heightfield.depth - 2) / displacedPatchSize + 1;
+
+	//One chunk per instance, in instance order
+	for(uint32_t pz = 0; pz < displacedPatchesZ; pz++)
+	{
+		for(uint32_t px = 0; px < displacedPatchesX; px++)
 		{
-			TerrainVertex v{};
-			v.position = glm::vec3(j*(desiredWidth/tileWidth),0,i*(desiredDepth/tileHeight));
-			v.position.y = heightData[(i*vertWidth + j)*4] / 256.0f * desiredHeight ;
-			vertices.emplace_back(v);
+			TerrainChunk chunk = {};
+			chunk.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+			chunk.boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+			uint32_t lastX = std::min((px + 1) * displacedPatchSize, heightfield.width - 1);
+			uint32_t lastZ = std::min((pz + 1) * displacedPatchSize, heightfield.depth - 1);
+			for(uint32_t z = pz * displacedPatchSize; z <= lastZ; z++)
+			{
+				for(uint32_t x = px * displacedPatchSize; x <= lastX; x++)
+				{
+					glm::vec3 position = heightfield.position(static_cast<int>(x), static_cast<int>(z));
+					chunk.boundsMin = glm::min(chunk.boundsMin, position);
+					chunk.boundsMax = glm::max(chunk.boundsMax, position);
+				}
+			}
+			chunks.emplace_back(chunk);
 		}
 	}
 
-	stbi_image_free(heightData);
+	indices.reserve(displacedPatchSize * displacedPatchSize * 6);
+	for(uint32_t i = 0; i < displacedPatchSize; i++)
+	{
+		for(uint32_t j = 0; j < displacedPatchSize; j++)
+		{
+			indices.emplace_back((i+1)*row + j+1);
+			indices.emplace_back(i*row + j+1);
+			indices.emplace_back(i*row + j);
 
-	indices.reserve(static_cast<uint32_t>(tileWidth*tileHeight * 6));
-	for(int i = 0; i < tileHeight; i++)
+			indices.emplace_back(i*row + j);
+			indices.emplace_back((i+1)*row + j);
+			indices.emplace_back((i+1)*row + j+1);
+		}
+	}
+}
+
+void Terrain::createHeightTexture()
+{
+	VkFormat format = VK_FORMAT_R32_SFLOAT;
+	vki->createImage(heightfield.width, heightfield.depth, 1, format, VK_IMAGE_TILING_OPTIMAL,
+	                 VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+	                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, heightTexture.image, heightTexture.imageMemory, 0);
+	vki->transitionImageLayout(heightTexture.image, format, VK_IMAGE_LAYOUT_UNDEFINED,
+	                           VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1);
+	uploadHeightRegion(0, 0, heightfield.width, heightfield.depth);
+
+	heightTexture.imageView = createImageView(vki->logicalDevice, VK_IMAGE_VIEW_TYPE_2D, heightTexture.image,
+	                                          format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+
+	//Fetched per texel, filtering is never used
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.anisotropyEnable = VK_FALSE;
+	samplerInfo.maxAnisotropy = 1;
+	samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+	samplerInfo.unnormalizedCoordinates = VK_FALSE;
+	samplerInfo.compareEnable = VK_FALSE;
+	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.mipLodBias = 0.0f;
+	samplerInfo.minLod = 0.0f;
+	samplerInfo.maxLod = 0.0f;
+
+	VK_RESULT_CHECK(vkCreateSampler(vki->logicalDevice, &samplerInfo, nullptr, &heightSampler))
+	Logger() << "Height texture created " << heightfield.width << "x" << heightfield.depth;
+}
+
+void Terrain::uploadHeightRegion(uint32_t x, uint32_t z, uint32_t width, uint32_t depth)
+{
+	if(heightTexture.image == VK_NULL_HANDLE || width == 0 || depth == 0)
+		return;
+
+	//Split into bands of rows so the whole texture can go through the ring on creation
+	StagingRing* ring = getStagingRing();
+	VkDeviceSize rowBytes = sizeof(float) * width;
+	auto bandRows = static_cast<uint32_t>(std::max<VkDeviceSize>(1, TERRAIN_STAGING_RING_SIZE / 4 / rowBytes));
+	for(uint32_t bandZ = z; bandZ < z + depth; bandZ += bandRows)
 	{
-		for(int j = 0; j < tileWidth; j++)
+		uint32_t rows = std::min(bandRows, z + depth - bandZ);
+		VkDeviceSize offset;
+		auto band = static_cast<float*>(ring->allocate(rowBytes * rows, offset));
+		for(uint32_t i = 0; i < rows; i++)
 		{
-			indices.emplace_back((i+1)*vertWidth + j+1);
-			indices.emplace_back(i*vertWidth + j+1);
-			indices.emplace_back(i*vertWidth + j);
+			memcpy(&band[i * width], &heightfield.heights[(bandZ + i) * heightfield.width + x], rowBytes);
+		}
+
+		VkCommandBuffer uploadCommandBuffer = ring->commands();
+
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = heightTexture.image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(uploadCommandBuffer, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		                     VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		VkBufferImageCopy region = {};
+		region.bufferOffset = offset;
+		region.bufferRowLength = 0;
+		region.bufferImageHeight = 0;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = 0;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = 1;
+		region.imageOffset = {static_cast<int32_t>(x), static_cast<int32_t>(bandZ), 0};
+		region.imageExtent = {width, rows, 1};
+		vkCmdCopyBufferToImage(uploadCommandBuffer, ring->getBuffer(), heightTexture.image,
+		                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(uploadCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		                     VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		                     0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+	ring->flush(VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+}
 
-			indices.emplace_back(i*vertWidth + j);
-			indices.emplace_back((i+1)*vertWidth + j);
-			indices.emplace_back((i+1)*vertWidth + j+1);
+StagingRing* Terrain::getStagingRing()
+{
+	if(!stagingRing)
+		stagingRing = new StagingRing(vki, TERRAIN_STAGING_RING_SIZE);
+	return stagingRing;
+}
+
+void Terrain::applyBrush(const TerrainBrush &brush, float x, float z, float deltaTime)
+{
+	if(heightfield.heights.empty() || brush.radius <= 0.0f)
+		return;
+
+	int firstX = std::max(static_cast<int>(std::floor((x - brush.radius) / heightfield.spacingX)), 0);
+	int firstZ = std::max(static_cast<int>(std::floor((z - brush.radius) / heightfield.spacingZ)), 0);
+	int lastX = std::min(static_cast<int>(std::ceil((x + brush.radius) / heightfield.spacingX)),
+	                     static_cast<int>(heightfield.width) - 1);
+	int lastZ = std::min(static_cast<int>(std::ceil((z + brush.radius) / heightfield.spacingZ)),
+	                     static_cast<int>(heightfield.depth) - 1);
+	if(firstX > lastX || firstZ > lastZ)
+		return;
+
+	float invRadiusSquared = 1.0f / (brush.radius * brush.radius);
+	float amount = brush.strength * deltaTime;
+	for(int sz = firstZ; sz <= lastZ; sz++)
+	{
+		float dz = sz * heightfield.spacingZ - z;
+		for(int sx = firstX; sx <= lastX; sx++)
+		{
+			float dx = sx * heightfield.spacingX - x;
+			float distanceSquared = (dx * dx + dz * dz) * invRadiusSquared;
+			if(distanceSquared >= 1.0f)
+				continue;
+			float falloff = (1.0f - distanceSquared) * (1.0f - distanceSquared);
+
+			float &height = heightfield.heights[sz * heightfield.width + sx];
+			if(brush.mode == TERRAIN_BRUSH_RAISE)
+				height += amount * falloff;
+			else if(brush.mode == TERRAIN_BRUSH_LOWER)
+				height -= amount * falloff;
+			else
+				height += (brush.targetHeight - height) * std::min(amount * falloff, 1.0f);
 		}
 	}
 
-	for(int i = 0; i < indices.size(); i += 3)
+	//Grow the dirty rectangle, several brush strokes in one frame go out together
+	auto x0 = static_cast<uint32_t>(firstX);
+	auto z0 = static_cast<uint32_t>(firstZ);
+	auto x1 = static_cast<uint32_t>(lastX);
+	auto z1 = static_cast<uint32_t>(lastZ);
+	if(!heightsDirty)
+	{
+		dirtyMinX = x0;
+		dirtyMinZ = z0;
+		dirtyMaxX = x1;
+		dirtyMaxZ = z1;
+		heightsDirty = true;
+	}
+	else
 	{
-		TerrainVertex* v1 = &vertices[indices[i]];
-		TerrainVertex* v2 = &vertices[indices[i+1]];
-		TerrainVertex* v3 = &vertices[indices[i+2]];
+		dirtyMinX = std::min(dirtyMinX, x0);
+		dirtyMinZ = std::min(dirtyMinZ, z0);
+		dirtyMaxX = std::max(dirtyMaxX, x1);
+		dirtyMaxZ = std::max(dirtyMaxZ, z1);
+	}
+}
 
-		glm::vec3 normal = constructNormal(v1->position, v2->position, v3->position);
-		v1->normal += normal;
-		v2->normal += normal;
-		v3->normal += normal;
+void Terrain::flushEdits()
+{
+	if(!heightsDirty)
+		return;
+	heightsDirty = false;
+
+	if(query)
+		query->refresh(dirtyMinX, dirtyMinZ, dirtyMaxX, dirtyMaxZ);
+
+	//Pages over the edit are baked again from the new heights the next time they are drawn
+	uploadHeightRegion(dirtyMinX, dirtyMinZ, dirtyMaxX - dirtyMinX + 1, dirtyMaxZ - dirtyMinZ + 1);
+	if(virtualTexture)
+		virtualTexture->invalidate(dirtyMinX * heightfield.spacingX, dirtyMinZ * heightfield.spacingZ,
+		                           dirtyMaxX * heightfield.spacingX, dirtyMaxZ * heightfield.spacingZ);
+	if(foliage)
+		foliage->refresh(dirtyMinX * heightfield.spacingX, dirtyMinZ * heightfield.spacingZ,
+		                 dirtyMaxX * heightfield.spacingX, dirtyMaxZ * heightfield.spacingZ, getStagingRing());
+
+	if(mode == TERRAIN_DISPLACED)
+	{
+		refreshChunkBounds(dirtyMinX, dirtyMinZ, dirtyMaxX, dirtyMaxZ, displacedPatchSize);
+		return;
 	}
+	if(mode != TERRAIN_MONOLITHIC && mode != TERRAIN_CHUNKED && mode != TERRAIN_ADAPTIVE)
+		return;
 
-	for(auto &&vertex : vertices)
+	//Normals read the neighbouring samples, so vertices one sample further out change as well
+	uint32_t x0 = dirtyMinX > 0 ? dirtyMinX - 1 : 0;
+	uint32_t z0 = dirtyMinZ > 0 ? dirtyMinZ - 1 : 0;
+	uint32_t x1 = std::min(dirtyMaxX + 1, heightfield.width - 1);
+	uint32_t z1 = std::min(dirtyMaxZ + 1, heightfield.depth - 1);
+
+	StagingRing* ring = getStagingRing();
+	if(mode == TERRAIN_ADAPTIVE)
 	{
-		vertex.normal = glm::normalize(vertex.normal);
-//		vertex.normal = (vertex.normal + glm::vec3(1))/2.0f;
+		refreshAdaptive(x0, z0, x1, z1, ring);
+		ring->flush(VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+		            VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT);
+		return;
 	}
 
-	createVertexBuffer();
-	createIndexBuffer();
+	auto writeVertices = [this, ring](uint32_t firstVertex, const TerrainVertex* data, uint32_t count)
+	{
+		VkBufferCopy copyRegion = {};
+		copyRegion.size = sizeof(TerrainVertex) * count;
+		copyRegion.dstOffset = sizeof(TerrainVertex) * firstVertex;
+		memcpy(ring->allocate(copyRegion.size, copyRegion.srcOffset), data, copyRegion.size);
+		vkCmdCopyBuffer(ring->commands(), ring->getBuffer(), vertexBuffer, 1, &copyRegion);
+	};
 
-	createTexture();
-	createDescriptor();
-	createPipeline();
-	allocateCommandBuffers();
+	if(mode == TERRAIN_CHUNKED)
+		quadtree->refresh(x0, z0, x1, z1, writeVertices);
+	else
+	{
+		//One grid vertex per sample, each row of the rectangle is a contiguous run
+		std::vector<TerrainVertex> run(x1 - x0 + 1);
+		for(uint32_t z = z0; z <= z1; z++)
+		{
+			for(uint32_t x = x0; x <= x1; x++)
+			{
+				run[x - x0].position = heightfield.position(static_cast<int>(x), static_cast<int>(z));
+				run[x - x0].normal = heightfield.normal(static_cast<int>(x), static_cast<int>(z));
+			}
+			writeVertices(z * heightfield.width + x0, run.data(), static_cast<uint32_t>(run.size()));
+		}
+		refreshChunkBounds(dirtyMinX, dirtyMinZ, dirtyMaxX, dirtyMaxZ, TERRAIN_CULL_CHUNK_CELLS);
+	}
+	ring->flush(VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+}
+
+void Terrain::refreshAdaptive(uint32_t x0, uint32_t z0, uint32_t x1, uint32_t z1, StagingRing* ring)
+{
+	//Meshes loaded from the cache measure their errors on the first edit and keep the cached layout
+	if(!rtin)
+	{
+		rtin = new TerrainRtin(&heightfield, 64);
+		rtin->adoptLayout(chunks, vertexCapacity, indexCapacity);
+	}
+
+	//Every tile has its slot before anything is recorded, so the buffers grow at most once per flush
+	std::vector<uint32_t> tiles = rtin->refresh(x0, z0, x1, z1);
+	std::vector<std::vector<TerrainVertex> > tileVertices(tiles.size());
+	std::vector<std::vector<uint32_t> > tileIndices(tiles.size());
+	for(size_t i = 0; i < tiles.size(); i++)
+	{
+		rtin->buildTile(tiles[i], errorTolerance, tileVertices[i], tileIndices[i]);
+		const TerrainRtinSlot &slot = rtin->reserve(tiles[i], static_cast<uint32_t>(tileVertices[i].size()),
+		                                            static_cast<uint32_t>(tileIndices[i].size()));
+
+		TerrainChunk &chunk = chunks[tiles[i]];
+		chunk.firstIndex = slot.firstIndex;
+		chunk.indexCount = static_cast<uint32_t>(tileIndices[i].size());
+		chunk.vertexOffset = static_cast<int32_t>(slot.firstVertex);
+		chunk.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+		chunk.boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+		for(auto &&vertex : tileVertices[i])
+		{
+			chunk.boundsMin = glm::min(chunk.boundsMin, vertex.position);
+			chunk.boundsMax = glm::max(chunk.boundsMax, vertex.position);
+		}
+	}
+
+	//Grown by half again so a run of strokes doesn't copy the whole mesh each time
+	VkDeviceSize indexSize = indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+	if(rtin->getVertexCount() > vertexCapacity)
+	{
+		uint32_t capacity = std::max(rtin->getVertexCount(), vertexCapacity + vertexCapacity / 2);
+		growBuffer(vertexBuffer, vertexBufferMemory, sizeof(TerrainVertex) * vertexCapacity,
+		           sizeof(TerrainVertex) * capacity, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, ring);
+		vertexCapacity = capacity;
+	}
+	if(rtin->getIndexCount() > indexCapacity)
+	{
+		uint32_t capacity = std::max(rtin->getIndexCount(), indexCapacity + indexCapacity / 2);
+		growBuffer(indexBuffer, indexBufferMemory, indexSize * indexCapacity, indexSize * capacity,
+		           VK_BUFFER_USAGE_INDEX_BUFFER_BIT, ring);
+		indexCapacity = capacity;
+	}
+
+	std::vector<uint16_t> narrowIndices;
+	for(size_t i = 0; i < tiles.size(); i++)
+	{
+		const TerrainChunk &chunk = chunks[tiles[i]];
+		VkBufferCopy copyRegion = {};
+		copyRegion.size = sizeof(TerrainVertex) * tileVertices[i].size();
+		copyRegion.dstOffset = sizeof(TerrainVertex) * chunk.vertexOffset;
+		memcpy(ring->allocate(copyRegion.size, copyRegion.srcOffset), tileVertices[i].data(), copyRegion.size);
+		vkCmdCopyBuffer(ring->commands(), ring->getBuffer(), vertexBuffer, 1, &copyRegion);
+
+		//Tile relative indices always fit a buffer that was narrowed
+		const void* indexData = tileIndices[i].data();
+		if(indexType == VK_INDEX_TYPE_UINT16)
+		{
+			narrowIndices.assign(tileIndices[i].begin(), tileIndices[i].end());
+			indexData = narrowIndices.data();
+		}
+		copyRegion.size = indexSize * chunk.indexCount;
+		copyRegion.dstOffset = indexSize * chunk.firstIndex;
+		memcpy(ring->allocate(copyRegion.size, copyRegion.srcOffset), indexData, copyRegion.size);
+		vkCmdCopyBuffer(ring->commands(), ring->getBuffer(), indexBuffer, 1, &copyRegion);
+	}
+}
+
+void Terrain::growBuffer(VkBuffer &buffer, VkDeviceMemory &bufferMemory, VkDeviceSize oldSize, VkDeviceSize newSize,
+                         VkBufferUsageFlags usage, StagingRing* ring)
+{
+	VkBuffer grown;
+	VkDeviceMemory grownMemory;
+	vki->createBuffer(newSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage,
+	                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, grown, grownMemory);
+
+	VkBufferCopy copyRegion = {};
+	copyRegion.size = oldSize;
+	vkCmdCopyBuffer(ring->commands(), buffer, grown, 1, &copyRegion);
+
+	//Tile writes later in the same flush land on top of what was just copied
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	vkCmdPipelineBarrier(ring->commands(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+	                     0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	//Command buffers are recorded again every frame, so nothing else refers to the old buffer
+	ring->destroyAfterFlush(buffer, bufferMemory);
+	buffer = grown;
+	bufferMemory = grownMemory;
+	Logger() << "Terrain buffer grown to " << newSize / 1024 << "KB";
+}
+
+void Terrain::refreshChunkBounds(uint32_t x0, uint32_t z0, uint32_t x1, uint32_t z1, uint32_t cellsPerChunk)
+{
+	//Chunks are square blocks of cells in row order, samples on a block edge belong to both sides
+	uint32_t chunksX = (heightfield.width - 2) / cellsPerChunk + 1;
+	uint32_t chunksZ = (heightfield.depth - 2) / cellsPerChunk + 1;
+	uint32_t firstX = x0 > 0 ? (x0 - 1) / cellsPerChunk : 0;
+	uint32_t firstZ = z0 > 0 ? (z0 - 1) / cellsPerChunk : 0;
+	uint32_t lastX = std::min(x1 / cellsPerChunk, chunksX - 1);
+	uint32_t lastZ = std::min(z1 / cellsPerChunk, chunksZ - 1);
+
+	for(uint32_t cz = firstZ; cz <= lastZ; cz++)
+	{
+		for(uint32_t cx = firstX; cx <= lastX; cx++)
+		{
+			float minY = std::numeric_limits<float>::max();
+			float maxY = -std::numeric_limits<float>::max();
+			uint32_t endX = std::min((cx + 1) * cellsPerChunk, heightfield.width - 1);
+			uint32_t endZ = std::min((cz + 1) * cellsPerChunk, heightfield.depth - 1);
+			for(uint32_t z = cz * cellsPerChunk; z <= endZ; z++)
+			{
+				for(uint32_t x = cx * cellsPerChunk; x <= endX; x++)
+				{
+					float h = heightfield.heights[z * heightfield.width + x];
+					minY = std::min(minY, h);
+					maxY = std::max(maxY, h);
+				}
+			}
+			TerrainChunk &chunk = chunks[cz * chunksX + cx];
+			chunk.boundsMin.y = minY;
+			chunk.boundsMax.y = maxY;
+		}
+	}
+}
+
+void Terrain::buildMonolithic()
+{
+	auto vertWidth = static_cast<int>(heightfield.width);
+	auto vertHeight = static_cast<int>(heightfield.depth);
+	int tileWidth = vertWidth-1;
+	int tileHeight = vertHeight-1;
+
+	//Each vertex gathers its normal from neighbouring heights, so rows are independent
+	//and the result doesn't depend on how they're split between threads
+	vertices.resize(static_cast<uint32_t>(vertWidth * vertHeight));
+	auto threadCount = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+	GenericThreadPool rowPool(threadCount);
+	for(int firstRow = 0; firstRow < vertHeight; firstRow += TERRAIN_ROWS_PER_JOB)
+	{
+		int lastRow = std::min(firstRow + TERRAIN_ROWS_PER_JOB, vertHeight);
+		rowPool.addJob([this, firstRow, lastRow, vertWidth]
+		{
+			std::vector<glm::vec3> rowNormals(static_cast<uint32_t>(vertWidth));
+			for(int i = firstRow; i < lastRow; i++)
+			{
+				heightfield.normalRow(i, rowNormals.data());
+				TerrainVertex* row = &vertices[i * vertWidth];
+				for(int j = 0; j < vertWidth; j++)
+				{
+					row[j].position = heightfield.position(j, i);
+					row[j].normal = rowNormals[j];
+				}
+			}
+		});
+	}
+	rowPool.wait();
+	rowPool.destroy();
+
+	//Indices are grouped by block of cells so each block can be culled as one range
+	indices.reserve(static_cast<uint32_t>(tileWidth*tileHeight * 6));
+	for(int chunkZ = 0; chunkZ < tileHeight; chunkZ += TERRAIN_CULL_CHUNK_CELLS)
+	{
+		for(int chunkX = 0; chunkX < tileWidth; chunkX += TERRAIN_CULL_CHUNK_CELLS)
+		{
+			int lastZ = std::min(chunkZ + TERRAIN_CULL_CHUNK_CELLS, tileHeight);
+			int lastX = std::min(chunkX + TERRAIN_CULL_CHUNK_CELLS, tileWidth);
+
+			TerrainChunk chunk = {};
+			chunk.firstIndex = static_cast<uint32_t>(indices.size());
+			chunk.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+			chunk.boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+			for(int i = chunkZ; i < lastZ; i++)
+			{
+				for(int j = chunkX; j < lastX; j++)
+				{
+					indices.emplace_back((i+1)*vertWidth + j+1);
+					indices.emplace_back(i*vertWidth + j+1);
+					indices.emplace_back(i*vertWidth + j);
+
+					indices.emplace_back(i*vertWidth + j);
+					indices.emplace_back((i+1)*vertWidth + j);
+					indices.emplace_back((i+1)*vertWidth + j+1);
+				}
+			}
+			for(int i = chunkZ; i <= lastZ; i++)
+			{
+				for(int j = chunkX; j <= lastX; j++)
+				{
+					chunk.boundsMin = glm::min(chunk.boundsMin, vertices[i * vertWidth + j].position);
+					chunk.boundsMax = glm::max(chunk.boundsMax, vertices[i * vertWidth + j].position);
+				}
+			}
+			chunk.indexCount = static_cast<uint32_t>(indices.size()) - chunk.firstIndex;
+			chunks.emplace_back(chunk);
+		}
+	}
 }
 
 void Terrain::createTexture()
 {
-	texture = new Texture(vki, {"images/rock.jpg", "images/sand.jpg"}, false);
+	texture = vki->assets->acquireTexture({"images/rock.jpg", "images/sand.jpg"}, false);
+}
+
+void Terrain::createFoliage()
+{
+	//Grass on gentle slopes below the peaks, sparse dry tufts along the low ground
+	FoliageType grass = {};
+	grass.texture = "images/grass.jpg";
+	grass.density = 300.0f;
+	grass.minUp = 0.85f;
+	grass.minHeight = 0.0f;
+	grass.maxHeight = 0.6f;
+	grass.minScale = 0.08f;
+	grass.maxScale = 0.16f;
+	grass.drawDistance = 12.0f;
+
+	FoliageType tufts = {};
+	tufts.texture = "images/sand.jpg";
+	tufts.density = 40.0f;
+	tufts.minUp = 0.7f;
+	tufts.minHeight = 0.0f;
+	tufts.maxHeight = 0.25f;
+	tufts.minScale = 0.12f;
+	tufts.maxScale = 0.25f;
+	tufts.drawDistance = 18.0f;
+
+	foliage = new TerrainFoliage(vki, &heightfield, query, {grass, tufts}, TERRAIN_FOLIAGE_SEED);
 }
 
 void Terrain::createDescriptor()
@@ -126,6 +773,30 @@ void Terrain::createDescriptor()
 	samplerLayoutBinding.pImmutableSamplers = nullptr; // Optional
 
 	std::vector<VkDescriptorSetLayoutBinding> bindings = {samplerLayoutBinding};
+	if(mode == TERRAIN_DISPLACED)
+	{
+		VkDescriptorSetLayoutBinding heightLayoutBinding = {};
+		heightLayoutBinding.binding = 1;
+		heightLayoutBinding.descriptorCount = 1;
+		heightLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		heightLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		heightLayoutBinding.pImmutableSamplers = nullptr;
+		bindings.emplace_back(heightLayoutBinding);
+	}
+	if(virtualTexture)
+	{
+		//Page cache then page table
+		for(uint32_t binding = 2; binding < 4; binding++)
+		{
+			VkDescriptorSetLayoutBinding pageLayoutBinding = {};
+			pageLayoutBinding.binding = binding;
+			pageLayoutBinding.descriptorCount = 1;
+			pageLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			pageLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+			pageLayoutBinding.pImmutableSamplers = nullptr;
+			bindings.emplace_back(pageLayoutBinding);
+		}
+	}
 	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
 	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
 	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
@@ -151,14 +822,32 @@ void Terrain::createDescriptor()
 	imageInfo.imageView = texture->texture.imageView;
 	imageInfo.sampler = texture->textureSampler;
 
-	std::array<VkWriteDescriptorSet, 1> descriptorWrites = {};
-	descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	descriptorWrites[0].dstSet = descriptorSet;
-	descriptorWrites[0].dstBinding = 0;
-	descriptorWrites[0].dstArrayElement = 0;
-	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	descriptorWrites[0].descriptorCount = 1;
-	descriptorWrites[0].pImageInfo = &imageInfo;
+	VkDescriptorImageInfo heightInfo = {};
+	heightInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	heightInfo.imageView = heightTexture.imageView;
+	heightInfo.sampler = heightSampler;
+
+	VkDescriptorImageInfo pageCacheInfo = {};
+	VkDescriptorImageInfo pageTableInfo = {};
+	if(virtualTexture)
+	{
+		pageCacheInfo = virtualTexture->getPageCacheInfo();
+		pageTableInfo = virtualTexture->getPageTableInfo();
+	}
+
+	//Indexed by binding, only the bindings in the layout are written
+	const VkDescriptorImageInfo* bindingInfos[] = {&imageInfo, &heightInfo, &pageCacheInfo, &pageTableInfo};
+	std::vector<VkWriteDescriptorSet> descriptorWrites(bindings.size());
+	for(uint32_t i = 0; i < descriptorWrites.size(); i++)
+	{
+		descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[i].dstSet = descriptorSet;
+		descriptorWrites[i].dstBinding = bindings[i].binding;
+		descriptorWrites[i].dstArrayElement = 0;
+		descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		descriptorWrites[i].descriptorCount = 1;
+		descriptorWrites[i].pImageInfo = bindingInfos[bindings[i].binding];
+	}
 
 	vkUpdateDescriptorSets(vki->logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
 }
@@ -182,6 +871,12 @@ void Terrain::createPipeline()
 {
 	auto bindingDescription = getBindingDescription();
 	auto attributeDescription = getAttributeDescription();
+	if(mode == TERRAIN_DISPLACED)
+	{
+		//Positions are rebuilt from gl_VertexIndex
+		bindingDescription.clear();
+		attributeDescription.clear();
+	}
 
 	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
 	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
@@ -290,7 +985,8 @@ void Terrain::createPipeline()
 	dynamicState.pDynamicStates = dynamicStates;*/
 
 	VkPushConstantRange pushConstantRange = {};
-	pushConstantRange.size = sizeof(PushConstantBufferObject);
+	pushConstantRange.size = mode == TERRAIN_DISPLACED ? sizeof(TerrainPushConstantBufferObject)
+	                                                   : sizeof(PushConstantBufferObject);
 	pushConstantRange.offset = 0;
 	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
@@ -306,10 +1002,30 @@ void Terrain::createPipeline()
 	Logger() << "Pipeline layout created";
 
 	std::vector<VkPipelineShaderStageCreateInfo> shaderStages = {
-			vki->loadShaderModule("shaders/terrain.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
-			vki->loadShaderModule("shaders/terrain.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT)
+			vki->loadShaderModule(mode == TERRAIN_DISPLACED ? "shaders/terrainDisplaced.vert.spv"
+			                                                : "shaders/terrain.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
+			vki->loadShaderModule(virtualTexture ? "shaders/terrainVirtual.frag.spv"
+			                                     : "shaders/terrain.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT)
 	};
 
+	//Page layout is fixed for the terrain's lifetime so it is baked into the shader
+	TerrainVirtualTextureConstants virtualConstants = {};
+	std::vector<VkSpecializationMapEntry> specializationEntries;
+	VkSpecializationInfo specializationInfo = {};
+	if(virtualTexture)
+	{
+		virtualConstants = virtualTexture->getConstants();
+		for(uint32_t i = 0; i < sizeof(virtualConstants) / sizeof(float); i++)
+		{
+			specializationEntries.emplace_back(VkSpecializationMapEntry{i, static_cast<uint32_t>(i * sizeof(float)), sizeof(float)});
+		}
+		specializationInfo.mapEntryCount = static_cast<uint32_t>(specializationEntries.size());
+		specializationInfo.pMapEntries = specializationEntries.data();
+		specializationInfo.dataSize = sizeof(virtualConstants);
+		specializationInfo.pData = &virtualConstants;
+		shaderStages[1].pSpecializationInfo = &specializationInfo;
+	}
+
 	VkGraphicsPipelineCreateInfo pipelineInfo = {};
 	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
 	pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
@@ -360,13 +1076,44 @@ void Terrain::updateCommandBuffer(VkCommandBufferInheritanceInfo inheritanceInfo
 
 	VkDeviceSize offsets[] = {0};
 	vkCmdBindVertexBuffers(commandBuffer, 0,1, &vertexBuffer, offsets);
-	vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0,VK_INDEX_TYPE_UINT32);
-	vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()),
-	                 1, 0, 0, 0);
+	vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, indexType);
+
+	cullChunks(chunks);
+	drawVisibleChunks(chunks);
 
 	VK_RESULT_CHECK(vkEndCommandBuffer(commandBuffer));
+}
+
+void Terrain::cullChunks(const std::vector<TerrainChunk> &candidates)
+{
+	culler.cull(candidates, vki->pushConstant.proj * vki->pushConstant.view, viewPosition, visibleChunks);
+}
+
+void Terrain::drawVisibleChunks(const std::vector<TerrainChunk> &candidates)
+{
+	//Back in index order so neighbouring ranges merge into one draw
+	std::sort(visibleChunks.begin(), visibleChunks.end());
 
-	commandBufferFilled = true;
+	drawnTriangles = 0;
+	size_t i = 0;
+	while(i < visibleChunks.size())
+	{
+		const TerrainChunk &first = candidates[visibleChunks[i]];
+		uint32_t count = first.indexCount;
+		size_t next = i + 1;
+		while(next < visibleChunks.size())
+		{
+			const TerrainChunk &chunk = candidates[visibleChunks[next]];
+			if(chunk.firstIndex != first.firstIndex + count || chunk.vertexOffset != first.vertexOffset)
+				break;
+			count += chunk.indexCount;
+			next++;
+		}
+
+		vkCmdDrawIndexed(commandBuffer, count, 1, first.firstIndex, first.vertexOffset, 0);
+		drawnTriangles += count / 3;
+		i = next;
+	}
 }
 
 void Terrain::updatePushConstantCommandBuffer(VkCommandBufferInheritanceInfo inheritanceInfo)
@@ -389,35 +1136,208 @@ void Terrain::updatePushConstantCommandBuffer(VkCommandBufferInheritanceInfo inh
 	VK_RESULT_CHECK(vkEndCommandBuffer(pushConstantCommandBuffer));
 }
 
+void Terrain::updateChunkedCommandBuffer(VkCommandBufferInheritanceInfo inheritanceInfo)
+{
+	quadtree->select(viewPosition, selection);
+
+	//Every patch shares the index buffer, the vertex offset picks its block
+	frameChunks.clear();
+	for(auto &&node : selection)
+	{
+		TerrainChunk chunk = {};
+		chunk.boundsMin = node->boundsMin;
+		chunk.boundsMax = node->boundsMax;
+		chunk.firstIndex = 0;
+		chunk.indexCount = quadtree->getIndicesPerNode();
+		chunk.vertexOffset = node->vertexOffset;
+		frameChunks.emplace_back(chunk);
+	}
+	cullChunks(frameChunks);
+
+	VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	commandBufferBeginInfo.pInheritanceInfo = &inheritanceInfo;
+
+	vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1,
+	                        &descriptorSet, 0, nullptr);
+
+	PushConstantBufferObject pushConstant = {};
+	pushConstant.view = vki->pushConstant.view;
+	pushConstant.proj = vki->pushConstant.proj;
+	pushConstant.model = glm::mat4(1.0f);
+
+	vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+	                   sizeof(pushConstant), &pushConstant);
+
+	VkDeviceSize offsets[] = {0};
+	vkCmdBindVertexBuffers(commandBuffer, 0,1, &vertexBuffer, offsets);
+	vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, indexType);
+
+	drawVisibleChunks(frameChunks);
+
+	VK_RESULT_CHECK(vkEndCommandBuffer(commandBuffer));
+}
+
+void Terrain::updateStreamedCommandBuffer(VkCommandBufferInheritanceInfo inheritanceInfo)
+{
+	streamer->update(viewPosition);
+	streamer->getResidentTiles(residentTiles);
+
+	frameChunks.clear();
+	for(auto &&tile : residentTiles)
+	{
+		TerrainChunk chunk = {};
+		chunk.boundsMin = tile->boundsMin;
+		chunk.boundsMax = tile->boundsMax;
+		chunk.indexCount = indexCount;
+		frameChunks.emplace_back(chunk);
+	}
+	cullChunks(frameChunks);
+
+	VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	commandBufferBeginInfo.pInheritanceInfo = &inheritanceInfo;
+
+	vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1,
+	                        &descriptorSet, 0, nullptr);
+
+	PushConstantBufferObject pushConstant = {};
+	pushConstant.view = vki->pushConstant.view;
+	pushConstant.proj = vki->pushConstant.proj;
+	pushConstant.model = glm::mat4(1.0f);
+
+	vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+	                   sizeof(pushConstant), &pushConstant);
+
+	vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, indexType);
+
+	//Tiles still loading are simply absent this frame
+	VkDeviceSize offsets[] = {0};
+	for(auto &&visible : visibleChunks)
+	{
+		vkCmdBindVertexBuffers(commandBuffer, 0,1, &residentTiles[visible]->vertexBuffer, offsets);
+		vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, 0);
+	}
+	drawnTriangles = static_cast<uint64_t>(visibleChunks.size()) * indexCount / 3;
+
+	VK_RESULT_CHECK(vkEndCommandBuffer(commandBuffer));
+}
+
+void Terrain::updateDisplacedCommandBuffer(VkCommandBufferInheritanceInfo inheritanceInfo)
+{
+	VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	commandBufferBeginInfo.pInheritanceInfo = &inheritanceInfo;
+
+	vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1,
+	                        &descriptorSet, 0, nullptr);
+
+	TerrainPushConstantBufferObject pushConstant = {};
+	pushConstant.view = vki->pushConstant.view;
+	pushConstant.proj = vki->pushConstant.proj;
+	pushConstant.gridParams = glm::vec4(displacedPatchSize, displacedPatchesX, heightfield.width, heightfield.depth);
+	pushConstant.spacing = glm::vec4(heightfield.spacingX, heightfield.spacingZ, 0, 0);
+
+	vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+	                   sizeof(pushConstant), &pushConstant);
+
+	vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, indexType);
+
+	//Runs of neighbouring visible patches become one instanced draw, firstInstance picks the patch
+	cullChunks(chunks);
+	std::sort(visibleChunks.begin(), visibleChunks.end());
+	size_t i = 0;
+	while(i < visibleChunks.size())
+	{
+		size_t next = i + 1;
+		while(next < visibleChunks.size() && visibleChunks[next] == visibleChunks[next - 1] + 1)
+			next++;
+		vkCmdDrawIndexed(commandBuffer, indexCount, static_cast<uint32_t>(next - i), 0, 0, visibleChunks[i]);
+		i = next;
+	}
+	drawnTriangles = static_cast<uint64_t>(visibleChunks.size()) * indexCount / 3;
+
+	VK_RESULT_CHECK(vkEndCommandBuffer(commandBuffer));
+}
+
 void Terrain::draw(std::vector<VkCommandBuffer> * commandBuffers, VkCommandBufferInheritanceInfo inheritanceInfo)
 {
-	if(!commandBufferFilled)
+	//Uploads are submitted ahead of the frame that draws with them
+	flushEdits();
+	if(virtualTexture)
+		virtualTexture->update(viewPosition, getStagingRing());
+	glm::mat4 viewProjection = vki->pushConstant.proj * vki->pushConstant.view;
+	if(foliage)
+	{
+		foliage->recordCull(getStagingRing(), viewProjection, viewPosition);
+		getStagingRing()->flush(VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+		                        VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+	}
+
+	if(mode == TERRAIN_DISPLACED)
+	{
+		updateDisplacedCommandBuffer(inheritanceInfo);
+		commandBuffers->emplace_back(commandBuffer);
+	}
+	else if(mode == TERRAIN_STREAMED)
+	{
+		updateStreamedCommandBuffer(inheritanceInfo);
+		commandBuffers->emplace_back(commandBuffer);
+	}
+	else if(mode == TERRAIN_CHUNKED)
+	{
+		//Selection changes with the view so the draws are recorded every frame
+		updateChunkedCommandBuffer(inheritanceInfo);
+		commandBuffers->emplace_back(commandBuffer);
+	}
+	else
+	{
+		//Visible chunks change with the view so the draws are recorded every frame
 		updateCommandBuffer(inheritanceInfo);
 
-	updatePushConstantCommandBuffer(inheritanceInfo);
+		updatePushConstantCommandBuffer(inheritanceInfo);
 
-	commandBuffers->emplace_back(pushConstantCommandBuffer);
-	commandBuffers->emplace_back(commandBuffer);
+		commandBuffers->emplace_back(pushConstantCommandBuffer);
+		commandBuffers->emplace_back(commandBuffer);
+	}
+
+	//After the ground so hidden blades fail the depth test
+	if(foliage)
+		foliage->draw(commandBuffers, inheritanceInfo, viewProjection, viewPosition);
 }
 
-void Terrain::createVertexBuffer()
+void Terrain::createVertexBuffer(const TerrainVertex* vertexData, size_t count)
 {
 	VkBuffer stagingBuffer;
 	VkDeviceMemory stagingBufferMemory;
 
-	VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
+	VkDeviceSize bufferSize = sizeof(TerrainVertex) * count;
 	vki->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
 	                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
 	                  stagingBuffer, stagingBufferMemory);
 
 	void* data;
 	vkMapMemory(vki->logicalDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, vertices.data(), bufferSize);
+	memcpy(data, vertexData, bufferSize);
 	vkUnmapMemory(vki->logicalDevice, stagingBufferMemory);
 
-	vki->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-	                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+	//Source of the copy when adaptive edits grow it
+	vki->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+	                  VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 	                  vertexBuffer, vertexBufferMemory);
+	vertexCapacity = static_cast<uint32_t>(count);
 
 	vki->copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
 
@@ -425,25 +1345,80 @@ void Terrain::createVertexBuffer()
 	vkFreeMemory(vki->logicalDevice, stagingBufferMemory, nullptr);
 }
 
-void Terrain::createIndexBuffer()
+void Terrain::createIndexBuffer(const uint32_t* indexData, size_t count)
 {
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
-	vki->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-	                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-	                  stagingBuffer, stagingBufferMemory);
-	void* data;
-	vkMapMemory(vki->logicalDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, indices.data(), bufferSize);
-	vkUnmapMemory(vki->logicalDevice, stagingBufferMemory);
+	//Chunk indices are relative to their vertex offset, so chunked and adaptive terrain narrow even when large
+	indexCount = static_cast<uint32_t>(count);
+	indexCapacity = indexCount;
+	indexType = vki->createIndexBuffer(indexData, count, VK_INDEX_TYPE_UINT32, indexBuffer, indexBufferMemory);
+}
 
-	vki->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-	                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-	                  indexBuffer, indexBufferMemory);
+void Terrain::setViewPosition(glm::vec3 position)
+{
+	viewPosition = position;
+}
 
-	vki->copyBuffer(stagingBuffer, indexBuffer, bufferSize);
+void Terrain::setLodFactor(float factor)
+{
+	if(quadtree)
+		quadtree->setLodFactor(factor);
+}
 
-	vkDestroyBuffer(vki->logicalDevice, stagingBuffer, nullptr);
-	vkFreeMemory(vki->logicalDevice, stagingBufferMemory, nullptr);
+float Terrain::heightAt(float x, float z) const
+{
+	if(!query)
+		return 0;
+	return query->heightAt(x, z);
+}
+
+glm::vec3 Terrain::normalAt(float x, float z) const
+{
+	if(!query)
+		return glm::vec3(0, 1, 0);
+	return query->normalAt(x, z);
+}
+
+bool Terrain::raycast(const TerrainRay &ray, TerrainHit &hit) const
+{
+	if(!query)
+	{
+		hit = {};
+		return false;
+	}
+	return query->raycast(ray, hit);
+}
+
+void Terrain::raycast(const std::vector<TerrainRay> &rays, std::vector<TerrainHit> &hits)
+{
+	if(!query)
+	{
+		hits.assign(rays.size(), TerrainHit{});
+		return;
+	}
+	query->raycast(rays, hits);
+}
+
+TerrainStreamer* Terrain::getStreamer() const
+{
+	return streamer;
+}
+
+TerrainMode Terrain::getMode() const
+{
+	return mode;
+}
+
+uint64_t Terrain::getDrawnTriangleCount() const
+{
+	return drawnTriangles;
+}
+
+const TerrainCullStats& Terrain::getCullStats() const
+{
+	return culler.getStats();
+}
+
+void Terrain::setHorizonCulling(bool enabled)
+{
+	culler.setHorizonCulling(enabled);
 }
\ No newline at end of file
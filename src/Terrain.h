@@ -9,9 +9,24 @@
 #include <vector>
 #include <vulkan/vulkan.h>
 #include <string>
+#include "Heightfield.h"
+#include "ImageAttachment.h"
+#include "TerrainCuller.h"
 
 class VulkanInterface;
 class Texture;
+class TerrainQuadtree;
+class TerrainStreamer;
+struct TerrainNode;
+struct TerrainTile;
+class HeightfieldQuery;
+class TerrainRtin;
+class StagingRing;
+class TerrainVirtualTexture;
+class TerrainFoliage;
+class TerrainCache;
+struct TerrainRay;
+struct TerrainHit;
 
 struct TerrainVertex
 {
@@ -19,33 +34,127 @@ struct TerrainVertex
 	glm::vec3 normal;
 };
 
+enum TerrainMode
+{
+	//One grid vertex per heightmap sample, drawn in full every frame
+	TERRAIN_MONOLITHIC,
+	//Quadtree of patches selected by distance from the viewer
+	TERRAIN_CHUNKED,
+	//Tiles paged in around the viewer from a memory mapped tile file
+	TERRAIN_STREAMED,
+	//One shared grid patch instanced across the terrain, heights read from a texture in the vertex shader
+	TERRAIN_DISPLACED,
+	//Right triangulated irregular network, flat areas collapse to a few large triangles
+	TERRAIN_ADAPTIVE
+};
+
+enum TerrainBrushMode
+{
+	TERRAIN_BRUSH_RAISE,
+	TERRAIN_BRUSH_LOWER,
+	TERRAIN_BRUSH_FLATTEN
+};
+
+struct TerrainBrush
+{
+	TerrainBrushMode mode;
+	//World space, the effect fades smoothly to nothing at the edge
+	float radius;
+	//Height change per second at the centre, flatten covers this fraction of the gap per second
+	float strength;
+	//Flatten only
+	float targetHeight;
+};
+
 class Terrain
 {
 	VulkanInterface* vki;
+	TerrainMode mode;
+	std::string filename;
+	//Mapped by loadFile and consumed by upload when the built mesh was cached
+	TerrainCache* cache = nullptr;
+
+	Heightfield heightfield;
+	TerrainQuadtree* quadtree = nullptr;
+	std::vector<const TerrainNode*> selection;
+	TerrainStreamer* streamer = nullptr;
+	HeightfieldQuery* query = nullptr;
+	TerrainRtin* rtin = nullptr;
+	float errorTolerance = 0.1f;
+
+	//Index ranges with bounds, fixed for monolithic, adaptive and displaced terrain
+	std::vector<TerrainChunk> chunks;
+	//Rebuilt every frame from the quadtree selection or resident tiles
+	std::vector<TerrainChunk> frameChunks;
+	std::vector<uint32_t> visibleChunks;
+	TerrainCuller culler;
+	std::vector<const TerrainTile*> residentTiles;
+	uint32_t displacedPatchSize = 32;
+	uint32_t displacedPatchesX = 0;
+	uint32_t displacedPatchesZ = 0;
+	ImageAttachment heightTexture = {};
+	VkSampler heightSampler = VK_NULL_HANDLE;
+	glm::vec3 viewPosition;
+	uint64_t drawnTriangles = 0;
+
+	//Samples edited since the mesh was last brought up to date
+	bool heightsDirty = false;
+	uint32_t dirtyMinX = 0;
+	uint32_t dirtyMinZ = 0;
+	uint32_t dirtyMaxX = 0;
+	uint32_t dirtyMaxZ = 0;
+	StagingRing* stagingRing = nullptr;
+	//Baked material pages, every mode except streamed
+	TerrainVirtualTexture* virtualTexture = nullptr;
+	//Scattered over every mode except streamed
+	TerrainFoliage* foliage = nullptr;
+
+	//World size the heightmap image is stretched over
+	float desiredWidth = 50;
+	float desiredHeight = 10;
+	float desiredDepth = 50;
 
 	std::vector<TerrainVertex> vertices;
 	std::vector<uint32_t> indices;
+	uint32_t indexCount = 0;
+	VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+	//Elements the buffers hold, adaptive edits grow them when tiles move past the end
+	uint32_t vertexCapacity = 0;
+	uint32_t indexCapacity = 0;
 
-	Texture* texture;
+	Texture* texture = nullptr;
 
-	VkBuffer vertexBuffer;
-	VkDeviceMemory vertexBufferMemory;
-	VkBuffer indexBuffer;
-	VkDeviceMemory indexBufferMemory;
+	VkBuffer vertexBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory vertexBufferMemory = VK_NULL_HANDLE;
+	VkBuffer indexBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory indexBufferMemory = VK_NULL_HANDLE;
 
-	VkPipeline pipeline;
-	VkPipelineLayout pipelineLayout;
-	VkDescriptorSetLayout descriptorSetLayout;
-	VkDescriptorSet descriptorSet;
-	bool commandBufferFilled = false;
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+	VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
 	VkCommandBuffer commandBuffer = nullptr;
 	VkCommandBuffer pushConstantCommandBuffer = nullptr;
 
-	void loadData(std::string filename);
-	void createVertexBuffer();
-	void createIndexBuffer();
+	void loadHeightfield();
+	void buildMonolithic();
+	void buildChunked();
+	void buildStreamed();
+	void buildDisplaced();
+	void buildAdaptive();
+	void createHeightTexture();
+	StagingRing* getStagingRing();
+	void flushEdits();
+	void refreshChunkBounds(uint32_t x0, uint32_t z0, uint32_t x1, uint32_t z1, uint32_t cellsPerChunk);
+	void refreshAdaptive(uint32_t x0, uint32_t z0, uint32_t x1, uint32_t z1, StagingRing* ring);
+	void growBuffer(VkBuffer &buffer, VkDeviceMemory &bufferMemory, VkDeviceSize oldSize, VkDeviceSize newSize,
+	                VkBufferUsageFlags usage, StagingRing* ring);
+	bool loadCache(const std::string &cacheFilename, uint64_t key);
+	void createVertexBuffer(const TerrainVertex* data, size_t count);
+	void createIndexBuffer(const uint32_t* data, size_t count);
 
 	void createTexture();
+	void createFoliage();
 	void createDescriptor();
 	std::vector<VkVertexInputBindingDescription> getBindingDescription();
 	std::vector<VkVertexInputAttributeDescription> getAttributeDescription();
@@ -53,11 +162,48 @@ class Terrain
 	void allocateCommandBuffers();
 	void updateCommandBuffer(VkCommandBufferInheritanceInfo inheritanceInfo);
 	void updatePushConstantCommandBuffer(VkCommandBufferInheritanceInfo inheritanceInfo);
+	void updateChunkedCommandBuffer(VkCommandBufferInheritanceInfo inheritanceInfo);
+	void cullChunks(const std::vector<TerrainChunk> &candidates);
+	void drawVisibleChunks(const std::vector<TerrainChunk> &candidates);
+	void updateStreamedCommandBuffer(VkCommandBufferInheritanceInfo inheritanceInfo);
+	void updateDisplacedCommandBuffer(VkCommandBufferInheritanceInfo inheritanceInfo);
 
 public:
-	explicit Terrain(VulkanInterface* inVulkan, std::string filename);
+	//Deferred leaves loadFile and upload to the caller so the heightmap can be read on a worker
+	explicit Terrain(VulkanInterface* inVulkan, std::string inFilename, TerrainMode inMode = TERRAIN_MONOLITHIC,
+	                 bool deferred = false);
 	~Terrain();
 
+	//Decodes the heightmap or maps the cache and builds the mesh, safe off the main thread
+	void loadFile();
+	//Creates the buffers, textures and pipeline, nothing may be drawn or edited before it
+	void upload();
+
+	void setViewPosition(glm::vec3 position);
+	//Chunked mode only, a patch splits when the viewer is closer than factor times its size
+	void setLodFactor(float factor);
+	//Adaptive mode only, largest vertical distance allowed between the mesh and the heightfield
+	void setErrorTolerance(float tolerance);
+	//Streamed mode only
+	TerrainStreamer* getStreamer() const;
+	//Queries follow the full resolution heightfield, streamed terrain reports no ground
+	float heightAt(float x, float z) const;
+	glm::vec3 normalAt(float x, float z) const;
+	bool raycast(const TerrainRay &ray, TerrainHit &hit) const;
+	void raycast(const std::vector<TerrainRay> &rays, std::vector<TerrainHit> &hits);
+
+	//Copies a rectangle of the heightfield into the height texture after an edit, streamed terrain has none
+	void uploadHeightRegion(uint32_t x, uint32_t z, uint32_t width, uint32_t depth);
+	//Changes heights under the brush around a world space point, scaled by the frame time. The mesh
+	//catches up when the next frame is recorded by re-uploading only the vertices that moved.
+	//Adaptive terrain triangulates again only the tiles around the edit.
+	void applyBrush(const TerrainBrush &brush, float x, float z, float deltaTime);
+	TerrainMode getMode() const;
+	uint64_t getDrawnTriangleCount() const;
+	//Chunk counts from the last recorded frame
+	const TerrainCullStats& getCullStats() const;
+	void setHorizonCulling(bool enabled);
+
 	void draw(std::vector<VkCommandBuffer> * commandBuffers,
 	          VkCommandBufferInheritanceInfo inheritanceInfo);
 };
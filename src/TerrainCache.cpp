@@ -0,0 +1,134 @@
+#include "TerrainCache.h"
+#include "logger.h"
+#include <fstream>
+#include <stdexcept>
+
+#define FNV_OFFSET_BASIS 14695981039346656037ull
+#define FNV_PRIME 1099511628211ull
+
+static uint64_t fnv1a(uint64_t hash, const char* data, size_t size)
+{
+	for(size_t i = 0; i < size; i++)
+	{
+		hash ^= static_cast<unsigned char>(data[i]);
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+uint64_t TerrainCache::makeKey(const std::string &source, const std::vector<float> &parameters)
+{
+	MappedFile sourceFile(source);
+	uint64_t hash = fnv1a(FNV_OFFSET_BASIS, sourceFile.data(), sourceFile.size());
+	hash = fnv1a(hash, reinterpret_cast<const char*>(parameters.data()), sizeof(float) * parameters.size());
+	uint32_t version = TERRAIN_CACHE_VERSION;
+	return fnv1a(hash, reinterpret_cast<const char*>(&version), sizeof(version));
+}
+
+void TerrainCache::write(const std::string &filename, uint64_t key, const Heightfield &heightfield,
+                         const std::vector<TerrainNode> &nodes, const std::vector<TerrainChunk> &chunks,
+                         const std::vector<TerrainVertex> &vertices, const std::vector<uint32_t> &indices)
+{
+	TerrainCacheHeader cacheHeader = {};
+	cacheHeader.magic = TERRAIN_CACHE_MAGIC;
+	cacheHeader.version = TERRAIN_CACHE_VERSION;
+	cacheHeader.key = key;
+	cacheHeader.width = heightfield.width;
+	cacheHeader.depth = heightfield.depth;
+	cacheHeader.spacingX = heightfield.spacingX;
+	cacheHeader.spacingZ = heightfield.spacingZ;
+	cacheHeader.nodeCount = static_cast<uint32_t>(nodes.size());
+	cacheHeader.chunkCount = static_cast<uint32_t>(chunks.size());
+	cacheHeader.vertexCount = vertices.size();
+	cacheHeader.indexCount = indices.size();
+	cacheHeader.heightsOffset = sizeof(TerrainCacheHeader);
+	cacheHeader.nodesOffset = cacheHeader.heightsOffset + sizeof(float) * heightfield.heights.size();
+	cacheHeader.chunksOffset = cacheHeader.nodesOffset + sizeof(TerrainNode) * nodes.size();
+	cacheHeader.verticesOffset = cacheHeader.chunksOffset + sizeof(TerrainChunk) * chunks.size();
+	cacheHeader.indicesOffset = cacheHeader.verticesOffset + sizeof(TerrainVertex) * vertices.size();
+
+	std::ofstream stream(filename.c_str(), std::ios::binary);
+	if(!stream.is_open())
+	{
+		Logger() << "Could not write terrain cache " << filename;
+		return;
+	}
+	stream.write(reinterpret_cast<const char*>(&cacheHeader), sizeof(cacheHeader));
+	stream.write(reinterpret_cast<const char*>(heightfield.heights.data()), sizeof(float) * heightfield.heights.size());
+	stream.write(reinterpret_cast<const char*>(nodes.data()), sizeof(TerrainNode) * nodes.size());
+	stream.write(reinterpret_cast<const char*>(chunks.data()), sizeof(TerrainChunk) * chunks.size());
+	stream.write(reinterpret_cast<const char*>(vertices.data()), sizeof(TerrainVertex) * vertices.size());
+	stream.write(reinterpret_cast<const char*>(indices.data()), sizeof(uint32_t) * indices.size());
+
+	Logger() << "Terrain cache " << filename << " written";
+}
+
+bool TerrainCache::open(const std::string &filename, uint64_t key)
+{
+	close();
+
+	std::ifstream exists(filename.c_str());
+	if(!exists.good())
+		return false;
+	exists.close();
+
+	try
+	{
+		file.open(filename);
+	}
+	catch(const std::runtime_error &e)
+	{
+		Logger() << e.what();
+		return false;
+	}
+
+	header = reinterpret_cast<const TerrainCacheHeader*>(file.data());
+	bool valid = file.size() >= sizeof(TerrainCacheHeader) &&
+	             header->magic == TERRAIN_CACHE_MAGIC &&
+	             header->version == TERRAIN_CACHE_VERSION &&
+	             header->key == key &&
+	             file.size() >= header->indicesOffset + sizeof(uint32_t) * header->indexCount;
+	if(!valid)
+	{
+		Logger() << "Terrain cache " << filename << " is stale";
+		close();
+		return false;
+	}
+	return true;
+}
+
+void TerrainCache::close()
+{
+	file.close();
+	header = nullptr;
+}
+
+const TerrainCacheHeader& TerrainCache::getHeader() const
+{
+	return *header;
+}
+
+const float* TerrainCache::heights() const
+{
+	return reinterpret_cast<const float*>(file.data() + header->heightsOffset);
+}
+
+const TerrainNode* TerrainCache::nodes() const
+{
+	return reinterpret_cast<const TerrainNode*>(file.data() + header->nodesOffset);
+}
+
+const TerrainChunk* TerrainCache::chunks() const
+{
+	return reinterpret_cast<const TerrainChunk*>(file.data() + header->chunksOffset);
+}
+
+const TerrainVertex* TerrainCache::vertices() const
+{
+	return reinterpret_cast<const TerrainVertex*>(file.data() + header->verticesOffset);
+}
+
+const uint32_t* TerrainCache::indices() const
+{
+	return reinterpret_cast<const uint32_t*>(file.data() + header->indicesOffset);
+}
@@ -0,0 +1,64 @@
+#ifndef VULKANITE_TERRAINCACHE_H
+#define VULKANITE_TERRAINCACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+#include "Heightfield.h"
+#include "Terrain.h"
+#include "TerrainQuadtree.h"
+#include "TerrainCuller.h"
+
+#define TERRAIN_CACHE_MAGIC 0x48435456 //"VTCH"
+#define TERRAIN_CACHE_VERSION 3
+
+struct TerrainCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	//Hash of the source image and every parameter that shaped the mesh
+	uint64_t key;
+	uint32_t width;
+	uint32_t depth;
+	float spacingX;
+	float spacingZ;
+	uint32_t nodeCount;
+	uint32_t chunkCount;
+	uint64_t vertexCount;
+	uint64_t indexCount;
+	//Byte offsets of each array from the start of the file
+	uint64_t heightsOffset;
+	uint64_t nodesOffset;
+	uint64_t chunksOffset;
+	uint64_t verticesOffset;
+	uint64_t indicesOffset;
+};
+
+//Built terrain written to disk so later runs skip decoding and meshing. Arrays are
+//read straight out of the mapping, a key mismatch means the source or settings changed.
+class TerrainCache
+{
+	MappedFile file;
+	const TerrainCacheHeader* header = nullptr;
+
+public:
+	//FNV-1a over the source file bytes followed by the parameters
+	static uint64_t makeKey(const std::string &source, const std::vector<float> &parameters);
+	static void write(const std::string &filename, uint64_t key, const Heightfield &heightfield,
+	                  const std::vector<TerrainNode> &nodes, const std::vector<TerrainChunk> &chunks,
+	                  const std::vector<TerrainVertex> &vertices, const std::vector<uint32_t> &indices);
+
+	//False when the cache is missing, truncated or built from something else
+	bool open(const std::string &filename, uint64_t key);
+	void close();
+
+	const TerrainCacheHeader& getHeader() const;
+	const float* heights() const;
+	const TerrainNode* nodes() const;
+	const TerrainChunk* chunks() const;
+	const TerrainVertex* vertices() const;
+	const uint32_t* indices() const;
+};
+
+#endif //VULKANITE_TERRAINCACHE_H
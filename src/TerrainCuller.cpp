@@ -0,0 +1,169 @@
+#include "TerrainCuller.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
+#include <glm/geometric.hpp>
+
+//Directions around the viewer the horizon is tracked in
+#define HORIZON_BINS 512
+
+static const float TWO_PI = 6.28318530718f;
+
+TerrainCuller::TerrainCuller() :
+	horizon(HORIZON_BINS)
+{
+}
+
+void TerrainCuller::cull(const std::vector<TerrainChunk> &chunks, const glm::mat4 &viewProjection, glm::vec3 eye,
+                         std::vector<uint32_t> &visible)
+{
+	frustum.update(viewProjection);
+	visible.clear();
+	candidates.clear();
+	stats = {};
+	stats.total = static_cast<uint32_t>(chunks.size());
+
+	for(uint32_t i = 0; i < chunks.size(); i++)
+	{
+		const TerrainChunk &chunk = chunks[i];
+		if(!frustum.intersects(chunk.boundsMin, chunk.boundsMax))
+		{
+			stats.frustumCulled++;
+			continue;
+		}
+		if(!horizonCulling)
+		{
+			visible.emplace_back(i);
+			continue;
+		}
+
+		Candidate candidate = {};
+		candidate.chunk = i;
+		glm::vec2 eyeXZ(eye.x, eye.z);
+		glm::vec2 closest = glm::clamp(eyeXZ, glm::vec2(chunk.boundsMin.x, chunk.boundsMin.z),
+		                               glm::vec2(chunk.boundsMax.x, chunk.boundsMax.z));
+		candidate.nearDistance = glm::distance(eyeXZ, closest);
+
+		//Angles are unwrapped around the first corner, a footprint not holding the eye spans under half a turn
+		glm::vec2 corners[4] = {
+				glm::vec2(chunk.boundsMin.x, chunk.boundsMin.z), glm::vec2(chunk.boundsMax.x, chunk.boundsMin.z),
+				glm::vec2(chunk.boundsMin.x, chunk.boundsMax.z), glm::vec2(chunk.boundsMax.x, chunk.boundsMax.z)
+		};
+		float base = std::atan2(corners[0].y - eye.z, corners[0].x - eye.x);
+		candidate.angleMin = candidate.angleMax = base;
+		for(auto &corner : corners)
+		{
+			glm::vec2 offset = corner - eyeXZ;
+			candidate.farDistance = std::max(candidate.farDistance, glm::length(offset));
+			float angle = std::atan2(offset.y, offset.x);
+			float delta = std::remainder(angle - base, TWO_PI);
+			candidate.angleMin = std::min(candidate.angleMin, base + delta);
+			candidate.angleMax = std::max(candidate.angleMax, base + delta);
+		}
+		candidates.emplace_back(candidate);
+	}
+
+	if(!horizonCulling)
+	{
+		stats.visible = static_cast<uint32_t>(visible.size());
+		return;
+	}
+
+	std::sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b)
+	{
+		return a.nearDistance < b.nearDistance;
+	});
+	std::fill(horizon.begin(), horizon.end(), -std::numeric_limits<float>::max());
+
+	//A chunk only occludes chunks wholly behind it, so it joins the horizon once the walk passes its far side
+	auto fartherFirst = [this](uint32_t a, uint32_t b)
+	{
+		return candidates[a].farDistance > candidates[b].farDistance;
+	};
+	std::priority_queue<uint32_t, std::vector<uint32_t>, decltype(fartherFirst)> pending(fartherFirst);
+
+	for(uint32_t i = 0; i < candidates.size(); i++)
+	{
+		const Candidate &candidate = candidates[i];
+		while(!pending.empty() && candidates[pending.top()].farDistance <= candidate.nearDistance)
+		{
+			const Candidate &occluder = candidates[pending.top()];
+			raiseHorizon(occluder, chunks[occluder.chunk].boundsMin.y, eye.y);
+			pending.pop();
+		}
+
+		//The chunk under the viewer has no direction to occlude in
+		if(candidate.nearDistance <= 0.0f)
+		{
+			visible.emplace_back(candidate.chunk);
+			continue;
+		}
+
+		if(belowHorizon(candidate, chunks[candidate.chunk].boundsMax.y, eye.y))
+		{
+			stats.horizonCulled++;
+			continue;
+		}
+		visible.emplace_back(candidate.chunk);
+		pending.push(i);
+	}
+	stats.visible = static_cast<uint32_t>(visible.size());
+}
+
+static int angleToBin(float angle)
+{
+	return static_cast<int>(std::floor(angle / TWO_PI * HORIZON_BINS));
+}
+
+static uint32_t wrapBin(int bin)
+{
+	return static_cast<uint32_t>(((bin % HORIZON_BINS) + HORIZON_BINS) % HORIZON_BINS);
+}
+
+void TerrainCuller::raiseHorizon(const Candidate &occluder, float minHeight, float eyeHeight)
+{
+	//Lowest sight line the ground under the chunk is guaranteed to block, anywhere across it
+	float rise = minHeight - eyeHeight;
+	float elevation = std::atan2(rise, rise < 0 ? occluder.nearDistance : occluder.farDistance);
+
+	//Only bins the footprint covers from edge to edge
+	auto first = static_cast<int>(std::ceil(occluder.angleMin / TWO_PI * HORIZON_BINS));
+	int last = angleToBin(occluder.angleMax) - 1;
+	for(int bin = first; bin <= last; bin++)
+	{
+		float &height = horizon[wrapBin(bin)];
+		height = std::max(height, elevation);
+	}
+}
+
+bool TerrainCuller::belowHorizon(const Candidate &candidate, float maxHeight, float eyeHeight) const
+{
+	//Highest sight line anything in the chunk could need
+	float rise = maxHeight - eyeHeight;
+	float elevation = std::atan2(rise, rise > 0 ? candidate.nearDistance : candidate.farDistance);
+
+	int first = angleToBin(candidate.angleMin);
+	int last = angleToBin(candidate.angleMax);
+	for(int bin = first; bin <= last; bin++)
+	{
+		if(horizon[wrapBin(bin)] <= elevation)
+			return false;
+	}
+	return true;
+}
+
+void TerrainCuller::setHorizonCulling(bool enabled)
+{
+	horizonCulling = enabled;
+}
+
+bool TerrainCuller::getHorizonCulling() const
+{
+	return horizonCulling;
+}
+
+const TerrainCullStats& TerrainCuller::getStats() const
+{
+	return stats;
+}
@@ -0,0 +1,63 @@
+#ifndef VULKANITE_TERRAINCULLER_H
+#define VULKANITE_TERRAINCULLER_H
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+#include <vector>
+#include <cstdint>
+#include "Frustum.h"
+
+//Range of a terrain index buffer covering one area, bounds include skirts
+struct TerrainChunk
+{
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	int32_t vertexOffset;
+};
+
+struct TerrainCullStats
+{
+	uint32_t total;
+	uint32_t visible;
+	uint32_t frustumCulled;
+	uint32_t horizonCulled;
+};
+
+//Frustum test per chunk followed by an optional horizon test. Chunks are walked front
+//to back around the viewer, ground below each chunk's minimum height raises the horizon
+//for every direction the chunk fully covers, and chunks whose top stays under it are dropped.
+class TerrainCuller
+{
+	Frustum frustum;
+	bool horizonCulling = true;
+	TerrainCullStats stats = {};
+	std::vector<float> horizon;
+
+	struct Candidate
+	{
+		uint32_t chunk;
+		float nearDistance;
+		float farDistance;
+		float angleMin;
+		float angleMax;
+	};
+	std::vector<Candidate> candidates;
+
+	void raiseHorizon(const Candidate &occluder, float minHeight, float eyeHeight);
+	bool belowHorizon(const Candidate &candidate, float maxHeight, float eyeHeight) const;
+
+public:
+	TerrainCuller();
+
+	//visible receives indices into chunks, in front to back order when the horizon test runs
+	void cull(const std::vector<TerrainChunk> &chunks, const glm::mat4 &viewProjection, glm::vec3 eye,
+	          std::vector<uint32_t> &visible);
+
+	void setHorizonCulling(bool enabled);
+	bool getHorizonCulling() const;
+	const TerrainCullStats& getStats() const;
+};
+
+#endif //VULKANITE_TERRAINCULLER_H
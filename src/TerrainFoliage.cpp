@@ -0,0 +1,608 @@
+#include "TerrainFoliage.h"
+#include "HeightfieldQuery.h"
+#include "StagingRing.h"
+#include "Frustum.h"
+#include "vulkanInterface.h"
+#include "logger.h"
+#include "GenericThreadPool.h"
+#include <thread>
+#include <random>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstring>
+
+TerrainFoliage::TerrainFoliage(VulkanInterface* inVulkan, const Heightfield* inHeightfield, const HeightfieldQuery* inQuery,
+                               std::vector<FoliageType> inTypes, uint32_t inSeed) :
+	vki(inVulkan),
+	heightfield(inHeightfield),
+	query(inQuery),
+	types(std::move(inTypes)),
+	seed(inSeed)
+{
+	auto minmax = std::minmax_element(heightfield->heights.begin(), heightfield->heights.end());
+	minHeight = *minmax.first;
+	maxHeight = *minmax.second;
+
+	uint32_t cellsX = heightfield->width - 1;
+	uint32_t cellsZ = heightfield->depth - 1;
+	chunksX = (cellsX + TERRAIN_FOLIAGE_CHUNK_CELLS - 1) / TERRAIN_FOLIAGE_CHUNK_CELLS;
+	chunksZ = (cellsZ + TERRAIN_FOLIAGE_CHUNK_CELLS - 1) / TERRAIN_FOLIAGE_CHUNK_CELLS;
+	chunkSizeX = TERRAIN_FOLIAGE_CHUNK_CELLS * heightfield->spacingX;
+	chunkSizeZ = TERRAIN_FOLIAGE_CHUNK_CELLS * heightfield->spacingZ;
+
+	scatter();
+	Logger() << "Foliage scattered " << instances.size() << " instances in " << chunks.size() << " chunks";
+	if(instances.empty())
+		return;
+
+	std::vector<std::string> filenames;
+	for(const FoliageType &type : types)
+		filenames.emplace_back(type.texture);
+	texture = vki->assets->acquireTexture(filenames, false);
+
+	createBuffers();
+	createCullPipeline();
+	createDescriptor();
+	createPipeline();
+
+	VkCommandBufferAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = vki->commandPool;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+	allocInfo.commandBufferCount = 1;
+	VK_RESULT_CHECK(vkAllocateCommandBuffers(vki->logicalDevice, &allocInfo, &commandBuffer));
+}
+
+TerrainFoliage::~TerrainFoliage()
+{
+	vki->assets->release(texture);
+
+	vkDestroyPipeline(vki->logicalDevice, pipeline, nullptr);
+	vkDestroyPipelineLayout(vki->logicalDevice, pipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(vki->logicalDevice, descriptorSetLayout, nullptr);
+	vkDestroyPipeline(vki->logicalDevice, cullPipeline, nullptr);
+	vkDestroyPipelineLayout(vki->logicalDevice, cullPipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(vki->logicalDevice, cullDescriptorSetLayout, nullptr);
+
+	vkDestroyBuffer(vki->logicalDevice, visibleBuffer, nullptr);
+	vkFreeMemory(vki->logicalDevice, visibleBufferMemory, nullptr);
+	vkDestroyBuffer(vki->logicalDevice, drawBuffer, nullptr);
+	vkFreeMemory(vki->logicalDevice, drawBufferMemory, nullptr);
+	vkDestroyBuffer(vki->logicalDevice, typeBuffer, nullptr);
+	vkFreeMemory(vki->logicalDevice, typeBufferMemory, nullptr);
+	vkDestroyBuffer(vki->logicalDevice, chunkBuffer, nullptr);
+	vkFreeMemory(vki->logicalDevice, chunkBufferMemory, nullptr);
+	vkDestroyBuffer(vki->logicalDevice, instanceBuffer, nullptr);
+	vkFreeMemory(vki->logicalDevice, instanceBufferMemory, nullptr);
+}
+
+void TerrainFoliage::scatter()
+{
+	//Rows of chunks scatter on their own threads, each chunk seeds its own generator so the
+	//result doesn't depend on how the rows were split
+	std::vector<std::vector<FoliageInstance> > rowInstances(chunksZ);
+	std::vector<std::vector<FoliageChunk> > rowChunks(chunksZ);
+	auto threadCount = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+	GenericThreadPool rowPool(threadCount);
+	for(uint32_t z = 0; z < chunksZ; z++)
+	{
+		rowPool.addJob([this, z, &rowInstances, &rowChunks]
+		{
+			for(uint32_t x = 0; x < chunksX; x++)
+			{
+				for(uint32_t type = 0; type < types.size(); type++)
+				{
+					FoliageChunk chunk = {};
+					chunk.range.x = static_cast<uint32_t>(rowInstances[z].size());
+					scatterChunk(x, z, type, rowInstances[z], chunk);
+					rowChunks[z].emplace_back(chunk);
+				}
+			}
+		});
+	}
+	rowPool.wait();
+	rowPool.destroy();
+
+	for(uint32_t z = 0; z < chunksZ; z++)
+	{
+		auto rowStart = static_cast<uint32_t>(instances.size());
+		for(FoliageChunk &chunk : rowChunks[z])
+		{
+			chunk.range.x += rowStart;
+			chunks.emplace_back(chunk);
+		}
+		instances.insert(instances.end(), rowInstances[z].begin(), rowInstances[z].end());
+	}
+
+	//Each type's visible list needs room for every instance of that type
+	typeData.resize(types.size());
+	std::vector<uint32_t> typeCounts(types.size(), 0);
+	for(const FoliageChunk &chunk : chunks)
+		typeCounts[chunk.range.z] += chunk.range.y;
+	uint32_t slot = 0;
+	for(uint32_t type = 0; type < types.size(); type++)
+	{
+		typeData[type].params = glm::vec4(types[type].drawDistance, 0, 0, 0);
+		typeData[type].slots = glm::uvec4(slot, typeCounts[type], 0, 0);
+		slot += typeCounts[type];
+	}
+}
+
+void TerrainFoliage::scatterChunk(uint32_t chunkX, uint32_t chunkZ, uint32_t type,
+                                  std::vector<FoliageInstance> &outInstances, FoliageChunk &outChunk) const
+{
+	const FoliageType &rules = types[type];
+	float x0 = chunkX * chunkSizeX;
+	float z0 = chunkZ * chunkSizeZ;
+	float x1 = std::min(x0 + chunkSizeX, heightfield->worldWidth());
+	float z1 = std::min(z0 + chunkSizeZ, heightfield->worldDepth());
+
+	std::seed_seq chunkSeed = {seed, chunkX, chunkZ, type};
+	std::mt19937 randGen(chunkSeed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	//Fractional candidates become one more with matching probability so density holds on small chunks
+	float expected = (x1 - x0) * (z1 - z0) * rules.density;
+	auto candidates = static_cast<uint32_t>(expected);
+	if(unit(randGen) < expected - candidates)
+		candidates++;
+
+	float heightRange = std::max(maxHeight - minHeight, std::numeric_limits<float>::epsilon());
+	outChunk.range.z = type;
+	for(uint32_t i = 0; i < candidates; i++)
+	{
+		//Every candidate draws the same numbers whether it is kept or not
+		float x = x0 + unit(randGen) * (x1 - x0);
+		float z = z0 + unit(randGen) * (z1 - z0);
+		float scale = rules.minScale + unit(randGen) * (rules.maxScale - rules.minScale);
+
+		float height = query->heightAt(x, z);
+		float relativeHeight = (height - minHeight) / heightRange;
+		if(relativeHeight < rules.minHeight || relativeHeight > rules.maxHeight)
+			continue;
+		if(query->normalAt(x, z).y < rules.minUp)
+			continue;
+
+		outInstances.emplace_back(FoliageInstance{glm::vec4(x, height, z, scale)});
+		outChunk.range.y++;
+	}
+	if(outChunk.range.y > 0)
+		updateBounds(&outInstances[outInstances.size() - outChunk.range.y], outChunk);
+}
+
+void TerrainFoliage::updateBounds(const FoliageInstance* first, FoliageChunk &chunk)
+{
+	//Instances stand up from their position, they can lean out by their size in any direction
+	glm::vec3 boundsMin(std::numeric_limits<float>::max());
+	glm::vec3 boundsMax(-std::numeric_limits<float>::max());
+	for(uint32_t i = 0; i < chunk.range.y; i++)
+	{
+		glm::vec3 position(first[i].positionScale);
+		float size = first[i].positionScale.w;
+		boundsMin = glm::min(boundsMin, position - glm::vec3(size, 0, size));
+		boundsMax = glm::max(boundsMax, position + glm::vec3(size));
+	}
+	chunk.boundsMin = glm::vec4(boundsMin, 0);
+	chunk.boundsMax = glm::vec4(boundsMax, 0);
+}
+
+void TerrainFoliage::createStorageBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage,
+                                         VkBuffer &buffer, VkDeviceMemory &bufferMemory)
+{
+	vki->createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | usage,
+	                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, bufferMemory);
+	if(!data)
+		return;
+
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingBufferMemory;
+	vki->createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+	                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	                  stagingBuffer, stagingBufferMemory);
+
+	void* mapped;
+	vkMapMemory(vki->logicalDevice, stagingBufferMemory, 0, size, 0, &mapped);
+	memcpy(mapped, data, size);
+	vkUnmapMemory(vki->logicalDevice, stagingBufferMemory);
+
+	vki->copyBuffer(stagingBuffer, buffer, size);
+
+	vkDestroyBuffer(vki->logicalDevice, stagingBuffer, nullptr);
+	vkFreeMemory(vki->logicalDevice, stagingBufferMemory, nullptr);
+}
+
+void TerrainFoliage::createBuffers()
+{
+	createStorageBuffer(instances.data(), sizeof(FoliageInstance) * instances.size(), 0,
+	                    instanceBuffer, instanceBufferMemory);
+	createStorageBuffer(chunks.data(), sizeof(FoliageChunk) * chunks.size(), 0,
+	                    chunkBuffer, chunkBufferMemory);
+	createStorageBuffer(typeData.data(), sizeof(FoliageTypeData) * typeData.size(), 0,
+	                    typeBuffer, typeBufferMemory);
+	//Reset by the cull each frame before anything reads them
+	createStorageBuffer(nullptr, sizeof(VkDrawIndirectCommand) * types.size(), VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+	                    drawBuffer, drawBufferMemory);
+	createStorageBuffer(nullptr, sizeof(uint32_t) * instances.size(), 0,
+	                    visibleBuffer, visibleBufferMemory);
+}
+
+void TerrainFoliage::createCullPipeline()
+{
+	//Instances, chunks, types, draw commands then the visible list
+	std::vector<VkDescriptorSetLayoutBinding> bindings(5);
+	for(uint32_t i = 0; i < bindings.size(); i++)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorCount = 1;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		bindings[i].pImmutableSamplers = nullptr;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+	VK_RESULT_CHECK(vkCreateDescriptorSetLayout(vki->logicalDevice, &layoutInfo, nullptr, &cullDescriptorSetLayout))
+
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = vki->descriptorPool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &cullDescriptorSetLayout;
+	VK_RESULT_CHECK(vkAllocateDescriptorSets(vki->logicalDevice, &allocInfo, &cullDescriptorSet))
+
+	VkDescriptorBufferInfo bufferInfos[5] = {};
+	bufferInfos[0].buffer = instanceBuffer;
+	bufferInfos[1].buffer = chunkBuffer;
+	bufferInfos[2].buffer = typeBuffer;
+	bufferInfos[3].buffer = drawBuffer;
+	bufferInfos[4].buffer = visibleBuffer;
+
+	std::vector<VkWriteDescriptorSet> descriptorWrites(bindings.size());
+	for(uint32_t i = 0; i < descriptorWrites.size(); i++)
+	{
+		bufferInfos[i].offset = 0;
+		bufferInfos[i].range = VK_WHOLE_SIZE;
+
+		descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[i].dstSet = cullDescriptorSet;
+		descriptorWrites[i].dstBinding = i;
+		descriptorWrites[i].dstArrayElement = 0;
+		descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrites[i].descriptorCount = 1;
+		descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+	}
+	vkUpdateDescriptorSets(vki->logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.size = sizeof(FoliageCullPushConstantBufferObject);
+	pushConstantRange.offset = 0;
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &cullDescriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+	VK_RESULT_CHECK(vkCreatePipelineLayout(vki->logicalDevice, &pipelineLayoutInfo, nullptr, &cullPipelineLayout))
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage = vki->loadShaderModule("shaders/foliageCull.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+	pipelineInfo.layout = cullPipelineLayout;
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+	pipelineInfo.basePipelineIndex = -1;
+	VK_RESULT_CHECK(vkCreateComputePipelines(vki->logicalDevice, vki->pipelineCache, 1, &pipelineInfo, nullptr, &cullPipeline))
+	Logger() << "Foliage cull pipeline created";
+}
+
+void TerrainFoliage::createDescriptor()
+{
+	//Instances and the visible list for the vertex shader, texture layers for the fragment shader
+	std::vector<VkDescriptorSetLayoutBinding> bindings(3);
+	for(uint32_t i = 0; i < bindings.size(); i++)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorCount = 1;
+		bindings[i].descriptorType = i < 2 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[i].stageFlags = i < 2 ? VK_SHADER_STAGE_VERTEX_BIT : VK_SHADER_STAGE_FRAGMENT_BIT;
+		bindings[i].pImmutableSamplers = nullptr;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+	VK_RESULT_CHECK(vkCreateDescriptorSetLayout(vki->logicalDevice, &layoutInfo, nullptr, &descriptorSetLayout))
+
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = vki->descriptorPool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &descriptorSetLayout;
+	VK_RESULT_CHECK(vkAllocateDescriptorSets(vki->logicalDevice, &allocInfo, &descriptorSet))
+
+	VkDescriptorBufferInfo bufferInfos[2] = {};
+	bufferInfos[0].buffer = instanceBuffer;
+	bufferInfos[0].offset = 0;
+	bufferInfos[0].range = VK_WHOLE_SIZE;
+	bufferInfos[1].buffer = visibleBuffer;
+	bufferInfos[1].offset = 0;
+	bufferInfos[1].range = VK_WHOLE_SIZE;
+
+	VkDescriptorImageInfo imageInfo = {};
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageInfo.imageView = texture->texture.imageView;
+	imageInfo.sampler = texture->textureSampler;
+
+	std::vector<VkWriteDescriptorSet> descriptorWrites(bindings.size());
+	for(uint32_t i = 0; i < descriptorWrites.size(); i++)
+	{
+		descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[i].dstSet = descriptorSet;
+		descriptorWrites[i].dstBinding = i;
+		descriptorWrites[i].dstArrayElement = 0;
+		descriptorWrites[i].descriptorType = bindings[i].descriptorType;
+		descriptorWrites[i].descriptorCount = 1;
+		if(i < 2)
+			descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+		else
+			descriptorWrites[i].pImageInfo = &imageInfo;
+	}
+	vkUpdateDescriptorSets(vki->logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+}
+
+void TerrainFoliage::createPipeline()
+{
+	//Corners come from gl_VertexIndex and instances from the storage buffers
+	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertexInputInfo.vertexBindingDescriptionCount = 0;
+	vertexInputInfo.pVertexBindingDescriptions = nullptr;
+	vertexInputInfo.vertexAttributeDescriptionCount = 0;
+	vertexInputInfo.pVertexAttributeDescriptions = nullptr;
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+	VkViewport viewport = {};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = (float) vki->window->width;
+	viewport.height = (float) vki->window->height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+
+	VkRect2D scissor = {};
+	scissor.offset = {0, 0};
+	scissor.extent = {static_cast<uint32_t>(vki->window->width),
+	                  static_cast<uint32_t>(vki->window->height)};
+
+	VkPipelineViewportStateCreateInfo viewportState = {};
+	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportState.viewportCount = 1;
+	viewportState.pViewports = &viewport;
+	viewportState.scissorCount = 1;
+	viewportState.pScissors = &scissor;
+
+	//Quads are seen from both sides
+	VkPipelineRasterizationStateCreateInfo rasterizer = {};
+	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.depthClampEnable = VK_FALSE;
+	rasterizer.rasterizerDiscardEnable = VK_FALSE;
+	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterizer.lineWidth = 1.0f;
+	rasterizer.cullMode = VK_CULL_MODE_NONE;
+	rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+	rasterizer.depthBiasEnable = VK_FALSE;
+
+	VkPipelineMultisampleStateCreateInfo multisampling = {};
+	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling.sampleShadingEnable = VK_FALSE;
+	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+	multisampling.minSampleShading = 1.0f;
+
+	VkPipelineDepthStencilStateCreateInfo depthStencil = {};
+	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencil.depthTestEnable = VK_TRUE;
+	depthStencil.depthWriteEnable = VK_TRUE;
+	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+	depthStencil.depthBoundsTestEnable = VK_FALSE;
+	depthStencil.stencilTestEnable = VK_FALSE;
+
+	//Blades are cut out in the fragment shader, nothing is blended
+	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
+	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	colorBlendAttachment.blendEnable = VK_FALSE;
+
+	VkPipelineColorBlendStateCreateInfo colorBlending = {};
+	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlending.logicOpEnable = VK_FALSE;
+	colorBlending.logicOp = VK_LOGIC_OP_COPY;
+	colorBlending.attachmentCount = 1;
+	colorBlending.pAttachments = &colorBlendAttachment;
+
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.size = sizeof(FoliagePushConstantBufferObject);
+	pushConstantRange.offset = 0;
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+	VK_RESULT_CHECK(vkCreatePipelineLayout(vki->logicalDevice, &pipelineLayoutInfo, nullptr, &pipelineLayout))
+
+	std::vector<VkPipelineShaderStageCreateInfo> shaderStages = {
+			vki->loadShaderModule("shaders/foliage.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
+			vki->loadShaderModule("shaders/foliage.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT)
+	};
+
+	VkGraphicsPipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+	pipelineInfo.pStages = shaderStages.data();
+	pipelineInfo.pVertexInputState = &vertexInputInfo;
+	pipelineInfo.pInputAssemblyState = &inputAssembly;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pRasterizationState = &rasterizer;
+	pipelineInfo.pMultisampleState = &multisampling;
+	pipelineInfo.pDepthStencilState = &depthStencil;
+	pipelineInfo.pColorBlendState = &colorBlending;
+	pipelineInfo.pDynamicState = nullptr;
+	pipelineInfo.layout = pipelineLayout;
+	pipelineInfo.renderPass = vki->offscreenRenderPass;
+	pipelineInfo.subpass = 0;
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+	pipelineInfo.basePipelineIndex = -1;
+
+	VK_RESULT_CHECK(vkCreateGraphicsPipelines(vki->logicalDevice, vki->pipelineCache, 1, &pipelineInfo, nullptr, &pipeline))
+	Logger() << "Foliage pipeline created";
+}
+
+void TerrainFoliage::recordCull(StagingRing* ring, const glm::mat4 &viewProjection, glm::vec3 viewPosition)
+{
+	if(instances.empty())
+		return;
+
+	VkCommandBuffer cullCommandBuffer = ring->commands();
+
+	//Counts start from zero every frame, the ring's leading barrier keeps last frame's draws ahead of this
+	std::vector<VkDrawIndirectCommand> drawCommands(types.size());
+	for(VkDrawIndirectCommand &drawCommand : drawCommands)
+	{
+		drawCommand.vertexCount = TERRAIN_FOLIAGE_VERTICES;
+		drawCommand.instanceCount = 0;
+		drawCommand.firstVertex = 0;
+		drawCommand.firstInstance = 0;
+	}
+	vkCmdUpdateBuffer(cullCommandBuffer, drawBuffer, 0, sizeof(VkDrawIndirectCommand) * drawCommands.size(),
+	                  drawCommands.data());
+
+	//Also covers instance edits copied through the ring earlier
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(cullCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+	                     0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	FoliageCullPushConstantBufferObject pushConstant = {};
+	Frustum frustum(viewProjection);
+	for(uint32_t i = 0; i < 6; i++)
+		pushConstant.planes[i] = frustum.getPlanes()[i];
+	pushConstant.viewPosition = glm::vec4(viewPosition, distanceScale);
+
+	vkCmdBindPipeline(cullCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+	vkCmdBindDescriptorSets(cullCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout,
+	                        0, 1, &cullDescriptorSet, 0, nullptr);
+	vkCmdPushConstants(cullCommandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT,
+	                   0, sizeof(pushConstant), &pushConstant);
+	//One workgroup per chunk, the first invocation tests the chunk and the group shares its instances
+	vkCmdDispatch(cullCommandBuffer, static_cast<uint32_t>(chunks.size()), 1, 1);
+
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(cullCommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+	                     VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+	                     0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void TerrainFoliage::refresh(float minX, float minZ, float maxX, float maxZ, StagingRing* ring)
+{
+	if(instances.empty())
+		return;
+
+	auto firstX = static_cast<uint32_t>(std::max(0.0f, std::floor(minX / chunkSizeX)));
+	auto firstZ = static_cast<uint32_t>(std::max(0.0f, std::floor(minZ / chunkSizeZ)));
+	auto lastX = std::min(static_cast<uint32_t>(std::max(0.0f, maxX / chunkSizeX)), chunksX - 1);
+	auto lastZ = std::min(static_cast<uint32_t>(std::max(0.0f, maxZ / chunkSizeZ)), chunksZ - 1);
+	auto typeCount = static_cast<uint32_t>(types.size());
+
+	for(uint32_t z = firstZ; z <= lastZ; z++)
+	{
+		for(uint32_t x = firstX; x <= lastX; x++)
+		{
+			//Every type of a chunk sits in one run of instances
+			uint32_t firstChunk = (z * chunksX + x) * typeCount;
+			uint32_t firstInstance = chunks[firstChunk].range.x;
+			uint32_t instanceCount = 0;
+			for(uint32_t type = 0; type < typeCount; type++)
+			{
+				FoliageChunk &chunk = chunks[firstChunk + type];
+				for(uint32_t i = chunk.range.x; i < chunk.range.x + chunk.range.y; i++)
+				{
+					glm::vec4 &instance = instances[i].positionScale;
+					instance.y = query->heightAt(instance.x, instance.z);
+				}
+				if(chunk.range.y > 0)
+					updateBounds(&instances[chunk.range.x], chunk);
+				instanceCount += chunk.range.y;
+			}
+
+			VkBufferCopy copyRegions[2] = {};
+			copyRegions[0].size = sizeof(FoliageChunk) * typeCount;
+			copyRegions[0].dstOffset = sizeof(FoliageChunk) * firstChunk;
+			memcpy(ring->allocate(copyRegions[0].size, copyRegions[0].srcOffset), &chunks[firstChunk], copyRegions[0].size);
+			vkCmdCopyBuffer(ring->commands(), ring->getBuffer(), chunkBuffer, 1, &copyRegions[0]);
+			if(instanceCount == 0)
+				continue;
+
+			copyRegions[1].size = sizeof(FoliageInstance) * instanceCount;
+			copyRegions[1].dstOffset = sizeof(FoliageInstance) * firstInstance;
+			memcpy(ring->allocate(copyRegions[1].size, copyRegions[1].srcOffset), &instances[firstInstance], copyRegions[1].size);
+			vkCmdCopyBuffer(ring->commands(), ring->getBuffer(), instanceBuffer, 1, &copyRegions[1]);
+		}
+	}
+}
+
+void TerrainFoliage::draw(std::vector<VkCommandBuffer> * commandBuffers, VkCommandBufferInheritanceInfo inheritanceInfo,
+                          const glm::mat4 &viewProjection, glm::vec3 viewPosition)
+{
+	if(instances.empty())
+		return;
+
+	VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	commandBufferBeginInfo.pInheritanceInfo = &inheritanceInfo;
+
+	vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1,
+	                        &descriptorSet, 0, nullptr);
+
+	//Instance counts were written by this frame's cull, the CPU never reads them back
+	for(uint32_t type = 0; type < types.size(); type++)
+	{
+		FoliagePushConstantBufferObject pushConstant = {};
+		pushConstant.viewProj = viewProjection;
+		pushConstant.viewPosition = glm::vec4(viewPosition, types[type].drawDistance * distanceScale);
+		pushConstant.type = glm::ivec4(typeData[type].slots.x, type, 0, 0);
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+		                   sizeof(pushConstant), &pushConstant);
+		vkCmdDrawIndirect(commandBuffer, drawBuffer, sizeof(VkDrawIndirectCommand) * type, 1,
+		                  sizeof(VkDrawIndirectCommand));
+	}
+
+	VK_RESULT_CHECK(vkEndCommandBuffer(commandBuffer));
+	commandBuffers->emplace_back(commandBuffer);
+}
+
+void TerrainFoliage::setDistanceScale(float scale)
+{
+	distanceScale = scale;
+}
+
+size_t TerrainFoliage::getInstanceCount() const
+{
+	return instances.size();
+}
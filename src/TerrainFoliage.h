@@ -0,0 +1,137 @@
+#ifndef VULKANITE_TERRAINFOLIAGE_H
+#define VULKANITE_TERRAINFOLIAGE_H
+
+#include <vulkan/vulkan.h>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+#include <string>
+#include <vector>
+#include "Heightfield.h"
+
+class VulkanInterface;
+class Texture;
+class HeightfieldQuery;
+class StagingRing;
+
+//Heightfield cells along the side of each foliage chunk
+#define TERRAIN_FOLIAGE_CHUNK_CELLS 16
+//Invocations in each cull workgroup, matches foliageCull.comp
+#define TERRAIN_FOLIAGE_CULL_GROUP 64
+//Two crossed quads per instance
+#define TERRAIN_FOLIAGE_VERTICES 12
+
+//Placement rules for one kind of foliage. Heights are fractions of the terrain's height range.
+struct FoliageType
+{
+	std::string texture;
+	//Candidate positions per square world unit, before the rules below reject any
+	float density;
+	//Smallest normal y accepted, steeper ground is left bare
+	float minUp;
+	float minHeight;
+	float maxHeight;
+	float minScale;
+	float maxScale;
+	float drawDistance;
+};
+
+//Matches FoliageInstance in foliageCull.comp and foliage.vert, w is the instance's height
+struct FoliageInstance
+{
+	glm::vec4 positionScale;
+};
+
+//One type's instances inside one chunk, tested as a whole before its instances are
+struct FoliageChunk
+{
+	glm::vec4 boundsMin;
+	glm::vec4 boundsMax;
+	glm::uvec4 range; //x first instance, y instance count, z type
+};
+
+struct FoliageTypeData
+{
+	glm::vec4 params; //x draw distance
+	glm::uvec4 slots; //x first slot of the type in the visible list
+};
+
+//Foliage scattered over the heightfield at load. Instances are grouped by chunk, a compute pass
+//culls chunks and then their instances by frustum and distance each frame, appending the
+//survivors to a visible list and counting them into one indirect draw per type.
+class TerrainFoliage
+{
+	VulkanInterface* vki;
+	const Heightfield* heightfield;
+	const HeightfieldQuery* query;
+	std::vector<FoliageType> types;
+	uint32_t seed;
+	float minHeight;
+	float maxHeight;
+	float distanceScale = 1.0f;
+
+	//Chunk (x, z) holds types.size() consecutive entries, their instances are consecutive too
+	uint32_t chunksX;
+	uint32_t chunksZ;
+	float chunkSizeX;
+	float chunkSizeZ;
+	std::vector<FoliageChunk> chunks;
+	std::vector<FoliageInstance> instances;
+	std::vector<FoliageTypeData> typeData;
+
+	Texture* texture = nullptr;
+
+	VkBuffer instanceBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory instanceBufferMemory = VK_NULL_HANDLE;
+	VkBuffer chunkBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory chunkBufferMemory = VK_NULL_HANDLE;
+	VkBuffer typeBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory typeBufferMemory = VK_NULL_HANDLE;
+	//One VkDrawIndirectCommand per type, instance counts are filled by the cull
+	VkBuffer drawBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory drawBufferMemory = VK_NULL_HANDLE;
+	//Instance indices that passed the cull, each type has room for all of its instances
+	VkBuffer visibleBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory visibleBufferMemory = VK_NULL_HANDLE;
+
+	VkDescriptorSetLayout cullDescriptorSetLayout = VK_NULL_HANDLE;
+	VkDescriptorSet cullDescriptorSet;
+	VkPipelineLayout cullPipelineLayout = VK_NULL_HANDLE;
+	VkPipeline cullPipeline = VK_NULL_HANDLE;
+
+	VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+	VkDescriptorSet descriptorSet;
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkCommandBuffer commandBuffer = nullptr;
+
+	void scatter();
+	void scatterChunk(uint32_t chunkX, uint32_t chunkZ, uint32_t type,
+	                  std::vector<FoliageInstance> &outInstances, FoliageChunk &outChunk) const;
+	static void updateBounds(const FoliageInstance* first, FoliageChunk &chunk);
+	void createStorageBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage,
+	                         VkBuffer &buffer, VkDeviceMemory &bufferMemory);
+	void createBuffers();
+	void createCullPipeline();
+	void createDescriptor();
+	void createPipeline();
+
+public:
+	//Scatters every type over the heightfield, the same seed always gives the same instances
+	TerrainFoliage(VulkanInterface* inVulkan, const Heightfield* inHeightfield, const HeightfieldQuery* inQuery,
+	               std::vector<FoliageType> inTypes, uint32_t inSeed);
+	~TerrainFoliage();
+
+	//Records this frame's cull, the ring has to be flushed before the frame that draws it
+	void recordCull(StagingRing* ring, const glm::mat4 &viewProjection, glm::vec3 viewPosition);
+	//Puts instances in chunks touching the world rectangle back on the ground after an edit
+	void refresh(float minX, float minZ, float maxX, float maxZ, StagingRing* ring);
+	void draw(std::vector<VkCommandBuffer> * commandBuffers, VkCommandBufferInheritanceInfo inheritanceInfo,
+	          const glm::mat4 &viewProjection, glm::vec3 viewPosition);
+
+	//Multiplies every type's draw distance
+	void setDistanceScale(float scale);
+	size_t getInstanceCount() const;
+};
+
+#endif //VULKANITE_TERRAINFOLIAGE_H
@@ -0,0 +1,315 @@
+#include "TerrainQuadtree.h"
+#include "logger.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+TerrainQuadtree::TerrainQuadtree(const Heightfield *inHeightfield, uint32_t inPatchSize,
+                                 std::vector<TerrainVertex> &vertices, std::vector<uint32_t> &indices) :
+	heightfield(inHeightfield),
+	patchSize(inPatchSize)
+{
+	//Enough levels for the root patch to cover the whole heightfield
+	uint32_t extent = std::max(heightfield->width, heightfield->depth) - 1;
+	levels = 1;
+	while((patchSize << (levels - 1)) < extent)
+		levels++;
+
+	computeSkirtDepth();
+	root = buildNode(levels - 1, 0, 0, vertices);
+	buildIndices(indices);
+
+	Logger() << "Terrain quadtree built with " << nodes.size() << " nodes over " << levels << " levels";
+}
+
+TerrainQuadtree::TerrainQuadtree(const Heightfield *inHeightfield, uint32_t inPatchSize, std::vector<TerrainNode> inNodes) :
+	heightfield(inHeightfield),
+	patchSize(inPatchSize),
+	nodes(std::move(inNodes))
+{
+	if(nodes.empty())
+		throw std::runtime_error("Terrain quadtree has no nodes");
+	//Edits rebuild skirts, so they need the same depth the cached vertices were built with
+	computeSkirtDepth();
+
+	//Nodes are stored children first, so the root is always last
+	root = static_cast<int32_t>(nodes.size() - 1);
+	levels = nodes[root].level + 1;
+}
+
+void TerrainQuadtree::computeSkirtDepth()
+{
+	auto minmax = std::minmax_element(heightfield->heights.begin(), heightfield->heights.end());
+	skirtDepth = std::max((*minmax.second - *minmax.first) * 0.1f,
+	                      std::max(heightfield->spacingX, heightfield->spacingZ));
+}
+
+TerrainVertex TerrainQuadtree::nodeVertex(const TerrainNode &node, uint32_t gx, uint32_t gz) const
+{
+	uint32_t step = 1u << node.level;
+	auto sx = static_cast<int>(node.x + gx * step);
+	auto sz = static_cast<int>(node.z + gz * step);
+
+	TerrainVertex v{};
+	v.position = heightfield->position(sx, sz);
+	v.normal = heightfield->normal(sx, sz);
+	return v;
+}
+
+int32_t TerrainQuadtree::buildNode(uint32_t level, uint32_t x, uint32_t z, std::vector<TerrainVertex> &vertices)
+{
+	if(x >= heightfield->width - 1 || z >= heightfield->depth - 1)
+		return -1;
+
+	uint32_t step = 1u << level;
+	uint32_t half = (patchSize * step) / 2;
+
+	TerrainNode node = {};
+	node.level = level;
+	node.x = x;
+	node.z = z;
+	node.vertexOffset = static_cast<int32_t>(vertices.size());
+	node.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+	node.boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+
+	//Grid, samples past the edge clamp so those triangles collapse
+	for(uint32_t gz = 0; gz <= patchSize; gz++)
+	{
+		for(uint32_t gx = 0; gx <= patchSize; gx++)
+		{
+			TerrainVertex v = nodeVertex(node, gx, gz);
+			vertices.emplace_back(v);
+
+			node.boundsMin = glm::min(node.boundsMin, v.position);
+			node.boundsMax = glm::max(node.boundsMax, v.position);
+		}
+	}
+
+	//Skirts, a lowered copy of each edge in the order top, bottom, left, right
+	uint32_t row = patchSize + 1;
+	auto gridOffset = static_cast<uint32_t>(node.vertexOffset);
+	for(uint32_t edge = 0; edge < 4; edge++)
+	{
+		for(uint32_t i = 0; i <= patchSize; i++)
+		{
+			uint32_t gridIndex;
+			if(edge == 0) gridIndex = i;
+			else if(edge == 1) gridIndex = patchSize * row + i;
+			else if(edge == 2) gridIndex = i * row;
+			else gridIndex = i * row + patchSize;
+
+			TerrainVertex v = vertices[gridOffset + gridIndex];
+			v.position.y -= skirtDepth;
+			vertices.emplace_back(v);
+		}
+	}
+	node.boundsMin.y -= skirtDepth;
+
+	for(int32_t &child : node.children)
+		child = -1;
+	if(level > 0)
+	{
+		for(uint32_t i = 0; i < 4; i++)
+		{
+			node.children[i] = buildNode(level - 1, x + (i & 1) * half, z + (i >> 1) * half, vertices);
+			if(node.children[i] >= 0)
+			{
+				//Coarse samples can miss peaks, so bounds also cover the children
+				node.boundsMin = glm::min(node.boundsMin, nodes[node.children[i]].boundsMin);
+				node.boundsMax = glm::max(node.boundsMax, nodes[node.children[i]].boundsMax);
+			}
+		}
+	}
+
+	nodes.emplace_back(node);
+	return static_cast<int32_t>(nodes.size() - 1);
+}
+
+void TerrainQuadtree::buildIndices(std::vector<uint32_t> &indices) const
+{
+	uint32_t row = patchSize + 1;
+	indices.reserve(getIndicesPerNode());
+
+	for(uint32_t i = 0; i < patchSize; i++)
+	{
+		for(uint32_t j = 0; j < patchSize; j++)
+		{
+			indices.emplace_back((i+1)*row + j+1);
+			indices.emplace_back(i*row + j+1);
+			indices.emplace_back(i*row + j);
+
+			indices.emplace_back(i*row + j);
+			indices.emplace_back((i+1)*row + j);
+			indices.emplace_back((i+1)*row + j+1);
+		}
+	}
+
+	uint32_t skirtOffset = row * row;
+	for(uint32_t edge = 0; edge < 4; edge++)
+	{
+		for(uint32_t i = 0; i < patchSize; i++)
+		{
+			uint32_t a, b;
+			if(edge == 0) { a = i; b = i + 1; }
+			else if(edge == 1) { a = patchSize * row + i; b = a + 1; }
+			else if(edge == 2) { a = i * row; b = a + row; }
+			else { a = i * row + patchSize; b = a + row; }
+
+			uint32_t skirtA = skirtOffset + edge * row + i;
+			uint32_t skirtB = skirtA + 1;
+
+			indices.emplace_back(a);
+			indices.emplace_back(b);
+			indices.emplace_back(skirtB);
+
+			indices.emplace_back(skirtB);
+			indices.emplace_back(skirtA);
+			indices.emplace_back(a);
+		}
+	}
+}
+
+void TerrainQuadtree::select(glm::vec3 viewPosition, std::vector<const TerrainNode *> &selection) const
+{
+	selection.clear();
+	if(root >= 0)
+		selectNode(root, viewPosition, selection);
+}
+
+void TerrainQuadtree::selectNode(int32_t index, glm::vec3 viewPosition, std::vector<const TerrainNode *> &selection) const
+{
+	const TerrainNode* node = &nodes[index];
+
+	glm::vec3 closest = glm::clamp(viewPosition, node->boundsMin, node->boundsMax);
+	float distance = glm::distance(closest, viewPosition);
+	float size = (patchSize << node->level) * std::max(heightfield->spacingX, heightfield->spacingZ);
+
+	if(node->level == 0 || distance > size * lodFactor)
+	{
+		selection.emplace_back(node);
+		return;
+	}
+
+	for(int32_t child : node->children)
+	{
+		if(child >= 0)
+			selectNode(child, viewPosition, selection);
+	}
+}
+
+void TerrainQuadtree::setLodFactor(float factor)
+{
+	lodFactor = factor;
+}
+
+void TerrainQuadtree::refresh(uint32_t x0, uint32_t z0, uint32_t x1, uint32_t z1, const TerrainVertexWriter &write)
+{
+	uint32_t row = patchSize + 1;
+	uint32_t lastX = heightfield->width - 1;
+	uint32_t lastZ = heightfield->depth - 1;
+	std::vector<TerrainVertex> run(row);
+
+	//Children are stored before their parents, so child bounds are final by the time a parent merges them
+	for(TerrainNode &node : nodes)
+	{
+		uint32_t step = 1u << node.level;
+		if(node.x > x1 || node.z > z1 ||
+		   std::min(node.x + patchSize * step, lastX) < x0 || std::min(node.z + patchSize * step, lastZ) < z0)
+			continue;
+
+		//Grid lines that land on a changed sample, clamped samples past the edge included
+		uint32_t gx0 = row, gx1 = 0, gz0 = row, gz1 = 0;
+		for(uint32_t g = 0; g <= patchSize; g++)
+		{
+			uint32_t sx = std::min(node.x + g * step, lastX);
+			uint32_t sz = std::min(node.z + g * step, lastZ);
+			if(sx >= x0 && sx <= x1) { gx0 = std::min(gx0, g); gx1 = g; }
+			if(sz >= z0 && sz <= z1) { gz0 = std::min(gz0, g); gz1 = g; }
+		}
+
+		auto offset = static_cast<uint32_t>(node.vertexOffset);
+		uint32_t skirtOffset = offset + row * row;
+		if(gx0 <= gx1 && gz0 <= gz1)
+		{
+			uint32_t width = gx1 - gx0 + 1;
+			uint32_t height = gz1 - gz0 + 1;
+			for(uint32_t gz = gz0; gz <= gz1; gz++)
+			{
+				for(uint32_t gx = gx0; gx <= gx1; gx++)
+					run[gx - gx0] = nodeVertex(node, gx, gz);
+				write(offset + gz * row + gx0, run.data(), width);
+			}
+
+			//Skirts in the same top, bottom, left, right order as the build
+			for(uint32_t edge = 0; edge < 4; edge++)
+			{
+				if((edge == 0 && gz0 != 0) || (edge == 1 && gz1 != patchSize) ||
+				   (edge == 2 && gx0 != 0) || (edge == 3 && gx1 != patchSize))
+					continue;
+				bool horizontal = edge < 2;
+				uint32_t first = horizontal ? gx0 : gz0;
+				uint32_t count = horizontal ? width : height;
+				for(uint32_t i = 0; i < count; i++)
+				{
+					if(edge == 0) run[i] = nodeVertex(node, first + i, 0);
+					else if(edge == 1) run[i] = nodeVertex(node, first + i, patchSize);
+					else if(edge == 2) run[i] = nodeVertex(node, 0, first + i);
+					else run[i] = nodeVertex(node, patchSize, first + i);
+					run[i].position.y -= skirtDepth;
+				}
+				write(skirtOffset + edge * row + first, run.data(), count);
+			}
+		}
+
+		//Only heights move, so only the vertical extent of the bounds is rebuilt
+		float minY = std::numeric_limits<float>::max();
+		float maxY = -std::numeric_limits<float>::max();
+		for(uint32_t gz = 0; gz <= patchSize; gz++)
+		{
+			for(uint32_t gx = 0; gx <= patchSize; gx++)
+			{
+				float h = heightfield->height(static_cast<int>(node.x + gx * step), static_cast<int>(node.z + gz * step));
+				minY = std::min(minY, h);
+				maxY = std::max(maxY, h);
+			}
+		}
+		minY -= skirtDepth;
+		for(int32_t child : node.children)
+		{
+			if(child >= 0)
+			{
+				minY = std::min(minY, nodes[child].boundsMin.y);
+				maxY = std::max(maxY, nodes[child].boundsMax.y);
+			}
+		}
+		node.boundsMin.y = minY;
+		node.boundsMax.y = maxY;
+	}
+}
+
+uint32_t TerrainQuadtree::getVerticesPerNode() const
+{
+	return (patchSize + 1) * (patchSize + 1) + 4 * (patchSize + 1);
+}
+
+uint32_t TerrainQuadtree::getIndicesPerNode() const
+{
+	return patchSize * patchSize * 6 + 4 * patchSize * 6;
+}
+
+uint32_t TerrainQuadtree::getLevels() const
+{
+	return levels;
+}
+
+size_t TerrainQuadtree::getNodeCount() const
+{
+	return nodes.size();
+}
+
+const std::vector<TerrainNode>& TerrainQuadtree::getNodes() const
+{
+	return nodes;
+}
\ No newline at end of file
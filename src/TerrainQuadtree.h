@@ -0,0 +1,66 @@
+#ifndef VULKANITE_TERRAINQUADTREE_H
+#define VULKANITE_TERRAINQUADTREE_H
+
+#include <glm/vec3.hpp>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include "Heightfield.h"
+#include "Terrain.h"
+
+//Patch covering patchSize quads, sampling every 2^level heightfield samples
+struct TerrainNode
+{
+	uint32_t level;
+	uint32_t x;
+	uint32_t z;
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	int32_t vertexOffset;
+	//Indices into the node list, -1 when absent
+	int32_t children[4];
+};
+
+//Receives count rebuilt vertices that belong at firstVertex in the vertex buffer
+typedef std::function<void(uint32_t firstVertex, const TerrainVertex* vertices, uint32_t count)> TerrainVertexWriter;
+
+//Chunked LOD terrain, every node owns a block of vertices and all nodes share one
+//grid index buffer. Cracks between levels are hidden by skirts around each patch.
+class TerrainQuadtree
+{
+	const Heightfield* heightfield;
+	uint32_t patchSize;
+	uint32_t levels;
+	float skirtDepth;
+	float lodFactor = 2.0f;
+
+	std::vector<TerrainNode> nodes;
+	int32_t root;
+
+	void computeSkirtDepth();
+	TerrainVertex nodeVertex(const TerrainNode &node, uint32_t gx, uint32_t gz) const;
+	int32_t buildNode(uint32_t level, uint32_t x, uint32_t z, std::vector<TerrainVertex> &vertices);
+	void buildIndices(std::vector<uint32_t> &indices) const;
+	void selectNode(int32_t index, glm::vec3 viewPosition, std::vector<const TerrainNode*> &selection) const;
+
+public:
+	TerrainQuadtree(const Heightfield* inHeightfield, uint32_t inPatchSize,
+	                std::vector<TerrainVertex> &vertices, std::vector<uint32_t> &indices);
+	//Restores a tree built earlier, the vertex blocks it refers to must be uploaded unchanged
+	TerrainQuadtree(const Heightfield* inHeightfield, uint32_t inPatchSize, std::vector<TerrainNode> inNodes);
+
+	//Nodes to draw from this view, children replace a node closer than lodFactor times its size
+	void select(glm::vec3 viewPosition, std::vector<const TerrainNode*> &selection) const;
+	void setLodFactor(float factor);
+	//Rebuilds every node vertex sitting on a sample in [x0,x1]x[z0,z1] and the bounds of the nodes
+	//covering them, after an edit. Only the rebuilt vertex runs are written.
+	void refresh(uint32_t x0, uint32_t z0, uint32_t x1, uint32_t z1, const TerrainVertexWriter &write);
+
+	uint32_t getVerticesPerNode() const;
+	uint32_t getIndicesPerNode() const;
+	uint32_t getLevels() const;
+	size_t getNodeCount() const;
+	const std::vector<TerrainNode>& getNodes() const;
+};
+
+#endif //VULKANITE_TERRAINQUADTREE_H
@@ -0,0 +1,399 @@
+#include "TerrainRtin.h"
+#include "logger.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <glm/common.hpp>
+
+TerrainRtin::TerrainRtin(const Heightfield *inHeightfield, uint32_t inTileSize) :
+	heightfield(inHeightfield),
+	tileSize(inTileSize)
+{
+	if(tileSize < 2 || (tileSize & (tileSize - 1)) != 0)
+		throw std::runtime_error("RTIN tile size must be a power of two");
+
+	tilesX = (heightfield->width - 2) / tileSize + 1;
+	tilesZ = (heightfield->depth - 2) / tileSize + 1;
+	errors.resize(tilesX * tilesZ);
+
+	threadPool.resize(static_cast<int>(std::max(1u, std::thread::hardware_concurrency())));
+
+	buildTriangleCoords();
+	for(uint32_t tile = 0; tile < errors.size(); tile++)
+		threadPool.addJob([this, tile] { computeErrors(tile, true); });
+	threadPool.wait();
+
+	//Raising an edge vertex can raise its ancestors, which may sit on another edge
+	int passes = 1;
+	std::vector<uint8_t> touched;
+	while(syncEdges(touched))
+	{
+		for(uint32_t tile = 0; tile < errors.size(); tile++)
+		{
+			if(touched[tile])
+				threadPool.addJob([this, tile] { computeErrors(tile, false); });
+		}
+		threadPool.wait();
+		passes++;
+	}
+	Logger() << "RTIN errors for " << tilesX << "x" << tilesZ << " tiles settled in " << passes << " passes";
+}
+
+TerrainRtin::~TerrainRtin()
+{
+	threadPool.destroy();
+}
+
+void TerrainRtin::buildTriangleCoords()
+{
+	//Triangle ids follow the binary tree, the two roots split the tile along its diagonal
+	uint32_t triangleCount = tileSize * tileSize * 2 - 2;
+	triangleCoords.resize(triangleCount * 4);
+	for(uint32_t i = 0; i < triangleCount; i++)
+	{
+		uint32_t id = i + 2;
+		uint32_t ax = 0, az = 0, bx = 0, bz = 0, cx = 0, cz = 0;
+		if(id & 1)
+		{
+			bx = bz = cx = tileSize;
+		}
+		else
+		{
+			ax = az = cz = tileSize;
+		}
+		while((id >>= 1) > 1)
+		{
+			uint32_t mx = (ax + bx) >> 1;
+			uint32_t mz = (az + bz) >> 1;
+			if(id & 1)
+			{
+				bx = ax; bz = az;
+				ax = cx; az = cz;
+			}
+			else
+			{
+				ax = bx; az = bz;
+				bx = cx; bz = cz;
+			}
+			cx = mx;
+			cz = mz;
+		}
+		triangleCoords[i * 4 + 0] = ax;
+		triangleCoords[i * 4 + 1] = az;
+		triangleCoords[i * 4 + 2] = bx;
+		triangleCoords[i * 4 + 3] = bz;
+	}
+}
+
+void TerrainRtin::computeErrors(uint32_t tile, bool measure)
+{
+	uint32_t size = tileSize + 1;
+	uint32_t originX = (tile % tilesX) * tileSize;
+	uint32_t originZ = (tile / tilesX) * tileSize;
+	std::vector<float> &tileErrors = errors[tile];
+	if(measure)
+		tileErrors.assign(size * size, 0.0f);
+
+	auto triangleCount = static_cast<uint32_t>(triangleCoords.size() / 4);
+	uint32_t lastLevel = triangleCount - tileSize * tileSize;
+	//Finest triangles first so each midpoint can take the worst error of the ones below it
+	for(uint32_t i = triangleCount; i-- > 0;)
+	{
+		uint32_t ax = triangleCoords[i * 4 + 0];
+		uint32_t az = triangleCoords[i * 4 + 1];
+		uint32_t bx = triangleCoords[i * 4 + 2];
+		uint32_t bz = triangleCoords[i * 4 + 3];
+		uint32_t mx = (ax + bx) >> 1;
+		uint32_t mz = (az + bz) >> 1;
+		uint32_t cx = mx + mz - az;
+		uint32_t cz = mz + ax - mx;
+		float &middle = tileErrors[mz * size + mx];
+
+		if(measure)
+		{
+			//Triangles reaching past the heightfield always split so none of them survive into the mesh
+			uint32_t farX = originX + std::max(std::max(ax, bx), cx);
+			uint32_t farZ = originZ + std::max(std::max(az, bz), cz);
+			float middleError;
+			if(farX >= heightfield->width || farZ >= heightfield->depth)
+			{
+				middleError = std::numeric_limits<float>::max();
+			}
+			else
+			{
+				float interpolated = (heightfield->height(originX + ax, originZ + az) +
+				                      heightfield->height(originX + bx, originZ + bz)) / 2.0f;
+				middleError = std::fabs(interpolated - heightfield->height(originX + mx, originZ + mz));
+			}
+			middle = std::max(middle, middleError);
+		}
+
+		if(i < lastLevel)
+		{
+			float left = tileErrors[((az + cz) >> 1) * size + ((ax + cx) >> 1)];
+			float right = tileErrors[((bz + cz) >> 1) * size + ((bx + cx) >> 1)];
+			middle = std::max(middle, std::max(left, right));
+		}
+	}
+}
+
+bool TerrainRtin::syncEdges(std::vector<uint8_t> &touched)
+{
+	uint32_t size = tileSize + 1;
+	bool changed = false;
+	touched.assign(errors.size(), 0);
+	for(uint32_t tz = 0; tz < tilesZ; tz++)
+	{
+		for(uint32_t tx = 0; tx < tilesX; tx++)
+		{
+			std::vector<float> &tileErrors = errors[tz * tilesX + tx];
+			//Right edge against the left edge of the next tile along x
+			if(tx + 1 < tilesX)
+			{
+				std::vector<float> &next = errors[tz * tilesX + tx + 1];
+				for(uint32_t i = 1; i < tileSize; i++)
+				{
+					float &a = tileErrors[i * size + tileSize];
+					float &b = next[i * size];
+					if(a != b)
+					{
+						touched[a < b ? tz * tilesX + tx : tz * tilesX + tx + 1] = 1;
+						a = b = std::max(a, b);
+						changed = true;
+					}
+				}
+			}
+			//Far edge against the near edge of the next tile along z
+			if(tz + 1 < tilesZ)
+			{
+				std::vector<float> &next = errors[(tz + 1) * tilesX + tx];
+				for(uint32_t i = 1; i < tileSize; i++)
+				{
+					float &a = tileErrors[tileSize * size + i];
+					float &b = next[i];
+					if(a != b)
+					{
+						touched[a < b ? tz * tilesX + tx : (tz + 1) * tilesX + tx] = 1;
+						a = b = std::max(a, b);
+						changed = true;
+					}
+				}
+			}
+		}
+	}
+	return changed;
+}
+
+std::vector<uint32_t> TerrainRtin::refresh(uint32_t x0, uint32_t z0, uint32_t x1, uint32_t z1)
+{
+	//Samples on a tile edge belong to both sides. Neighbours are measured again as well so
+	//their shared edges drop errors taken from before the edit.
+	uint32_t firstX = x0 > 0 ? (x0 - 1) / tileSize : 0;
+	uint32_t firstZ = z0 > 0 ? (z0 - 1) / tileSize : 0;
+	uint32_t lastX = std::min(x1 / tileSize + 1, tilesX - 1);
+	uint32_t lastZ = std::min(z1 / tileSize + 1, tilesZ - 1);
+	firstX = firstX > 0 ? firstX - 1 : 0;
+	firstZ = firstZ > 0 ? firstZ - 1 : 0;
+
+	std::vector<uint8_t> rebuild(errors.size(), 0);
+	for(uint32_t tz = firstZ; tz <= lastZ; tz++)
+	{
+		for(uint32_t tx = firstX; tx <= lastX; tx++)
+		{
+			uint32_t tile = tz * tilesX + tx;
+			rebuild[tile] = 1;
+			threadPool.addJob([this, tile] { computeErrors(tile, true); });
+		}
+	}
+	threadPool.wait();
+
+	//Anything an edge raised has to be rebuilt too, even outside the rectangle
+	std::vector<uint8_t> touched;
+	while(syncEdges(touched))
+	{
+		for(uint32_t tile = 0; tile < errors.size(); tile++)
+		{
+			if(!touched[tile])
+				continue;
+			rebuild[tile] = 1;
+			threadPool.addJob([this, tile] { computeErrors(tile, false); });
+		}
+		threadPool.wait();
+	}
+
+	std::vector<uint32_t> tiles;
+	for(uint32_t tile = 0; tile < errors.size(); tile++)
+	{
+		if(rebuild[tile])
+			tiles.emplace_back(tile);
+	}
+	return tiles;
+}
+
+void TerrainRtin::buildTile(uint32_t tile, float maxError, std::vector<TerrainVertex> &vertices,
+                            std::vector<uint32_t> &indices) const
+{
+	uint32_t size = tileSize + 1;
+	uint32_t originX = (tile % tilesX) * tileSize;
+	uint32_t originZ = (tile / tilesX) * tileSize;
+	const std::vector<float> &tileErrors = errors[tile];
+	std::vector<int32_t> vertexIndices(size * size, -1);
+
+	auto addVertex = [&](uint32_t x, uint32_t z) -> uint32_t
+	{
+		int32_t &index = vertexIndices[z * size + x];
+		if(index < 0)
+		{
+			auto gx = static_cast<int>(originX + x);
+			auto gz = static_cast<int>(originZ + z);
+			TerrainVertex v{};
+			v.position = heightfield->position(gx, gz);
+			v.normal = heightfield->normal(gx, gz);
+			index = static_cast<int32_t>(vertices.size());
+			vertices.emplace_back(v);
+		}
+		return static_cast<uint32_t>(index);
+	};
+
+	struct Triangle
+	{
+		uint32_t ax, az, bx, bz, cx, cz;
+	};
+	std::vector<Triangle> stack;
+	stack.push_back({0, 0, tileSize, tileSize, tileSize, 0});
+	stack.push_back({tileSize, tileSize, 0, 0, 0, tileSize});
+	while(!stack.empty())
+	{
+		Triangle t = stack.back();
+		stack.pop_back();
+
+		uint32_t mx = (t.ax + t.bx) >> 1;
+		uint32_t mz = (t.az + t.bz) >> 1;
+		bool canSplit = std::abs(static_cast<int>(t.ax) - static_cast<int>(t.cx)) +
+		                std::abs(static_cast<int>(t.az) - static_cast<int>(t.cz)) > 1;
+		if(canSplit && tileErrors[mz * size + mx] > maxError)
+		{
+			stack.push_back({t.cx, t.cz, t.ax, t.az, mx, mz});
+			stack.push_back({t.bx, t.bz, t.cx, t.cz, mx, mz});
+			continue;
+		}
+
+		//Only finest triangles past the heightfield get here, and they lie wholly outside it
+		if(originX + std::max(std::max(t.ax, t.bx), t.cx) >= heightfield->width ||
+		   originZ + std::max(std::max(t.az, t.bz), t.cz) >= heightfield->depth)
+			continue;
+
+		indices.emplace_back(addVertex(t.ax, t.az));
+		indices.emplace_back(addVertex(t.bx, t.bz));
+		indices.emplace_back(addVertex(t.cx, t.cz));
+	}
+}
+
+static uint32_t slotCapacity(size_t count, uint32_t minimum)
+{
+	auto capacity = static_cast<uint32_t>(count + count / TERRAIN_RTIN_SLOT_SLACK);
+	return std::max(capacity, minimum);
+}
+
+void TerrainRtin::build(float maxError, std::vector<TerrainVertex> &vertices, std::vector<uint32_t> &indices,
+                        std::vector<TerrainChunk> &chunks)
+{
+	auto tileCount = static_cast<uint32_t>(errors.size());
+	std::vector<std::vector<TerrainVertex> > tileVertices(tileCount);
+	std::vector<std::vector<uint32_t> > tileIndices(tileCount);
+	for(uint32_t tile = 0; tile < tileCount; tile++)
+	{
+		threadPool.addJob([this, tile, maxError, &tileVertices, &tileIndices]
+		{
+			buildTile(tile, maxError, tileVertices[tile], tileIndices[tile]);
+		});
+	}
+	threadPool.wait();
+
+	//Tiles keep their own copy of shared edge vertices, identical on both sides. Every tile
+	//covers at least one cell, so chunks line up with tiles. Indices stay relative to the
+	//tile, which keeps them narrow enough for 16 bits however large the mesh is.
+	vertices.clear();
+	indices.clear();
+	chunks.clear();
+	slots.clear();
+	for(uint32_t tile = 0; tile < tileCount; tile++)
+	{
+		TerrainRtinSlot slot = {};
+		slot.firstVertex = static_cast<uint32_t>(vertices.size());
+		slot.vertexCapacity = slotCapacity(tileVertices[tile].size(), TERRAIN_RTIN_SLOT_MIN_VERTICES);
+		slot.firstIndex = static_cast<uint32_t>(indices.size());
+		slot.indexCapacity = slotCapacity(tileIndices[tile].size(), TERRAIN_RTIN_SLOT_MIN_INDICES);
+		slots.emplace_back(slot);
+
+		TerrainChunk chunk = {};
+		chunk.firstIndex = slot.firstIndex;
+		chunk.indexCount = static_cast<uint32_t>(tileIndices[tile].size());
+		chunk.vertexOffset = static_cast<int32_t>(slot.firstVertex);
+		chunk.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+		chunk.boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+		for(auto &&vertex : tileVertices[tile])
+		{
+			chunk.boundsMin = glm::min(chunk.boundsMin, vertex.position);
+			chunk.boundsMax = glm::max(chunk.boundsMax, vertex.position);
+		}
+		chunks.emplace_back(chunk);
+
+		//Slack is never drawn
+		vertices.insert(vertices.end(), tileVertices[tile].begin(), tileVertices[tile].end());
+		vertices.resize(slot.firstVertex + slot.vertexCapacity);
+		indices.insert(indices.end(), tileIndices[tile].begin(), tileIndices[tile].end());
+		indices.resize(slot.firstIndex + slot.indexCapacity, 0);
+	}
+	vertexEnd = static_cast<uint32_t>(vertices.size());
+	indexEnd = static_cast<uint32_t>(indices.size());
+}
+
+void TerrainRtin::adoptLayout(const std::vector<TerrainChunk> &chunks, uint32_t vertexCount, uint32_t indexCount)
+{
+	if(chunks.size() != errors.size())
+		throw std::runtime_error("Terrain chunks don't match the RTIN tiles");
+
+	//Build packs slots back to back in tile order, so each one runs up to the next
+	slots.resize(chunks.size());
+	for(size_t tile = 0; tile < chunks.size(); tile++)
+	{
+		bool last = tile + 1 == chunks.size();
+		TerrainRtinSlot &slot = slots[tile];
+		slot.firstVertex = static_cast<uint32_t>(chunks[tile].vertexOffset);
+		slot.vertexCapacity = (last ? vertexCount : static_cast<uint32_t>(chunks[tile + 1].vertexOffset)) -
+		                      slot.firstVertex;
+		slot.firstIndex = chunks[tile].firstIndex;
+		slot.indexCapacity = (last ? indexCount : chunks[tile + 1].firstIndex) - slot.firstIndex;
+	}
+	vertexEnd = vertexCount;
+	indexEnd = indexCount;
+}
+
+const TerrainRtinSlot &TerrainRtin::reserve(uint32_t tile, uint32_t vertexCount, uint32_t indexCount)
+{
+	TerrainRtinSlot &slot = slots[tile];
+	if(vertexCount <= slot.vertexCapacity && indexCount <= slot.indexCapacity)
+		return slot;
+
+	//The old space is only reclaimed by the next build
+	slot.firstVertex = vertexEnd;
+	slot.vertexCapacity = slotCapacity(vertexCount, TERRAIN_RTIN_SLOT_MIN_VERTICES);
+	slot.firstIndex = indexEnd;
+	slot.indexCapacity = slotCapacity(indexCount, TERRAIN_RTIN_SLOT_MIN_INDICES);
+	vertexEnd += slot.vertexCapacity;
+	indexEnd += slot.indexCapacity;
+	return slot;
+}
+
+uint32_t TerrainRtin::getVertexCount() const
+{
+	return vertexEnd;
+}
+
+uint32_t TerrainRtin::getIndexCount() const
+{
+	return indexEnd;
+}
@@ -0,0 +1,72 @@
+#ifndef VULKANITE_TERRAINRTIN_H
+#define VULKANITE_TERRAINRTIN_H
+
+#include <vector>
+#include <cstdint>
+#include "Heightfield.h"
+#include "GenericThreadPool.h"
+#include "Terrain.h"
+#include "TerrainCuller.h"
+
+//Slots get a quarter more room than their tile needs, so edits can refine a tile in place
+#define TERRAIN_RTIN_SLOT_SLACK 4
+//Flat tiles are only two triangles, the minimum leaves them room for a brush stroke
+#define TERRAIN_RTIN_SLOT_MIN_VERTICES 256
+#define TERRAIN_RTIN_SLOT_MIN_INDICES 1536
+
+//Where one tile's vertices and indices sit in the mesh, its indices are relative to firstVertex
+struct TerrainRtinSlot
+{
+	uint32_t firstVertex;
+	uint32_t vertexCapacity;
+	uint32_t firstIndex;
+	uint32_t indexCapacity;
+};
+
+//Right triangulated irregular network over square tiles of the heightfield. Each tile
+//keeps the vertical error of every vertex it could add, so meshes for any tolerance
+//come from one recursive walk per tile. Errors along shared tile edges are kept equal
+//so neighbouring tiles pick the same edge vertices and meet without cracks.
+class TerrainRtin
+{
+	const Heightfield* heightfield;
+	uint32_t tileSize;
+	uint32_t tilesX;
+	uint32_t tilesZ;
+	//Two corners of every triangle in the binary tree, shared by all tiles
+	std::vector<uint32_t> triangleCoords;
+	std::vector<std::vector<float> > errors;
+	//Layout of the mesh, slots moved by reserve leave their old space unused until the next build
+	std::vector<TerrainRtinSlot> slots;
+	uint32_t vertexEnd = 0;
+	uint32_t indexEnd = 0;
+	GenericThreadPool threadPool;
+
+	void buildTriangleCoords();
+	void computeErrors(uint32_t tile, bool measure);
+	bool syncEdges(std::vector<uint8_t> &touched);
+
+public:
+	//tileSize must be a power of two, partial tiles at the far edges are handled
+	TerrainRtin(const Heightfield* inHeightfield, uint32_t inTileSize);
+	~TerrainRtin();
+
+	//Mesh whose height never strays more than maxError from the heightfield
+	//Each tile becomes one chunk covering its range of indices, inside a slot with room to grow
+	void build(float maxError, std::vector<TerrainVertex> &vertices, std::vector<uint32_t> &indices,
+	           std::vector<TerrainChunk> &chunks);
+	//Takes the slots of a mesh an earlier build laid out, such as one loaded from the cache
+	void adoptLayout(const std::vector<TerrainChunk> &chunks, uint32_t vertexCount, uint32_t indexCount);
+	//Slot for a rebuilt tile, moved past the end of the mesh when the tile has outgrown its own
+	const TerrainRtinSlot &reserve(uint32_t tile, uint32_t vertexCount, uint32_t indexCount);
+	//Extent of the mesh including every slot
+	uint32_t getVertexCount() const;
+	uint32_t getIndexCount() const;
+	//Measures the tiles over an edited rectangle of samples again, returns every tile whose mesh changed
+	std::vector<uint32_t> refresh(uint32_t x0, uint32_t z0, uint32_t x1, uint32_t z1);
+	//Vertices and tile relative indices of a single tile
+	void buildTile(uint32_t tile, float maxError, std::vector<TerrainVertex> &vertices,
+	               std::vector<uint32_t> &indices) const;
+};
+
+#endif //VULKANITE_TERRAINRTIN_H
@@ -0,0 +1,359 @@
+#include "TerrainStreamer.h"
+#include "vulkanInterface.h"
+#include "logger.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+//Frames an evicted buffer is kept alive for in case it is still being drawn
+#define TERRAIN_RETIRE_FRAMES 3
+
+TerrainStreamer::TerrainStreamer(VulkanInterface *inVulkanInterface, const std::string &filename,
+                                 float inLoadRadius, VkDeviceSize inMemoryBudget) :
+	vki(inVulkanInterface),
+	tileFile(filename),
+	loadRadius(inLoadRadius),
+	memoryBudget(inMemoryBudget)
+{
+	threadPool.resize(2);
+}
+
+TerrainStreamer::~TerrainStreamer()
+{
+	threadPool.wait();
+	threadPool.destroy();
+
+	for(auto &&entry : tiles)
+	{
+		TerrainTile* tile = entry.second;
+		if(tile->state == TILE_UPLOADING)
+		{
+			vkWaitForFences(vki->logicalDevice, 1, &tile->uploadFence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+			vkDestroyFence(vki->logicalDevice, tile->uploadFence, nullptr);
+			vkFreeCommandBuffers(vki->logicalDevice, vki->commandPool, 1, &tile->uploadCommandBuffer);
+			vkDestroyBuffer(vki->logicalDevice, tile->stagingBuffer, nullptr);
+			vkFreeMemory(vki->logicalDevice, tile->stagingBufferMemory, nullptr);
+		}
+		vkDestroyBuffer(vki->logicalDevice, tile->vertexBuffer, nullptr);
+		vkFreeMemory(vki->logicalDevice, tile->vertexBufferMemory, nullptr);
+		delete tile;
+	}
+	tiles.clear();
+
+	destroyRetired(true);
+}
+
+void TerrainStreamer::update(glm::vec3 viewPosition)
+{
+	frameIndex++;
+
+	{
+		std::unique_lock<std::mutex> lock(loadedMutex);
+		for(auto &&tile : loadedTiles)
+			tile->state = TILE_LOADED;
+		loadedTiles.clear();
+	}
+
+	finishUploads();
+	requestTiles(viewPosition);
+
+	//Tiles still wanted this frame get the upload slots, the rest are dropped before costing device memory
+	uint32_t uploads = 0;
+	for(auto it = tiles.begin(); it != tiles.end();)
+	{
+		TerrainTile* tile = it->second;
+		if(tile->state == TILE_LOADED)
+		{
+			if(tile->lastUsedFrame != frameIndex)
+			{
+				delete tile;
+				it = tiles.erase(it);
+				continue;
+			}
+			if(uploads < maxUploadsPerFrame)
+			{
+				beginUpload(tile);
+				uploads++;
+			}
+		}
+		++it;
+	}
+
+	evictTiles();
+	destroyRetired(false);
+}
+
+void TerrainStreamer::requestTiles(glm::vec3 viewPosition)
+{
+	const TerrainTileHeader& header = tileFile.getHeader();
+	float tileWidth = header.tileSize * header.spacingX;
+	float tileDepth = header.tileSize * header.spacingZ;
+
+	auto firstX = static_cast<int>(std::floor((viewPosition.x - loadRadius) / tileWidth));
+	auto lastX = static_cast<int>(std::floor((viewPosition.x + loadRadius) / tileWidth));
+	auto firstZ = static_cast<int>(std::floor((viewPosition.z - loadRadius) / tileDepth));
+	auto lastZ = static_cast<int>(std::floor((viewPosition.z + loadRadius) / tileDepth));
+	firstX = std::max(firstX, 0);
+	firstZ = std::max(firstZ, 0);
+	lastX = std::min(lastX, static_cast<int>(header.tilesX) - 1);
+	lastZ = std::min(lastZ, static_cast<int>(header.tilesZ) - 1);
+
+	std::vector<std::pair<float, TerrainTile*> > missing;
+	for(int z = firstZ; z <= lastZ; z++)
+	{
+		for(int x = firstX; x <= lastX; x++)
+		{
+			glm::vec2 tileMin(x * tileWidth, z * tileDepth);
+			glm::vec2 view(viewPosition.x, viewPosition.z);
+			glm::vec2 closest = glm::clamp(view, tileMin, tileMin + glm::vec2(tileWidth, tileDepth));
+			float distance = glm::distance(closest, view);
+			if(distance > loadRadius)
+				continue;
+
+			uint32_t key = static_cast<uint32_t>(z) * header.tilesX + static_cast<uint32_t>(x);
+			auto found = tiles.find(key);
+			if(found != tiles.end())
+			{
+				found->second->lastUsedFrame = frameIndex;
+				continue;
+			}
+
+			auto tile = new TerrainTile();
+			tile->x = static_cast<uint32_t>(x);
+			tile->z = static_cast<uint32_t>(z);
+			tile->state = TILE_LOADING;
+			tile->lastUsedFrame = frameIndex;
+			tiles[key] = tile;
+			missing.emplace_back(distance, tile);
+		}
+	}
+
+	//Nearest tiles are queued first
+	std::sort(missing.begin(), missing.end(),
+	          [](const std::pair<float, TerrainTile*> &a, const std::pair<float, TerrainTile*> &b)
+	          {
+		          return a.first < b.first;
+	          });
+	for(auto &&request : missing)
+	{
+		threadPool.addJob(std::bind(&TerrainStreamer::loadTile, this, request.second));
+	}
+}
+
+void TerrainStreamer::loadTile(TerrainTile *tile)
+{
+	const TerrainTileHeader& header = tileFile.getHeader();
+	uint32_t stride = tileFile.getTileStride();
+	uint32_t row = header.tileSize + 1;
+	//Touching the mapping here is what pulls the tile in from disk
+	const float* heights = tileFile.tileHeights(tile->x, tile->z);
+
+	tile->vertices.resize(row * row);
+	tile->boundsMin = glm::vec3(std::numeric_limits<float>::max());
+	tile->boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+
+	for(uint32_t gz = 0; gz < row; gz++)
+	{
+		for(uint32_t gx = 0; gx < row; gx++)
+		{
+			//Skip the apron
+			const float* sample = &heights[(gz + 1) * stride + gx + 1];
+			uint32_t sx = std::min(tile->x * header.tileSize + gx, header.width - 1);
+			uint32_t sz = std::min(tile->z * header.tileSize + gz, header.depth - 1);
+
+			TerrainVertex v{};
+			v.position = glm::vec3(sx * header.spacingX, *sample, sz * header.spacingZ);
+			float dx = (sample[1] - sample[-1]) / (2.0f * header.spacingX);
+			float dz = (sample[stride] - sample[-static_cast<int>(stride)]) / (2.0f * header.spacingZ);
+			v.normal = glm::normalize(glm::vec3(-dx, 1.0f, -dz));
+			tile->vertices[gz * row + gx] = v;
+
+			tile->boundsMin = glm::min(tile->boundsMin, v.position);
+			tile->boundsMax = glm::max(tile->boundsMax, v.position);
+		}
+	}
+
+	std::unique_lock<std::mutex> lock(loadedMutex);
+	loadedTiles.emplace_back(tile);
+}
+
+void TerrainStreamer::beginUpload(TerrainTile *tile)
+{
+	VkDeviceSize bufferSize = sizeof(TerrainVertex) * tile->vertices.size();
+	vki->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+	                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	                  tile->stagingBuffer, tile->stagingBufferMemory);
+
+	void* data;
+	vkMapMemory(vki->logicalDevice, tile->stagingBufferMemory, 0, bufferSize, 0, &data);
+	memcpy(data, tile->vertices.data(), bufferSize);
+	vkUnmapMemory(vki->logicalDevice, tile->stagingBufferMemory);
+
+	vki->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+	                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+	                  tile->vertexBuffer, tile->vertexBufferMemory);
+
+	VkCommandBufferAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandPool = vki->commandPool;
+	allocInfo.commandBufferCount = 1;
+	VK_RESULT_CHECK(vkAllocateCommandBuffers(vki->logicalDevice, &allocInfo, &tile->uploadCommandBuffer))
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(tile->uploadCommandBuffer, &beginInfo);
+
+	VkBufferCopy copyRegion = {};
+	copyRegion.size = bufferSize;
+	vkCmdCopyBuffer(tile->uploadCommandBuffer, tile->stagingBuffer, tile->vertexBuffer, 1, &copyRegion);
+
+	VK_RESULT_CHECK(vkEndCommandBuffer(tile->uploadCommandBuffer))
+
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	VK_RESULT_CHECK(vkCreateFence(vki->logicalDevice, &fenceInfo, nullptr, &tile->uploadFence))
+
+	//Polled in finishUploads rather than waited on
+	vki->submitAsync(tile->uploadCommandBuffer, tile->uploadFence);
+
+	tile->vertices.clear();
+	tile->vertices.shrink_to_fit();
+	tile->state = TILE_UPLOADING;
+	residentBytes += bufferSize;
+}
+
+void TerrainStreamer::finishUploads()
+{
+	for(auto &&entry : tiles)
+	{
+		TerrainTile* tile = entry.second;
+		if(tile->state != TILE_UPLOADING)
+			continue;
+		if(vkGetFenceStatus(vki->logicalDevice, tile->uploadFence) != VK_SUCCESS)
+			continue;
+
+		vkDestroyFence(vki->logicalDevice, tile->uploadFence, nullptr);
+		vkFreeCommandBuffers(vki->logicalDevice, vki->commandPool, 1, &tile->uploadCommandBuffer);
+		vkDestroyBuffer(vki->logicalDevice, tile->stagingBuffer, nullptr);
+		vkFreeMemory(vki->logicalDevice, tile->stagingBufferMemory, nullptr);
+		tile->uploadFence = VK_NULL_HANDLE;
+		tile->uploadCommandBuffer = VK_NULL_HANDLE;
+		tile->stagingBuffer = VK_NULL_HANDLE;
+		tile->stagingBufferMemory = VK_NULL_HANDLE;
+		tile->state = TILE_RESIDENT;
+	}
+}
+
+void TerrainStreamer::evictTiles()
+{
+	const TerrainTileHeader& header = tileFile.getHeader();
+	VkDeviceSize tileBytes = sizeof(TerrainVertex) * (header.tileSize + 1) * (header.tileSize + 1);
+
+	while(residentBytes > memoryBudget)
+	{
+		//Least recently used resident tile that isn't needed this frame
+		auto oldest = tiles.end();
+		for(auto it = tiles.begin(); it != tiles.end(); ++it)
+		{
+			if(it->second->state != TILE_RESIDENT || it->second->lastUsedFrame == frameIndex)
+				continue;
+			if(oldest == tiles.end() || it->second->lastUsedFrame < oldest->second->lastUsedFrame)
+				oldest = it;
+		}
+		if(oldest == tiles.end())
+			break;
+
+		retire(oldest->second->vertexBuffer, oldest->second->vertexBufferMemory);
+		residentBytes -= tileBytes;
+		delete oldest->second;
+		tiles.erase(oldest);
+	}
+}
+
+void TerrainStreamer::retire(VkBuffer buffer, VkDeviceMemory memory)
+{
+	RetiredBuffer retired = {buffer, memory, frameIndex};
+	retiredBuffers.emplace_back(retired);
+}
+
+void TerrainStreamer::destroyRetired(bool all)
+{
+	for(auto it = retiredBuffers.begin(); it != retiredBuffers.end();)
+	{
+		if(all || it->frame + TERRAIN_RETIRE_FRAMES <= frameIndex)
+		{
+			vkDestroyBuffer(vki->logicalDevice, it->buffer, nullptr);
+			vkFreeMemory(vki->logicalDevice, it->memory, nullptr);
+			it = retiredBuffers.erase(it);
+		}
+		else
+			++it;
+	}
+}
+
+void TerrainStreamer::getResidentTiles(std::vector<const TerrainTile *> &residentTiles) const
+{
+	residentTiles.clear();
+	for(auto &&entry : tiles)
+	{
+		if(entry.second->state == TILE_RESIDENT)
+			residentTiles.emplace_back(entry.second);
+	}
+}
+
+void TerrainStreamer::buildIndices(std::vector<uint32_t> &indices) const
+{
+	uint32_t tileSize = tileFile.getHeader().tileSize;
+	uint32_t row = tileSize + 1;
+
+	indices.clear();
+	indices.reserve(tileSize * tileSize * 6);
+	for(uint32_t i = 0; i < tileSize; i++)
+	{
+		for(uint32_t j = 0; j < tileSize; j++)
+		{
+			indices.emplace_back((i+1)*row + j+1);
+			indices.emplace_back(i*row + j+1);
+			indices.emplace_back(i*row + j);
+
+			indices.emplace_back(i*row + j);
+			indices.emplace_back((i+1)*row + j);
+			indices.emplace_back((i+1)*row + j+1);
+		}
+	}
+}
+
+void TerrainStreamer::setLoadRadius(float radius)
+{
+	loadRadius = radius;
+}
+
+void TerrainStreamer::setMemoryBudget(VkDeviceSize budget)
+{
+	memoryBudget = budget;
+}
+
+VkDeviceSize TerrainStreamer::getResidentBytes() const
+{
+	return residentBytes;
+}
+
+size_t TerrainStreamer::getResidentTileCount() const
+{
+	size_t count = 0;
+	for(auto &&entry : tiles)
+	{
+		if(entry.second->state == TILE_RESIDENT)
+			count++;
+	}
+	return count;
+}
+
+const TerrainTileHeader& TerrainStreamer::getHeader() const
+{
+	return tileFile.getHeader();
+}
@@ -0,0 +1,99 @@
+#ifndef VULKANITE_TERRAINSTREAMER_H
+#define VULKANITE_TERRAINSTREAMER_H
+
+#include <vulkan/vulkan.h>
+#include <glm/vec3.hpp>
+#include <unordered_map>
+#include <vector>
+#include <mutex>
+#include <string>
+#include "GenericThreadPool.h"
+#include "TerrainTileFile.h"
+#include "Terrain.h"
+
+class VulkanInterface;
+
+enum TerrainTileState
+{
+	//Heights being read and vertices built on a worker
+	TILE_LOADING,
+	//Vertices ready on the CPU, waiting for an upload slot
+	TILE_LOADED,
+	//Copy to device memory submitted, waiting on its fence
+	TILE_UPLOADING,
+	TILE_RESIDENT
+};
+
+struct TerrainTile
+{
+	uint32_t x;
+	uint32_t z;
+	TerrainTileState state;
+	uint64_t lastUsedFrame;
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+
+	std::vector<TerrainVertex> vertices;
+
+	VkBuffer vertexBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory vertexBufferMemory = VK_NULL_HANDLE;
+	VkBuffer stagingBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory stagingBufferMemory = VK_NULL_HANDLE;
+	VkCommandBuffer uploadCommandBuffer = VK_NULL_HANDLE;
+	VkFence uploadFence = VK_NULL_HANDLE;
+};
+
+//Keeps the tiles around the viewer resident. Tiles are read from the mapped file and built
+//on worker threads, uploaded from the main thread without stalling and evicted least
+//recently used first once the device memory budget is exceeded.
+class TerrainStreamer
+{
+	struct RetiredBuffer
+	{
+		VkBuffer buffer;
+		VkDeviceMemory memory;
+		uint64_t frame;
+	};
+
+	VulkanInterface* vki;
+	TerrainTileFile tileFile;
+	GenericThreadPool threadPool;
+
+	std::unordered_map<uint32_t, TerrainTile*> tiles;
+	std::mutex loadedMutex;
+	std::vector<TerrainTile*> loadedTiles;
+	//Evicted buffers may still be read by frames in flight
+	std::vector<RetiredBuffer> retiredBuffers;
+
+	uint64_t frameIndex = 0;
+	float loadRadius;
+	VkDeviceSize memoryBudget;
+	VkDeviceSize residentBytes = 0;
+	uint32_t maxUploadsPerFrame = 4;
+
+	void loadTile(TerrainTile* tile);
+	void beginUpload(TerrainTile* tile);
+	void finishUploads();
+	void requestTiles(glm::vec3 viewPosition);
+	void evictTiles();
+	void destroyRetired(bool all);
+	void retire(VkBuffer buffer, VkDeviceMemory memory);
+
+public:
+	TerrainStreamer(VulkanInterface* inVulkanInterface, const std::string &filename,
+	                float inLoadRadius, VkDeviceSize inMemoryBudget);
+	~TerrainStreamer();
+
+	//Call once per frame before drawing
+	void update(glm::vec3 viewPosition);
+	void getResidentTiles(std::vector<const TerrainTile*> &residentTiles) const;
+	void buildIndices(std::vector<uint32_t> &indices) const;
+
+	void setLoadRadius(float radius);
+	void setMemoryBudget(VkDeviceSize budget);
+	VkDeviceSize getResidentBytes() const;
+	size_t getResidentTileCount() const;
+	const TerrainTileHeader& getHeader() const;
+};
+
+#endif //VULKANITE_TERRAINSTREAMER_H
@@ -0,0 +1,185 @@
+#include "TerrainTileFile.h"
+#include "HeightmapReader.h"
+#include "logger.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+TerrainTileFile::TerrainTileFile(const std::string &filename) :
+	file(filename)
+{
+	if(file.size() < sizeof(TerrainTileHeader))
+		throw std::runtime_error("Terrain tile file too small " + filename);
+
+	memcpy(&header, file.data(), sizeof(header));
+	if(header.magic != TERRAIN_TILE_MAGIC)
+		throw std::runtime_error("Not a terrain tile file " + filename);
+	if(header.version != TERRAIN_TILE_VERSION)
+		throw std::runtime_error("Unsupported terrain tile version " + filename);
+	if(header.tileSize == 0 || header.tilesX == 0 || header.tilesZ == 0)
+		throw std::runtime_error("Terrain tile file has no tiles " + filename);
+	if(file.size() < tileOffset(header, header.tilesX - 1, header.tilesZ - 1) + getTileBytes())
+		throw std::runtime_error("Terrain tile file is truncated " + filename);
+
+	Logger() << "Terrain tile file " << filename << " mapped, " << header.tilesX << "x" << header.tilesZ
+	         << " tiles of " << header.tileSize;
+}
+
+const TerrainTileHeader& TerrainTileFile::getHeader() const
+{
+	return header;
+}
+
+uint32_t TerrainTileFile::getTileStride() const
+{
+	return header.tileSize + 3;
+}
+
+size_t TerrainTileFile::getTileBytes() const
+{
+	return sizeof(float) * getTileStride() * getTileStride();
+}
+
+const float* TerrainTileFile::tileHeights(uint32_t tileX, uint32_t tileZ) const
+{
+	return reinterpret_cast<const float*>(file.data() + tileOffset(header, tileX, tileZ));
+}
+
+size_t TerrainTileFile::tileOffset(const TerrainTileHeader &header, uint32_t tileX, uint32_t tileZ)
+{
+	size_t stride = header.tileSize + 3;
+	size_t tileBytes = sizeof(float) * stride * stride;
+	return sizeof(TerrainTileHeader) + (static_cast<size_t>(tileZ) * header.tilesX + tileX) * tileBytes;
+}
+
+void TerrainTileFile::write(const Heightfield &heightfield, uint32_t tileSize, const std::string &filename)
+{
+	TerrainTileHeader header = {};
+	header.magic = TERRAIN_TILE_MAGIC;
+	header.version = TERRAIN_TILE_VERSION;
+	header.tileSize = tileSize;
+	header.tilesX = (heightfield.width - 1 + tileSize - 1) / tileSize;
+	header.tilesZ = (heightfield.depth - 1 + tileSize - 1) / tileSize;
+	header.width = heightfield.width;
+	header.depth = heightfield.depth;
+	header.spacingX = heightfield.spacingX;
+	header.spacingZ = heightfield.spacingZ;
+
+	std::ofstream stream(filename.c_str(), std::ios::binary);
+	if(!stream.is_open())
+		throw std::runtime_error("Could not write terrain tile file " + filename);
+	stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	uint32_t stride = tileSize + 3;
+	std::vector<float> tile(stride * stride);
+	for(uint32_t tz = 0; tz < header.tilesZ; tz++)
+	{
+		for(uint32_t tx = 0; tx < header.tilesX; tx++)
+		{
+			//Apron starts one sample before the tile, samples past the world edge clamp
+			int baseX = static_cast<int>(tx * tileSize) - 1;
+			int baseZ = static_cast<int>(tz * tileSize) - 1;
+			for(uint32_t z = 0; z < stride; z++)
+			{
+				for(uint32_t x = 0; x < stride; x++)
+				{
+					tile[z * stride + x] = heightfield.height(baseX + static_cast<int>(x), baseZ + static_cast<int>(z));
+				}
+			}
+			stream.write(reinterpret_cast<const char*>(tile.data()), sizeof(float) * tile.size());
+		}
+	}
+
+	Logger() << "Terrain tile file " << filename << " written, " << header.tilesX << "x" << header.tilesZ << " tiles";
+}
+
+void TerrainTileFile::write(HeightmapReader &reader, float heightScale, float spacingX, float spacingZ,
+                            uint32_t tileSize, const std::string &filename)
+{
+	if(reader.getWidth() < 2 || reader.getDepth() < 2)
+		throw std::runtime_error("Heightmap is too small for terrain tiles " + filename);
+	if(tileSize == 0)
+		throw std::runtime_error("Terrain tiles need at least one sample " + filename);
+
+	TerrainTileHeader header = {};
+	header.magic = TERRAIN_TILE_MAGIC;
+	header.version = TERRAIN_TILE_VERSION;
+	header.tileSize = tileSize;
+	header.tilesX = (reader.getWidth() - 1 + tileSize - 1) / tileSize;
+	header.tilesZ = (reader.getDepth() - 1 + tileSize - 1) / tileSize;
+	header.width = reader.getWidth();
+	header.depth = reader.getDepth();
+	header.spacingX = spacingX;
+	header.spacingZ = spacingZ;
+
+	std::ofstream stream(filename.c_str(), std::ios::binary);
+	if(!stream.is_open())
+		throw std::runtime_error("Could not write terrain tile file " + filename);
+	stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	//Band row r holds source row tz * tileSize - 1 + r, consecutive bands overlap by the 3 rows
+	//of apron and shared border so the source is only ever read once from top to bottom
+	size_t width = header.width;
+	uint32_t stride = tileSize + 3;
+	std::vector<float> band(stride * width);
+	std::vector<float> tile(stride * stride);
+	for(uint32_t tz = 0; tz < header.tilesZ; tz++)
+	{
+		uint32_t firstNewRow = 0;
+		if(tz > 0)
+		{
+			memmove(band.data(), band.data() + tileSize * width, sizeof(float) * 3 * width);
+			firstNewRow = 3;
+		}
+		for(uint32_t r = firstNewRow; r < stride; r++)
+		{
+			float* row = band.data() + r * width;
+			int z = static_cast<int>(tz * tileSize + r) - 1;
+			//Rows outside the source clamp to the edge, which is always the row just before or after
+			if(z < 0)
+				continue;
+			if(z < static_cast<int>(header.depth))
+			{
+				if(reader.readRows(row, 1) != 1)
+				{
+					//Nothing should stream a half written file
+					stream.close();
+					std::remove(filename.c_str());
+					throw std::runtime_error("Heightmap is truncated, terrain tiles not written " + filename);
+				}
+				for(size_t x = 0; x < width; x++)
+					row[x] *= heightScale;
+			}
+			else
+				memcpy(row, row - width, sizeof(float) * width);
+			if(z == 0)
+				memcpy(band.data(), row, sizeof(float) * width);
+		}
+
+		for(uint32_t tx = 0; tx < header.tilesX; tx++)
+		{
+			int baseX = static_cast<int>(tx * tileSize) - 1;
+			for(uint32_t z = 0; z < stride; z++)
+			{
+				const float* row = band.data() + z * width;
+				for(uint32_t x = 0; x < stride; x++)
+				{
+					int sourceX = std::min(std::max(baseX + static_cast<int>(x), 0), static_cast<int>(width) - 1);
+					tile[z * stride + x] = row[sourceX];
+				}
+			}
+			stream.write(reinterpret_cast<const char*>(tile.data()), sizeof(float) * tile.size());
+		}
+
+		if(tz % 64 == 63)
+			Logger() << "Terrain tile file " << filename << " " << tz + 1 << "/" << header.tilesZ << " tile rows";
+	}
+	if(!stream)
+		throw std::runtime_error("Could not write terrain tile file " + filename);
+
+	Logger() << "Terrain tile file " << filename << " written, " << header.tilesX << "x" << header.tilesZ
+	         << " tiles from " << header.width << "x" << header.depth << " samples";
+}
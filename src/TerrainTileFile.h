@@ -0,0 +1,53 @@
+#ifndef VULKANITE_TERRAINTILEFILE_H
+#define VULKANITE_TERRAINTILEFILE_H
+
+#include <cstdint>
+#include <string>
+#include "MappedFile.h"
+#include "Heightfield.h"
+
+class HeightmapReader;
+
+#define TERRAIN_TILE_MAGIC 0x4C545456 //"VTTL"
+#define TERRAIN_TILE_VERSION 1
+
+struct TerrainTileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	//Quads along a tile edge, neighbouring tiles share their border samples
+	uint32_t tileSize;
+	uint32_t tilesX;
+	uint32_t tilesZ;
+	//Samples in the whole world
+	uint32_t width;
+	uint32_t depth;
+	float spacingX;
+	float spacingZ;
+};
+
+//Heightmap split into fixed size tiles of float heights, stored back to back after the header.
+//Each tile keeps a one sample apron on every side so normals can be built without its neighbours.
+class TerrainTileFile
+{
+	MappedFile file;
+	TerrainTileHeader header;
+
+public:
+	explicit TerrainTileFile(const std::string &filename);
+
+	const TerrainTileHeader& getHeader() const;
+	//Samples along a stored tile edge, tileSize + 1 plus the apron
+	uint32_t getTileStride() const;
+	size_t getTileBytes() const;
+	//Row major tile heights including the apron, backed by the mapping
+	const float* tileHeights(uint32_t tileX, uint32_t tileZ) const;
+
+	static size_t tileOffset(const TerrainTileHeader &header, uint32_t tileX, uint32_t tileZ);
+	static void write(const Heightfield &heightfield, uint32_t tileSize, const std::string &filename);
+	//Converts a heightmap a band of tile rows at a time, only tileSize + 3 source rows are held in memory
+	static void write(HeightmapReader &reader, float heightScale, float spacingX, float spacingZ,
+	                  uint32_t tileSize, const std::string &filename);
+};
+
+#endif //VULKANITE_TERRAINTILEFILE_H
@@ -0,0 +1,490 @@
+#include "TerrainVirtualTexture.h"
+#include "vulkanInterface.h"
+#include "StagingRing.h"
+#include "Texture.h"
+#include "logger.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+TerrainVirtualTexture::TerrainVirtualTexture(VulkanInterface* inVulkan, const Heightfield* inHeightfield,
+                                             const Texture* material, const ImageAttachment &heightTexture,
+                                             VkSampler heightSampler, float texelsPerUnit) :
+	vki(inVulkan),
+	heightfield(inHeightfield)
+{
+	virtualSize = std::max(heightfield->worldWidth(), heightfield->worldDepth());
+
+	//Finest level pages, a power of two so every level halves cleanly, capped to keep keys and the table small
+	float contentTexels = TERRAIN_VT_PAGE_SIZE - 2 * TERRAIN_VT_PAGE_BORDER;
+	auto pagesNeeded = static_cast<uint32_t>(std::ceil(virtualSize * texelsPerUnit / contentTexels));
+	levelZeroPages = 1;
+	levels = 1;
+	while(levelZeroPages < pagesNeeded && levelZeroPages < 256)
+	{
+		levelZeroPages *= 2;
+		levels++;
+	}
+
+	auto minmax = std::minmax_element(heightfield->heights.begin(), heightfield->heights.end());
+	minHeight = *minmax.first;
+	maxHeight = *minmax.second;
+
+	pageTableData.assign(levelZeroPages * levelZeroPages * 4, 0);
+	createImages();
+	createBakePipeline(material, heightTexture, heightSampler);
+
+	Logger() << "Terrain virtual texture " << levelZeroPages * static_cast<uint32_t>(contentTexels) << " texels square over "
+	         << levels << " levels, " << TERRAIN_VT_CACHE_PAGES * TERRAIN_VT_CACHE_PAGES << " cached pages";
+}
+
+TerrainVirtualTexture::~TerrainVirtualTexture()
+{
+	vkDestroyPipeline(vki->logicalDevice, bakePipeline, nullptr);
+	vkDestroyPipelineLayout(vki->logicalDevice, bakePipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(vki->logicalDevice, bakeDescriptorSetLayout, nullptr);
+
+	vkDestroySampler(vki->logicalDevice, pageCacheSampler, nullptr);
+	vkDestroySampler(vki->logicalDevice, pageTableSampler, nullptr);
+	pageCache.destroy(vki->logicalDevice);
+	pageTable.destroy(vki->logicalDevice);
+}
+
+uint32_t TerrainVirtualTexture::pageKey(uint32_t level, uint32_t x, uint32_t z)
+{
+	return (level << 24) | (z << 12) | x;
+}
+
+float TerrainVirtualTexture::pageWorldSize(uint32_t level) const
+{
+	return virtualSize / (levelZeroPages >> level);
+}
+
+static VkSampler createPageSampler(VkDevice logicalDevice, VkFilter filter)
+{
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = filter;
+	samplerInfo.minFilter = filter;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.anisotropyEnable = VK_FALSE;
+	samplerInfo.maxAnisotropy = 1;
+	samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+	samplerInfo.unnormalizedCoordinates = VK_FALSE;
+	samplerInfo.compareEnable = VK_FALSE;
+	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.mipLodBias = 0.0f;
+	samplerInfo.minLod = 0.0f;
+	samplerInfo.maxLod = 0.0f;
+
+	VkSampler sampler;
+	VK_RESULT_CHECK(vkCreateSampler(logicalDevice, &samplerInfo, nullptr, &sampler))
+	return sampler;
+}
+
+void TerrainVirtualTexture::createImages()
+{
+	VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+	uint32_t cacheSize = TERRAIN_VT_CACHE_PAGES * TERRAIN_VT_PAGE_SIZE;
+	vki->createImage(cacheSize, cacheSize, 1, format, VK_IMAGE_TILING_OPTIMAL,
+	                 VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+	                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, pageCache.image, pageCache.imageMemory, 0);
+	pageCache.imageView = createImageView(vki->logicalDevice, VK_IMAGE_VIEW_TYPE_2D, pageCache.image,
+	                                      format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+	//Filtered within a page, the border keeps neighbouring pages out
+	pageCacheSampler = createPageSampler(vki->logicalDevice, VK_FILTER_LINEAR);
+
+	vki->createImage(levelZeroPages, levelZeroPages, 1, format, VK_IMAGE_TILING_OPTIMAL,
+	                 VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+	                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, pageTable.image, pageTable.imageMemory, 0);
+	pageTable.imageView = createImageView(vki->logicalDevice, VK_IMAGE_VIEW_TYPE_2D, pageTable.image,
+	                                      format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+	pageTableSampler = createPageSampler(vki->logicalDevice, VK_FILTER_NEAREST);
+
+	//Cache stays in the general layout since it is both written by the bake and sampled by the terrain
+	VkCommandBuffer commandBuffer = vki->beginSingleTimeCommands();
+	VkImageMemoryBarrier barriers[2] = {};
+	for(VkImageMemoryBarrier &barrier : barriers)
+	{
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+	}
+	barriers[0].image = pageCache.image;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barriers[1].image = pageTable.image;
+	barriers[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+	                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+	                     0, 0, nullptr, 0, nullptr, 2, barriers);
+	vki->endSingleTimeCommands(commandBuffer);
+}
+
+void TerrainVirtualTexture::createBakePipeline(const Texture* material, const ImageAttachment &heightTexture,
+                                               VkSampler heightSampler)
+{
+	std::vector<VkDescriptorSetLayoutBinding> bindings(3);
+	for(uint32_t i = 0; i < bindings.size(); i++)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorCount = 1;
+		bindings[i].descriptorType = i < 2 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		bindings[i].pImmutableSamplers = nullptr;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+	VK_RESULT_CHECK(vkCreateDescriptorSetLayout(vki->logicalDevice, &layoutInfo, nullptr, &bakeDescriptorSetLayout))
+
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = vki->descriptorPool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &bakeDescriptorSetLayout;
+	VK_RESULT_CHECK(vkAllocateDescriptorSets(vki->logicalDevice, &allocInfo, &bakeDescriptorSet))
+
+	VkDescriptorImageInfo imageInfos[3] = {};
+	imageInfos[0].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageInfos[0].imageView = material->texture.imageView;
+	imageInfos[0].sampler = material->textureSampler;
+	imageInfos[1].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageInfos[1].imageView = heightTexture.imageView;
+	imageInfos[1].sampler = heightSampler;
+	imageInfos[2].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	imageInfos[2].imageView = pageCache.imageView;
+
+	std::vector<VkWriteDescriptorSet> descriptorWrites(bindings.size());
+	for(uint32_t i = 0; i < descriptorWrites.size(); i++)
+	{
+		descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[i].dstSet = bakeDescriptorSet;
+		descriptorWrites[i].dstBinding = i;
+		descriptorWrites[i].dstArrayElement = 0;
+		descriptorWrites[i].descriptorType = bindings[i].descriptorType;
+		descriptorWrites[i].descriptorCount = 1;
+		descriptorWrites[i].pImageInfo = &imageInfos[i];
+	}
+	vkUpdateDescriptorSets(vki->logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.size = sizeof(TerrainBakePushConstantBufferObject);
+	pushConstantRange.offset = 0;
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &bakeDescriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+	VK_RESULT_CHECK(vkCreatePipelineLayout(vki->logicalDevice, &pipelineLayoutInfo, nullptr, &bakePipelineLayout))
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage = vki->loadShaderModule("shaders/terrainBake.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+	pipelineInfo.layout = bakePipelineLayout;
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+	pipelineInfo.basePipelineIndex = -1;
+	VK_RESULT_CHECK(vkCreateComputePipelines(vki->logicalDevice, vki->pipelineCache, 1, &pipelineInfo, nullptr, &bakePipeline))
+	Logger() << "Terrain bake pipeline created";
+}
+
+void TerrainVirtualTexture::selectPages(uint32_t level, uint32_t x, uint32_t z, glm::vec3 viewPosition)
+{
+	float size = pageWorldSize(level);
+	glm::vec3 boundsMin(x * size, minHeight, z * size);
+	glm::vec3 boundsMax(boundsMin.x + size, maxHeight, boundsMin.z + size);
+	//The virtual square is as wide as the longest side, pages past the shorter side are never drawn
+	if(boundsMin.x >= heightfield->worldWidth() || boundsMin.z >= heightfield->worldDepth())
+		return;
+
+	//Coarser pages are always requested too so there is something to show while finer ones bake
+	float distance = glm::distance(glm::clamp(viewPosition, boundsMin, boundsMax), viewPosition);
+	requests.emplace_back(PageRequest{pageKey(level, x, z), level, distance});
+	if(level == 0 || distance > size * lodFactor)
+		return;
+
+	for(uint32_t i = 0; i < 4; i++)
+	{
+		selectPages(level - 1, x * 2 + (i & 1), z * 2 + (i >> 1), viewPosition);
+	}
+}
+
+int32_t TerrainVirtualTexture::acquireSlot()
+{
+	if(slots.size() < TERRAIN_VT_CACHE_PAGES * TERRAIN_VT_CACHE_PAGES)
+	{
+		slots.emplace_back(PageSlot{0, 0, false, false});
+		return static_cast<int32_t>(slots.size() - 1);
+	}
+
+	//Least recently used page that this frame doesn't need
+	int32_t oldest = -1;
+	for(uint32_t i = 0; i < slots.size(); i++)
+	{
+		if(slots[i].lastUsedFrame < frameIndex && (oldest < 0 || slots[i].lastUsedFrame < slots[oldest].lastUsedFrame))
+			oldest = static_cast<int32_t>(i);
+	}
+	if(oldest >= 0)
+	{
+		residentPages.erase(slots[oldest].key);
+		if(slots[oldest].baked)
+			pageTableDirty = true;
+	}
+	return oldest;
+}
+
+void TerrainVirtualTexture::update(glm::vec3 viewPosition, StagingRing* ring)
+{
+	frameIndex++;
+	requests.clear();
+	selectPages(levels - 1, 0, 0, viewPosition);
+
+	std::vector<PageRequest> missing;
+	std::vector<PageRequest> stale;
+	for(const PageRequest &request : requests)
+	{
+		auto resident = residentPages.find(request.key);
+		if(resident == residentPages.end())
+		{
+			missing.emplace_back(request);
+			continue;
+		}
+		PageSlot &slot = slots[resident->second];
+		slot.lastUsedFrame = frameIndex;
+		if(slot.dirty)
+			stale.emplace_back(request);
+	}
+
+	//Coarse pages first so every part of the terrain has a fallback, then nearest first
+	std::sort(missing.begin(), missing.end(), [](const PageRequest &a, const PageRequest &b)
+	{
+		return a.level != b.level ? a.level > b.level : a.distance < b.distance;
+	});
+	std::sort(stale.begin(), stale.end(), [](const PageRequest &a, const PageRequest &b)
+	{
+		return a.distance < b.distance;
+	});
+
+	std::vector<uint32_t> bakes;
+	for(const PageRequest &request : stale)
+	{
+		if(bakes.size() >= TERRAIN_VT_BAKES_PER_FRAME)
+			break;
+		uint32_t slot = residentPages[request.key];
+		slots[slot].dirty = false;
+		bakes.emplace_back(slot);
+	}
+	for(const PageRequest &request : missing)
+	{
+		if(bakes.size() >= TERRAIN_VT_BAKES_PER_FRAME)
+			break;
+		int32_t slot = acquireSlot();
+		if(slot < 0)
+			break;
+		slots[slot] = PageSlot{request.key, frameIndex, true, false};
+		residentPages[request.key] = static_cast<uint32_t>(slot);
+		bakes.emplace_back(static_cast<uint32_t>(slot));
+		pageTableDirty = true;
+	}
+
+	if(bakes.empty() && !pageTableDirty)
+		return;
+	if(!bakes.empty())
+		recordBakes(ring->commands(), bakes);
+	if(pageTableDirty)
+		uploadPageTable(ring);
+	ring->flush(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+}
+
+void TerrainVirtualTexture::recordBakes(VkCommandBuffer commandBuffer, const std::vector<uint32_t> &bakes)
+{
+	//Earlier frames may still be sampling the cache
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = pageCache.image;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+	                     0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, bakePipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, bakePipelineLayout,
+	                        0, 1, &bakeDescriptorSet, 0, nullptr);
+
+	float contentTexels = TERRAIN_VT_PAGE_SIZE - 2 * TERRAIN_VT_PAGE_BORDER;
+	for(uint32_t slot : bakes)
+	{
+		uint32_t key = slots[slot].key;
+		uint32_t level = key >> 24;
+		float size = pageWorldSize(level);
+
+		TerrainBakePushConstantBufferObject pushConstant = {};
+		pushConstant.page = glm::vec4((key & 0xFFF) * size, ((key >> 12) & 0xFFF) * size,
+		                              size / contentTexels, TERRAIN_VT_PAGE_BORDER);
+		pushConstant.target = glm::ivec4((slot % TERRAIN_VT_CACHE_PAGES) * TERRAIN_VT_PAGE_SIZE,
+		                                 (slot / TERRAIN_VT_CACHE_PAGES) * TERRAIN_VT_PAGE_SIZE, 0, 0);
+		pushConstant.spacing = glm::vec4(heightfield->spacingX, heightfield->spacingZ,
+		                                 heightfield->width, heightfield->depth);
+		vkCmdPushConstants(commandBuffer, bakePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT,
+		                   0, sizeof(pushConstant), &pushConstant);
+		vkCmdDispatch(commandBuffer, TERRAIN_VT_PAGE_SIZE / 8, TERRAIN_VT_PAGE_SIZE / 8, 1);
+	}
+
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+	                     0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+void TerrainVirtualTexture::uploadPageTable(StagingRing* ring)
+{
+	pageTableDirty = false;
+
+	//Each level zero page points at the finest resident page covering it
+	for(uint32_t z = 0; z < levelZeroPages; z++)
+	{
+		for(uint32_t x = 0; x < levelZeroPages; x++)
+		{
+			uint8_t* entry = &pageTableData[(z * levelZeroPages + x) * 4];
+			memset(entry, 0, 4);
+			for(uint32_t level = 0; level < levels; level++)
+			{
+				auto resident = residentPages.find(pageKey(level, x >> level, z >> level));
+				if(resident == residentPages.end())
+					continue;
+				entry[0] = static_cast<uint8_t>(resident->second % TERRAIN_VT_CACHE_PAGES);
+				entry[1] = static_cast<uint8_t>(resident->second / TERRAIN_VT_CACHE_PAGES);
+				entry[2] = static_cast<uint8_t>(level);
+				entry[3] = 255;
+				break;
+			}
+		}
+	}
+
+	VkDeviceSize offset;
+	memcpy(ring->allocate(pageTableData.size(), offset), pageTableData.data(), pageTableData.size());
+	VkCommandBuffer commandBuffer = ring->commands();
+
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = pageTable.image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+	                     0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	VkBufferImageCopy region = {};
+	region.bufferOffset = offset;
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.mipLevel = 0;
+	region.imageSubresource.baseArrayLayer = 0;
+	region.imageSubresource.layerCount = 1;
+	region.imageOffset = {0, 0, 0};
+	region.imageExtent = {levelZeroPages, levelZeroPages, 1};
+	vkCmdCopyBufferToImage(commandBuffer, ring->getBuffer(), pageTable.image,
+	                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+	                     0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+void TerrainVirtualTexture::invalidate(float minX, float minZ, float maxX, float maxZ)
+{
+	//Baked normals reach one sample further out than the heights that changed
+	minX -= heightfield->spacingX;
+	minZ -= heightfield->spacingZ;
+	maxX += heightfield->spacingX;
+	maxZ += heightfield->spacingZ;
+
+	float contentTexels = TERRAIN_VT_PAGE_SIZE - 2 * TERRAIN_VT_PAGE_BORDER;
+	for(PageSlot &slot : slots)
+	{
+		if(!slot.baked)
+			continue;
+		float size = pageWorldSize(slot.key >> 24);
+		float border = size / contentTexels * TERRAIN_VT_PAGE_BORDER;
+		float pageX = (slot.key & 0xFFF) * size;
+		float pageZ = ((slot.key >> 12) & 0xFFF) * size;
+		if(pageX - border <= maxX && pageX + size + border >= minX &&
+		   pageZ - border <= maxZ && pageZ + size + border >= minZ)
+			slot.dirty = true;
+	}
+}
+
+void TerrainVirtualTexture::setLodFactor(float factor)
+{
+	lodFactor = factor;
+}
+
+VkDescriptorImageInfo TerrainVirtualTexture::getPageCacheInfo() const
+{
+	VkDescriptorImageInfo info = {};
+	info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	info.imageView = pageCache.imageView;
+	info.sampler = pageCacheSampler;
+	return info;
+}
+
+VkDescriptorImageInfo TerrainVirtualTexture::getPageTableInfo() const
+{
+	VkDescriptorImageInfo info = {};
+	info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	info.imageView = pageTable.imageView;
+	info.sampler = pageTableSampler;
+	return info;
+}
+
+TerrainVirtualTextureConstants TerrainVirtualTexture::getConstants() const
+{
+	TerrainVirtualTextureConstants constants = {};
+	constants.virtualSize = virtualSize;
+	constants.levelZeroPages = static_cast<float>(levelZeroPages);
+	constants.cachePages = TERRAIN_VT_CACHE_PAGES;
+	constants.pageSize = TERRAIN_VT_PAGE_SIZE;
+	constants.pageBorder = TERRAIN_VT_PAGE_BORDER;
+	return constants;
+}
+
+size_t TerrainVirtualTexture::getResidentPageCount() const
+{
+	return residentPages.size();
+}
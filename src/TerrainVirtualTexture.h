@@ -0,0 +1,109 @@
+#ifndef VULKANITE_TERRAINVIRTUALTEXTURE_H
+#define VULKANITE_TERRAINVIRTUALTEXTURE_H
+
+#include <vulkan/vulkan.h>
+#include <glm/vec3.hpp>
+#include <unordered_map>
+#include <vector>
+#include "ImageAttachment.h"
+#include "Heightfield.h"
+
+class VulkanInterface;
+class Texture;
+class StagingRing;
+
+//Texels along a cached page including the border on each side
+#define TERRAIN_VT_PAGE_SIZE 128
+#define TERRAIN_VT_PAGE_BORDER 2
+//Cache is a square of pages
+#define TERRAIN_VT_CACHE_PAGES 16
+//Pages baked per frame, the rest wait so a fast camera never stalls a frame
+#define TERRAIN_VT_BAKES_PER_FRAME 12
+
+//Matches the specialisation constants in terrainVirtual.frag
+struct TerrainVirtualTextureConstants
+{
+	float virtualSize;
+	float levelZeroPages;
+	float cachePages;
+	float pageSize;
+	float pageBorder;
+};
+
+//Runtime virtual texture for the terrain albedo. The terrain is covered by a quadtree of pages,
+//the ones needed at the viewer's distance are baked with the triplanar material blend into a
+//page cache by a compute pass and the terrain shader reads them through a page table.
+class TerrainVirtualTexture
+{
+	struct PageSlot
+	{
+		uint32_t key;
+		uint64_t lastUsedFrame;
+		bool baked;
+		//Heights under the page changed since it was baked
+		bool dirty;
+	};
+
+	struct PageRequest
+	{
+		uint32_t key;
+		uint32_t level;
+		float distance;
+	};
+
+	VulkanInterface* vki;
+	const Heightfield* heightfield;
+
+	//Pages cover a square of virtualSize from the origin, level zero is the finest
+	float virtualSize;
+	uint32_t levelZeroPages;
+	uint32_t levels;
+	float minHeight;
+	float maxHeight;
+	float lodFactor = 1.5f;
+
+	ImageAttachment pageCache = {};
+	VkSampler pageCacheSampler = VK_NULL_HANDLE;
+	ImageAttachment pageTable = {};
+	VkSampler pageTableSampler = VK_NULL_HANDLE;
+	std::vector<uint8_t> pageTableData;
+	bool pageTableDirty = true;
+
+	std::vector<PageSlot> slots;
+	std::unordered_map<uint32_t, uint32_t> residentPages;
+	std::vector<PageRequest> requests;
+	uint64_t frameIndex = 0;
+
+	VkDescriptorSetLayout bakeDescriptorSetLayout;
+	VkDescriptorSet bakeDescriptorSet;
+	VkPipelineLayout bakePipelineLayout;
+	VkPipeline bakePipeline;
+
+	static uint32_t pageKey(uint32_t level, uint32_t x, uint32_t z);
+	float pageWorldSize(uint32_t level) const;
+	void createImages();
+	void createBakePipeline(const Texture* material, const ImageAttachment &heightTexture, VkSampler heightSampler);
+	void selectPages(uint32_t level, uint32_t x, uint32_t z, glm::vec3 viewPosition);
+	int32_t acquireSlot();
+	void recordBakes(VkCommandBuffer commandBuffer, const std::vector<uint32_t> &bakes);
+	void uploadPageTable(StagingRing* ring);
+
+public:
+	//texelsPerUnit is the density of the finest level, rounded so the finest level is a power of two pages
+	TerrainVirtualTexture(VulkanInterface* inVulkan, const Heightfield* inHeightfield, const Texture* material,
+	                      const ImageAttachment &heightTexture, VkSampler heightSampler, float texelsPerUnit);
+	~TerrainVirtualTexture();
+
+	//Requests pages for this view and records any bakes and page table changes ahead of the frame
+	void update(glm::vec3 viewPosition, StagingRing* ring);
+	//Pages over this world rectangle are baked again the next time they are used
+	void invalidate(float minX, float minZ, float maxX, float maxZ);
+	void setLodFactor(float factor);
+
+	VkDescriptorImageInfo getPageCacheInfo() const;
+	VkDescriptorImageInfo getPageTableInfo() const;
+	TerrainVirtualTextureConstants getConstants() const;
+	size_t getResidentPageCount() const;
+};
+
+#endif //VULKANITE_TERRAINVIRTUALTEXTURE_H
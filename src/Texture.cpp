@@ -7,43 +7,91 @@
 #include "vulkanInterface.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 
-Texture::Texture(VulkanInterface *inVulkanInterface, std::vector<std::string> inFilenames, bool cube):
+Texture::Texture(VulkanInterface *inVulkanInterface, std::vector<std::string> inFilenames, bool cube, bool deferred):
 	vki(inVulkanInterface),
 	filenames(std::move(inFilenames)),
 	isCubemap(cube)
 {
-	loadImage();
-	createTextureImageView(static_cast<uint32_t>(filenames.size()));
-	createTextureSampler();
+	if(deferred)
+		return;
+
+	decode();
+	upload();
+	finishUpload();
 }
 
 Texture::~Texture()
 {
+	freePixels();
+	if(!uploaded)
+		return;
+
 	vkDestroySampler(vki->logicalDevice, textureSampler, nullptr);
 	Logger() << "Texture sampler destroyed";
 	texture.destroy(vki->logicalDevice);
 }
 
-void Texture::loadImage()
+void Texture::freePixels()
 {
+	for(auto &&pixels : layerPixels)
+	{
+		stbi_image_free(pixels);
+	}
+	layerPixels.clear();
+	widths.clear();
+	heights.clear();
+}
+
+void Texture::decode()
+{
+	freePixels();
 	auto layerCount = static_cast<uint32_t>(filenames.size());
-	std::vector<stbi_uc*> imageData(layerCount);
-	std::vector<int> widths(layerCount);
-	std::vector<int> heights(layerCount);
-	std::vector<int> comps(layerCount);
-	VkDeviceSize textureSize = 0;
-	int maxWidth = 0, maxHeight = 0;
-	for(int i = 0; i < layerCount; ++i)
+	layerPixels.resize(layerCount, nullptr);
+	widths.resize(layerCount);
+	heights.resize(layerCount);
+	for(uint32_t i = 0; i < layerCount; ++i)
 	{
-		imageData[i] = stbi_load(filenames[i].c_str(), &widths[i], &heights[i], &comps[i], STBI_rgb_alpha);
+		int comp;
+		layerPixels[i] = stbi_load(filenames[i].c_str(), &widths[i], &heights[i], &comp, STBI_rgb_alpha);
 
-		if(!imageData[i])
+		if(!layerPixels[i])
 		{
-			Logger() << "Texture image failed to load";
+			Logger() << "Texture image failed to load: " << filenames[i];
+			freePixels();
 			throw std::runtime_error("Failed to load texture image");
 		}
+	}
+}
 
+void Texture::fill(uint32_t rgba)
+{
+	freePixels();
+	auto layerCount = static_cast<uint32_t>(std::max<size_t>(filenames.size(), 1));
+	for(uint32_t i = 0; i < layerCount; ++i)
+	{
+		//stbi_image_free is free
+		auto pixels = static_cast<unsigned char*>(malloc(sizeof(rgba)));
+		memcpy(pixels, &rgba, sizeof(rgba));
+		layerPixels.emplace_back(pixels);
+		widths.emplace_back(1);
+		heights.emplace_back(1);
+	}
+}
+
+void Texture::upload()
+{
+	auto layerCount = static_cast<uint32_t>(layerPixels.size());
+	if(layerCount == 0)
+		throw std::runtime_error("Texture uploaded before it was decoded");
+
+	VkDeviceSize textureSize = 0;
+	int maxWidth = 0, maxHeight = 0;
+	for(uint32_t i = 0; i < layerCount; ++i)
+	{
 		textureSize += widths[i] * heights[i] * 4;
 		if(widths[i] > maxWidth) maxWidth = widths[i];
 		if(heights[i] > maxHeight) maxHeight = heights[i];
@@ -55,30 +103,17 @@ void Texture::loadImage()
 				 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
 				 stagingBuffer, stagingBufferMemory);
 
-	void* allImageData = malloc(textureSize);
-	size_t memCopyOffset = 0;
-	for(int i = 0; i < imageData.size(); ++i)
-	{
-		memcpy(reinterpret_cast<char*>(allImageData)+memCopyOffset, imageData[i], static_cast<size_t>(widths[i] * heights[i] * 4));
-		memCopyOffset += widths[i] * heights[i] * 4;
-	}
+	//Layers are copied straight into the staging memory back to back
 	void* data;
 	vkMapMemory(vki->logicalDevice, stagingBufferMemory, 0, textureSize, 0, &data);
-	memcpy(data, allImageData, static_cast<size_t>(textureSize));
-	vkUnmapMemory(vki->logicalDevice, stagingBufferMemory);
-
-	free(allImageData);
-
-	for(auto &&item : imageData)
-	{
-		stbi_image_free(item);
-	}
-
 	std::vector<VkBufferImageCopy> bufferCopyRegions;
 	bufferCopyRegions.reserve(layerCount);
 	size_t offset = 0;
 	for(uint32_t i = 0; i < layerCount; ++i)
 	{
+		auto layerSize = static_cast<size_t>(widths[i] * heights[i] * 4);
+		memcpy(static_cast<char*>(data) + offset, layerPixels[i], layerSize);
+
 		VkBufferImageCopy region = {};
 		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 		region.imageSubresource.mipLevel = 0;
@@ -93,8 +128,11 @@ void Texture::loadImage()
 		};
 		bufferCopyRegions.emplace_back(region);
 
-		offset += widths[i] * heights[i] * 4;
+		offset += layerSize;
 	}
+	vkUnmapMemory(vki->logicalDevice, stagingBufferMemory);
+
+	freePixels();
 
 	createImage(static_cast<uint32_t>(maxWidth), static_cast<uint32_t>(maxHeight), layerCount);
 
@@ -112,8 +150,21 @@ void Texture::loadImage()
 	vki->transitionImageLayout(texture.image, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 							   VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, layerCount);
 
-	vkDestroyBuffer(vki->logicalDevice, stagingBuffer, nullptr);
-	vkFreeMemory(vki->logicalDevice, stagingBufferMemory, nullptr);
+	vki->destroyStagingBuffer(stagingBuffer, stagingBufferMemory);
+
+	createTextureImageView(layerCount);
+	createTextureSampler();
+	uploaded = true;
+}
+
+void Texture::finishUpload()
+{
+	resident = true;
+}
+
+bool Texture::isResident() const
+{
+	return resident;
 }
 
 void Texture::createImage(uint32_t width, uint32_t height, uint32_t layers)
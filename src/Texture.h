@@ -19,16 +19,35 @@ class Texture
 	bool isCubemap = false;
 	std::vector<std::string> filenames;
 
-	void loadImage();
+	//Decoded RGBA layers waiting for upload
+	std::vector<unsigned char*> layerPixels;
+	std::vector<int> widths;
+	std::vector<int> heights;
+	//Image and sampler exist, resident once the copy into them has finished
+	bool uploaded = false;
+	bool resident = false;
+
+	void freePixels();
 
 	void createImage(uint32_t width, uint32_t height, uint32_t layers);
 	void createTextureImageView(uint32_t layers);
 	void createTextureSampler();
 
 public:
-	Texture(VulkanInterface* inVulkanInterface, std::vector<std::string> inFilenames, bool cube);
+	//Deferred leaves decode, upload and finishUpload to the caller so the decode can run on a worker
+	Texture(VulkanInterface* inVulkanInterface, std::vector<std::string> inFilenames, bool cube, bool deferred = false);
 	~Texture();
 
+	//Reads every layer into memory, safe off the main thread. Throws if a file can't be read.
+	void decode();
+	//One texel of the colour per layer instead of the files, 0xAABBGGRR
+	void fill(uint32_t rgba);
+	//Creates the image and records the copy, frees the decoded layers
+	void upload();
+	//Call once the upload's commands have finished
+	void finishUpload();
+	bool isResident() const;
+
 	VkSampler textureSampler;
 
 	ImageAttachment texture;
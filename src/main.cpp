@@ -1,4 +1,5 @@
 #include <iostream>
+#include <memory>
 //#include <vulkan/vulkan.h>
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
@@ -10,6 +11,14 @@
 #include "Transform.h"
 #include "KeyboardInput.h"
 #include "SpecificThreadPool.h"
+#include "Terrain.h"
+#include "HeightmapReader.h"
+#include "TerrainTileFile.h"
+#include "HeightfieldQuery.h"
+#include "ModelCache.h"
+
+//Updates stepped twice by the deterministic particle check at startup
+#define PARTICLE_REPLAY_CHECK_FRAMES 120
 
 bool shouldExit = false;
 glm::vec2 storedLastPos = glm::vec2(0,0);
@@ -57,11 +66,71 @@ void keyboardInputEvent(GLFWwindow* inWindow, int keyCode, int scanCode, int act
 	keyboardInput->keyList[keyCode] = action;
 }
 
-int main()
+//Vulkanite --ingest <heightmap> <tiles.vtt> [tileSize] [world width] [world height] [world depth]
+//Converts a heightmap of any size into streamed terrain tiles without opening a window
+int ingestHeightmap(int argc, char* argv[])
+{
+	try
+	{
+		uint32_t tileSize = argc > 4 ? static_cast<uint32_t>(std::stoul(argv[4])) : 256;
+		if(tileSize == 0)
+			throw std::runtime_error("Tile size must be at least one sample");
+		std::unique_ptr<HeightmapReader> reader(HeightmapReader::open(argv[2]));
+		float worldWidth = argc > 5 ? std::stof(argv[5]) : reader->getWidth() - 1.0f;
+		float worldHeight = argc > 6 ? std::stof(argv[6]) : 1.0f;
+		float worldDepth = argc > 7 ? std::stof(argv[7]) : reader->getDepth() - 1.0f;
+		float spacingX = worldWidth / (reader->getWidth() - 1);
+		float spacingZ = worldDepth / (reader->getDepth() - 1);
+		TerrainTileFile::write(*reader, worldHeight, spacingX, spacingZ, tileSize, argv[3]);
+	} catch(const std::exception& e) {
+		Logger() << " -- #INGEST ERROR# -- " << e.what();
+		return EXIT_FAILURE;
+	}
+	Logger::close();
+	return EXIT_SUCCESS;
+}
+
+//Vulkanite --cook <model> [more models]
+//Writes each model's cooked file ahead of time so the first launch doesn't run Assimp either
+int cookModels(int argc, char* argv[])
+{
+	try
+	{
+		for(int i = 2; i < argc; i++)
+			ModelCache::cook(argv[i]);
+	} catch(const std::exception& e) {
+		Logger() << " -- #COOK ERROR# -- " << e.what();
+		return EXIT_FAILURE;
+	}
+	Logger::close();
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[])
 {
 	Logger::initLogger();
 	Logger() << "First Line of Program";
 
+	if(argc >= 4 && std::string(argv[1]) == "--ingest")
+		return ingestHeightmap(argc, argv);
+	if(argc >= 3 && std::string(argv[1]) == "--cook")
+		return cookModels(argc, argv);
+
+	//Vulkanite --deterministic [seed]
+	//Particles replay bit-exactly from the seed, checked once at startup
+	bool deterministicParticles = argc >= 2 && std::string(argv[1]) == "--deterministic";
+	uint32_t particleSeed = 0;
+	if(deterministicParticles && argc >= 3)
+	{
+		try
+		{
+			particleSeed = static_cast<uint32_t>(std::stoul(argv[2]));
+		} catch(const std::exception& e) {
+			Logger() << " -- #ARGUMENT ERROR# -- particle seed " << argv[2];
+			return EXIT_FAILURE;
+		}
+	}
+
 	if(!glfwInit())
 	{
 		Logger() << "GLFW init failed";
@@ -78,7 +147,9 @@ int main()
 	auto vulkanInterface = new VulkanInterface();
 	try
 	{
-		vulkanInterface->initVulkan(window);
+		vulkanInterface->initVulkan(window, deterministicParticles, particleSeed);
+		if(deterministicParticles && !vulkanInterface->getParticles()->verifyReplay(PARTICLE_REPLAY_CHECK_FRAMES))
+			Logger() << " -- #PARTICLE ERROR# -- deterministic particles did not replay bit-exactly";
 
 		glfwSetWindowSizeCallback(window->glfwWindow, windowResize);
 		glfwSetWindowUserPointer(window->glfwWindow, vulkanInterface);
@@ -121,6 +192,34 @@ int main()
 
 			cameraTransform->position = displaced;
 
+			//Terrain brushes where the camera is looking, R raises, F lowers and G flattens
+			bool raise = keyboardInput->isKeyPressed('R');
+			bool lower = keyboardInput->isKeyPressed('F');
+			bool flatten = keyboardInput->isKeyPressed('G');
+			if(raise || lower || flatten)
+			{
+				Terrain* terrain = vulkanInterface->getTerrain();
+				TerrainRay ray = {cameraTransform->position, cameraTransform->forward, 100.0f};
+				TerrainHit hit;
+				if(terrain && terrain->raycast(ray, hit))
+				{
+					TerrainBrush brush = {};
+					brush.mode = raise ? TERRAIN_BRUSH_RAISE : (lower ? TERRAIN_BRUSH_LOWER : TERRAIN_BRUSH_FLATTEN);
+					brush.radius = 3.0f;
+					brush.strength = 2.0f;
+					brush.targetHeight = hit.position.y;
+					terrain->applyBrush(brush, hit.position.x, hit.position.z, static_cast<float>(dtf));
+				}
+			}
+
+			//Particle resolution, full, half or quarter
+			if(keyboardInput->isKeyPressed('1'))
+				vulkanInterface->setParticleResolutionDivisor(1);
+			if(keyboardInput->isKeyPressed('2'))
+				vulkanInterface->setParticleResolutionDivisor(2);
+			if(keyboardInput->isKeyPressed('4'))
+				vulkanInterface->setParticleResolutionDivisor(4);
+
 			camera->lookAt(cameraTransform->position, cameraTransform->position + cameraTransform->forward, cameraTransform->up);
 
 			vulkanInterface->update(camera);
@@ -129,7 +228,19 @@ int main()
 			frames++;
 			if(((std::chrono::duration<double>)(current - then)).count() > 1.0)
 			{
-				glfwSetWindowTitle(window->glfwWindow, std::to_string(frames).c_str());
+				std::string title = std::to_string(frames) + " fps";
+				Terrain* terrain = vulkanInterface->getTerrain();
+				if(terrain)
+				{
+					const TerrainCullStats& cullStats = terrain->getCullStats();
+					title += ", terrain chunks " +
+					         std::to_string(cullStats.visible) + "/" + std::to_string(cullStats.total) +
+					         " (frustum culled " + std::to_string(cullStats.frustumCulled) +
+					         ", horizon culled " + std::to_string(cullStats.horizonCulled) + ")";
+				}
+				else
+					title += ", terrain loading";
+				glfwSetWindowTitle(window->glfwWindow, title.c_str());
 				frames = 0;
 				then = current;
 			}
@@ -53,6 +53,8 @@ VulkanInterface::~VulkanInterface()
 
 	offscreenColorImage.destroy(logicalDevice);
 	offscreenDepthImage.destroy(logicalDevice);
+	destroyParticleTargets();
+	vkDestroyRenderPass(logicalDevice, particleRenderPass, nullptr);
 
 	vkDestroySemaphore(logicalDevice, offscreenRenderedSemaphore, nullptr);
 	vkDestroySampler(logicalDevice, offscreenSampler, nullptr);
@@ -63,6 +65,7 @@ VulkanInterface::~VulkanInterface()
 	vkDestroyPipeline(logicalDevice, pipelines.screen, nullptr);
 	vkDestroyPipelineLayout(logicalDevice, pipelineLayouts.screen, nullptr);
 	vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayouts.screen, nullptr);
+	vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayouts.depthDownsample, nullptr);
 
 	threadPool.destroy();
 	for(auto &i : threadData)
@@ -83,16 +86,21 @@ VulkanInterface::~VulkanInterface()
 	Logger() << "Descriptor set layout destroyed";
 	vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayouts.particle, nullptr);
 	Logger() << "Particle descriptor set layout destroyed";
+	vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayouts.particleBillboard, nullptr);
+	Logger() << "Particle billboard descriptor set layout destroyed";
 	vkDestroyBuffer(logicalDevice, uniformBuffer, nullptr);
 	Logger() << "Uniform buffer destroyed";
 	vkFreeMemory(logicalDevice, uniformBufferMemory, nullptr);
 	Logger() << "Uniform buffer memory freed";
 
 	delete particles;
-	delete model;
+	assets->release(model);
 	delete screenQuad;
+	//A worker may still be building the terrain
+	assets->waitForWorkers();
 	delete terrain;
 	delete skybox;
+	delete assets;
 	for(auto& shaderModule : shaderModules)
 	{
 		vkDestroyShaderModule(logicalDevice, shaderModule, nullptr);
@@ -132,13 +140,24 @@ void VulkanInterface::cleanupSwapchain(bool delSwapchain)
 	vkFreeCommandBuffers(logicalDevice, commandPool, 1, &particleCommandBuffer);
 
 	vkDestroyPipeline(logicalDevice, pipelines.standard, nullptr);
+	vkDestroyPipeline(logicalDevice, pipelines.standardQuantized, nullptr);
 	Logger() << "Standard pipeline destroyed";
 	vkDestroyPipeline(logicalDevice, pipelines.particle, nullptr);
 	Logger() << "Particle pipeline destroyed";
+	vkDestroyPipeline(logicalDevice, pipelines.particleBillboard, nullptr);
+	Logger() << "Particle billboard pipeline destroyed";
+	vkDestroyPipeline(logicalDevice, pipelines.particleLowRes, nullptr);
+	vkDestroyPipeline(logicalDevice, pipelines.particleBillboardLowRes, nullptr);
+	vkDestroyPipeline(logicalDevice, pipelines.depthDownsample, nullptr);
+	Logger() << "Low resolution particle pipelines destroyed";
 	vkDestroyPipelineLayout(logicalDevice, pipelineLayouts.standard, nullptr);
 	Logger() << "Pipeline layout destroyed";
 	vkDestroyPipelineLayout(logicalDevice, pipelineLayouts.particle, nullptr);
 	Logger() << "Particle pipeline layout destroyed";
+	vkDestroyPipelineLayout(logicalDevice, pipelineLayouts.particleBillboard, nullptr);
+	Logger() << "Particle billboard pipeline layout destroyed";
+	vkDestroyPipelineLayout(logicalDevice, pipelineLayouts.depthDownsample, nullptr);
+	Logger() << "Depth downsample pipeline layout destroyed";
 	vkDestroyRenderPass(logicalDevice, renderPass, nullptr);
 	Logger() << "Render pass destroyed";
 	i = 0;
@@ -155,7 +174,7 @@ void VulkanInterface::cleanupSwapchain(bool delSwapchain)
 	}
 }
 
-void VulkanInterface::initVulkan(Window * inWindow)
+void VulkanInterface::initVulkan(Window * inWindow, bool deterministicParticles, uint32_t particleSeed)
 {
 	window = inWindow;
 
@@ -170,24 +189,37 @@ void VulkanInterface::initVulkan(Window * inWindow)
 	createRenderPass();
 	createOffscreenRenderPass();
 	createOffscreenFramebuffer();
+	createParticleRenderPass();
 	createStandardDescriptorSetLayout();
 	createParticleDescriptorSetLayout();
+	createParticleBillboardDescriptorSetLayout();
 	createScreenDescriptorSetLayout();
+	createDepthDownsampleDescriptorSetLayout();
 	createPipelineCache();
 	createGraphicsPipeline();
 	createCommandPool();
+	//Transitions its targets through single time commands, so needs the pool
+	createParticleTargets();
 	createDepthResources();
 	createFramebuffers();
-	particles = new ParticleSystem(this, "models/Particles/particle1.fbx");
-	model = new Model(this, "models/Mushroom/mushroom.fbx");
+	assets = new AssetManager(this);
+	particles = new ParticleSystem(this, "models/Particles/particle1.fbx", deterministicParticles, particleSeed);
+	model = assets->acquireModel("models/Mushroom/mushroom.fbx", VERTEX_FORMAT_QUANTIZED);
 	Mesh * quadMesh = createScreenQuad(this);
 	screenQuad = new Model(this, quadMesh);
 	createUniformBuffer();
 	createDescriptorPool();
-	terrain = new Terrain(this, "images/island.png");
+	//Built on a worker and uploaded between frames, the first frames go without it
+	terrain = new Terrain(this, "images/island.png", TERRAIN_CHUNKED, true);
+	assets->loadAsync(std::bind(&Terrain::loadFile, terrain), [this]
+	{
+		terrain->upload();
+		terrainResident = true;
+	});
 	skybox = new Skybox(this);
 	createDescriptorSets();
 	createScreenDescriptorSet();
+	createParticleBillboardDescriptorSet();
 	createCommandBuffers();
 	createScreenCommandBuffer();
 	createSemaphoresAndFences();
@@ -237,6 +269,10 @@ void VulkanInterface::recreateSwapchain()
 	createRenderPass();
 	createGraphicsPipeline();
 	createFramebuffers();
+	//Low resolution particle targets follow the swapchain extent
+	destroyParticleTargets();
+	createParticleTargets();
+	updateScreenDescriptorSets();
 	createCommandBuffers();
 }
 
@@ -440,7 +476,7 @@ void VulkanInterface::createOffscreenImages()
 	VkFormat depthFormat = findDepthFormat(physicalDevice);
 	createImage(swapchainExtent.width, swapchainExtent.height, 1,
 	            depthFormat, VK_IMAGE_TILING_OPTIMAL,
-	            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+	            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
 	            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, offscreenDepthImage.image, offscreenDepthImage.imageMemory, VK_NULL_HANDLE);
 	offscreenDepthImage.imageView = createImageView(logicalDevice, VK_IMAGE_VIEW_TYPE_2D, offscreenDepthImage.image,
 	                                          depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
@@ -486,11 +522,11 @@ void VulkanInterface::createOffscreenRenderPass()
 	attachmentDescriptions[1].format = depthFormat;
 	attachmentDescriptions[1].samples = VK_SAMPLE_COUNT_1_BIT;
 	attachmentDescriptions[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	attachmentDescriptions[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachmentDescriptions[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE; //Sampled by the particle and screen passes
 	attachmentDescriptions[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	attachmentDescriptions[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	attachmentDescriptions[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	attachmentDescriptions[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	attachmentDescriptions[1].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
 	VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
 	VkAttachmentReference depthReference = { 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
@@ -513,10 +549,10 @@ void VulkanInterface::createOffscreenRenderPass()
 
 	dependencies[1].srcSubpass = 0;
 	dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-	dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 	dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
 	VkRenderPassCreateInfo renderPassInfo = {};
@@ -531,6 +567,169 @@ void VulkanInterface::createOffscreenRenderPass()
 	VK_RESULT_CHECK(vkCreateRenderPass(logicalDevice, &renderPassInfo, nullptr, &offscreenRenderPass));
 }
 
+void VulkanInterface::createParticleRenderPass()
+{
+	std::array<VkAttachmentDescription, 2> attachmentDescriptions = {};
+	// Color attachment, premultiplied particle colour with coverage in alpha
+	attachmentDescriptions[0].format = VK_FORMAT_R8G8B8A8_UNORM;
+	attachmentDescriptions[0].samples = VK_SAMPLE_COUNT_1_BIT;
+	attachmentDescriptions[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	attachmentDescriptions[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	attachmentDescriptions[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	attachmentDescriptions[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachmentDescriptions[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	attachmentDescriptions[0].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	// Downsampled depth, fully written by the first subpass
+	VkFormat depthFormat = findDepthFormat(physicalDevice);
+	attachmentDescriptions[1].format = depthFormat;
+	attachmentDescriptions[1].samples = VK_SAMPLE_COUNT_1_BIT;
+	attachmentDescriptions[1].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	attachmentDescriptions[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	attachmentDescriptions[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	attachmentDescriptions[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachmentDescriptions[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	attachmentDescriptions[1].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+	VkAttachmentReference depthReference = { 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+	//Subpass 0 downsamples the offscreen depth, subpass 1 draws the particles against it
+	std::array<VkSubpassDescription, 2> subpassDescriptions = {};
+	subpassDescriptions[0].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpassDescriptions[0].colorAttachmentCount = 0;
+	subpassDescriptions[0].pDepthStencilAttachment = &depthReference;
+
+	subpassDescriptions[1].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpassDescriptions[1].colorAttachmentCount = 1;
+	subpassDescriptions[1].pColorAttachments = &colorReference;
+	subpassDescriptions[1].pDepthStencilAttachment = &depthReference;
+
+	std::array<VkSubpassDependency, 3> dependencies{};
+	dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[0].dstSubpass = 0;
+	dependencies[0].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[0].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	dependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	dependencies[0].dependencyFlags = 0;
+
+	dependencies[1].srcSubpass = 0;
+	dependencies[1].dstSubpass = 1;
+	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[1].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+	dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+	dependencies[2].srcSubpass = 1;
+	dependencies[2].dstSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[2].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[2].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	dependencies[2].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[2].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	dependencies[2].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+	VkRenderPassCreateInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassInfo.attachmentCount = static_cast<uint32_t>(attachmentDescriptions.size());
+	renderPassInfo.pAttachments = attachmentDescriptions.data();
+	renderPassInfo.subpassCount = static_cast<uint32_t>(subpassDescriptions.size());
+	renderPassInfo.pSubpasses = subpassDescriptions.data();
+	renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+	renderPassInfo.pDependencies = dependencies.data();
+
+	VK_RESULT_CHECK(vkCreateRenderPass(logicalDevice, &renderPassInfo, nullptr, &particleRenderPass));
+	Logger() << "Particle render pass created";
+}
+
+void VulkanInterface::createParticleTargets()
+{
+	//The screen pass always samples these, so a divisor of 1 only keeps a single texel placeholder
+	if(particleResolutionDivisor > 1)
+	{
+		particleExtent.width = std::max(swapchainExtent.width / particleResolutionDivisor, 1u);
+		particleExtent.height = std::max(swapchainExtent.height / particleResolutionDivisor, 1u);
+	}
+	else
+	{
+		particleExtent.width = 1;
+		particleExtent.height = 1;
+	}
+
+	createImage(particleExtent.width, particleExtent.height, 1, VK_FORMAT_R8G8B8A8_UNORM,
+	            VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+	            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, particleColorImage.image, particleColorImage.imageMemory, VK_NULL_HANDLE);
+	particleColorImage.imageView = createImageView(logicalDevice, VK_IMAGE_VIEW_TYPE_2D, particleColorImage.image,
+	                                               VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+
+	VkFormat depthFormat = findDepthFormat(physicalDevice);
+	createImage(particleExtent.width, particleExtent.height, 1,
+	            depthFormat, VK_IMAGE_TILING_OPTIMAL,
+	            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+	            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, particleDepthImage.image, particleDepthImage.imageMemory, VK_NULL_HANDLE);
+	particleDepthImage.imageView = createImageView(logicalDevice, VK_IMAGE_VIEW_TYPE_2D, particleDepthImage.image,
+	                                               depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
+
+	//Valid layout for the screen pass before the particle pass first runs
+	transitionImageLayout(particleColorImage.image, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_UNDEFINED,
+	                      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1);
+	transitionImageLayout(particleDepthImage.image, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED,
+	                      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1);
+
+	VkImageView attachments[2];
+	attachments[0] = particleColorImage.imageView;
+	attachments[1] = particleDepthImage.imageView;
+
+	VkFramebufferCreateInfo fbufCreateInfo = {};
+	fbufCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	fbufCreateInfo.renderPass = particleRenderPass;
+	fbufCreateInfo.attachmentCount = 2;
+	fbufCreateInfo.pAttachments = attachments;
+	fbufCreateInfo.width = particleExtent.width;
+	fbufCreateInfo.height = particleExtent.height;
+	fbufCreateInfo.layers = 1;
+
+	VK_RESULT_CHECK(vkCreateFramebuffer(logicalDevice, &fbufCreateInfo, nullptr, &particleFramebuffer));
+	Logger() << "Particle targets created at " << particleExtent.width << "x" << particleExtent.height;
+}
+
+void VulkanInterface::destroyParticleTargets()
+{
+	vkDestroyFramebuffer(logicalDevice, particleFramebuffer, nullptr);
+	particleColorImage.destroy(logicalDevice);
+	particleDepthImage.destroy(logicalDevice);
+}
+
+void VulkanInterface::setParticleResolutionDivisor(uint32_t divisor)
+{
+	if(divisor != 1 && divisor != 2 && divisor != 4)
+		throw std::invalid_argument("Particle resolution divisor must be 1, 2 or 4");
+	if(divisor == particleResolutionDivisor)
+		return;
+
+	vkDeviceWaitIdle(logicalDevice);
+
+	particleResolutionDivisor = divisor;
+	destroyParticleTargets();
+	createParticleTargets();
+	updateScreenDescriptorSets();
+}
+
+uint32_t VulkanInterface::getParticleResolutionDivisor() const
+{
+	return particleResolutionDivisor;
+}
+
+Terrain* VulkanInterface::getTerrain() const
+{
+	return terrainResident ? terrain : nullptr;
+}
+
+ParticleSystem* VulkanInterface::getParticles() const
+{
+	return particles;
+}
+
 void VulkanInterface::createOffscreenFramebuffer()
 {
 	VkImageView attachments[2];
@@ -585,6 +784,13 @@ void VulkanInterface::updateScreenCommandBuffer(VkFramebuffer framebuffer)
 	vkCmdBindDescriptorSets(screenCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.screen, 0, 1,
 	                        &descriptorSets.screen, 0, nullptr);
 
+	ScreenPushConstantBufferObject screenPushConstant = {};
+	screenPushConstant.particleParams.x = particleResolutionDivisor > 1 ? 1.0f : 0.0f;
+	screenPushConstant.depthParams.x = pushConstant.proj[2][2];
+	screenPushConstant.depthParams.y = pushConstant.proj[3][2];
+	vkCmdPushConstants(screenCommandBuffer, pipelineLayouts.screen, VK_SHADER_STAGE_FRAGMENT_BIT,
+	                   0, sizeof(screenPushConstant), &screenPushConstant);
+
 	screenQuad->draw(screenCommandBuffer);
 
 	vkCmdEndRenderPass(screenCommandBuffer);
@@ -604,21 +810,96 @@ void VulkanInterface::createScreenDescriptorSet()
 
 	VK_RESULT_CHECK(vkAllocateDescriptorSets(logicalDevice, &allocInfo, &descriptorSets.screen))
 
+	layouts = {
+			descriptorSetLayouts.depthDownsample
+	};
+	allocInfo.pSetLayouts = layouts.data();
+	VK_RESULT_CHECK(vkAllocateDescriptorSets(logicalDevice, &allocInfo, &descriptorSets.depthDownsample))
+
+	updateScreenDescriptorSets();
+}
+
+void VulkanInterface::updateScreenDescriptorSets()
+{
+	//Screen samples scene colour, scene depth, particle colour and particle depth in that order
+	std::array<VkImageView, 4> imageViews = {
+			offscreenColorImage.imageView,
+			offscreenDepthImage.imageView,
+			particleColorImage.imageView,
+			particleDepthImage.imageView
+	};
+
+	std::array<VkDescriptorImageInfo, 4> imageInfos = {};
+	std::array<VkWriteDescriptorSet, 5> descriptorWrites = {};
+	for(uint32_t i = 0; i < imageInfos.size(); i++)
+	{
+		imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageInfos[i].imageView = imageViews[i];
+		imageInfos[i].sampler = offscreenSampler;
+
+		descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[i].dstSet = descriptorSets.screen;
+		descriptorWrites[i].dstBinding = i;
+		descriptorWrites[i].dstArrayElement = 0;
+		descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		descriptorWrites[i].descriptorCount = 1;
+		descriptorWrites[i].pImageInfo = &imageInfos[i];
+	}
+
+	//Downsample reads the full resolution scene depth
+	descriptorWrites[4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrites[4].dstSet = descriptorSets.depthDownsample;
+	descriptorWrites[4].dstBinding = 0;
+	descriptorWrites[4].dstArrayElement = 0;
+	descriptorWrites[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	descriptorWrites[4].descriptorCount = 1;
+	descriptorWrites[4].pImageInfo = &imageInfos[1];
+
+	vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+}
+
+void VulkanInterface::createParticleBillboardDescriptorSet()
+{
+	std::vector<VkDescriptorSetLayout> layouts = {
+			descriptorSetLayouts.particleBillboard
+	};
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = descriptorPool;
+	allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+	allocInfo.pSetLayouts = layouts.data();
+
+	VK_RESULT_CHECK(vkAllocateDescriptorSets(logicalDevice, &allocInfo, &descriptorSets.particleBillboard))
+
+	VkDescriptorBufferInfo bufferInfo = {};
+	bufferInfo.buffer = particles->billboardBuffer;
+	bufferInfo.offset = 0;
+	bufferInfo.range = particles->getBillboardBufferSize();
+
 	VkDescriptorImageInfo imageInfo = {};
 	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	imageInfo.imageView = offscreenColorImage.imageView;
-	imageInfo.sampler = offscreenSampler;
+	imageInfo.imageView = particles->particleModel->texture->texture.imageView;
+	imageInfo.sampler = particles->particleModel->texture->textureSampler;
 
-	std::array<VkWriteDescriptorSet, 1> descriptorWrites = {};
+	std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
 	descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	descriptorWrites[0].dstSet = descriptorSets.screen;
+	descriptorWrites[0].dstSet = descriptorSets.particleBillboard;
 	descriptorWrites[0].dstBinding = 0;
 	descriptorWrites[0].dstArrayElement = 0;
-	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 	descriptorWrites[0].descriptorCount = 1;
-	descriptorWrites[0].pImageInfo = &imageInfo;
+	descriptorWrites[0].pBufferInfo = &bufferInfo;
+
+	descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrites[1].dstSet = descriptorSets.particleBillboard;
+	descriptorWrites[1].dstBinding = 1;
+	descriptorWrites[1].dstArrayElement = 0;
+	descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	descriptorWrites[1].descriptorCount = 1;
+	descriptorWrites[1].pImageInfo = &imageInfo;
 
 	vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+	Logger() << "Particle billboard descriptor set created";
 }
 
 void VulkanInterface::createImageViews()
@@ -738,7 +1019,55 @@ void VulkanInterface::createParticleDescriptorSetLayout()
 	Logger() << "Particle descriptor set layout created";
 }
 
+void VulkanInterface::createParticleBillboardDescriptorSetLayout()
+{
+	VkDescriptorSetLayoutBinding storageLayoutBinding = {};
+	storageLayoutBinding.binding = 0;
+	storageLayoutBinding.descriptorCount = 1;
+	storageLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	storageLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	storageLayoutBinding.pImmutableSamplers = nullptr; // Optional
+
+	VkDescriptorSetLayoutBinding samplerLayoutBinding = {};
+	samplerLayoutBinding.binding = 1;
+	samplerLayoutBinding.descriptorCount = 1;
+	samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	samplerLayoutBinding.pImmutableSamplers = nullptr; // Optional
+
+	std::array<VkDescriptorSetLayoutBinding, 2> bindings = {storageLayoutBinding, samplerLayoutBinding};
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	VK_RESULT_CHECK(vkCreateDescriptorSetLayout(logicalDevice, &layoutInfo, nullptr, &descriptorSetLayouts.particleBillboard))
+	Logger() << "Particle billboard descriptor set layout created";
+}
+
 void VulkanInterface::createScreenDescriptorSetLayout()
+{
+	//Scene colour, scene depth, particle colour, particle depth
+	std::array<VkDescriptorSetLayoutBinding, 4> bindings = {};
+	for(uint32_t i = 0; i < bindings.size(); i++)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorCount = 1;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		bindings[i].pImmutableSamplers = nullptr; // Optional
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	VK_RESULT_CHECK(vkCreateDescriptorSetLayout(logicalDevice, &layoutInfo, nullptr, &descriptorSetLayouts.screen))
+	Logger() << "Screen descriptor set layout created";
+}
+
+void VulkanInterface::createDepthDownsampleDescriptorSetLayout()
 {
 	VkDescriptorSetLayoutBinding samplerLayoutBinding = {};
 	samplerLayoutBinding.binding = 0;
@@ -753,8 +1082,8 @@ void VulkanInterface::createScreenDescriptorSetLayout()
 	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
 	layoutInfo.pBindings = bindings.data();
 
-	VK_RESULT_CHECK(vkCreateDescriptorSetLayout(logicalDevice, &layoutInfo, nullptr, &descriptorSetLayouts.screen))
-	Logger() << "Screen descriptor set layout created";
+	VK_RESULT_CHECK(vkCreateDescriptorSetLayout(logicalDevice, &layoutInfo, nullptr, &descriptorSetLayouts.depthDownsample))
+	Logger() << "Depth downsample descriptor set layout created";
 }
 
 void VulkanInterface::createPipelineCache()
@@ -768,6 +1097,8 @@ void VulkanInterface::createGraphicsPipeline()
 {
 	auto bindingDescription = modelBindingDescription();
 	auto attributeDescription = modelAttributeDescription();
+	auto quantizedBinding = modelBindingDescription(VERTEX_FORMAT_QUANTIZED);
+	auto quantizedAttribute = modelAttributeDescription(VERTEX_FORMAT_QUANTIZED);
 
 	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
 	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
@@ -776,6 +1107,12 @@ void VulkanInterface::createGraphicsPipeline()
 	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescription.size());
 	vertexInputInfo.pVertexAttributeDescriptions = attributeDescription.data(); // Optional
 
+	VkPipelineVertexInputStateCreateInfo quantizedVertexInputInfo = vertexInputInfo;
+	quantizedVertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(quantizedBinding.size());
+	quantizedVertexInputInfo.pVertexBindingDescriptions = quantizedBinding.data();
+	quantizedVertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(quantizedAttribute.size());
+	quantizedVertexInputInfo.pVertexAttributeDescriptions = quantizedAttribute.data();
+
 	auto particleBinding = particleBindingDescription();
 	auto particleAttribute = particleAttributeDescription();
 
@@ -786,6 +1123,12 @@ void VulkanInterface::createGraphicsPipeline()
 	particleVertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(particleAttribute.size());
 	particleVertexInputInfo.pVertexAttributeDescriptions = particleAttribute.data(); // Optional
 
+	//Billboards pull everything from a storage buffer so have no vertex input
+	VkPipelineVertexInputStateCreateInfo billboardVertexInputInfo = {};
+	billboardVertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	billboardVertexInputInfo.vertexBindingDescriptionCount = 0;
+	billboardVertexInputInfo.vertexAttributeDescriptionCount = 0;
+
 	auto screenBinding = screenBindingDescription();
 	auto screenAttribute = screenAttributeDescription();
 
@@ -801,6 +1144,9 @@ void VulkanInterface::createGraphicsPipeline()
 	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 	inputAssembly.primitiveRestartEnable = VK_FALSE;
 
+	VkPipelineInputAssemblyStateCreateInfo billboardInputAssembly = inputAssembly;
+	billboardInputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+
 	VkViewport viewport = {};
 	viewport.x = 0.0f;
 	viewport.y = 0.0f;
@@ -854,6 +1200,10 @@ void VulkanInterface::createGraphicsPipeline()
 	depthStencil.front = {}; // Optional
 	depthStencil.back = {}; // Optional
 
+	//Blended billboards are depth tested but don't occlude each other
+	VkPipelineDepthStencilStateCreateInfo billboardDepthStencil = depthStencil;
+	billboardDepthStencil.depthWriteEnable = VK_FALSE;
+
 	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
 	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
 	/*colorBlendAttachment.blendEnable = VK_FALSE;
@@ -915,12 +1265,21 @@ void VulkanInterface::createGraphicsPipeline()
 	VK_RESULT_CHECK(vkCreatePipelineLayout(logicalDevice, &pipelineLayoutInfo, nullptr, &pipelineLayouts.particle))
 	Logger() << "Particle pipeline layout created";
 
-	pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-	pipelineLayoutInfo.pPushConstantRanges = VK_NULL_HANDLE; // Optional
+	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayouts.particleBillboard; // Optional
+	VK_RESULT_CHECK(vkCreatePipelineLayout(logicalDevice, &pipelineLayoutInfo, nullptr, &pipelineLayouts.particleBillboard))
+	Logger() << "Particle billboard pipeline layout created";
+
+	pushConstantRange.size = sizeof(ScreenPushConstantBufferObject);
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayouts.screen; // Optional
 	VK_RESULT_CHECK(vkCreatePipelineLayout(logicalDevice, &pipelineLayoutInfo, nullptr, &pipelineLayouts.screen))
 	Logger() << "Screen pipeline layout created";
 
+	pushConstantRange.size = sizeof(uint32_t);
+	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayouts.depthDownsample; // Optional
+	VK_RESULT_CHECK(vkCreatePipelineLayout(logicalDevice, &pipelineLayoutInfo, nullptr, &pipelineLayouts.depthDownsample))
+	Logger() << "Depth downsample pipeline layout created";
+
 	std::vector<VkPipelineShaderStageCreateInfo> shaderStages = {
 			loadShaderModule("shaders/standard.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
 			loadShaderModule("shaders/standard.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT)
@@ -953,6 +1312,15 @@ void VulkanInterface::createGraphicsPipeline()
 	pipelineInfo.basePipelineIndex = -1;
 	VK_RESULT_CHECK(vkCreateGraphicsPipelines(logicalDevice, pipelineCache, 1, &pipelineInfo, nullptr, &offscreenPipeline))
 
+	//Same pipeline reading 16 byte quantized vertices
+	shaderStages = {
+			loadShaderModule("shaders/standardQuantized.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
+			loadShaderModule("shaders/standard.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT)
+	};
+	pipelineInfo.pVertexInputState = &quantizedVertexInputInfo;
+	VK_RESULT_CHECK(vkCreateGraphicsPipelines(logicalDevice, pipelineCache, 1, &pipelineInfo, nullptr, &pipelines.standardQuantized))
+	Logger() << "Quantized standard pipeline created";
+
 	shaderStages = {
 			loadShaderModule("shaders/particle.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
 			loadShaderModule("shaders/particle.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT)
@@ -962,6 +1330,89 @@ void VulkanInterface::createGraphicsPipeline()
 	VK_RESULT_CHECK(vkCreateGraphicsPipelines(logicalDevice, pipelineCache, 1, &pipelineInfo, nullptr, &pipelines.particle))
 	Logger() << "Particle pipeline created";
 
+	shaderStages = {
+			loadShaderModule("shaders/particleBillboard.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
+			loadShaderModule("shaders/particleBillboard.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT)
+	};
+	pipelineInfo.pVertexInputState = &billboardVertexInputInfo;
+	pipelineInfo.pInputAssemblyState = &billboardInputAssembly;
+	pipelineInfo.pDepthStencilState = &billboardDepthStencil;
+	pipelineInfo.layout = pipelineLayouts.particleBillboard;
+	VK_RESULT_CHECK(vkCreateGraphicsPipelines(logicalDevice, pipelineCache, 1, &pipelineInfo, nullptr, &pipelines.particleBillboard))
+	Logger() << "Particle billboard pipeline created";
+	pipelineInfo.pInputAssemblyState = &inputAssembly;
+	pipelineInfo.pDepthStencilState = &depthStencil;
+
+	//Low resolution particle pipelines, the viewport follows the runtime resolution divisor
+	VkDynamicState dynamicStates[] = {
+			VK_DYNAMIC_STATE_VIEWPORT,
+			VK_DYNAMIC_STATE_SCISSOR
+	};
+
+	VkPipelineDynamicStateCreateInfo dynamicState = {};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount = 2;
+	dynamicState.pDynamicStates = dynamicStates;
+
+	//Accumulate premultiplied colour and coverage for compositing over the scene
+	VkPipelineColorBlendAttachmentState lowResBlendAttachment = colorBlendAttachment;
+	lowResBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	lowResBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+
+	VkPipelineColorBlendStateCreateInfo lowResColorBlending = colorBlending;
+	lowResColorBlending.pAttachments = &lowResBlendAttachment;
+
+	VkPipelineDepthStencilStateCreateInfo lowResDepthStencil = depthStencil;
+	lowResDepthStencil.depthWriteEnable = VK_FALSE;
+
+	pipelineInfo.pDynamicState = &dynamicState;
+	pipelineInfo.pColorBlendState = &lowResColorBlending;
+	pipelineInfo.pDepthStencilState = &lowResDepthStencil;
+	pipelineInfo.renderPass = particleRenderPass;
+	pipelineInfo.subpass = 1;
+
+	shaderStages = {
+			loadShaderModule("shaders/particle.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
+			loadShaderModule("shaders/particle.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT)
+	};
+	pipelineInfo.pVertexInputState = &particleVertexInputInfo;
+	pipelineInfo.layout = pipelineLayouts.particle;
+	VK_RESULT_CHECK(vkCreateGraphicsPipelines(logicalDevice, pipelineCache, 1, &pipelineInfo, nullptr, &pipelines.particleLowRes))
+
+	shaderStages = {
+			loadShaderModule("shaders/particleBillboard.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
+			loadShaderModule("shaders/particleBillboard.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT)
+	};
+	pipelineInfo.pVertexInputState = &billboardVertexInputInfo;
+	pipelineInfo.pInputAssemblyState = &billboardInputAssembly;
+	pipelineInfo.layout = pipelineLayouts.particleBillboard;
+	VK_RESULT_CHECK(vkCreateGraphicsPipelines(logicalDevice, pipelineCache, 1, &pipelineInfo, nullptr, &pipelines.particleBillboardLowRes))
+	pipelineInfo.pInputAssemblyState = &inputAssembly;
+
+	//Depth only subpass, writes the farthest depth of each block through gl_FragDepth
+	VkPipelineDepthStencilStateCreateInfo downsampleDepthStencil = depthStencil;
+	downsampleDepthStencil.depthCompareOp = VK_COMPARE_OP_ALWAYS;
+
+	VkPipelineColorBlendStateCreateInfo downsampleColorBlending = colorBlending;
+	downsampleColorBlending.attachmentCount = 0;
+	downsampleColorBlending.pAttachments = nullptr;
+
+	shaderStages = {
+			loadShaderModule("shaders/screen.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
+			loadShaderModule("shaders/depthDownsample.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT)
+	};
+	pipelineInfo.pVertexInputState = &screenVertexInputInfo;
+	pipelineInfo.pColorBlendState = &downsampleColorBlending;
+	pipelineInfo.pDepthStencilState = &downsampleDepthStencil;
+	pipelineInfo.layout = pipelineLayouts.depthDownsample;
+	pipelineInfo.subpass = 0;
+	VK_RESULT_CHECK(vkCreateGraphicsPipelines(logicalDevice, pipelineCache, 1, &pipelineInfo, nullptr, &pipelines.depthDownsample))
+	Logger() << "Low resolution particle pipelines created";
+
+	pipelineInfo.pDynamicState = nullptr;
+	pipelineInfo.pColorBlendState = &colorBlending;
+	pipelineInfo.pDepthStencilState = &depthStencil;
+
 	shaderStages = {
 			loadShaderModule("shaders/screen.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
 			loadShaderModule("shaders/screen.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT)
@@ -1042,17 +1493,21 @@ void VulkanInterface::createUniformBuffer()
 
 void VulkanInterface::createDescriptorPool()
 {
-	std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+	std::array<VkDescriptorPoolSize, 4> poolSizes = {};
 	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 	poolSizes[0].descriptorCount = 10;
 	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	poolSizes[1].descriptorCount = 10;
+	poolSizes[1].descriptorCount = 30;
+	poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[2].descriptorCount = 20;
+	poolSizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	poolSizes[3].descriptorCount = 4;
 
 	VkDescriptorPoolCreateInfo poolInfo = {};
 	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	poolInfo.poolSizeCount = poolSizes.size();
 	poolInfo.pPoolSizes = poolSizes.data();
-	poolInfo.maxSets = 20;
+	poolInfo.maxSets = 24;
 
 	VK_RESULT_CHECK(vkCreateDescriptorPool(logicalDevice, &poolInfo, nullptr, &descriptorPool))
 	Logger() << "Descriptor pool created";
@@ -1084,6 +1539,9 @@ void VulkanInterface::createDescriptorSets()
 	imageInfo.imageView = model->texture->texture.imageView;
 	imageInfo.sampler = model->texture->textureSampler;
 
+	//The model binds a set per material itself
+	model->createDescriptorSets(descriptorSetLayouts.standard, bufferInfo);
+
 	VkDescriptorImageInfo particleImageInfo = {};
 	particleImageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 	particleImageInfo.imageView = particles->particleModel->texture->texture.imageView;
@@ -1117,6 +1575,47 @@ void VulkanInterface::createDescriptorSets()
 	vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
 }
 
+void VulkanInterface::updateModelTextureDescriptors()
+{
+	VkDescriptorImageInfo imageInfo = {};
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageInfo.imageView = model->texture->texture.imageView;
+	imageInfo.sampler = model->texture->textureSampler;
+
+	VkDescriptorImageInfo particleImageInfo = {};
+	particleImageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	particleImageInfo.imageView = particles->particleModel->texture->texture.imageView;
+	particleImageInfo.sampler = particles->particleModel->texture->textureSampler;
+
+	std::array<VkWriteDescriptorSet, 3> descriptorWrites = {};
+	descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrites[0].dstSet = descriptorSets.standard;
+	descriptorWrites[0].dstBinding = 1;
+	descriptorWrites[0].dstArrayElement = 0;
+	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	descriptorWrites[0].descriptorCount = 1;
+	descriptorWrites[0].pImageInfo = &imageInfo;
+
+	descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrites[1].dstSet = descriptorSets.particle;
+	descriptorWrites[1].dstBinding = 0;
+	descriptorWrites[1].dstArrayElement = 0;
+	descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	descriptorWrites[1].descriptorCount = 1;
+	descriptorWrites[1].pImageInfo = &particleImageInfo;
+
+	descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrites[2].dstSet = descriptorSets.particleBillboard;
+	descriptorWrites[2].dstBinding = 1;
+	descriptorWrites[2].dstArrayElement = 0;
+	descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	descriptorWrites[2].descriptorCount = 1;
+	descriptorWrites[2].pImageInfo = &particleImageInfo;
+
+	vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+	Logger() << "Model texture descriptors updated";
+}
+
 void VulkanInterface::createCommandBuffers()
 {
 	VkCommandBufferAllocateInfo allocInfo = {};
@@ -1163,6 +1662,7 @@ void VulkanInterface::createCommandBuffers()
 		Logger() << "Sub command buffers allocated";
 
 		thread->modelPositions.resize(numPerThread);
+		thread->modelLods.resize(numPerThread, 0);
 		thread->pushConstantBlock.resize(numPerThread);
 		for(int j = 0; j < numPerThread; j++)
 		{
@@ -1185,6 +1685,13 @@ void VulkanInterface::threadedRender(int threadIndex, int objectIndex, VkCommand
 
 	VK_RESULT_CHECK(vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo))
 
+	//Left empty until the model is resident
+	if(!model->isResident())
+	{
+		VK_RESULT_CHECK(vkEndCommandBuffer(commandBuffer));
+		return;
+	}
+
 	VkViewport viewport = {};
 	viewport.width = window->width;
 	viewport.height = window->height;
@@ -1197,11 +1704,14 @@ void VulkanInterface::threadedRender(int threadIndex, int objectIndex, VkCommand
 	scissor.offset = {0,0};
 	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.standard);
+	const Mesh* mesh = model->getMesh();
+	bool quantized = mesh->format == VERTEX_FORMAT_QUANTIZED;
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, quantized ? pipelines.standardQuantized : pipelines.standard);
 
+	//Quantized positions are scaled back out of the mesh bounds by the model matrix
 	thread->pushConstantBlock[objectIndex].view = pushConstant.view;
 	thread->pushConstantBlock[objectIndex].proj = pushConstant.proj;
-	thread->pushConstantBlock[objectIndex].model = glm::translate(glm::mat4(1.0f), modelPosition);
+	thread->pushConstantBlock[objectIndex].model = glm::translate(glm::mat4(1.0f), modelPosition) * mesh->positionTransform();
 
 	vkCmdPushConstants(
 			commandBuffer,
@@ -1211,10 +1721,9 @@ void VulkanInterface::threadedRender(int threadIndex, int objectIndex, VkCommand
 			&thread->pushConstantBlock[objectIndex]
 	);
 
-	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.standard,
-	                        0, 1, &descriptorSets.standard, 0, nullptr);
-
-	model->draw(commandBuffer);
+	uint32_t lod = model->selectLod(modelPosition, viewPosition, pushConstant.proj[1][1], thread->modelLods[objectIndex]);
+	thread->modelLods[objectIndex] = lod;
+	model->draw(commandBuffer, pipelineLayouts.standard, lod);
 
 	VK_RESULT_CHECK(vkEndCommandBuffer(commandBuffer));
 }
@@ -1243,6 +1752,10 @@ void VulkanInterface::update(Camera *camera)
 
 	pushConstant.view = camera->viewMatrix;
 	pushConstant.proj = camera->projectionMatrix;
+	viewPosition = camera->position;
+	particles->setViewPosition(camera->position);
+	if(terrainResident)
+		terrain->setViewPosition(camera->position);
 	//ubo.proj[1][1] *= -1; //Flip Y coordinate as its designed for OGL
 
 //	beginSingleTimeCommands();
@@ -1261,13 +1774,37 @@ void VulkanInterface::updateParticleCommandBuffer(VkCommandBufferInheritanceInfo
 
 	VK_RESULT_CHECK(vkBeginCommandBuffer(particleCommandBuffer, &commandBufferBeginInfo));
 
-	vkCmdBindPipeline(particleCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.particle);
-	vkCmdBindDescriptorSets(particleCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.particle,
-	                        0, 1, &descriptorSets.particle, 0, nullptr);
+	bool billboard = particles->getRenderMode() == PARTICLE_RENDER_BILLBOARD;
+	bool lowRes = particleResolutionDivisor > 1;
+	VkPipeline pipeline;
+	if(lowRes)
+		pipeline = billboard ? pipelines.particleBillboardLowRes : pipelines.particleLowRes;
+	else
+		pipeline = billboard ? pipelines.particleBillboard : pipelines.particle;
+	VkPipelineLayout pipelineLayout = billboard ? pipelineLayouts.particleBillboard : pipelineLayouts.particle;
+	VkDescriptorSet descriptorSet = billboard ? descriptorSets.particleBillboard : descriptorSets.particle;
+
+	vkCmdBindPipeline(particleCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	if(lowRes)
+	{
+		VkViewport viewport = {};
+		viewport.width = particleExtent.width;
+		viewport.height = particleExtent.height;
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+		vkCmdSetViewport(particleCommandBuffer, 0, 1, &viewport);
+
+		VkRect2D scissor = {};
+		scissor.extent = particleExtent;
+		scissor.offset = {0,0};
+		vkCmdSetScissor(particleCommandBuffer, 0, 1, &scissor);
+	}
+	vkCmdBindDescriptorSets(particleCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+	                        0, 1, &descriptorSet, 0, nullptr);
 
 	vkCmdPushConstants(
 			particleCommandBuffer,
-			pipelineLayouts.particle,
+			pipelineLayout,
 			VK_SHADER_STAGE_VERTEX_BIT,
 			0, sizeof(pushConstant),
 			&pushConstant
@@ -1309,10 +1846,15 @@ void VulkanInterface::updateCommandBuffers()
 	//Skybox must go first to render behind everything
 	skybox->draw(&commandBuffers, inheritanceInfo);
 
-//	updateParticleCommandBuffer(inheritanceInfo);
-//	commandBuffers.emplace_back(particleCommandBuffer);
+	//Low resolution particles are drawn in their own pass after the scene
+	if(particleResolutionDivisor == 1)
+	{
+		updateParticleCommandBuffer(inheritanceInfo);
+		commandBuffers.emplace_back(particleCommandBuffer);
+	}
 
-	terrain->draw(&commandBuffers, inheritanceInfo);
+	if(terrainResident)
+		terrain->draw(&commandBuffers, inheritanceInfo);
 
 	for(int i = 0; i < numThread; i++)
 	{
@@ -1336,9 +1878,62 @@ void VulkanInterface::updateCommandBuffers()
 
 	vkCmdEndRenderPass(primaryCommandBuffer);
 
+	if(particleResolutionDivisor > 1)
+		recordParticlePass();
+
 	VK_RESULT_CHECK(vkEndCommandBuffer(primaryCommandBuffer))
 }
 
+void VulkanInterface::recordParticlePass()
+{
+	std::array<VkClearValue,2> clearValues = {};
+	clearValues[0].color = {0.0f, 0.0f, 0.0f, 0.0f};
+	clearValues[1].depthStencil = {1.0f, 0};
+
+	VkRenderPassBeginInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = particleRenderPass;
+	renderPassInfo.framebuffer = particleFramebuffer;
+	renderPassInfo.renderArea.offset = {0, 0};
+	renderPassInfo.renderArea.extent = particleExtent;
+	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+	renderPassInfo.pClearValues = clearValues.data();
+
+	vkCmdBeginRenderPass(primaryCommandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+	VkViewport viewport = {};
+	viewport.width = particleExtent.width;
+	viewport.height = particleExtent.height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(primaryCommandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor = {};
+	scissor.extent = particleExtent;
+	scissor.offset = {0,0};
+	vkCmdSetScissor(primaryCommandBuffer, 0, 1, &scissor);
+
+	vkCmdBindPipeline(primaryCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.depthDownsample);
+	vkCmdBindDescriptorSets(primaryCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.depthDownsample,
+	                        0, 1, &descriptorSets.depthDownsample, 0, nullptr);
+	vkCmdPushConstants(primaryCommandBuffer, pipelineLayouts.depthDownsample, VK_SHADER_STAGE_FRAGMENT_BIT,
+	                   0, sizeof(particleResolutionDivisor), &particleResolutionDivisor);
+	screenQuad->draw(primaryCommandBuffer);
+
+	vkCmdNextSubpass(primaryCommandBuffer, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+	VkCommandBufferInheritanceInfo inheritanceInfo = {};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = particleRenderPass;
+	inheritanceInfo.subpass = 1;
+	inheritanceInfo.framebuffer = particleFramebuffer;
+
+	updateParticleCommandBuffer(inheritanceInfo);
+	vkCmdExecuteCommands(primaryCommandBuffer, 1, &particleCommandBuffer);
+
+	vkCmdEndRenderPass(primaryCommandBuffer);
+}
+
 void VulkanInterface::draw()
 {
 	uint32_t imageIndex;
@@ -1355,6 +1950,10 @@ void VulkanInterface::draw()
 	}
 	while(result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR);
 
+	//The last frame was waited on so its sets are free to rewrite
+	if(assets->update())
+		updateModelTextureDescriptors();
+
 	updateCommandBuffers();
 	updateScreenCommandBuffer(swapchainFramebuffers[imageIndex]);
 
@@ -1371,6 +1970,9 @@ void VulkanInterface::draw()
 
 	VK_RESULT_CHECK(vkQueueSubmit(graphicsQueue, 1, &submitInfo, nullptr));
 
+	//Screen pass samples the offscreen targets in its fragment shader
+	VkPipelineStageFlags screenWaitStages[] = {VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT};
+	submitInfo.pWaitDstStageMask = screenWaitStages;
 	submitInfo.pWaitSemaphores = &offscreenRenderedSemaphore;
 	submitInfo.pSignalSemaphores = &renderFinishedSemaphore;
 	submitInfo.pCommandBuffers = &screenCommandBuffer;
@@ -1703,6 +2305,11 @@ bool hasStencilComponent(VkFormat format)
 	return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
 }
 
+bool hasDepthComponent(VkFormat format)
+{
+	return format == VK_FORMAT_D32_SFLOAT || hasStencilComponent(format);
+}
+
 VkPipelineShaderStageCreateInfo VulkanInterface::loadShaderModule(const std::string &shaderFilename,
                                                                   VkShaderStageFlagBits stage)
 {
@@ -1763,8 +2370,10 @@ VkVertexInputAttributeDescription attributeDescription(uint32_t binding, uint32_
 	return attributeDescription(binding, location, format, static_cast<uint32_t>(offset));
 }
 
-std::vector<VkVertexInputBindingDescription> modelBindingDescription()
+std::vector<VkVertexInputBindingDescription> modelBindingDescription(VertexFormat format)
 {
+	if(format == VERTEX_FORMAT_QUANTIZED)
+		return {bindingDescription(0, sizeof(QuantizedVertex), VK_VERTEX_INPUT_RATE_VERTEX)};
 	return {bindingDescription(0, sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX)};
 }
 
@@ -1781,11 +2390,21 @@ std::vector<VkVertexInputBindingDescription> screenBindingDescription()
 	return {bindingDescription(0, sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX)};
 }
 
-std::vector<VkVertexInputAttributeDescription> modelAttributeDescription()
+std::vector<VkVertexInputAttributeDescription> modelAttributeDescription(VertexFormat format)
 {
 	std::vector<VkVertexInputAttributeDescription> attributeDescriptions(3);
 	uint32_t index = 0;
 
+	if(format == VERTEX_FORMAT_QUANTIZED)
+	{
+		attributeDescriptions[index] = attributeDescription(0, index, VK_FORMAT_R16G16B16A16_UNORM, offsetof(QuantizedVertex, position));
+		index++;
+		attributeDescriptions[index] = attributeDescription(0, index, VK_FORMAT_R16G16_SFLOAT, offsetof(QuantizedVertex, uv));
+		index++;
+		attributeDescriptions[index] = attributeDescription(0, index, VK_FORMAT_R16G16_SNORM, offsetof(QuantizedVertex, normal));
+		return attributeDescriptions;
+	}
+
 	attributeDescriptions[index] = attributeDescription(0, index, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, position));
 	index++;
 	attributeDescriptions[index] = attributeDescription(0, index, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, uv));
@@ -1825,6 +2444,21 @@ std::vector<VkVertexInputAttributeDescription> particleAttributeDescription()
 	return attributeDescriptions;
 }
 
+VkIndexType chooseIndexType(const uint32_t* indices, size_t count)
+{
+	for(size_t i = 0; i < count; i++)
+	{
+		if(indices[i] > UINT16_MAX)
+			return VK_INDEX_TYPE_UINT32;
+	}
+	return VK_INDEX_TYPE_UINT16;
+}
+
+VkDeviceSize indexTypeSize(VkIndexType type)
+{
+	return type == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
 uint32_t findMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags propertyFlags)
 {
 	VkPhysicalDeviceMemoryProperties memProperties = {};
@@ -1880,8 +2514,51 @@ void VulkanInterface::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDevic
 	endSingleTimeCommands(copyCommandBuffer);
 }
 
+VkIndexType VulkanInterface::createIndexBuffer(const void* indexData, size_t count, VkIndexType sourceType,
+                                               VkBuffer &buffer, VkDeviceMemory &bufferMemory)
+{
+	VkIndexType indexType = sourceType;
+	if(sourceType == VK_INDEX_TYPE_UINT32)
+		indexType = chooseIndexType(static_cast<const uint32_t*>(indexData), count);
+
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingBufferMemory;
+	VkDeviceSize bufferSize = indexTypeSize(indexType) * count;
+	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+	             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	             stagingBuffer, stagingBufferMemory);
+	void* data;
+	vkMapMemory(logicalDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
+	if(indexType == sourceType)
+	{
+		memcpy(data, indexData, bufferSize);
+	}
+	else
+	{
+		//Narrowed straight into the staging memory
+		auto source = static_cast<const uint32_t*>(indexData);
+		auto narrowed = static_cast<uint16_t*>(data);
+		for(size_t i = 0; i < count; i++)
+			narrowed[i] = static_cast<uint16_t>(source[i]);
+	}
+	vkUnmapMemory(logicalDevice, stagingBufferMemory);
+
+	//Transfer source so owners can copy it into a larger buffer
+	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+	             VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+	             buffer, bufferMemory);
+
+	copyBuffer(stagingBuffer, buffer, bufferSize);
+
+	destroyStagingBuffer(stagingBuffer, stagingBufferMemory);
+	return indexType;
+}
+
 VkCommandBuffer VulkanInterface::beginSingleTimeCommands()
 {
+	if(uploadBatch && std::this_thread::get_id() == uploadBatchThread)
+		return uploadBatch->commandBuffer;
+
 	VkCommandBufferAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
@@ -1903,6 +2580,10 @@ VkCommandBuffer VulkanInterface::beginSingleTimeCommands()
 
 void VulkanInterface::endSingleTimeCommands(VkCommandBuffer commandBuffer)
 {
+	//Submitted with the rest of the batch
+	if(uploadBatch && commandBuffer == uploadBatch->commandBuffer)
+		return;
+
 	vkEndCommandBuffer(commandBuffer);
 
 	VkSubmitInfo submitInfo = {};
@@ -1916,6 +2597,71 @@ void VulkanInterface::endSingleTimeCommands(VkCommandBuffer commandBuffer)
 	vkFreeCommandBuffers(logicalDevice, commandPool, 1, &commandBuffer);
 }
 
+void VulkanInterface::submitAsync(VkCommandBuffer commandBuffer, VkFence fence)
+{
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+
+	VK_RESULT_CHECK(vkQueueSubmit(graphicsQueue, 1, &submitInfo, fence))
+}
+
+void VulkanInterface::beginUploadBatch()
+{
+	if(uploadBatch)
+		throw std::runtime_error("Upload batch already open");
+
+	auto batch = new UploadBatch();
+	batch->commandBuffer = beginSingleTimeCommands();
+
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	VK_RESULT_CHECK(vkCreateFence(logicalDevice, &fenceInfo, nullptr, &batch->fence))
+
+	uploadBatch = batch;
+	uploadBatchThread = std::this_thread::get_id();
+}
+
+UploadBatch* VulkanInterface::submitUploadBatch()
+{
+	UploadBatch* batch = uploadBatch;
+	uploadBatch = nullptr;
+
+	VK_RESULT_CHECK(vkEndCommandBuffer(batch->commandBuffer))
+	submitAsync(batch->commandBuffer, batch->fence);
+	return batch;
+}
+
+bool VulkanInterface::finishUploadBatch(UploadBatch *batch, bool wait)
+{
+	if(wait)
+		vkWaitForFences(logicalDevice, 1, &batch->fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+	else if(vkGetFenceStatus(logicalDevice, batch->fence) != VK_SUCCESS)
+		return false;
+
+	vkDestroyFence(logicalDevice, batch->fence, nullptr);
+	vkFreeCommandBuffers(logicalDevice, commandPool, 1, &batch->commandBuffer);
+	for(auto &&staging : batch->stagingBuffers)
+	{
+		vkDestroyBuffer(logicalDevice, staging.first, nullptr);
+		vkFreeMemory(logicalDevice, staging.second, nullptr);
+	}
+	delete batch;
+	return true;
+}
+
+void VulkanInterface::destroyStagingBuffer(VkBuffer buffer, VkDeviceMemory bufferMemory)
+{
+	if(uploadBatch && std::this_thread::get_id() == uploadBatchThread)
+	{
+		uploadBatch->stagingBuffers.emplace_back(buffer, bufferMemory);
+		return;
+	}
+	vkDestroyBuffer(logicalDevice, buffer, nullptr);
+	vkFreeMemory(logicalDevice, bufferMemory, nullptr);
+}
+
 void VulkanInterface::transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t layers)
 {
 	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
@@ -1932,7 +2678,7 @@ void VulkanInterface::transitionImageLayout(VkImage image, VkFormat format, VkIm
 	barrier.subresourceRange.baseArrayLayer = 0;
 	barrier.subresourceRange.layerCount = layers;
 
-	if(newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
+	if(newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL || hasDepthComponent(format))
 	{
 		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
 
@@ -1963,6 +2709,15 @@ void VulkanInterface::transitionImageLayout(VkImage image, VkFormat format, VkIm
 		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
 		sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		//Heightmaps are read by the vertex stage
+		destinationStage = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	}
+	else if(oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+	{
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
 		destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
 	}
 	else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
@@ -8,12 +8,15 @@
 #include <vulkan/vulkan.h>
 #include <vector>
 #include <array>
+#include <thread>
 #include <glm/vec3.hpp>
 #include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
 #include <glm/mat4x4.hpp>
 #include "window.h"
 #include "Texture.h"
 #include "Model.h"
+#include "AssetManager.h"
 #include "SpecificThreadPool.h"
 #include "ParticleSystem.h"
 #include "ImageAttachment.h"
@@ -52,6 +55,35 @@ struct ParticlePushConstantBufferObject {
 	glm::mat4 proj;
 };
 
+struct TerrainPushConstantBufferObject {
+	glm::mat4 view;
+	glm::mat4 proj;
+	glm::vec4 gridParams; //x patch quads per side, y patches along x, zw heightmap samples
+	glm::vec4 spacing; //xy world distance between samples
+};
+
+struct TerrainBakePushConstantBufferObject {
+	glm::vec4 page; //xy world origin, z world size of a texel, w border texels
+	glm::ivec4 target; //xy first cache texel
+	glm::vec4 spacing; //xy world distance between samples, zw heightmap samples
+};
+
+struct FoliageCullPushConstantBufferObject {
+	glm::vec4 planes[6]; //frustum planes, normals facing inwards
+	glm::vec4 viewPosition; //w scales every draw distance
+};
+
+struct FoliagePushConstantBufferObject {
+	glm::mat4 viewProj;
+	glm::vec4 viewPosition; //w is the type's draw distance
+	glm::ivec4 type; //x first visible slot, y texture layer
+};
+
+struct ScreenPushConstantBufferObject {
+	glm::vec4 particleParams; //x is 1 when low resolution particles are composited
+	glm::vec4 depthParams; //xy are the projection terms used to linearise depth
+};
+
 struct VulkanQueues
 {
 	int graphicsFamily = -1;
@@ -76,6 +108,17 @@ struct ThreadData
 	std::vector<VkCommandBuffer> commandBuffers;
 	std::vector<PushConstantBufferObject> pushConstantBlock;
 	std::vector<glm::vec3> modelPositions;
+	//Level of detail each object drew with last frame, for hysteresis
+	std::vector<uint32_t> modelLods;
+};
+
+//Copies recorded while a batch is open, submitted together with one fence
+struct UploadBatch
+{
+	VkCommandBuffer commandBuffer;
+	VkFence fence;
+	//Freed once the fence signals
+	std::vector<std::pair<VkBuffer, VkDeviceMemory> > stagingBuffers;
 };
 
 class VulkanInterface
@@ -94,22 +137,33 @@ class VulkanInterface
 	struct {
 		VkDescriptorSetLayout standard;
 		VkDescriptorSetLayout particle;
+		VkDescriptorSetLayout particleBillboard;
 		VkDescriptorSetLayout screen;
+		VkDescriptorSetLayout depthDownsample;
 	} descriptorSetLayouts;
 	struct {
 		VkPipelineLayout standard;
 		VkPipelineLayout particle;
+		VkPipelineLayout particleBillboard;
 		VkPipelineLayout screen;
+		VkPipelineLayout depthDownsample;
 	} pipelineLayouts;
 	struct {
 		VkPipeline standard;
+		VkPipeline standardQuantized;
 		VkPipeline particle;
+		VkPipeline particleBillboard;
 		VkPipeline screen;
+		VkPipeline depthDownsample;
+		VkPipeline particleLowRes;
+		VkPipeline particleBillboardLowRes;
 	} pipelines;
 	struct {
 		VkDescriptorSet standard;
 		VkDescriptorSet particle;
+		VkDescriptorSet particleBillboard;
 		VkDescriptorSet screen;
+		VkDescriptorSet depthDownsample;
 	} descriptorSets;
 	VkBuffer uniformBuffer;
 	VkDeviceMemory uniformBufferMemory;
@@ -124,6 +178,15 @@ class VulkanInterface
 	VkPipeline offscreenPipeline;
 	PushConstantBufferObject offscreenPushConstant;
 
+	//Particles are drawn into a reduced resolution target when the divisor is above 1,
+	//occluded by a downsampled copy of the offscreen depth
+	uint32_t particleResolutionDivisor = 1;
+	VkExtent2D particleExtent;
+	VkRenderPass particleRenderPass;
+	VkFramebuffer particleFramebuffer;
+	ImageAttachment particleColorImage;
+	ImageAttachment particleDepthImage;
+
 	VkCommandBuffer primaryCommandBuffer;
 	VkCommandBuffer particleCommandBuffer;
 	VkCommandBuffer screenCommandBuffer;
@@ -146,7 +209,9 @@ class VulkanInterface
 	void createRenderPass();
 	void createStandardDescriptorSetLayout();
 	void createParticleDescriptorSetLayout();
+	void createParticleBillboardDescriptorSetLayout();
 	void createScreenDescriptorSetLayout();
+	void createDepthDownsampleDescriptorSetLayout();
 	void createPipelineCache();
 	void createGraphicsPipeline();
 	void createFramebuffers();
@@ -155,6 +220,8 @@ class VulkanInterface
 	void createUniformBuffer();
 	void createDescriptorPool();
 	void createDescriptorSets();
+	//Points the shared sets at the models' current textures, placeholders until they're resident
+	void updateModelTextureDescriptors();
 	void createCommandBuffers();
 	void createSemaphoresAndFences();
 
@@ -165,8 +232,14 @@ class VulkanInterface
 	void createScreenCommandBuffer();
 	void updateScreenCommandBuffer(VkFramebuffer framebuffer);
 	void createScreenDescriptorSet();
+	void updateScreenDescriptorSets();
+	void createParticleBillboardDescriptorSet();
 
 	void threadedRender(int threadIndex, int objectIndex, VkCommandBufferInheritanceInfo inheritanceInfo);
+	void createParticleRenderPass();
+	void createParticleTargets();
+	void destroyParticleTargets();
+	void recordParticlePass();
 	void updateParticleCommandBuffer(VkCommandBufferInheritanceInfo inheritanceInfo);
 	void updateCommandBuffers();
 
@@ -175,12 +248,17 @@ class VulkanInterface
 	Model * model;
 	Model * screenQuad;
 	Terrain * terrain;
+	//Set once the asset loader has uploaded it, nothing touches the terrain before
+	bool terrainResident = false;
 	Skybox * skybox;
 	uint32_t numThread = 2;
 	uint32_t numPerThread = 3;
 	SpecificThreadPool threadPool;
 	std::vector<ThreadData> threadData;
 	ParticleSystem* particles;
+	//Open between beginUploadBatch and submitUploadBatch, only on the thread that opened it
+	UploadBatch* uploadBatch = nullptr;
+	std::thread::id uploadBatchThread;
 
 #ifdef VALIDATION_LAYERS
 	bool enableValidationLayers = true;
@@ -197,22 +275,36 @@ class VulkanInterface
 	void destroyDebug();
 
 public:
-	void initVulkan(Window * window);
+	//Deterministic particles simulate in fixed chunks from particleSeed, 0 picks a random seed
+	void initVulkan(Window * window, bool deterministicParticles = false, uint32_t particleSeed = 0);
 	~VulkanInterface();
 
 	void update(Camera *camera);
 	void draw();
 	void waitForIdle();
 	void recreateSwapchain();
+	//1 draws particles in the main pass, 2 or 4 draws them at half or quarter resolution
+	void setParticleResolutionDivisor(uint32_t divisor);
+	uint32_t getParticleResolutionDivisor() const;
+	//Null while the terrain is still loading
+	Terrain* getTerrain() const;
+	ParticleSystem* getParticles() const;
 
 	Window * window;
 	VkDevice logicalDevice;
+	//Shared models and textures, everything loaded from a file goes through it
+	AssetManager * assets;
 
 	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
 					  VkMemoryPropertyFlags propertyFlags, VkBuffer &buffer, VkDeviceMemory &bufferMemory);
 
 	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
 
+	//Uploads through a staging buffer. 32 bit source indices are narrowed to 16 bit on the way
+	//when they all fit, returns the type the buffer ended up with.
+	VkIndexType createIndexBuffer(const void* data, size_t count, VkIndexType sourceType,
+	                              VkBuffer &buffer, VkDeviceMemory &bufferMemory);
+
 	void createImage(uint32_t width, uint32_t height, uint32_t layers, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory, VkImageCreateFlags flags);
 
 	void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t layers);
@@ -226,10 +318,23 @@ public:
 	VkDescriptorPool descriptorPool;
 	VkCommandPool commandPool;
 	ParticlePushConstantBufferObject pushConstant;
+	glm::vec3 viewPosition;
 
 	VkCommandBuffer beginSingleTimeCommands();
 
 	void endSingleTimeCommands(VkCommandBuffer commandBuffer);
+	//Submits to the graphics queue without waiting, completion is signalled on the fence
+	void submitAsync(VkCommandBuffer commandBuffer, VkFence fence);
+
+	//Until submitUploadBatch, single time commands from this thread record into one command buffer
+	//instead of each waiting on the queue
+	void beginUploadBatch();
+	//Submits without waiting, the batch is polled or waited on with finishUploadBatch
+	UploadBatch* submitUploadBatch();
+	//True once the GPU is done with the batch, which is then freed with its staging buffers
+	bool finishUploadBatch(UploadBatch* batch, bool wait);
+	//Kept until the open batch finishes, freed straight away otherwise
+	void destroyStagingBuffer(VkBuffer buffer, VkDeviceMemory bufferMemory);
 };
 
 bool isDeviceSuitable(VkPhysicalDevice device, VkSurfaceKHR surface);
@@ -243,6 +348,7 @@ VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities, Window
 VkFormat findSupportedFormat(VkPhysicalDevice device, const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 VkFormat findDepthFormat(VkPhysicalDevice device);
 bool hasStencilComponent(VkFormat format);
+bool hasDepthComponent(VkFormat format);
 
 VkVertexInputBindingDescription bindingDescription(uint32_t binding, uint32_t stride,
                                                    VkVertexInputRate inputType);
@@ -251,13 +357,16 @@ VkVertexInputAttributeDescription attributeDescription(uint32_t binding, uint32_
 VkVertexInputAttributeDescription attributeDescription(uint32_t binding, uint32_t location,
                                                        VkFormat format, size_t offset);
 
-std::vector<VkVertexInputBindingDescription> modelBindingDescription();
+std::vector<VkVertexInputBindingDescription> modelBindingDescription(VertexFormat format = VERTEX_FORMAT_FLOAT);
 std::vector<VkVertexInputBindingDescription> particleBindingDescription();
 std::vector<VkVertexInputBindingDescription> screenBindingDescription();
-std::vector<VkVertexInputAttributeDescription> modelAttributeDescription();
+std::vector<VkVertexInputAttributeDescription> modelAttributeDescription(VertexFormat format = VERTEX_FORMAT_FLOAT);
 std::vector<VkVertexInputAttributeDescription> screenAttributeDescription();
 std::vector<VkVertexInputAttributeDescription> particleAttributeDescription();
 uint32_t findMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags propertyFlags);
+//16 bit when every index fits, whatever vertex offset they're drawn with
+VkIndexType chooseIndexType(const uint32_t* indices, size_t count);
+VkDeviceSize indexTypeSize(VkIndexType type);
 
 VkImageView createImageView(VkDevice logicalDevice, VkImageViewType viewType, VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t layers);
 